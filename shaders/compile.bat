@@ -1,2 +1,5 @@
-C:\VulkanSDK\1.1.82.1\Bin\glslangValidator.exe -V shader.vert
-C:\VulkanSDK\1.1.82.1\Bin\glslangValidator.exe -V shader.frag
\ No newline at end of file
+cd /d "%~dp0"
+"%VULKAN_SDK%\Bin\glslangValidator.exe" -V shader.vert
+"%VULKAN_SDK%\Bin\glslangValidator.exe" -V shader.frag
+"%VULKAN_SDK%\Bin\glslangValidator.exe" -V cull.comp -o cull.spv
+"%VULKAN_SDK%\Bin\glslangValidator.exe" -V virtual_texture.frag -o virtual_texture.spv
@@ -5,21 +5,32 @@ out gl_PerVertex {
     vec4 gl_Position;
 };
 
+layout(location = 0) in vec4 objectCenterRadius;
+// Quantized to the mesh's bounding sphere, see src/mesh/mesh.h
+layout(location = 1) in ivec4 position;
+layout(location = 2) in vec4 normal;
+
 layout(location = 0) out vec3 fragColor;
+// The objects show a virtual texture laid over the area they move in, see virtual_texture.frag
+layout(location = 1) out vec2 fragUv;
+
+// See struct vulkan_scene_frame_uniforms
+layout(std140, set = 0, binding = 0) uniform Frame {
+    mat4 viewProjection;
+    float lodTint;
+} frame;
 
-vec2 positions[3] = vec2[](
-    vec2(0.0, -0.5),
-    vec2(0.5, 0.5),
-    vec2(-0.5, 0.5)
-);
+// See vulkan_draw_item's push_constant
+layout(push_constant) uniform Draw {
+    uint lod;
+} draw;
 
-vec3 colors[3] = vec3[](
-    vec3(1.0, 0.0, 0.0),
-    vec3(0.0, 1.0, 0.0),
-    vec3(0.0, 0.0, 1.0)
-);
+const vec3 lodColors[4] = vec3[](vec3(0.2, 0.9, 0.2), vec3(0.2, 0.4, 1.0), vec3(1.0, 0.8, 0.1), vec3(1.0, 0.2, 0.2));
 
 void main() {
-    gl_Position = vec4(positions[gl_VertexIndex], 0.0, 1.0);
-    fragColor = colors[gl_VertexIndex];
-}
\ No newline at end of file
+    vec2 unitPosition = vec2(position.xy)*(1.0/32768.0);
+    vec4 worldPosition = vec4(objectCenterRadius.xy + unitPosition*objectCenterRadius.w, objectCenterRadius.z, 1.0);
+    gl_Position = frame.viewProjection*worldPosition;
+    fragUv = worldPosition.xy*(1.0/2.4) + 0.5;
+    fragColor = mix(normal.xyz*0.5 + 0.5, lodColors[min(draw.lod, 3)], frame.lodTint);
+}
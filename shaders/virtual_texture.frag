@@ -0,0 +1,73 @@
+#version 450
+#extension GL_ARB_separate_shader_objects : enable
+
+// See src/texture/texture.h
+const uint TILE_SIZE = 128;
+const uint TILE_BORDER = 4;
+const uint TILE_CONTENT = TILE_SIZE - 2*TILE_BORDER;
+const uint MAX_MIPS = 16;
+// Requests are written from one pixel in every FEEDBACK_SPACING*FEEDBACK_SPACING, a tile covers far more
+const uint FEEDBACK_SPACING = 8;
+
+layout(location = 0) in vec3 fragColor;
+layout(location = 1) in vec2 fragUv;
+
+layout(location = 0) out vec4 outColor;
+
+// See struct texture_mip
+struct Mip {
+    uint width;
+    uint height;
+    uint tilesX;
+    uint tilesY;
+    uint firstTile;
+};
+
+// Set 0 holds the per-frame uniforms of shader.vert
+layout(set = 1, binding = 0) uniform sampler2D tileCache;
+
+// Nonzero entries are 1 + the cache slot holding the tile
+layout(std430, set = 1, binding = 1) readonly buffer Indirection {
+    uint mipCount;
+    uint cacheSide;
+    Mip mips[MAX_MIPS];
+    uint entries[];
+};
+
+// Set for every tile wanted at its exact level, the host clears what it has seen
+layout(std430, set = 1, binding = 2) writeonly buffer Feedback {
+    uint requests[];
+};
+
+uint tileIndex(uint level, out vec2 tileTexel) {
+    Mip mip = mips[level];
+    vec2 texel = clamp(fragUv, 0.0, 1.0)*vec2(mip.width, mip.height);
+    uvec2 tile = min(uvec2(texel/float(TILE_CONTENT)), uvec2(mip.tilesX - 1, mip.tilesY - 1));
+    tileTexel = texel - vec2(tile*TILE_CONTENT);
+    return mip.firstTile + tile.y*mip.tilesX + tile.x;
+}
+
+void main() {
+    vec2 texel = fragUv*vec2(mips[0].width, mips[0].height);
+    float lod = log2(max(max(length(dFdx(texel)), length(dFdy(texel))), 1.0));
+    uint wanted = min(uint(lod), mipCount - 1);
+
+    vec2 tileTexel;
+    uint tile = tileIndex(wanted, tileTexel);
+    if (uint(gl_FragCoord.x) % FEEDBACK_SPACING == 0 && uint(gl_FragCoord.y) % FEEDBACK_SPACING == 0) {
+        requests[tile] = 1;
+    }
+
+    // The last level is always resident
+    uint level = wanted;
+    uint entry = entries[tile];
+    while (entry == 0 && level + 1 < mipCount) {
+        ++level;
+        tile = tileIndex(level, tileTexel);
+        entry = entries[tile];
+    }
+    uint slot = entry - 1;
+    vec2 cacheTexel = vec2(slot % cacheSide, slot / cacheSide)*float(TILE_SIZE) + float(TILE_BORDER) + tileTexel;
+    vec3 color = textureLod(tileCache, cacheTexel/float(cacheSide*TILE_SIZE), 0.0).rgb;
+    outColor = vec4(color*(0.5 + 0.5*fragColor.z), 1.0);
+}
@@ -18,4 +18,19 @@ struct file__try_read file__try_read(char *file_name) {
 	fclose(file);
 	result.result = 0;
 	return result;
+}
+
+int file__try_write(char *file_name, const char *bytes, long length) {
+	FILE *file = fopen(file_name, "wb");
+	if (!file) {
+		return -1;
+	}
+	if (fwrite(bytes, 1, (size_t) length, file) != (size_t) length) {
+		fclose(file);
+		return -2;
+	}
+	if (fclose(file) != 0) {
+		return -3;
+	}
+	return 0;
 }
\ No newline at end of file
@@ -5,4 +5,6 @@ struct file__try_read {
 	long length;
 	char *malloc_bytes;
 }
-file__try_read(char *file_name);
\ No newline at end of file
+file__try_read(char *file_name);
+
+int file__try_write(char *file_name, const char *bytes, long length);
\ No newline at end of file
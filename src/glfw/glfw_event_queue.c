@@ -0,0 +1,39 @@
+#include "glfw_event_queue.h"
+
+void glfw_event_queue__init(struct glfw_event_queue *this) {
+	this->head = 0;
+	this->tail = 0;
+	this->overflowed = 0;
+}
+
+int glfw_event_queue__try_push(struct glfw_event_queue *this, const struct glfw_event *event) {
+	unsigned int tail = this->tail;
+	unsigned int head = __atomic_load_n(&this->head, __ATOMIC_ACQUIRE);
+	if (tail - head == GLFW_EVENT_QUEUE__CAPACITY) {
+		__atomic_store_n(&this->overflowed, 1, __ATOMIC_RELEASE);
+		return -1;
+	}
+	this->events[tail & (GLFW_EVENT_QUEUE__CAPACITY - 1)] = *event;
+	// Publishes the event written above
+	__atomic_store_n(&this->tail, tail + 1, __ATOMIC_RELEASE);
+	return 0;
+}
+
+int glfw_event_queue__pop(struct glfw_event_queue *this, struct glfw_event *event_out) {
+	unsigned int head = this->head;
+	unsigned int tail = __atomic_load_n(&this->tail, __ATOMIC_ACQUIRE);
+	if (head == tail) {
+		return 0;
+	}
+	*event_out = this->events[head & (GLFW_EVENT_QUEUE__CAPACITY - 1)];
+	// Hands the slot back to the producer only after it has been read
+	__atomic_store_n(&this->head, head + 1, __ATOMIC_RELEASE);
+	return 1;
+}
+
+int glfw_event_queue__take_overflowed(struct glfw_event_queue *this) {
+	if (!__atomic_load_n(&this->overflowed, __ATOMIC_ACQUIRE)) {
+		return 0;
+	}
+	return __atomic_exchange_n(&this->overflowed, 0, __ATOMIC_ACQ_REL);
+}
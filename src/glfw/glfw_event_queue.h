@@ -0,0 +1,45 @@
+#pragma once
+
+// Must be a power of two
+#define GLFW_EVENT_QUEUE__CAPACITY 256
+#define GLFW_EVENT_QUEUE__CACHE_LINE 64
+
+enum glfw_event_type {
+	GLFW_EVENT__RESIZE,
+	GLFW_EVENT__KEY
+};
+
+struct glfw_event {
+	enum glfw_event_type type;
+	int window_index;
+	union {
+		struct {
+			int width;
+			int height;
+		} resize;
+		struct {
+			int key;
+			int action;
+			int mods;
+		} key;
+	} data;
+};
+
+// Lock-free ring for exactly one producer thread and one consumer thread.
+// head is only written by the consumer and tail only by the producer, each on its own cache line.
+struct glfw_event_queue {
+	struct glfw_event events[GLFW_EVENT_QUEUE__CAPACITY];
+	unsigned int head;
+	char head_padding[GLFW_EVENT_QUEUE__CACHE_LINE - sizeof(unsigned int)];
+	unsigned int tail;
+	char tail_padding[GLFW_EVENT_QUEUE__CACHE_LINE - sizeof(unsigned int)];
+	int overflowed;
+};
+
+void glfw_event_queue__init(struct glfw_event_queue *this);
+// Producer side, returns -1 and marks the queue overflowed if it is full
+int glfw_event_queue__try_push(struct glfw_event_queue *this, const struct glfw_event *event);
+// Consumer side, returns 1 if an event was popped and 0 if the queue is empty
+int glfw_event_queue__pop(struct glfw_event_queue *this, struct glfw_event *event_out);
+// Consumer side, returns 1 once after events have been dropped
+int glfw_event_queue__take_overflowed(struct glfw_event_queue *this);
@@ -1,31 +1,42 @@
 #include <stdio.h>
+#include <malloc.h>
+#include <string.h>
+#include <time.h>
 #include "glfw_handler.h"
+#include "../profiler/profiler.h"
 
 #define MAX_UINT64 0xFFFFFFFFFFFFFFFF
+#define SIMULATION_STEP_SECONDS (1.0/60.0)
+#define SIMULATION_BOUNDS 1.2f
+#define SIMULATION_SEED 1
+// Querying the budget is not free on every driver, and usage changes slowly outside of streaming
+#define MEMORY_BUDGET_INTERVAL_FRAMES 30
+// How long the render thread sleeps while no window has a drawable area
+#define IDLE_SLEEP_NANOSECONDS 10000000L
 
 static VkResult create_window_surface(void *user_data, VkInstance instance, VkSurfaceKHR *surface_out) {
 	struct glfw_handler *this = (struct glfw_handler *) user_data;
-	return glfwCreateWindowSurface(instance, this->window, 0, surface_out);
+	return glfwCreateWindowSurface(instance, this->windows[0].window, this->vulkan_base.allocator, surface_out);
 }
 
 static void free_glfw(struct glfw_handler *this) {
-	glfwDestroyWindow(this->window);
+	for (int i = 0; i < this->window_count; ++i) {
+		glfwDestroyWindow(this->windows[i].window);
+	}
 	glfwTerminate();
 }
 
 static void free_semaphores_and_fences(struct glfw_handler *this) {
 	for (int i = 0; i < FRAME_RESOURCES; ++i) {
-		vkDestroySemaphore(this->vulkan_base.device, this->render_finished_semaphores[i], 0);
-		vkDestroySemaphore(this->vulkan_base.device, this->image_available_semaphores[i], 0);
-		vkDestroyFence(this->vulkan_base.device, this->resource_fences[i], 0);
+		vkDestroySemaphore(this->vulkan_base.device, this->render_finished_semaphores[i], this->vulkan_base.allocator);
+		vkDestroyFence(this->vulkan_base.device, this->resource_fences[i], this->vulkan_base.allocator);
 	}
 }
 
 static void free_semaphores_and_fences_below(struct glfw_handler *this, int i) {
 	for (--i;i >= 0; --i) {
-		vkDestroySemaphore(this->vulkan_base.device, this->render_finished_semaphores[i], 0);
-		vkDestroySemaphore(this->vulkan_base.device, this->image_available_semaphores[i], 0);
-		vkDestroyFence(this->vulkan_base.device, this->resource_fences[i], 0);
+		vkDestroySemaphore(this->vulkan_base.device, this->render_finished_semaphores[i], this->vulkan_base.allocator);
+		vkDestroyFence(this->vulkan_base.device, this->resource_fences[i], this->vulkan_base.allocator);
 	}
 }
 
@@ -41,261 +52,959 @@ static int create_semaphores_and_fences(struct glfw_handler *this) {
 	fence_create_info.flags = VK_FENCE_CREATE_SIGNALED_BIT;
 	int i = 0;
 	for (; i < FRAME_RESOURCES; ++i) {
-		if (vkCreateSemaphore(this->vulkan_base.device, &semaphore_create_info, 0, this->image_available_semaphores + i) != VK_SUCCESS) {
+		if (vkCreateSemaphore(this->vulkan_base.device, &semaphore_create_info, this->vulkan_base.allocator, this->render_finished_semaphores + i) != VK_SUCCESS) {
 			free_semaphores_and_fences_below(this, i);
 			return -1;
 		}
 
-		if (vkCreateSemaphore(this->vulkan_base.device, &semaphore_create_info, 0, this->render_finished_semaphores + i) != VK_SUCCESS) {
-			vkDestroySemaphore(this->vulkan_base.device, this->image_available_semaphores[i], 0);
+		if (vkCreateFence(this->vulkan_base.device, &fence_create_info, this->vulkan_base.allocator, this->resource_fences + i) != VK_SUCCESS) {
+			vkDestroySemaphore(this->vulkan_base.device, this->render_finished_semaphores[i], this->vulkan_base.allocator);
 			free_semaphores_and_fences_below(this, i);
 			return -2;
 		}
+	}
+	return 0;
+}
 
-		if (vkCreateFence(this->vulkan_base.device, &fence_create_info, 0, this->resource_fences + i) != VK_SUCCESS) {
-			vkDestroySemaphore(this->vulkan_base.device, this->image_available_semaphores[i], 0);
-			vkDestroySemaphore(this->vulkan_base.device, this->render_finished_semaphores[i], 0);
-			free_semaphores_and_fences_below(this, i);
-			return -3;
+static void free_window_semaphores_below(struct glfw_handler *this, struct glfw_handler_window *window, int i) {
+	for (--i;i >= 0; --i) {
+		vkDestroySemaphore(this->vulkan_base.device, window->image_available_semaphores[i], this->vulkan_base.allocator);
+	}
+}
+
+static int create_window_semaphores(struct glfw_handler *this, struct glfw_handler_window *window) {
+	VkSemaphoreCreateInfo semaphore_create_info;
+	semaphore_create_info.sType = VK_STRUCTURE_TYPE_SEMAPHORE_CREATE_INFO;
+	semaphore_create_info.pNext = 0;
+	semaphore_create_info.flags = 0;
+	for (int i = 0; i < FRAME_RESOURCES; ++i) {
+		if (vkCreateSemaphore(this->vulkan_base.device, &semaphore_create_info, this->vulkan_base.allocator, window->image_available_semaphores + i) != VK_SUCCESS) {
+			free_window_semaphores_below(this, window, i);
+			return -1;
 		}
 	}
 	return 0;
 }
 
-static int try_record_command_buffers(struct glfw_handler *this) {
-	for (int i = 0; i < this->vulkan_swapchain.image_count; ++i) {
-		VkCommandBufferBeginInfo command_begin_info;
-		command_begin_info.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO;
-		command_begin_info.pNext = 0;
-		command_begin_info.pInheritanceInfo = 0;
-		command_begin_info.flags = VK_COMMAND_BUFFER_USAGE_SIMULTANEOUS_USE_BIT;
+// The first window presents to the base's surface, the others own theirs
+static void free_window_surface(struct glfw_handler *this, struct glfw_handler_window *window) {
+	if (window->surface != this->vulkan_base.surface) {
+		vkDestroySurfaceKHR(this->vulkan_base.instance, window->surface, this->vulkan_base.allocator);
+	}
+}
 
-		if (vkBeginCommandBuffer(this->vulkan_swapchain.command_buffers[i], &command_begin_info) != VK_SUCCESS) {
+static int try_init_window_swapchain(struct glfw_handler *this, struct glfw_handler_window *window) {
+	window->should_recreate_swapchain = 0;
+	if (window == this->windows) {
+		window->surface = this->vulkan_base.surface;
+	} else {
+		if (glfwCreateWindowSurface(this->vulkan_base.instance, window->window, this->vulkan_base.allocator, &window->surface) != VK_SUCCESS) {
 			return -1;
 		}
-
-		VkOffset2D render_area_offset;
-		render_area_offset.x = 0;
-		render_area_offset.y = 0;
-
-		VkClearValue clear_value;
-		clear_value.color.float32[0] = 0.0f;
-		clear_value.color.float32[1] = 0.0f;
-		clear_value.color.float32[2] = 0.0f;
-		clear_value.color.float32[3] = 1.0f;
-		clear_value.depthStencil.depth = 0.0f;
-		clear_value.depthStencil.stencil = 0;
-
-		VkRenderPassBeginInfo render_pass_begin_info;
-		render_pass_begin_info.sType = VK_STRUCTURE_TYPE_RENDER_PASS_BEGIN_INFO;
-		render_pass_begin_info.pNext = 0;
-		render_pass_begin_info.renderPass = this->vulkan_swapchain.render_pass;
-		render_pass_begin_info.framebuffer = this->vulkan_swapchain.framebuffers[i];
-		render_pass_begin_info.renderArea.offset = render_area_offset;
-		render_pass_begin_info.renderArea.extent = this->vulkan_swapchain.extent;
-		render_pass_begin_info.clearValueCount = 1;
-		render_pass_begin_info.pClearValues = &clear_value;
-
-		vkCmdBeginRenderPass(this->vulkan_swapchain.command_buffers[i], &render_pass_begin_info, VK_SUBPASS_CONTENTS_INLINE);
-		vkCmdBindPipeline(this->vulkan_swapchain.command_buffers[i], VK_PIPELINE_BIND_POINT_GRAPHICS, this->vulkan_swapchain.graphics_pipeline);
-		vkCmdDraw(this->vulkan_swapchain.command_buffers[i], 3, 1, 0, 0);
-		vkCmdEndRenderPass(this->vulkan_swapchain.command_buffers[i]);
-
-		if (vkEndCommandBuffer(this->vulkan_swapchain.command_buffers[i]) != VK_SUCCESS) {
+		VkBool32 present_support = VK_FALSE;
+		vkGetPhysicalDeviceSurfaceSupportKHR(this->vulkan_base.physical_device, (uint32_t) this->vulkan_base.queue_family_index, window->surface, &present_support);
+		if (!present_support) {
+			free_window_surface(this, window);
 			return -2;
 		}
 	}
+
+	if (vulkan_swapchain__try_init(&window->vulkan_swapchain, &this->vulkan_base) < 0) {
+		free_window_surface(this, window);
+		return -3;
+	}
+	window->vulkan_swapchain.surface = window->surface;
+	if (this->textured) {
+		window->vulkan_swapchain.texture_set_layout = this->vulkan_texture.descriptor_set_layout;
+	}
+
+	if (vulkan_swapchain__try_init_swapchain(&window->vulkan_swapchain, window->width, window->height) < 0) {
+		vulkan_swapchain__free(&window->vulkan_swapchain);
+		free_window_surface(this, window);
+		return -4;
+	}
+	return 0;
+}
+
+static void free_window_swapchain(struct glfw_handler *this, struct glfw_handler_window *window) {
+	vulkan_swapchain__free_swapchain(&window->vulkan_swapchain);
+	vulkan_swapchain__free(&window->vulkan_swapchain);
+	free_window_surface(this, window);
+}
+
+// Needs the swapchain and the shared culling
+static int try_init_window_frames(struct glfw_handler *this, struct glfw_handler_window *window) {
+	// A culling view per window, in the order of the windows
+	int culling_view = (int) (window - this->windows);
+	if (vulkan_scene__try_init(&window->vulkan_scene, &this->vulkan_base, &window->vulkan_swapchain, &this->vulkan_culling, culling_view) < 0) {
+		return -1;
+	}
+	if (this->textured) {
+		vulkan_scene__set_texture(&window->vulkan_scene, &this->vulkan_texture);
+	}
+	if (vulkan_scene__try_init_graph(&window->vulkan_scene) < 0) {
+		vulkan_scene__free(&window->vulkan_scene);
+		return -2;
+	}
+
+	if (create_window_semaphores(this, window) < 0) {
+		vulkan_scene__free_graph(&window->vulkan_scene);
+		vulkan_scene__free(&window->vulkan_scene);
+		return -3;
+	}
 	return 0;
 }
 
+static void free_window_frames(struct glfw_handler *this, struct glfw_handler_window *window) {
+	free_window_semaphores_below(this, window, FRAME_RESOURCES);
+	vulkan_scene__free_graph(&window->vulkan_scene);
+	vulkan_scene__free(&window->vulkan_scene);
+}
+
+static void free_window(struct glfw_handler *this, struct glfw_handler_window *window) {
+	free_window_frames(this, window);
+	free_window_swapchain(this, window);
+}
+
+static void free_windows_below(struct glfw_handler *this, int i) {
+	for (--i;i >= 0; --i) {
+		free_window(this, this->windows + i);
+	}
+}
+
 enum try_recreate_swapchain {
     TRY_RECREATE_SWAPCHAIN__NO_AREA = 1
 }
-static try_recreate_swapchain(struct glfw_handler *this) {
-	int width, height;
-	glfwGetFramebufferSize(this->window, &width, &height);
+static try_recreate_swapchain(struct glfw_handler *this, struct glfw_handler_window *window) {
+	int width = window->width;
+	int height = window->height;
 
 	if (width == 0 || height == 0) {
 		return TRY_RECREATE_SWAPCHAIN__NO_AREA;
 	}
 
 	vkDeviceWaitIdle(this->vulkan_base.device);
-	vulkan_swapchain__free_swapchain(&this->vulkan_swapchain);
+	int captured = window == this->windows && this->capturing;
+	if (captured && this->capture_targets) {
+		vulkan_capture__free_targets(&this->vulkan_capture);
+		this->capture_targets = 0;
+	}
+	vulkan_scene__free_graph(&window->vulkan_scene);
+	vulkan_swapchain__free_swapchain(&window->vulkan_swapchain);
 
-	if (vulkan_swapchain__try_init_swapchain(&this->vulkan_swapchain, width, height) < 0) {
+	if (vulkan_swapchain__try_init_swapchain(&window->vulkan_swapchain, width, height) < 0) {
 		return -1;
 	}
 
-	if (try_record_command_buffers(this) < 0) {
+	if (vulkan_scene__try_init_graph(&window->vulkan_scene) < 0) {
 		return -2;
 	}
+
+	if (captured) {
+		if (vulkan_capture__try_init_targets(&this->vulkan_capture, &window->vulkan_swapchain) < 0) {
+			return -3;
+		}
+		this->capture_targets = 1;
+	}
 	return 0;
 }
 
-static int draw_frame(struct glfw_handler *this) {
-	this->resources_index = (this->resources_index + 1) % FRAME_RESOURCES;
-
-	vkWaitForFences(this->vulkan_base.device, 1, this->resource_fences + this->resources_index, VK_TRUE, MAX_UINT64);
-	vkResetFences(this->vulkan_base.device, 1, this->resource_fences + this->resources_index);
+// Acquires an image for the window, returns 1 if the window has nothing to draw to this frame
+static int try_acquire(struct glfw_handler *this, struct glfw_handler_window *window, uint32_t *image_index_out) {
+	if (window->should_recreate_swapchain) {
+		int result = try_recreate_swapchain(this, window);
+		if (result < 0) {
+			return -1;
+		} else if (result == TRY_RECREATE_SWAPCHAIN__NO_AREA) {
+			return 1;
+		}
+		window->should_recreate_swapchain = 0;
+	}
 
-	uint32_t image_index;
 	while (1) {
-		VkResult vk_result = vkAcquireNextImageKHR(this->vulkan_base.device, this->vulkan_swapchain.swapchain, MAX_UINT64,
-												this->image_available_semaphores[this->resources_index], VK_NULL_HANDLE,
-												&image_index);
+		VkResult vk_result = vkAcquireNextImageKHR(this->vulkan_base.device, window->vulkan_swapchain.swapchain, MAX_UINT64,
+												window->image_available_semaphores[this->resources_index], VK_NULL_HANDLE,
+												image_index_out);
 
 		if (vk_result == VK_SUCCESS || vk_result == VK_SUBOPTIMAL_KHR) {
-			break;
+			return 0;
 		} else if (vk_result == VK_ERROR_OUT_OF_DATE_KHR) {
-			int result = try_recreate_swapchain(this);
+			int result = try_recreate_swapchain(this, window);
 			if (result < 0) {
-				return -1;
+				return -2;
 			} else if (result == TRY_RECREATE_SWAPCHAIN__NO_AREA) {
-				return 0;
+				window->should_recreate_swapchain = 1;
+				return 1;
 			}
 		} else {
+			return -3;
+		}
+	}
+}
+
+enum draw_frame {
+	DRAW_FRAME__NOTHING_DRAWN = 1
+};
+
+// Returns DRAW_FRAME__NOTHING_DRAWN when every window was minimized
+static int draw_frame(struct glfw_handler *this) {
+	this->resources_index = (this->resources_index + 1) % FRAME_RESOURCES;
+
+	PROFILER_BEGIN("wait_fence");
+	vkWaitForFences(this->vulkan_base.device, 1, this->resource_fences + this->resources_index, VK_TRUE, MAX_UINT64);
+	PROFILER_END("wait_fence");
+	if (this->capture_targets) {
+		vulkan_capture__complete(&this->vulkan_capture, this->resources_index);
+	}
+
+	// Rendering never waits for the simulation, it keeps drawing the last snapshot until a new one arrives
+	const struct simulation_snapshot *snapshot = simulation__read(&this->simulation);
+	if (snapshot) {
+		simulation__interpolate(snapshot, this->simulation.step_seconds, simulation__now(), this->frame_positions);
+		for (int i = 0; i < snapshot->body_count; ++i) {
+			this->frame_objects[i].center[0] = this->frame_positions[i][0];
+			this->frame_objects[i].center[1] = this->frame_positions[i][1];
+		}
+	}
+	// Ahead of recording windows culled on the CPU, its copy is only submitted once something is drawn
+	VkCommandBuffer update_command_buffer = VK_NULL_HANDLE;
+	if (snapshot) {
+		update_command_buffer = vulkan_culling__update_objects(&this->vulkan_culling, this->resources_index, this->frame_objects);
+	}
+
+	struct glfw_handler_window *windows[GLFW_HANDLER__MAX_WINDOWS];
+	VkSwapchainKHR swapchains[GLFW_HANDLER__MAX_WINDOWS];
+	uint32_t image_indices[GLFW_HANDLER__MAX_WINDOWS];
+	VkSemaphore wait_semaphores[GLFW_HANDLER__MAX_WINDOWS];
+	VkPipelineStageFlags wait_stages[GLFW_HANDLER__MAX_WINDOWS];
+	// The first two are left for the texture's copies and the object update, which are only worth recording once
+	// something gets submitted and go ahead of every window's
+	VkCommandBuffer command_buffers[2*GLFW_HANDLER__MAX_WINDOWS + 2];
+	uint32_t acquired_count = 0;
+	uint32_t command_buffer_count = 2;
+	for (int i = 0; i < this->window_count; ++i) {
+		struct glfw_handler_window *window = this->windows + i;
+		uint32_t image_index;
+		PROFILER_BEGIN("acquire");
+		int result = try_acquire(this, window, &image_index);
+		PROFILER_END("acquire");
+		if (result < 0) {
+			return -1;
+		} else if (result > 0) {
+			continue;
+		}
+		windows[acquired_count] = window;
+		swapchains[acquired_count] = window->vulkan_swapchain.swapchain;
+		image_indices[acquired_count] = image_index;
+		wait_semaphores[acquired_count] = window->image_available_semaphores[this->resources_index];
+		wait_stages[acquired_count] = VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT;
+		++acquired_count;
+
+		window->vulkan_scene.frame_uniforms.lod_tint = this->lod_tint;
+		PROFILER_BEGIN("update_frame");
+		result = vulkan_scene__try_update_frame(&window->vulkan_scene, image_index, this->resource_fences[this->resources_index]);
+		PROFILER_END("update_frame");
+		if (result < 0) {
 			return -2;
 		}
+		command_buffers[command_buffer_count++] = window->vulkan_swapchain.command_buffers[image_index];
+		if (i == 0 && this->capture_targets) {
+			VkCommandBuffer capture_command_buffer = vulkan_capture__begin_frame(&this->vulkan_capture, image_index, this->resources_index, glfwGetTime());
+			if (capture_command_buffer != VK_NULL_HANDLE) {
+				command_buffers[command_buffer_count++] = capture_command_buffer;
+			}
+		}
+	}
+	// Leave the fence signaled when nothing is submitted, the next wait on it would never return otherwise
+	if (acquired_count == 0) {
+		return DRAW_FRAME__NOTHING_DRAWN;
+	}
+	vkResetFences(this->vulkan_base.device, 1, this->resource_fences + this->resources_index);
+	uint32_t first_command_buffer = 2;
+	if (update_command_buffer != VK_NULL_HANDLE) {
+		command_buffers[--first_command_buffer] = update_command_buffer;
+	}
+	if (this->textured) {
+		PROFILER_BEGIN("texture_update");
+		VkCommandBuffer texture_command_buffer = vulkan_virtual_texture__update(&this->vulkan_texture, this->resources_index);
+		PROFILER_END("texture_update");
+		if (texture_command_buffer != VK_NULL_HANDLE) {
+			command_buffers[--first_command_buffer] = texture_command_buffer;
+		}
 	}
-	VkPipelineStageFlags wait_stage = VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT;
 
 	VkSubmitInfo submit_info;
 	submit_info.sType = VK_STRUCTURE_TYPE_SUBMIT_INFO;
 	submit_info.pNext = 0;
-	submit_info.waitSemaphoreCount = 1;
-	submit_info.pWaitSemaphores = this->image_available_semaphores + this->resources_index;
-	submit_info.pWaitDstStageMask = &wait_stage;
-	submit_info.commandBufferCount = 1;
-	submit_info.pCommandBuffers = this->vulkan_swapchain.command_buffers + image_index;
+	submit_info.waitSemaphoreCount = acquired_count;
+	submit_info.pWaitSemaphores = wait_semaphores;
+	submit_info.pWaitDstStageMask = wait_stages;
+	submit_info.commandBufferCount = command_buffer_count - first_command_buffer;
+	submit_info.pCommandBuffers = command_buffers + first_command_buffer;
 	submit_info.signalSemaphoreCount = 1;
 	submit_info.pSignalSemaphores = this->render_finished_semaphores + this->resources_index;
 
-	if (vkQueueSubmit(this->vulkan_base.queue, 1, &submit_info, this->resource_fences[this->resources_index]) != VK_SUCCESS) {
+	PROFILER_BEGIN("submit");
+	vulkan_base__queue_begin_label(&this->vulkan_base, "frame");
+	VkResult vk_result = vkQueueSubmit(this->vulkan_base.queue, 1, &submit_info, this->resource_fences[this->resources_index]);
+	PROFILER_END("submit");
+	if (vk_result != VK_SUCCESS) {
+		vulkan_base__queue_end_label(&this->vulkan_base);
 		return -3;
 	}
 
+	VkResult present_results[GLFW_HANDLER__MAX_WINDOWS];
 	VkPresentInfoKHR present_info;
 	present_info.sType = VK_STRUCTURE_TYPE_PRESENT_INFO_KHR;
 	present_info.waitSemaphoreCount = 1;
 	present_info.pWaitSemaphores = this->render_finished_semaphores + this->resources_index;
-	present_info.pImageIndices = &image_index;
-	present_info.pResults = 0;
+	present_info.pImageIndices = image_indices;
+	present_info.pResults = present_results;
 	present_info.pNext = 0;
-	present_info.swapchainCount = 1;
-	present_info.pSwapchains = &this->vulkan_swapchain.swapchain;
-
-	VkResult vk_result = vkQueuePresentKHR(this->vulkan_base.queue, &present_info);
-	if (vk_result != VK_SUCCESS) {
-		if (vk_result == VK_SUBOPTIMAL_KHR || vk_result == VK_ERROR_OUT_OF_DATE_KHR) {
-			int result = try_recreate_swapchain(this);
-			if (result < 0) {
-				return -4;
-			}
-		} else {
-			return -5;
+	present_info.swapchainCount = acquired_count;
+	present_info.pSwapchains = swapchains;
+
+	PROFILER_BEGIN("present");
+	vk_result = vkQueuePresentKHR(this->vulkan_base.queue, &present_info);
+	vulkan_base__queue_end_label(&this->vulkan_base);
+	PROFILER_END("present");
+	if (vk_result != VK_SUCCESS && vk_result != VK_SUBOPTIMAL_KHR && vk_result != VK_ERROR_OUT_OF_DATE_KHR) {
+		return -5;
+	}
+	// Recreated on the window's next acquire
+	for (uint32_t i = 0; i < acquired_count; ++i) {
+		if (present_results[i] == VK_SUBOPTIMAL_KHR || present_results[i] == VK_ERROR_OUT_OF_DATE_KHR) {
+			windows[i]->should_recreate_swapchain = 1;
+		} else if (present_results[i] != VK_SUCCESS) {
+			return -4;
 		}
 	}
 	return 0;
 }
 
+static void free_simulation(struct glfw_handler *this) {
+	simulation__free(&this->simulation);
+	free(this->frame_positions);
+	free(this->frame_objects);
+}
+
+// The culling has the starting layout
+static int try_init_simulation(struct glfw_handler *this) {
+	struct vulkan_culling *culling = &this->vulkan_culling;
+	int object_count = (int) culling->object_count;
+	this->frame_objects = malloc(object_count*sizeof(*this->frame_objects));
+	this->frame_positions = malloc(object_count*sizeof(*this->frame_positions));
+	if (!this->frame_objects || !this->frame_positions) {
+		free(this->frame_positions);
+		free(this->frame_objects);
+		return -1;
+	}
+	memcpy(this->frame_objects, culling->objects, object_count*sizeof(*this->frame_objects));
+	for (int i = 0; i < object_count; ++i) {
+		this->frame_positions[i][0] = this->frame_objects[i].center[0];
+		this->frame_positions[i][1] = this->frame_objects[i].center[1];
+	}
+	if (simulation__try_init(&this->simulation, (const float (*)[2]) this->frame_positions, object_count, SIMULATION_BOUNDS,
+							 SIMULATION_STEP_SECONDS, SIMULATION_SEED) < 0) {
+		free(this->frame_positions);
+		free(this->frame_objects);
+		return -2;
+	}
+	return 0;
+}
+
+static uint64_t pack_size(int width, int height) {
+	return (uint64_t) (uint32_t) width << 32 | (uint32_t) height;
+}
+
+// GLFW callbacks run on the main thread and only forward to the render thread
 static void framebuffer_size_callback(GLFWwindow *window, int width, int height) {
-	struct glfw_handler *this = glfwGetWindowUserPointer(window);
-	this->should_recreate_swapchain = 1;
+	struct glfw_handler_window *handler_window = glfwGetWindowUserPointer(window);
+	__atomic_store_n(&handler_window->latest_size, pack_size(width, height), __ATOMIC_RELEASE);
+	struct glfw_event event;
+	event.type = GLFW_EVENT__RESIZE;
+	event.window_index = (int) (handler_window - handler_window->handler->windows);
+	event.data.resize.width = width;
+	event.data.resize.height = height;
+	glfw_event_queue__try_push(&handler_window->handler->events, &event);
 }
 
-int glfw_handler__try_init(struct glfw_handler *this, int width, int height, char *title, int fullscreen) {
-	this->resources_index = 0;
-	glfwInit();
+static void key_callback(GLFWwindow *window, int key, int scancode, int action, int mods) {
+	struct glfw_handler_window *handler_window = glfwGetWindowUserPointer(window);
+	struct glfw_event event;
+	event.type = GLFW_EVENT__KEY;
+	event.window_index = (int) (handler_window - handler_window->handler->windows);
+	event.data.key.key = key;
+	event.data.key.action = action;
+	event.data.key.mods = mods;
+	glfw_event_queue__try_push(&handler_window->handler->events, &event);
+}
 
-	glfwWindowHint(GLFW_CLIENT_API, GLFW_NO_API);
+struct startup {
+	struct glfw_handler *handler;
+	int vulkan_flags;
+	// Zero once the main thread has created the windows
+	int windows_pending;
+	// Null for the built-in triangle
+	const char *mesh_path;
+	struct mesh mesh;
+	const char *texture_path;
+	// -2 when the mesh could not be mapped, -3 when the texture could not
+	int files_result;
+	int base_result;
+	double files_seconds;
+	double base_seconds;
+};
+
+struct culling_startup {
+	struct glfw_handler *handler;
+	int result;
+	double seconds;
+};
+
+static void load_files_job(void *user_data) {
+	struct startup *startup = (struct startup *) user_data;
+	PROFILER_BEGIN("load_files");
+	double start = glfwGetTime();
+	startup->files_result = vulkan_base__try_load_files(&startup->handler->vulkan_base);
+	if (startup->files_result >= 0 && startup->mesh_path) {
+		if (mesh__try_map(&startup->mesh, startup->mesh_path) < 0) {
+			vulkan_base__free_files(&startup->handler->vulkan_base);
+			startup->files_result = -2;
+		}
+	} else if (startup->files_result >= 0) {
+		mesh__init_triangle(&startup->mesh);
+	}
+	if (startup->files_result >= 0 && startup->texture_path && texture__try_map(&startup->handler->texture, startup->texture_path) < 0) {
+		mesh__unmap(&startup->mesh);
+		vulkan_base__free_files(&startup->handler->vulkan_base);
+		startup->files_result = -3;
+	}
+	startup->files_seconds = glfwGetTime() - start;
+	PROFILER_END("load_files");
+}
 
-	GLFWmonitor *monitor = NULL;
-	if (fullscreen) {
-		monitor = glfwGetPrimaryMonitor();
-        glfwWindowHint(GLFW_RESIZABLE, GLFW_FALSE);
-	} else {
-        glfwWindowHint(GLFW_RESIZABLE, GLFW_TRUE);
+// Instance creation runs while the main thread creates the windows, the surface has to wait for them
+static VkResult create_window_surface_after_windows(void *user_data, VkInstance instance, VkSurfaceKHR *surface_out) {
+	struct startup *startup = (struct startup *) user_data;
+	job_system__wait(&startup->handler->job_system, &startup->windows_pending);
+	if (startup->handler->window_count == 0) {
+		return VK_ERROR_INITIALIZATION_FAILED;
 	}
-	this->window = glfwCreateWindow(width, height, title, monitor, 0);
-	glfwSetWindowUserPointer(this->window, this);
-	glfwSetFramebufferSizeCallback(this->window, framebuffer_size_callback);
+	return create_window_surface(startup->handler, instance, surface_out);
+}
 
+static void init_base_job(void *user_data) {
+	struct startup *startup = (struct startup *) user_data;
+	PROFILER_BEGIN("init_base");
+	double start = glfwGetTime();
 	uint32_t extension_count;
 	const char **extensions = glfwGetRequiredInstanceExtensions(&extension_count);
 	struct vulkan_base__create_surface callback;
-	callback.create_window_surface = create_window_surface;
-	callback.user_data = this;
-	int result = vulkan_base__try_init(&this->vulkan_base, extensions, extension_count, callback);
+	callback.create_window_surface = create_window_surface_after_windows;
+	callback.user_data = startup;
+	startup->base_result = vulkan_base__try_init(&startup->handler->vulkan_base, extensions, (int) extension_count, startup->vulkan_flags, callback);
+	startup->base_seconds = glfwGetTime() - start;
+	PROFILER_END("init_base");
+}
+
+static void init_culling_job(void *user_data) {
+	struct culling_startup *startup = (struct culling_startup *) user_data;
+	PROFILER_BEGIN("init_culling");
+	double start = glfwGetTime();
+	startup->result = vulkan_culling__try_init_grid(&startup->handler->vulkan_culling, &startup->handler->vulkan_base, &startup->handler->vulkan_mesh,
+													VULKAN_CULLING__DEFAULT_GRID_SIZE, startup->handler->window_count);
+	startup->seconds = glfwGetTime() - start;
+	PROFILER_END("init_culling");
+}
+
+static int try_create_windows(struct glfw_handler *this, int width, int height, char *title, int fullscreen, int window_count) {
+	glfwWindowHint(GLFW_CLIENT_API, GLFW_NO_API);
+
+	int monitor_count = 0;
+	GLFWmonitor **monitors = glfwGetMonitors(&monitor_count);
+	for (int i = 0; i < window_count; ++i) {
+		GLFWmonitor *monitor = NULL;
+		if (fullscreen && i < monitor_count) {
+			monitor = monitors[i];
+	        glfwWindowHint(GLFW_RESIZABLE, GLFW_FALSE);
+		} else {
+	        glfwWindowHint(GLFW_RESIZABLE, GLFW_TRUE);
+		}
+		struct glfw_handler_window *window = this->windows + i;
+		window->window = glfwCreateWindow(width, height, title, monitor, 0);
+		if (!window->window) {
+			return -1;
+		}
+		++this->window_count;
+		window->handler = this;
+		glfwGetFramebufferSize(window->window, &window->width, &window->height);
+		window->latest_size = pack_size(window->width, window->height);
+		glfwSetWindowUserPointer(window->window, window);
+		glfwSetFramebufferSizeCallback(window->window, framebuffer_size_callback);
+		glfwSetKeyCallback(window->window, key_callback);
+	}
+	return 0;
+}
+
+static void free_culling(struct glfw_handler *this) {
+	vulkan_culling__free_updates(&this->vulkan_culling);
+	vulkan_culling__free(&this->vulkan_culling);
+}
+
+// The culling's compute pipeline compiles on a worker while this thread creates the swapchains and their graphics
+// pipelines, which share the base's command pool and so stay on one thread
+static int try_init_windows(struct glfw_handler *this) {
+	struct culling_startup startup;
+	startup.handler = this;
+	int counter = 0;
+	job_system__run(&this->job_system, init_culling_job, &startup, &counter);
+
+	double start = glfwGetTime();
+	int swapchain_count = 0;
+	for (; swapchain_count < this->window_count; ++swapchain_count) {
+		if (try_init_window_swapchain(this, this->windows + swapchain_count) < 0) {
+			break;
+		}
+	}
+	double swapchains_seconds = glfwGetTime() - start;
+	job_system__wait(&this->job_system, &counter);
+	printf("Startup: swapchains %.1f ms, culling %.1f ms (concurrently)\n", swapchains_seconds*1000.0, startup.seconds*1000.0);
+
+	int result = swapchain_count < this->window_count ? -1 : 0;
+	int culling_ready = startup.result >= 0;
+	if (culling_ready && vulkan_culling__try_init_updates(&this->vulkan_culling, FRAME_RESOURCES) < 0) {
+		vulkan_culling__free(&this->vulkan_culling);
+		culling_ready = 0;
+	}
+	if (!culling_ready) {
+		result = -2;
+	}
+
+	int frames_count = 0;
+	if (result == 0) {
+		start = glfwGetTime();
+		for (; frames_count < this->window_count; ++frames_count) {
+			if (try_init_window_frames(this, this->windows + frames_count) < 0) {
+				result = -3;
+				break;
+			}
+		}
+		printf("Startup: render graphs and command buffers %.1f ms\n", (glfwGetTime() - start)*1000.0);
+	}
 	if (result < 0) {
-		free_glfw(this);
+		for (int i = frames_count - 1; i >= 0; --i) {
+			free_window_frames(this, this->windows + i);
+		}
+		for (int i = swapchain_count - 1; i >= 0; --i) {
+			free_window_swapchain(this, this->windows + i);
+		}
+		if (culling_ready) {
+			free_culling(this);
+		}
+	}
+	return result;
+}
+
+// Needs the mesh uploaded, the first upload uses the base's command pool
+static int try_init_texture(struct glfw_handler *this) {
+	if (!this->textured) {
+		return 0;
+	}
+	if (!this->vulkan_base.enabled_features.fragmentStoresAndAtomics) {
+		printf("Texture: the device can't write feedback from fragment shaders, drawing without it\n");
+		texture__unmap(&this->texture);
+		this->textured = 0;
+		return 0;
+	}
+	if (vulkan_virtual_texture__try_init(&this->vulkan_texture, &this->vulkan_base, &this->texture, &this->job_system,
+										 VULKAN_VIRTUAL_TEXTURE__DEFAULT_CACHE_SIDE) < 0) {
+		texture__unmap(&this->texture);
+		this->textured = 0;
 		return -1;
 	}
+	if (vulkan_virtual_texture__try_init_updates(&this->vulkan_texture, FRAME_RESOURCES) < 0) {
+		vulkan_virtual_texture__free(&this->vulkan_texture);
+		texture__unmap(&this->texture);
+		this->textured = 0;
+		return -2;
+	}
+	printf("Texture: %ux%u texels, %u levels, %u tiles streamed into a cache of %u\n", this->texture.width, this->texture.height,
+		   this->texture.mip_count, this->texture.tile_count, this->vulkan_texture.slot_count);
+	return 0;
+}
+
+static void free_texture(struct glfw_handler *this) {
+	if (this->textured) {
+		vulkan_virtual_texture__free(&this->vulkan_texture);
+		texture__unmap(&this->texture);
+	}
+}
+
+static void free_vulkan_base(struct glfw_handler *this) {
+	if (this->vulkan_base.pipeline_cache != VK_NULL_HANDLE) {
+		vulkan_base__free_pipeline_cache(&this->vulkan_base);
+	}
+	vulkan_base__free(&this->vulkan_base);
+	vulkan_base__free_files(&this->vulkan_base);
+}
 
-	result = vulkan_swapchain__try_init(&this->vulkan_swapchain, &this->vulkan_base);
+int glfw_handler__try_init(struct glfw_handler *this, int width, int height, char *title, int fullscreen, int window_count, int vulkan_flags,
+						   const char *mesh_path, const char *texture_path) {
+	if (window_count < 1 || window_count > GLFW_HANDLER__MAX_WINDOWS) {
+		return -7;
+	}
+	this->resources_index = 0;
+	this->lod_tint = 0.0f;
+	this->capturing = 0;
+	this->capture_targets = 0;
+	this->window_count = 0;
+	this->textured = texture_path != 0;
+	glfw_event_queue__init(&this->events);
+	PROFILER_THREAD_NAME("main");
+	PROFILER_BEGIN("startup");
+	if (job_system__try_init(&this->job_system, -1) < 0) {
+		PROFILER_END("startup");
+		return -10;
+	}
+	glfwInit();
+	this->startup_time = glfwGetTime();
+
+	// File reads and instance/device creation overlap with window creation, which GLFW keeps on this thread
+	struct startup startup;
+	startup.handler = this;
+	startup.vulkan_flags = vulkan_flags;
+	startup.mesh_path = mesh_path;
+	startup.texture_path = texture_path;
+	startup.windows_pending = 1;
+	int files_counter = 0;
+	int base_counter = 0;
+	job_system__run(&this->job_system, load_files_job, &startup, &files_counter);
+	job_system__run(&this->job_system, init_base_job, &startup, &base_counter);
+
+	PROFILER_BEGIN("create_windows");
+	double start = glfwGetTime();
+	int result = try_create_windows(this, width, height, title, fullscreen, window_count);
+	double windows_seconds = glfwGetTime() - start;
+	PROFILER_END("create_windows");
+	__atomic_store_n(&startup.windows_pending, 0, __ATOMIC_RELEASE);
+	job_system__wait(&this->job_system, &files_counter);
+	job_system__wait(&this->job_system, &base_counter);
+	printf("Startup: windows %.1f ms, files %.1f ms, instance and device %.1f ms (concurrently)\n",
+		   windows_seconds*1000.0, startup.files_seconds*1000.0, startup.base_seconds*1000.0);
+
+	if (result < 0 || startup.files_result < 0 || startup.base_result < 0) {
+		if (startup.base_result >= 0) {
+			vulkan_base__free(&this->vulkan_base);
+		}
+		if (startup.files_result >= 0) {
+			mesh__unmap(&startup.mesh);
+			if (texture_path) {
+				texture__unmap(&this->texture);
+			}
+			vulkan_base__free_files(&this->vulkan_base);
+		} else if (startup.files_result == -2) {
+			printf("Could not map the mesh %s\n", mesh_path);
+		} else if (startup.files_result == -3) {
+			printf("Could not map the texture %s\n", texture_path);
+		}
+		free_glfw(this);
+		job_system__free(&this->job_system);
+		PROFILER_END("startup");
+		return result < 0 ? -8 : -1;
+	}
+	printf("Rendering with %s\n", this->vulkan_base.dynamic_rendering ? "dynamic rendering" : "render pass objects");
+
+	// Without a cache pipelines still get created, just slower
+	if (vulkan_base__try_init_pipeline_cache(&this->vulkan_base) < 0) {
+		printf("Could not create the pipeline cache\n");
+	}
+
+	// Once uploaded the mapping is no longer needed
+	result = vulkan_mesh__try_init(&this->vulkan_mesh, &this->vulkan_base, &startup.mesh);
+	mesh__unmap(&startup.mesh);
 	if (result < 0) {
-		vulkan_base__free(&this->vulkan_base);
+		if (this->textured) {
+			texture__unmap(&this->texture);
+		}
+		free_vulkan_base(this);
 		free_glfw(this);
-		return -2;
+		job_system__free(&this->job_system);
+		PROFILER_END("startup");
+		return -11;
 	}
+	printf("Mesh: %u vertices, %u triangles, %u levels of detail\n", this->vulkan_mesh.vertex_count, this->vulkan_mesh.lods[0].index_count/3,
+		   this->vulkan_mesh.lod_count);
 
-	result = vulkan_swapchain__try_init_swapchain(&this->vulkan_swapchain, width, height);
+	if (try_init_texture(this) < 0) {
+		vulkan_mesh__free(&this->vulkan_mesh);
+		free_vulkan_base(this);
+		free_glfw(this);
+		job_system__free(&this->job_system);
+		PROFILER_END("startup");
+		return -12;
+	}
+
+	PROFILER_BEGIN("init_windows");
+	result = try_init_windows(this);
+	PROFILER_END("init_windows");
 	if (result < 0) {
-		vulkan_swapchain__free(&this->vulkan_swapchain);
-	    vulkan_base__free(&this->vulkan_base);
-	    free_glfw(this);
-	    return -3;
+		free_texture(this);
+		vulkan_mesh__free(&this->vulkan_mesh);
+		free_vulkan_base(this);
+		free_glfw(this);
+		job_system__free(&this->job_system);
+		PROFILER_END("startup");
+		return -2;
 	}
 
 	result = create_semaphores_and_fences(this);
 	if (result < 0) {
-		vulkan_swapchain__free_swapchain(&this->vulkan_swapchain);
-		vulkan_swapchain__free(&this->vulkan_swapchain);
-		vulkan_base__free(&this->vulkan_base);
+		free_windows_below(this, this->window_count);
+		free_culling(this);
+		free_texture(this);
+		vulkan_mesh__free(&this->vulkan_mesh);
+		free_vulkan_base(this);
 		free_glfw(this);
-		return -4;
+		job_system__free(&this->job_system);
+		PROFILER_END("startup");
+		return -6;
 	}
+
+	result = try_init_simulation(this);
+	if (result < 0) {
+		free_semaphores_and_fences(this);
+		free_windows_below(this, this->window_count);
+		free_culling(this);
+		free_texture(this);
+		vulkan_mesh__free(&this->vulkan_mesh);
+		free_vulkan_base(this);
+		free_glfw(this);
+		job_system__free(&this->job_system);
+		PROFILER_END("startup");
+		return -9;
+	}
+	printf("Startup: %.1f ms in total\n", (glfwGetTime() - this->startup_time)*1000.0);
+	PROFILER_END("startup");
 	return 0;
 }
 
 void glfw_handler__free(struct glfw_handler *this) {
+	free_simulation(this);
 	free_semaphores_and_fences(this);
-	vulkan_swapchain__free_swapchain(&this->vulkan_swapchain);
-	vulkan_swapchain__free(&this->vulkan_swapchain);
-	vulkan_base__free(&this->vulkan_base);
+	if (this->capture_targets) {
+		vulkan_capture__free_targets(&this->vulkan_capture);
+	}
+	if (this->capturing) {
+		vulkan_capture__free(&this->vulkan_capture);
+	}
+	free_windows_below(this, this->window_count);
+	free_culling(this);
+	free_texture(this);
+	vulkan_mesh__free(&this->vulkan_mesh);
+	free_vulkan_base(this);
 	free_glfw(this);
+	job_system__free(&this->job_system);
 }
 
-int glfw_handler__try_run(struct glfw_handler *this) {
-	if (try_record_command_buffers(this) < 0) {
-		return -1;
+static int should_close(struct glfw_handler *this) {
+	for (int i = 0; i < this->window_count; ++i) {
+		if (glfwWindowShouldClose(this->windows[i].window)) {
+			return 1;
+		}
+	}
+	return 0;
+}
+
+static void handle_events(struct glfw_handler *this) {
+	int overflowed = glfw_event_queue__take_overflowed(&this->events);
+	struct glfw_event event;
+	while (glfw_event_queue__pop(&this->events, &event)) {
+		struct glfw_handler_window *window = this->windows + event.window_index;
+		switch (event.type) {
+			case GLFW_EVENT__RESIZE:
+				window->width = event.data.resize.width;
+				window->height = event.data.resize.height;
+				window->should_recreate_swapchain = 1;
+				break;
+			case GLFW_EVENT__KEY:
+				if (event.data.key.key == GLFW_KEY_L && event.data.key.action == GLFW_PRESS) {
+					this->lod_tint = this->lod_tint > 0.0f ? 0.0f : 0.5f;
+				}
+				break;
+		}
+	}
+	// Resizes were dropped, so the queued ones may be older than the window. Each size is stored before its event is pushed,
+	// so the stored one is never older than anything popped above.
+	if (overflowed) {
+		for (int i = 0; i < this->window_count; ++i) {
+			struct glfw_handler_window *window = this->windows + i;
+			uint64_t size = __atomic_load_n(&window->latest_size, __ATOMIC_ACQUIRE);
+			window->width = (int) (uint32_t) (size >> 32);
+			window->height = (int) (uint32_t) size;
+			window->should_recreate_swapchain = 1;
+		}
 	}
+}
+
+// After the memory budget shrank the texture cache, the windows' command buffers still bind the old image
+static int try_rerecord_windows(struct glfw_handler *this) {
+	for (int i = 0; i < this->window_count; ++i) {
+		struct vulkan_scene *scene = &this->windows[i].vulkan_scene;
+		vulkan_scene__free_graph(scene);
+		if (vulkan_scene__try_init_graph(scene) < 0) {
+			return -1;
+		}
+	}
+	return 0;
+}
+
+// Where the GPU's work went in a recent frame of the first window
+static void print_statistics(struct glfw_handler *this) {
+	struct vulkan_scene *scene = &this->windows[0].vulkan_scene;
+	struct vulkan_render_graph *graph = &scene->render_graph;
+	struct vulkan_render_graph_statistics statistics[VULKAN_RENDER_GRAPH__MAX_PASSES];
+	if (vulkan_render_graph__get_statistics(graph, statistics) == 0) {
+		for (int i = 0; i < graph->pass_count; ++i) {
+			if (graph->passes[i].culled) {
+				continue;
+			}
+			printf("Pass %s: %llu vertex, %llu fragment and %llu compute invocations, %llu of %llu primitives after clipping\n", graph->passes[i].name,
+				   (unsigned long long) statistics[i].vertex_invocations, (unsigned long long) statistics[i].fragment_invocations,
+				   (unsigned long long) statistics[i].compute_invocations, (unsigned long long) statistics[i].clipping_primitives,
+				   (unsigned long long) statistics[i].clipping_invocations);
+		}
+	}
+	if (!this->vulkan_culling.gpu_driven) {
+		struct vulkan_draw_list_stats *stats = &scene->draw_list.stats;
+		printf("Draw list: %u items in %u draws, %u pipeline and %u descriptor binds, %u push constant updates\n", stats->items, stats->draws,
+			   stats->pipeline_binds, stats->descriptor_binds, stats->push_constant_updates);
+	}
+	if (this->textured) {
+		struct vulkan_virtual_texture_stats *stats = &this->vulkan_texture.stats;
+		printf("Texture: %u of %u cache slots used, %u tiles requested, %ld loaded and %ld evicted in total\n", stats->resident,
+			   this->vulkan_texture.slot_count, stats->requested, stats->loaded, stats->evicted);
+	}
+}
+
+static void *render_thread_main(void *user_data) {
+	struct glfw_handler *this = (struct glfw_handler *) user_data;
+	PROFILER_THREAD_NAME("render");
 	double prev_time = glfwGetTime();
 	long frames = 0;
-	while (!glfwWindowShouldClose(this->window)) {
+	// Host allocations made by the driver while drawing, ideally none once the first frames are done
+	struct vulkan_allocator *host_allocator = &this->vulkan_base.host_allocator;
+	unsigned long prev_allocations = vulkan_allocator__allocations(host_allocator);
+	unsigned long second_allocations = 0;
+	unsigned long max_frame_allocations = 0;
+	struct vulkan_memory_budget *budget = &this->vulkan_base.memory_budget;
+	long budget_frames = 0;
+	while (!__atomic_load_n(&this->stop, __ATOMIC_ACQUIRE)) {
 		++frames;
 		double delta_time = glfwGetTime() - prev_time;
 		if (delta_time >= 1.0) {
-			printf("%f FPS\n", frames / delta_time);
+			struct vulkan_allocator_stats stats;
+			vulkan_allocator__read_stats(host_allocator, &stats);
+			size_t live_bytes = 0;
+			for (int i = 0; i < VULKAN_ALLOCATOR__SCOPE_COUNT; ++i) {
+				live_bytes += stats.scopes[i].live_bytes;
+			}
+			printf("%f FPS, %.1f host allocations per frame (at most %lu), %zu bytes live\n", frames / delta_time,
+				   (double) second_allocations / frames, max_frame_allocations, live_bytes);
+			struct vulkan_memory_budget_heap heaps[VK_MAX_MEMORY_HEAPS];
+			vulkan_memory_budget__update(budget, heaps);
+			for (uint32_t i = 0; i < budget->heap_count; ++i) {
+				if (budget->memory_properties.memoryHeaps[i].flags & VK_MEMORY_HEAP_DEVICE_LOCAL_BIT) {
+					printf("Heap %u: %llu of %llu MiB budget used, %llu MiB by us\n", i, (unsigned long long) (heaps[i].usage >> 20),
+						   (unsigned long long) (heaps[i].budget >> 20), (unsigned long long) (heaps[i].allocated >> 20));
+				}
+			}
+			print_statistics(this);
 			frames = 0;
+			second_allocations = 0;
+			max_frame_allocations = 0;
 			prev_time = glfwGetTime();
 		}
 
-		glfwPollEvents();
-		if (this->should_recreate_swapchain) {
-			int result = try_recreate_swapchain(this);
-			if (result < 0) {
-				return -2;
-			} else if (result == TRY_RECREATE_SWAPCHAIN__NO_AREA) {
-				continue;
+		if (++budget_frames == MEMORY_BUDGET_INTERVAL_FRAMES) {
+			budget_frames = 0;
+			PROFILER_BEGIN("memory_budget");
+			VkDeviceSize evicted = vulkan_memory_budget__enforce(budget);
+			PROFILER_END("memory_budget");
+			if (evicted > 0) {
+				printf("Over the memory budget, evicted %llu KiB\n", (unsigned long long) (evicted >> 10));
+			}
+			if (this->textured && this->vulkan_texture.cache_resized) {
+				this->vulkan_texture.cache_resized = 0;
+				if (try_rerecord_windows(this) < 0) {
+					__atomic_store_n(&this->render_result, -6, __ATOMIC_RELEASE);
+					glfwPostEmptyEvent();
+					break;
+				}
 			}
-			this->should_recreate_swapchain = 0;
 		}
-
+		PROFILER_BEGIN("handle_events");
+		handle_events(this);
+		PROFILER_END("handle_events");
+		PROFILER_BEGIN("draw_frame");
 		int result = draw_frame(this);
+		PROFILER_END("draw_frame");
+		unsigned long allocations = vulkan_allocator__allocations(host_allocator);
+		second_allocations += allocations - prev_allocations;
+		if (allocations - prev_allocations > max_frame_allocations) {
+			max_frame_allocations = allocations - prev_allocations;
+		}
+		prev_allocations = allocations;
 		if (result < 0) {
-			return -3;
+			__atomic_store_n(&this->render_result, result, __ATOMIC_RELEASE);
+			// Wake the main thread so it notices
+			glfwPostEmptyEvent();
+			break;
+		}
+		// Minimized windows present nothing, so nothing else would pace the loop until one is restored
+		if (result == DRAW_FRAME__NOTHING_DRAWN) {
+			struct timespec idle = { 0, IDLE_SLEEP_NANOSECONDS };
+			nanosleep(&idle, 0);
+			continue;
+		}
+		if (this->startup_time >= 0.0) {
+			printf("First frame %.1f ms after startup began\n", (glfwGetTime() - this->startup_time)*1000.0);
+			this->startup_time = -1.0;
 		}
 	}
 	vkDeviceWaitIdle(this->vulkan_base.device);
 	return 0;
 }
+
+int glfw_handler__try_run(struct glfw_handler *this) {
+	this->stop = 0;
+	this->render_result = 0;
+	if (simulation__try_start(&this->simulation) < 0) {
+		return -1;
+	}
+	if (pthread_create(&this->render_thread, 0, render_thread_main, this) != 0) {
+		simulation__stop(&this->simulation);
+		return -2;
+	}
+	while (!should_close(this) && __atomic_load_n(&this->render_result, __ATOMIC_ACQUIRE) == 0) {
+		glfwWaitEvents();
+	}
+	__atomic_store_n(&this->stop, 1, __ATOMIC_RELEASE);
+	pthread_join(this->render_thread, 0);
+	simulation__stop(&this->simulation);
+	if (this->render_result < 0) {
+		return -3;
+	}
+	return 0;
+}
+
+int glfw_handler__try_start_capture(struct glfw_handler *this, const char *path) {
+	if (vulkan_capture__try_init(&this->vulkan_capture, &this->vulkan_base, path) < 0) {
+		return -1;
+	}
+	this->capturing = 1;
+	this->windows[0].vulkan_swapchain.image_usage |= VK_IMAGE_USAGE_TRANSFER_SRC_BIT;
+	// Recreate now so the images get the new usage
+	this->windows[0].should_recreate_swapchain = 1;
+	return 0;
+}
\ No newline at end of file
@@ -1,22 +1,81 @@
 #pragma once
 #define GLFW_INCLUDE_VULKAN
 #include <GLFW/glfw3.h>
+#include <pthread.h>
 #include "../vulkan/vulkan_base.h"
 #include "../vulkan/vulkan_swapchain.h"
+#include "../vulkan/vulkan_scene.h"
+#include "../vulkan/vulkan_mesh.h"
+#include "../vulkan/vulkan_capture.h"
+#include "../vulkan/vulkan_virtual_texture.h"
+#include "../texture/texture.h"
+#include "../simulation/simulation.h"
+#include "../job/job_system.h"
+#include "glfw_event_queue.h"
 
 #define FRAME_RESOURCES 2
+#define GLFW_HANDLER__MAX_WINDOWS 8
 
-struct glfw_handler {
-	struct vulkan_base vulkan_base;
-	struct vulkan_swapchain vulkan_swapchain;
+struct glfw_handler_window {
+	struct glfw_handler *handler;
 	GLFWwindow *window;
+	// Framebuffer size as last reported to the render thread
+	int width;
+	int height;
+	// Latest framebuffer size from the main thread, width in the high and height in the low 32 bits. Read instead of
+	// the events once the event queue overflowed and resizes may have been dropped.
+	uint64_t latest_size;
+	VkSurfaceKHR surface;
+	struct vulkan_swapchain vulkan_swapchain;
+	struct vulkan_scene vulkan_scene;
 	VkSemaphore image_available_semaphores[FRAME_RESOURCES];
+	int should_recreate_swapchain;
+};
+
+// All windows share one device, each frame is one submit and one present over every window with a drawable area.
+// Capture records the first window. Rendering runs on its own thread while the main thread only pumps GLFW
+// events, which reach the render thread through events. The objects move with a fixed step simulation on a third
+// thread, interpolated to the time each frame is drawn.
+struct glfw_handler {
+	struct job_system job_system;
+	// Negative once the first frame has been reported
+	double startup_time;
+	struct vulkan_base vulkan_base;
+	// Shared by every window's scene
+	struct vulkan_mesh vulkan_mesh;
+	// The objects every window shows, culled in each window's frame. Its buffers, queries and pipeline exist once
+	// however many windows there are.
+	struct vulkan_culling vulkan_culling;
+	// Shades every window's objects when textured, streamed from the mapped texture
+	int textured;
+	struct texture texture;
+	struct vulkan_virtual_texture vulkan_texture;
+	struct glfw_handler_window windows[GLFW_HANDLER__MAX_WINDOWS];
+	int window_count;
+	struct vulkan_capture vulkan_capture;
+	int capturing;
+	int capture_targets;
 	VkSemaphore render_finished_semaphores[FRAME_RESOURCES];
 	VkFence resource_fences[FRAME_RESOURCES];
 	int resources_index;
-	int should_recreate_swapchain;
+	// Toggled with L, written to every scene's frame uniforms
+	float lod_tint;
+
+	struct glfw_event_queue events;
+	pthread_t render_thread;
+	int stop;
+	int render_result;
+
+	struct simulation simulation;
+	struct vulkan_culling_object *frame_objects;
+	float (*frame_positions)[2];
 };
 
-int glfw_handler__try_init(struct glfw_handler *this, int width, int height, char *title, int fullscreen);
+// With fullscreen, window i goes on monitor i, windows without a monitor of their own are windowed.
+// mesh_path is a file written by mesh_convert, the built-in triangle is drawn without one. texture_path is a file
+// written by texture_convert or null, objects keep their vertex colors without one.
+int glfw_handler__try_init(struct glfw_handler *this, int width, int height, char *title, int fullscreen, int window_count, int vulkan_flags,
+						   const char *mesh_path, const char *texture_path);
 void glfw_handler__free(struct glfw_handler *this);
-int glfw_handler__try_run(struct glfw_handler *this);
\ No newline at end of file
+int glfw_handler__try_run(struct glfw_handler *this);
+int glfw_handler__try_start_capture(struct glfw_handler *this, const char *path);
\ No newline at end of file
@@ -0,0 +1,277 @@
+#include <malloc.h>
+#include <unistd.h>
+#include <sched.h>
+#include "job_system.h"
+#include "../profiler/profiler.h"
+
+#define DEQUE_MASK (JOB_SYSTEM__DEQUE_CAPACITY - 1)
+#define SPINS_BEFORE_SLEEP 64
+
+struct worker_start {
+	struct job_system *system;
+	int index;
+};
+
+// Which deque the current thread owns, -1 for threads outside the pool
+static __thread struct job_system *current_system;
+static __thread int current_index = -1;
+static __thread unsigned int steal_seed = 1;
+
+static int try_push(struct job_deque *deque, const struct job *job) {
+	long bottom = __atomic_load_n(&deque->bottom, __ATOMIC_RELAXED);
+	long top = __atomic_load_n(&deque->top, __ATOMIC_ACQUIRE);
+	if (bottom - top >= JOB_SYSTEM__DEQUE_CAPACITY) {
+		return -1;
+	}
+	deque->jobs[bottom & DEQUE_MASK] = *job;
+	__atomic_thread_fence(__ATOMIC_RELEASE);
+	__atomic_store_n(&deque->bottom, bottom + 1, __ATOMIC_RELAXED);
+	return 0;
+}
+
+static int pop(struct job_deque *deque, struct job *job_out) {
+	long bottom = __atomic_load_n(&deque->bottom, __ATOMIC_RELAXED) - 1;
+	__atomic_store_n(&deque->bottom, bottom, __ATOMIC_RELAXED);
+	__atomic_thread_fence(__ATOMIC_SEQ_CST);
+	long top = __atomic_load_n(&deque->top, __ATOMIC_RELAXED);
+	if (top > bottom) {
+		__atomic_store_n(&deque->bottom, bottom + 1, __ATOMIC_RELAXED);
+		return 0;
+	}
+	*job_out = deque->jobs[bottom & DEQUE_MASK];
+	if (top == bottom) {
+		// Last job, race thieves for it
+		int won = __atomic_compare_exchange_n(&deque->top, &top, top + 1, 0, __ATOMIC_SEQ_CST, __ATOMIC_RELAXED);
+		__atomic_store_n(&deque->bottom, bottom + 1, __ATOMIC_RELAXED);
+		return won;
+	}
+	return 1;
+}
+
+static int steal(struct job_deque *deque, struct job *job_out) {
+	long top = __atomic_load_n(&deque->top, __ATOMIC_ACQUIRE);
+	__atomic_thread_fence(__ATOMIC_SEQ_CST);
+	long bottom = __atomic_load_n(&deque->bottom, __ATOMIC_ACQUIRE);
+	if (top >= bottom) {
+		return 0;
+	}
+	*job_out = deque->jobs[top & DEQUE_MASK];
+	return __atomic_compare_exchange_n(&deque->top, &top, top + 1, 0, __ATOMIC_SEQ_CST, __ATOMIC_RELAXED);
+}
+
+// Called with the mutex held
+static int has_shared_job(struct job_system *this) {
+	return this->shared_head != this->shared_tail;
+}
+
+static int try_take_shared(struct job_system *this, struct job *job_out) {
+	if (__atomic_load_n(&this->shared_head, __ATOMIC_RELAXED) == __atomic_load_n(&this->shared_tail, __ATOMIC_RELAXED)) {
+		return 0;
+	}
+	int taken = 0;
+	pthread_mutex_lock(&this->mutex);
+	if (has_shared_job(this)) {
+		*job_out = this->shared_jobs[this->shared_head & DEQUE_MASK];
+		__atomic_store_n(&this->shared_head, this->shared_head + 1, __ATOMIC_RELAXED);
+		taken = 1;
+	}
+	pthread_mutex_unlock(&this->mutex);
+	return taken;
+}
+
+static int try_find_job(struct job_system *this, struct job *job_out) {
+	int own = current_system == this ? current_index : -1;
+	if (own >= 0 && pop(this->deques + own, job_out)) {
+		return 1;
+	}
+	if (try_take_shared(this, job_out)) {
+		return 1;
+	}
+	int deque_count = this->worker_count + 1;
+	steal_seed = steal_seed*1103515245u + 12345u;
+	int start = (int) ((steal_seed >> 16) % (unsigned int) deque_count);
+	for (int i = 0; i < deque_count; ++i) {
+		int victim = (start + i) % deque_count;
+		if (victim != own && steal(this->deques + victim, job_out)) {
+			return 1;
+		}
+	}
+	return 0;
+}
+
+static int has_any_job(struct job_system *this) {
+	if (has_shared_job(this)) {
+		return 1;
+	}
+	for (int i = 0; i < this->worker_count + 1; ++i) {
+		if (__atomic_load_n(&this->deques[i].top, __ATOMIC_SEQ_CST) < __atomic_load_n(&this->deques[i].bottom, __ATOMIC_SEQ_CST)) {
+			return 1;
+		}
+	}
+	return 0;
+}
+
+static void execute(struct job *job) {
+	PROFILER_BEGIN("job");
+	job->function(job->user_data);
+	PROFILER_END("job");
+	if (job->counter) {
+		__atomic_sub_fetch(job->counter, 1, __ATOMIC_RELEASE);
+	}
+}
+
+static void *worker_main(void *user_data) {
+	struct worker_start *start = (struct worker_start *) user_data;
+	struct job_system *this = start->system;
+	current_system = this;
+	current_index = start->index;
+	steal_seed = (unsigned int) start->index*2654435761u;
+	free(start);
+	PROFILER_THREAD_NAME("job worker");
+
+	int spins = 0;
+	while (!__atomic_load_n(&this->stop, __ATOMIC_ACQUIRE)) {
+		struct job job;
+		if (try_find_job(this, &job)) {
+			execute(&job);
+			spins = 0;
+			continue;
+		}
+		if (++spins < SPINS_BEFORE_SLEEP) {
+			continue;
+		}
+		spins = 0;
+		// Submitters only signal when someone sleeps, so check for work again after announcing it
+		pthread_mutex_lock(&this->mutex);
+		__atomic_add_fetch(&this->sleeping, 1, __ATOMIC_SEQ_CST);
+		if (!has_any_job(this) && !__atomic_load_n(&this->stop, __ATOMIC_ACQUIRE)) {
+			pthread_cond_wait(&this->cond, &this->mutex);
+		}
+		__atomic_sub_fetch(&this->sleeping, 1, __ATOMIC_SEQ_CST);
+		pthread_mutex_unlock(&this->mutex);
+	}
+	return 0;
+}
+
+static void wake_worker(struct job_system *this) {
+	__atomic_thread_fence(__ATOMIC_SEQ_CST);
+	if (__atomic_load_n(&this->sleeping, __ATOMIC_SEQ_CST) > 0) {
+		pthread_mutex_lock(&this->mutex);
+		pthread_cond_signal(&this->cond);
+		pthread_mutex_unlock(&this->mutex);
+	}
+}
+
+void job_system__run(struct job_system *this, void (*function)(void *user_data), void *user_data, int *counter) {
+	struct job job;
+	job.function = function;
+	job.user_data = user_data;
+	job.counter = counter;
+	if (counter) {
+		__atomic_add_fetch(counter, 1, __ATOMIC_RELAXED);
+	}
+
+	if (current_system == this) {
+		if (try_push(this->deques + current_index, &job) == 0) {
+			wake_worker(this);
+			return;
+		}
+	} else {
+		pthread_mutex_lock(&this->mutex);
+		if (this->shared_tail - this->shared_head < JOB_SYSTEM__DEQUE_CAPACITY) {
+			this->shared_jobs[this->shared_tail & DEQUE_MASK] = job;
+			__atomic_store_n(&this->shared_tail, this->shared_tail + 1, __ATOMIC_RELAXED);
+			pthread_cond_signal(&this->cond);
+			pthread_mutex_unlock(&this->mutex);
+			return;
+		}
+		pthread_mutex_unlock(&this->mutex);
+	}
+	// Full, running it here keeps the ordering guarantees of counters
+	execute(&job);
+}
+
+void job_system__wait(struct job_system *this, int *counter) {
+	while (__atomic_load_n(counter, __ATOMIC_ACQUIRE) > 0) {
+		struct job job;
+		if (try_find_job(this, &job)) {
+			execute(&job);
+		} else {
+			sched_yield();
+		}
+	}
+}
+
+static void stop_workers(struct job_system *this, int count) {
+	pthread_mutex_lock(&this->mutex);
+	__atomic_store_n(&this->stop, 1, __ATOMIC_RELEASE);
+	pthread_cond_broadcast(&this->cond);
+	pthread_mutex_unlock(&this->mutex);
+	for (int i = 0; i < count; ++i) {
+		pthread_join(this->workers[i], 0);
+	}
+}
+
+int job_system__try_init(struct job_system *this, int worker_count) {
+	if (worker_count < 0) {
+		worker_count = (int) sysconf(_SC_NPROCESSORS_ONLN) - 1;
+	}
+	if (worker_count < 0) {
+		worker_count = 0;
+	} else if (worker_count > JOB_SYSTEM__MAX_WORKERS) {
+		worker_count = JOB_SYSTEM__MAX_WORKERS;
+	}
+	this->worker_count = worker_count;
+	this->shared_head = 0;
+	this->shared_tail = 0;
+	this->sleeping = 0;
+	this->stop = 0;
+
+	this->deques = malloc((worker_count + 1)*sizeof(*this->deques));
+	if (!this->deques) {
+		return -1;
+	}
+	this->shared_jobs = malloc(JOB_SYSTEM__DEQUE_CAPACITY*sizeof(*this->shared_jobs));
+	if (!this->shared_jobs) {
+		free(this->deques);
+		return -2;
+	}
+	for (int i = 0; i < worker_count + 1; ++i) {
+		this->deques[i].top = 0;
+		this->deques[i].bottom = 0;
+	}
+	pthread_mutex_init(&this->mutex, 0);
+	pthread_cond_init(&this->cond, 0);
+
+	current_system = this;
+	current_index = 0;
+	for (int i = 0; i < worker_count; ++i) {
+		struct worker_start *start = malloc(sizeof(*start));
+		if (start) {
+			start->system = this;
+			start->index = i + 1;
+		}
+		if (!start || pthread_create(this->workers + i, 0, worker_main, start) != 0) {
+			free(start);
+			stop_workers(this, i);
+			pthread_cond_destroy(&this->cond);
+			pthread_mutex_destroy(&this->mutex);
+			free(this->shared_jobs);
+			free(this->deques);
+			current_system = 0;
+			return -3;
+		}
+	}
+	return 0;
+}
+
+void job_system__free(struct job_system *this) {
+	stop_workers(this, this->worker_count);
+	pthread_cond_destroy(&this->cond);
+	pthread_mutex_destroy(&this->mutex);
+	free(this->shared_jobs);
+	free(this->deques);
+	if (current_system == this) {
+		current_system = 0;
+	}
+}
@@ -0,0 +1,48 @@
+#pragma once
+
+#include <pthread.h>
+
+#define JOB_SYSTEM__MAX_WORKERS 63
+// Must be a power of two
+#define JOB_SYSTEM__DEQUE_CAPACITY 4096
+#define JOB_SYSTEM__CACHE_LINE 64
+
+struct job {
+	void (*function)(void *user_data);
+	void *user_data;
+	int *counter;
+};
+
+// Chase-Lev deque, the owning thread pushes and pops at bottom while other threads steal from top
+struct job_deque {
+	long top;
+	char top_padding[JOB_SYSTEM__CACHE_LINE - sizeof(long)];
+	long bottom;
+	char bottom_padding[JOB_SYSTEM__CACHE_LINE - sizeof(long)];
+	struct job jobs[JOB_SYSTEM__DEQUE_CAPACITY];
+};
+
+// Fixed pool of workers, each with its own deque. The thread that called try_init owns deque 0 and works
+// through jobs while it waits. Other threads submit through a locked queue.
+struct job_system {
+	int worker_count;
+	struct job_deque *deques;
+	pthread_t workers[JOB_SYSTEM__MAX_WORKERS];
+
+	pthread_mutex_t mutex;
+	pthread_cond_t cond;
+	struct job *shared_jobs;
+	long shared_head;
+	long shared_tail;
+	int sleeping;
+	int stop;
+};
+
+// worker_count < 0 uses one worker per core besides the calling thread
+int job_system__try_init(struct job_system *this, int worker_count);
+void job_system__free(struct job_system *this);
+
+// Increments *counter, which the job decrements when it has run. counter may be 0.
+void job_system__run(struct job_system *this, void (*function)(void *user_data), void *user_data, int *counter);
+// Runs jobs until *counter reaches zero, so jobs may wait on the jobs they start
+void job_system__wait(struct job_system *this, int *counter);
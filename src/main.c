@@ -1,17 +1,56 @@
 #include "glfw/glfw_handler.h"
+#include "profiler/profiler.h"
 #include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
 
 int main(int argc, char **argv) {
+	int vulkan_flags = 0;
+	const char *capture_path = 0;
+	const char *profile_path = 0;
+	const char *mesh_path = 0;
+	const char *texture_path = 0;
+	int window_count = 1;
+	for (int i = 1; i < argc; ++i) {
+		if (strcmp(argv[i], "--dynamic-rendering") == 0) {
+			vulkan_flags |= VULKAN_BASE__FLAG_DYNAMIC_RENDERING;
+		} else if (strcmp(argv[i], "--benchmark-devices") == 0) {
+			vulkan_flags |= VULKAN_BASE__FLAG_BENCHMARK_DEVICES;
+		} else if (strcmp(argv[i], "--capture") == 0 && i + 1 < argc) {
+			capture_path = argv[++i];
+		} else if (strcmp(argv[i], "--profile") == 0 && i + 1 < argc) {
+			profile_path = argv[++i];
+		} else if (strcmp(argv[i], "--mesh") == 0 && i + 1 < argc) {
+			mesh_path = argv[++i];
+		} else if (strcmp(argv[i], "--texture") == 0 && i + 1 < argc) {
+			texture_path = argv[++i];
+		} else if (strcmp(argv[i], "--windows") == 0 && i + 1 < argc) {
+			window_count = atoi(argv[++i]);
+		}
+	}
+
 	struct glfw_handler glfw_handler;
-	int result = glfw_handler__try_init(&glfw_handler, 1920, 1080, "Vulkan", 1);
+	int result = glfw_handler__try_init(&glfw_handler, 1920, 1080, "Vulkan", 1, window_count, vulkan_flags, mesh_path, texture_path);
 	if (result < 0) {
 		return -1;
 	}
+	if (capture_path && glfw_handler__try_start_capture(&glfw_handler, capture_path) < 0) {
+		glfw_handler__free(&glfw_handler);
+		return -3;
+	}
 	result = glfw_handler__try_run(&glfw_handler);
+	glfw_handler__free(&glfw_handler);
+#ifdef VULKAN_BASE_PROFILER
+	if (profile_path && profiler__try_export(profile_path) < 0) {
+		printf("Could not write the profile to %s\n", profile_path);
+	}
+#else
+	if (profile_path) {
+		printf("Built without VULKAN_BASE_PROFILER, no profile written\n");
+	}
+#endif
 	if (result < 0) {
-		glfw_handler__free(&glfw_handler);
 		return -2;
 	}
-	glfw_handler__free(&glfw_handler);
 	return 0;
 }
\ No newline at end of file
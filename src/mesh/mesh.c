@@ -0,0 +1,150 @@
+#include <fcntl.h>
+#include <stdio.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include "mesh.h"
+
+#define ALIGNMENT 16
+
+// Colors come from the normals, these give the red, green and blue corners the triangle always had
+static const struct mesh_vertex triangle_vertices[3] = {
+	{ { 0, -16384, 0, 0 }, { 127, -127, -127, 0 } },
+	{ { 16384, 16384, 0, 0 }, { -127, 127, -127, 0 } },
+	{ { -16384, 16384, 0, 0 }, { -127, -127, 127, 0 } }
+};
+static const uint16_t triangle_indices[3] = { 0, 1, 2 };
+
+static uint32_t align(uint32_t offset) {
+	return (offset + ALIGNMENT - 1) & ~(uint32_t) (ALIGNMENT - 1);
+}
+
+static int is_valid(const struct mesh_header *header, size_t size) {
+	if (size < sizeof(*header) || header->magic != MESH__MAGIC || header->version != MESH__VERSION || header->file_size > size) {
+		return 0;
+	}
+	if (header->index_size != 2 && header->index_size != 4) {
+		return 0;
+	}
+	if (header->lod_count == 0 || header->lod_count > MESH__MAX_LODS) {
+		return 0;
+	}
+	for (uint32_t i = 0; i < header->lod_count; ++i) {
+		if ((uint64_t) header->lods[i].first_index + header->lods[i].index_count > header->index_count) {
+			return 0;
+		}
+	}
+	uint64_t vertex_end = header->vertex_offset + (uint64_t) header->vertex_count*sizeof(struct mesh_vertex);
+	uint64_t index_end = header->index_offset + (uint64_t) header->index_count*header->index_size;
+	return header->vertex_offset >= sizeof(*header) && vertex_end <= header->file_size && index_end <= header->file_size &&
+		   header->vertex_offset % ALIGNMENT == 0 && header->index_offset % ALIGNMENT == 0;
+}
+
+int mesh__try_map(struct mesh *this, const char *path) {
+	int fd = open(path, O_RDONLY);
+	if (fd < 0) {
+		return -1;
+	}
+	struct stat stat_buffer;
+	if (fstat(fd, &stat_buffer) != 0 || stat_buffer.st_size < (off_t) sizeof(struct mesh_header)) {
+		close(fd);
+		return -2;
+	}
+	size_t size = (size_t) stat_buffer.st_size;
+	void *mapping = mmap(0, size, PROT_READ, MAP_PRIVATE, fd, 0);
+	// The mapping keeps the file alive
+	close(fd);
+	if (mapping == MAP_FAILED) {
+		return -3;
+	}
+
+	const struct mesh_header *header = (const struct mesh_header *) mapping;
+	if (!is_valid(header, size)) {
+		munmap(mapping, size);
+		return -4;
+	}
+	// Read front to back once by the upload
+	madvise(mapping, size, MADV_SEQUENTIAL);
+
+	this->vertex_count = header->vertex_count;
+	this->index_count = header->index_count;
+	this->index_size = header->index_size;
+	this->vertices = (const struct mesh_vertex *) ((const char *) mapping + header->vertex_offset);
+	this->indices = (const char *) mapping + header->index_offset;
+	this->lod_count = header->lod_count;
+	memcpy(this->lods, header->lods, sizeof(this->lods));
+	this->mapping = mapping;
+	this->mapping_size = size;
+	return 0;
+}
+
+void mesh__unmap(struct mesh *this) {
+	if (this->mapping) {
+		munmap(this->mapping, this->mapping_size);
+	}
+}
+
+void mesh__init_triangle(struct mesh *this) {
+	this->vertex_count = 3;
+	this->index_count = 3;
+	this->index_size = 2;
+	this->vertices = triangle_vertices;
+	this->indices = triangle_indices;
+	this->lod_count = 1;
+	memset(this->lods, 0, sizeof(this->lods));
+	this->lods[0].index_count = 3;
+	this->mapping = 0;
+	this->mapping_size = 0;
+}
+
+uint32_t mesh__index(const struct mesh *this, uint32_t i) {
+	if (this->index_size == 2) {
+		return ((const uint16_t *) this->indices)[i];
+	}
+	return ((const uint32_t *) this->indices)[i];
+}
+
+int mesh__try_write(const char *path, const struct mesh_vertex *vertices, uint32_t vertex_count, const uint32_t *indices, uint32_t index_count,
+					const struct mesh_lod *lods, uint32_t lod_count, const float center[3], float radius) {
+	if (lod_count == 0 || lod_count > MESH__MAX_LODS) {
+		return -1;
+	}
+	struct mesh_header header;
+	memset(&header, 0, sizeof(header));
+	header.magic = MESH__MAGIC;
+	header.version = MESH__VERSION;
+	header.vertex_count = vertex_count;
+	header.index_count = index_count;
+	header.index_size = vertex_count <= MESH__MAX_16BIT_VERTICES ? 2 : 4;
+	header.vertex_offset = align(sizeof(header));
+	header.index_offset = align(header.vertex_offset + vertex_count*(uint32_t) sizeof(*vertices));
+	header.file_size = header.index_offset + index_count*header.index_size;
+	memcpy(header.center, center, sizeof(header.center));
+	header.radius = radius;
+	header.lod_count = lod_count;
+	memcpy(header.lods, lods, lod_count*sizeof(*lods));
+
+	FILE *file = fopen(path, "wb");
+	if (!file) {
+		return -2;
+	}
+	static const char padding[ALIGNMENT];
+	int result = fwrite(&header, sizeof(header), 1, file) == 1;
+	result = result && fwrite(padding, 1, header.vertex_offset - sizeof(header), file) == header.vertex_offset - sizeof(header);
+	result = result && fwrite(vertices, sizeof(*vertices), vertex_count, file) == vertex_count;
+	uint32_t vertex_end = header.vertex_offset + vertex_count*(uint32_t) sizeof(*vertices);
+	result = result && fwrite(padding, 1, header.index_offset - vertex_end, file) == header.index_offset - vertex_end;
+	if (header.index_size == 2) {
+		for (uint32_t i = 0; result && i < index_count; ++i) {
+			uint16_t index = (uint16_t) indices[i];
+			result = fwrite(&index, sizeof(index), 1, file) == 1;
+		}
+	} else {
+		result = result && fwrite(indices, sizeof(*indices), index_count, file) == index_count;
+	}
+	if (fclose(file) != 0 || !result) {
+		return -3;
+	}
+	return 0;
+}
@@ -0,0 +1,68 @@
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+
+#define MESH__MAGIC 0x4853454Du
+#define MESH__VERSION 2
+// Positions are stored as int16 over [-1, 1), relative to the bounding sphere and scaled to its radius
+#define MESH__POSITION_SCALE 32768.0f
+// Meshes with at most this many vertices get 16-bit indices
+#define MESH__MAX_16BIT_VERTICES 65536u
+#define MESH__MAX_LODS 8
+
+// Matches the vertex input of the graphics pipeline: R16G16B16A16_SINT position, R8G8B8A8_SNORM normal
+struct mesh_vertex {
+	int16_t position[4];
+	int8_t normal[4];
+};
+
+// A range of the index buffer over the shared vertices, each level coarser than the one before
+struct mesh_lod {
+	uint32_t first_index;
+	uint32_t index_count;
+	// Furthest the simplified surface is from the full one, in the unit sphere the positions are quantized to
+	float error;
+};
+
+// Vertices and indices follow the header at their offsets, each aligned to 16 bytes so a mapping can be
+// copied straight into buffers
+struct mesh_header {
+	uint32_t magic;
+	uint32_t version;
+	uint32_t vertex_count;
+	uint32_t index_count;
+	uint32_t index_size;
+	uint32_t vertex_offset;
+	uint32_t index_offset;
+	uint32_t file_size;
+	// Where the quantized unit sphere sits in the source model's units
+	float center[3];
+	float radius;
+	uint32_t lod_count;
+	struct mesh_lod lods[MESH__MAX_LODS];
+};
+
+struct mesh {
+	uint32_t vertex_count;
+	uint32_t index_count;
+	// 2 or 4
+	uint32_t index_size;
+	const struct mesh_vertex *vertices;
+	const void *indices;
+	uint32_t lod_count;
+	struct mesh_lod lods[MESH__MAX_LODS];
+	void *mapping;
+	size_t mapping_size;
+};
+
+// Maps a file written by mesh__try_write, the mesh points into the mapping until mesh__unmap
+int mesh__try_map(struct mesh *this, const char *path);
+void mesh__unmap(struct mesh *this);
+// The triangle drawn when no mesh is given, nothing to unmap
+void mesh__init_triangle(struct mesh *this);
+
+uint32_t mesh__index(const struct mesh *this, uint32_t i);
+// Picks 16-bit indices when vertex_count allows, the lods cover ranges of indices
+int mesh__try_write(const char *path, const struct mesh_vertex *vertices, uint32_t vertex_count, const uint32_t *indices, uint32_t index_count,
+					const struct mesh_lod *lods, uint32_t lod_count, const float center[3], float radius);
@@ -0,0 +1,282 @@
+#include <malloc.h>
+#include <math.h>
+#include <string.h>
+#include "mesh_optimize.h"
+
+#define CACHE_DECAY_POWER 1.5f
+#define LAST_TRIANGLE_SCORE 0.75f
+#define VALENCE_BOOST_SCALE 2.0f
+#define VALENCE_BOOST_POWER 0.5f
+
+#define FETCH_LINE_SIZE 64
+#define FETCH_LINES 16
+
+struct forsyth {
+	uint32_t *triangle_offsets;
+	uint32_t *triangle_counts;
+	uint32_t *triangles;
+	int *cache_positions;
+	float *vertex_scores;
+	float *triangle_scores;
+	unsigned char *triangle_added;
+};
+
+static float vertex_score(int cache_position, uint32_t remaining_triangles) {
+	if (remaining_triangles == 0) {
+		return -1.0f;
+	}
+	float score = 0.0f;
+	if (cache_position >= 0) {
+		if (cache_position < 3) {
+			// The last triangle's vertices, deliberately scored lower so strips don't run away
+			score = LAST_TRIANGLE_SCORE;
+		} else {
+			float scale = 1.0f/(MESH_OPTIMIZE__CACHE_SIZE - 3);
+			score = powf(1.0f - (cache_position - 3)*scale, CACHE_DECAY_POWER);
+		}
+	}
+	// Vertices with few triangles left are worth finishing so they can leave the cache for good
+	return score + VALENCE_BOOST_SCALE*powf((float) remaining_triangles, -VALENCE_BOOST_POWER);
+}
+
+static void free_forsyth(struct forsyth *forsyth) {
+	free(forsyth->triangle_offsets);
+	free(forsyth->triangle_counts);
+	free(forsyth->triangles);
+	free(forsyth->cache_positions);
+	free(forsyth->vertex_scores);
+	free(forsyth->triangle_scores);
+	free(forsyth->triangle_added);
+}
+
+static int try_init_forsyth(struct forsyth *forsyth, const uint32_t *indices, uint32_t triangle_count, uint32_t vertex_count) {
+	forsyth->triangle_offsets = malloc((vertex_count + 1)*sizeof(uint32_t));
+	forsyth->triangle_counts = calloc(vertex_count, sizeof(uint32_t));
+	forsyth->triangles = malloc(3*triangle_count*sizeof(uint32_t));
+	forsyth->cache_positions = malloc(vertex_count*sizeof(int));
+	forsyth->vertex_scores = malloc(vertex_count*sizeof(float));
+	forsyth->triangle_scores = malloc(triangle_count*sizeof(float));
+	forsyth->triangle_added = calloc(triangle_count, 1);
+	if (!forsyth->triangle_offsets || !forsyth->triangle_counts || !forsyth->triangles || !forsyth->cache_positions ||
+		!forsyth->vertex_scores || !forsyth->triangle_scores || !forsyth->triangle_added) {
+		free_forsyth(forsyth);
+		return -1;
+	}
+
+	// Triangles of each vertex, counts are the triangles not yet added
+	for (uint32_t i = 0; i < 3*triangle_count; ++i) {
+		++forsyth->triangle_counts[indices[i]];
+	}
+	uint32_t offset = 0;
+	for (uint32_t i = 0; i < vertex_count; ++i) {
+		forsyth->triangle_offsets[i] = offset;
+		offset += forsyth->triangle_counts[i];
+		forsyth->triangle_counts[i] = 0;
+	}
+	forsyth->triangle_offsets[vertex_count] = offset;
+	for (uint32_t i = 0; i < 3*triangle_count; ++i) {
+		uint32_t vertex = indices[i];
+		forsyth->triangles[forsyth->triangle_offsets[vertex] + forsyth->triangle_counts[vertex]++] = i/3;
+	}
+
+	for (uint32_t i = 0; i < vertex_count; ++i) {
+		forsyth->cache_positions[i] = -1;
+		forsyth->vertex_scores[i] = vertex_score(-1, forsyth->triangle_counts[i]);
+	}
+	for (uint32_t i = 0; i < triangle_count; ++i) {
+		const uint32_t *triangle = indices + 3*i;
+		forsyth->triangle_scores[i] = forsyth->vertex_scores[triangle[0]] + forsyth->vertex_scores[triangle[1]] + forsyth->vertex_scores[triangle[2]];
+	}
+	return 0;
+}
+
+static void remove_triangle(struct forsyth *forsyth, uint32_t vertex, uint32_t triangle) {
+	uint32_t *triangles = forsyth->triangles + forsyth->triangle_offsets[vertex];
+	uint32_t count = forsyth->triangle_counts[vertex];
+	for (uint32_t i = 0; i < count; ++i) {
+		if (triangles[i] == triangle) {
+			triangles[i] = triangles[count - 1];
+			break;
+		}
+	}
+	--forsyth->triangle_counts[vertex];
+}
+
+int mesh_optimize__try_vertex_cache(uint32_t *indices, uint32_t index_count, uint32_t vertex_count) {
+	uint32_t triangle_count = index_count/3;
+	if (triangle_count == 0) {
+		return 0;
+	}
+	struct forsyth forsyth;
+	if (try_init_forsyth(&forsyth, indices, triangle_count, vertex_count) < 0) {
+		return -1;
+	}
+	uint32_t *output = malloc(3*triangle_count*sizeof(uint32_t));
+	if (!output) {
+		free_forsyth(&forsyth);
+		return -2;
+	}
+
+	// Room for the cache plus the three vertices pushed in front of it before the tail falls out
+	uint32_t cache[MESH_OPTIMIZE__CACHE_SIZE + 3];
+	uint32_t new_cache[MESH_OPTIMIZE__CACHE_SIZE + 3];
+	int cache_count = 0;
+
+	uint32_t best = 0;
+	for (uint32_t i = 1; i < triangle_count; ++i) {
+		if (forsyth.triangle_scores[i] > forsyth.triangle_scores[best]) {
+			best = i;
+		}
+	}
+	// Next triangle to consider once nothing in the cache has triangles left
+	uint32_t scan = 0;
+	for (uint32_t added = 0; added < triangle_count; ++added) {
+		const uint32_t *triangle = indices + 3*best;
+		memcpy(output + 3*added, triangle, 3*sizeof(uint32_t));
+		forsyth.triangle_added[best] = 1;
+
+		int new_count = 0;
+		for (int i = 0; i < 3; ++i) {
+			remove_triangle(&forsyth, triangle[i], best);
+			new_cache[new_count++] = triangle[i];
+		}
+		for (int i = 0; i < cache_count; ++i) {
+			if (cache[i] != triangle[0] && cache[i] != triangle[1] && cache[i] != triangle[2]) {
+				new_cache[new_count++] = cache[i];
+			}
+		}
+		for (int i = 0; i < new_count; ++i) {
+			uint32_t vertex = new_cache[i];
+			forsyth.cache_positions[vertex] = i < MESH_OPTIMIZE__CACHE_SIZE ? i : -1;
+			forsyth.vertex_scores[vertex] = vertex_score(forsyth.cache_positions[vertex], forsyth.triangle_counts[vertex]);
+		}
+
+		// Only triangles around vertices whose score changed can have a new score
+		float best_score = -1.0f;
+		int found = 0;
+		for (int i = 0; i < new_count; ++i) {
+			uint32_t vertex = new_cache[i];
+			const uint32_t *triangles = forsyth.triangles + forsyth.triangle_offsets[vertex];
+			for (uint32_t j = 0; j < forsyth.triangle_counts[vertex]; ++j) {
+				uint32_t candidate = triangles[j];
+				const uint32_t *candidate_indices = indices + 3*candidate;
+				float score = forsyth.vertex_scores[candidate_indices[0]] + forsyth.vertex_scores[candidate_indices[1]] +
+							  forsyth.vertex_scores[candidate_indices[2]];
+				forsyth.triangle_scores[candidate] = score;
+				if (score > best_score) {
+					best_score = score;
+					best = candidate;
+					found = 1;
+				}
+			}
+		}
+		cache_count = new_count < MESH_OPTIMIZE__CACHE_SIZE ? new_count : MESH_OPTIMIZE__CACHE_SIZE;
+		memcpy(cache, new_cache, cache_count*sizeof(uint32_t));
+
+		if (!found && added + 1 < triangle_count) {
+			while (forsyth.triangle_added[scan]) {
+				++scan;
+			}
+			best = scan;
+		}
+	}
+
+	memcpy(indices, output, 3*triangle_count*sizeof(uint32_t));
+	free(output);
+	free_forsyth(&forsyth);
+	return 0;
+}
+
+uint32_t mesh_optimize__vertex_fetch(struct mesh_vertex *vertices, uint32_t vertex_count, uint32_t *indices, uint32_t index_count) {
+	uint32_t *remap = malloc(vertex_count*sizeof(uint32_t));
+	struct mesh_vertex *reordered = malloc(vertex_count*sizeof(struct mesh_vertex));
+	if (!remap || !reordered) {
+		free(remap);
+		free(reordered);
+		return vertex_count;
+	}
+	memset(remap, 0xFF, vertex_count*sizeof(uint32_t));
+
+	uint32_t next = 0;
+	for (uint32_t i = 0; i < index_count; ++i) {
+		uint32_t vertex = indices[i];
+		if (remap[vertex] == UINT32_MAX) {
+			remap[vertex] = next;
+			reordered[next++] = vertices[vertex];
+		}
+		indices[i] = remap[vertex];
+	}
+	memcpy(vertices, reordered, next*sizeof(struct mesh_vertex));
+	free(reordered);
+	free(remap);
+	return next;
+}
+
+double mesh_optimize__acmr(const uint32_t *indices, uint32_t index_count, uint32_t vertex_count, int cache_size) {
+	if (index_count < 3) {
+		return 0.0;
+	}
+	// A vertex is in the FIFO if it entered within the last cache_size misses
+	unsigned long *entered = malloc(vertex_count*sizeof(unsigned long));
+	if (!entered) {
+		return -1.0;
+	}
+	for (uint32_t i = 0; i < vertex_count; ++i) {
+		entered[i] = 0;
+	}
+	unsigned long misses = 0;
+	for (uint32_t i = 0; i < index_count; ++i) {
+		uint32_t vertex = indices[i];
+		if (entered[vertex] == 0 || misses - entered[vertex] + 1 > (unsigned long) cache_size) {
+			++misses;
+			entered[vertex] = misses;
+		}
+	}
+	free(entered);
+	return (double) misses/(index_count/3);
+}
+
+double mesh_optimize__overfetch(const uint32_t *indices, uint32_t index_count, uint32_t vertex_count) {
+	if (vertex_count == 0) {
+		return 0.0;
+	}
+	// Each post-transform cache miss fetches the vertex, which costs a line unless it is among the recent ones
+	unsigned long *entered = calloc(vertex_count, sizeof(unsigned long));
+	if (!entered) {
+		return -1.0;
+	}
+	size_t lines[FETCH_LINES];
+	int line_count = 0;
+	int line_next = 0;
+	unsigned long misses = 0;
+	unsigned long line_loads = 0;
+	for (uint32_t i = 0; i < index_count; ++i) {
+		uint32_t vertex = indices[i];
+		if (entered[vertex] != 0 && misses - entered[vertex] + 1 <= MESH_OPTIMIZE__CACHE_SIZE) {
+			continue;
+		}
+		++misses;
+		entered[vertex] = misses;
+
+		size_t start = (size_t) vertex*sizeof(struct mesh_vertex);
+		for (size_t line = start/FETCH_LINE_SIZE; line <= (start + sizeof(struct mesh_vertex) - 1)/FETCH_LINE_SIZE; ++line) {
+			int hit = 0;
+			for (int j = 0; j < line_count; ++j) {
+				if (lines[j] == line) {
+					hit = 1;
+					break;
+				}
+			}
+			if (!hit) {
+				++line_loads;
+				lines[line_next] = line;
+				line_next = (line_next + 1) % FETCH_LINES;
+				if (line_count < FETCH_LINES) {
+					++line_count;
+				}
+			}
+		}
+	}
+	free(entered);
+	return (double) line_loads*FETCH_LINE_SIZE/((double) vertex_count*sizeof(struct mesh_vertex));
+}
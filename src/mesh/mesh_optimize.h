@@ -0,0 +1,18 @@
+#pragma once
+
+#include <stdint.h>
+#include "mesh.h"
+
+// Post-transform cache size the index order is tuned for, real caches are around this or behave like it
+#define MESH_OPTIMIZE__CACHE_SIZE 32
+
+// Reorders triangles for post-transform vertex cache hits with Forsyth's linear-speed algorithm
+int mesh_optimize__try_vertex_cache(uint32_t *indices, uint32_t index_count, uint32_t vertex_count);
+// Reorders vertices by first use so fetches walk the vertex buffer forwards, unused vertices are dropped.
+// Returns the new vertex count.
+uint32_t mesh_optimize__vertex_fetch(struct mesh_vertex *vertices, uint32_t vertex_count, uint32_t *indices, uint32_t index_count);
+
+// Transformed vertices per triangle with a FIFO cache of cache_size, 0.5 is ideal and 3 is the worst
+double mesh_optimize__acmr(const uint32_t *indices, uint32_t index_count, uint32_t vertex_count, int cache_size);
+// Bytes read from memory per vertex byte, assuming 64-byte lines and a small FIFO of lines, 1 is ideal
+double mesh_optimize__overfetch(const uint32_t *indices, uint32_t index_count, uint32_t vertex_count);
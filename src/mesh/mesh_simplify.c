@@ -0,0 +1,498 @@
+#include <malloc.h>
+#include <math.h>
+#include <stdlib.h>
+#include <string.h>
+#include "mesh_simplify.h"
+#include "mesh_optimize.h"
+
+// Planes along open borders weigh this much more than the faces, so borders keep their shape
+#define BORDER_WEIGHT 10.0
+// Collapses that turn a triangle further than this, as the cosine between the normals, are rejected
+#define MIN_NORMAL_COSINE 0.25
+// A level that keeps more than this fraction of the previous level's indices is not worth storing
+#define MIN_LOD_REDUCTION 0.85f
+
+enum vertex_kind {
+	VERTEX_KIND__FREE,
+	// On an open border, collapses only along it
+	VERTEX_KIND__BORDER,
+	// Shares its position with other vertices, moving it would tear the seam
+	VERTEX_KIND__LOCKED
+};
+
+// Sum of squared distances to planes, as the symmetric 4x4 matrix of the plane equations
+struct quadric {
+	double a2, ab, ac, ad, b2, bc, bd, c2, cd, d2;
+	double weight;
+};
+
+struct collapse {
+	float cost;
+	uint32_t from;
+	uint32_t to;
+};
+
+struct position_key {
+	int16_t position[3];
+	uint32_t vertex;
+};
+
+struct simplifier {
+	uint32_t vertex_count;
+	float (*positions)[3];
+	unsigned char *kinds;
+	struct quadric *quadrics;
+	// Directed edges of the current triangles, for telling border edges apart
+	uint64_t *edges;
+	size_t edge_capacity;
+	uint32_t *triangle_offsets;
+	uint32_t *triangle_counts;
+	uint32_t *triangles;
+	struct collapse *collapses;
+	uint32_t *remap;
+	unsigned char *touched;
+};
+
+static void add_plane(struct quadric *quadric, const double normal[3], double d, double weight) {
+	quadric->a2 += weight*normal[0]*normal[0];
+	quadric->ab += weight*normal[0]*normal[1];
+	quadric->ac += weight*normal[0]*normal[2];
+	quadric->ad += weight*normal[0]*d;
+	quadric->b2 += weight*normal[1]*normal[1];
+	quadric->bc += weight*normal[1]*normal[2];
+	quadric->bd += weight*normal[1]*d;
+	quadric->c2 += weight*normal[2]*normal[2];
+	quadric->cd += weight*normal[2]*d;
+	quadric->d2 += weight*d*d;
+	quadric->weight += weight;
+}
+
+static void add_quadric(struct quadric *quadric, const struct quadric *other) {
+	quadric->a2 += other->a2;
+	quadric->ab += other->ab;
+	quadric->ac += other->ac;
+	quadric->ad += other->ad;
+	quadric->b2 += other->b2;
+	quadric->bc += other->bc;
+	quadric->bd += other->bd;
+	quadric->c2 += other->c2;
+	quadric->cd += other->cd;
+	quadric->d2 += other->d2;
+	quadric->weight += other->weight;
+}
+
+// Mean squared distance to the planes
+static double quadric_error(const struct quadric *quadric, const float *position) {
+	double x = position[0];
+	double y = position[1];
+	double z = position[2];
+	double error = quadric->a2*x*x + quadric->b2*y*y + quadric->c2*z*z + quadric->d2 +
+				   2.0*(quadric->ab*x*y + quadric->ac*x*z + quadric->bc*y*z + quadric->ad*x + quadric->bd*y + quadric->cd*z);
+	return quadric->weight > 0.0 ? fabs(error)/quadric->weight : 0.0;
+}
+
+static void cross(const float *a, const float *b, const float *c, double normal_out[3]) {
+	double ab[3] = { b[0] - a[0], b[1] - a[1], b[2] - a[2] };
+	double ac[3] = { c[0] - a[0], c[1] - a[1], c[2] - a[2] };
+	normal_out[0] = ab[1]*ac[2] - ab[2]*ac[1];
+	normal_out[1] = ab[2]*ac[0] - ab[0]*ac[2];
+	normal_out[2] = ab[0]*ac[1] - ab[1]*ac[0];
+}
+
+static uint64_t hash_edge(uint64_t key) {
+	key ^= key >> 33;
+	key *= 0xFF51AFD7ED558CCDull;
+	key ^= key >> 33;
+	return key;
+}
+
+static void insert_edge(struct simplifier *simplifier, uint32_t from, uint32_t to) {
+	uint64_t key = ((uint64_t) from << 32) | to;
+	size_t slot = hash_edge(key) & (simplifier->edge_capacity - 1);
+	while (simplifier->edges[slot] != UINT64_MAX && simplifier->edges[slot] != key) {
+		slot = (slot + 1) & (simplifier->edge_capacity - 1);
+	}
+	simplifier->edges[slot] = key;
+}
+
+static int has_edge(const struct simplifier *simplifier, uint32_t from, uint32_t to) {
+	uint64_t key = ((uint64_t) from << 32) | to;
+	size_t slot = hash_edge(key) & (simplifier->edge_capacity - 1);
+	while (simplifier->edges[slot] != UINT64_MAX) {
+		if (simplifier->edges[slot] == key) {
+			return 1;
+		}
+		slot = (slot + 1) & (simplifier->edge_capacity - 1);
+	}
+	return 0;
+}
+
+static void build_edges(struct simplifier *simplifier, const uint32_t *indices, uint32_t index_count) {
+	memset(simplifier->edges, 0xFF, simplifier->edge_capacity*sizeof(uint64_t));
+	for (uint32_t i = 0; i < index_count; i += 3) {
+		for (int j = 0; j < 3; ++j) {
+			insert_edge(simplifier, indices[i + j], indices[i + (j + 1) % 3]);
+		}
+	}
+}
+
+static int compare_position_keys(const void *a, const void *b) {
+	const struct position_key *key_a = (const struct position_key *) a;
+	const struct position_key *key_b = (const struct position_key *) b;
+	return memcmp(key_a->position, key_b->position, sizeof(key_a->position));
+}
+
+static int compare_collapses(const void *a, const void *b) {
+	float difference = ((const struct collapse *) a)->cost - ((const struct collapse *) b)->cost;
+	return (difference > 0.0f) - (difference < 0.0f);
+}
+
+static void free_simplifier(struct simplifier *simplifier) {
+	free(simplifier->positions);
+	free(simplifier->kinds);
+	free(simplifier->quadrics);
+	free(simplifier->edges);
+	free(simplifier->triangle_offsets);
+	free(simplifier->triangle_counts);
+	free(simplifier->triangles);
+	free(simplifier->collapses);
+	free(simplifier->remap);
+	free(simplifier->touched);
+}
+
+static int try_classify_vertices(struct simplifier *simplifier, const struct mesh_vertex *vertices, const uint32_t *indices, uint32_t index_count) {
+	struct position_key *keys = malloc(simplifier->vertex_count*sizeof(*keys));
+	if (!keys) {
+		return -1;
+	}
+	for (uint32_t i = 0; i < simplifier->vertex_count; ++i) {
+		memcpy(keys[i].position, vertices[i].position, sizeof(keys[i].position));
+		keys[i].vertex = i;
+	}
+	qsort(keys, simplifier->vertex_count, sizeof(*keys), compare_position_keys);
+	memset(simplifier->kinds, VERTEX_KIND__FREE, simplifier->vertex_count);
+	for (uint32_t i = 1; i < simplifier->vertex_count; ++i) {
+		if (compare_position_keys(keys + i - 1, keys + i) == 0) {
+			simplifier->kinds[keys[i - 1].vertex] = VERTEX_KIND__LOCKED;
+			simplifier->kinds[keys[i].vertex] = VERTEX_KIND__LOCKED;
+		}
+	}
+	free(keys);
+
+	build_edges(simplifier, indices, index_count);
+	for (uint32_t i = 0; i < index_count; i += 3) {
+		for (int j = 0; j < 3; ++j) {
+			uint32_t from = indices[i + j];
+			uint32_t to = indices[i + (j + 1) % 3];
+			if (!has_edge(simplifier, to, from)) {
+				if (simplifier->kinds[from] == VERTEX_KIND__FREE) {
+					simplifier->kinds[from] = VERTEX_KIND__BORDER;
+				}
+				if (simplifier->kinds[to] == VERTEX_KIND__FREE) {
+					simplifier->kinds[to] = VERTEX_KIND__BORDER;
+				}
+			}
+		}
+	}
+	return 0;
+}
+
+// Face planes weighted by area, plus planes standing up from open borders
+static void init_quadrics(struct simplifier *simplifier, const uint32_t *indices, uint32_t index_count) {
+	memset(simplifier->quadrics, 0, simplifier->vertex_count*sizeof(struct quadric));
+	for (uint32_t i = 0; i < index_count; i += 3) {
+		const float *corners[3] = { simplifier->positions[indices[i]], simplifier->positions[indices[i + 1]], simplifier->positions[indices[i + 2]] };
+		double normal[3];
+		cross(corners[0], corners[1], corners[2], normal);
+		double length = sqrt(normal[0]*normal[0] + normal[1]*normal[1] + normal[2]*normal[2]);
+		if (length == 0.0) {
+			continue;
+		}
+		for (int j = 0; j < 3; ++j) {
+			normal[j] /= length;
+		}
+		double d = -(normal[0]*corners[0][0] + normal[1]*corners[0][1] + normal[2]*corners[0][2]);
+		double area = 0.5*length;
+		for (int j = 0; j < 3; ++j) {
+			add_plane(simplifier->quadrics + indices[i + j], normal, d, area);
+		}
+
+		for (int j = 0; j < 3; ++j) {
+			uint32_t from = indices[i + j];
+			uint32_t to = indices[i + (j + 1) % 3];
+			if (has_edge(simplifier, to, from)) {
+				continue;
+			}
+			const float *a = simplifier->positions[from];
+			const float *b = simplifier->positions[to];
+			double edge[3] = { b[0] - a[0], b[1] - a[1], b[2] - a[2] };
+			double border_normal[3] = { edge[1]*normal[2] - edge[2]*normal[1], edge[2]*normal[0] - edge[0]*normal[2], edge[0]*normal[1] - edge[1]*normal[0] };
+			double border_length = sqrt(border_normal[0]*border_normal[0] + border_normal[1]*border_normal[1] + border_normal[2]*border_normal[2]);
+			if (border_length == 0.0) {
+				continue;
+			}
+			for (int k = 0; k < 3; ++k) {
+				border_normal[k] /= border_length;
+			}
+			double border_d = -(border_normal[0]*a[0] + border_normal[1]*a[1] + border_normal[2]*a[2]);
+			double weight = BORDER_WEIGHT*(edge[0]*edge[0] + edge[1]*edge[1] + edge[2]*edge[2]);
+			add_plane(simplifier->quadrics + from, border_normal, border_d, weight);
+			add_plane(simplifier->quadrics + to, border_normal, border_d, weight);
+		}
+	}
+}
+
+static void build_adjacency(struct simplifier *simplifier, const uint32_t *indices, uint32_t index_count) {
+	memset(simplifier->triangle_counts, 0, simplifier->vertex_count*sizeof(uint32_t));
+	for (uint32_t i = 0; i < index_count; ++i) {
+		++simplifier->triangle_counts[indices[i]];
+	}
+	uint32_t offset = 0;
+	for (uint32_t i = 0; i < simplifier->vertex_count; ++i) {
+		simplifier->triangle_offsets[i] = offset;
+		offset += simplifier->triangle_counts[i];
+		simplifier->triangle_counts[i] = 0;
+	}
+	for (uint32_t i = 0; i < index_count; ++i) {
+		uint32_t vertex = indices[i];
+		simplifier->triangles[simplifier->triangle_offsets[vertex] + simplifier->triangle_counts[vertex]++] = i/3;
+	}
+}
+
+static int is_allowed(const struct simplifier *simplifier, uint32_t from, uint32_t to) {
+	switch (simplifier->kinds[from]) {
+		case VERTEX_KIND__FREE:
+			return 1;
+		case VERTEX_KIND__BORDER:
+			// Along the border, which has the edge in one direction only
+			return has_edge(simplifier, from, to) != has_edge(simplifier, to, from);
+		default:
+			return 0;
+	}
+}
+
+// Moving from onto to must not fold any of the triangles that stay over
+static int flips(const struct simplifier *simplifier, const uint32_t *indices, uint32_t from, uint32_t to, uint32_t *removed_out) {
+	const uint32_t *triangles = simplifier->triangles + simplifier->triangle_offsets[from];
+	uint32_t removed = 0;
+	for (uint32_t i = 0; i < simplifier->triangle_counts[from]; ++i) {
+		const uint32_t *triangle = indices + 3*triangles[i];
+		if (triangle[0] == to || triangle[1] == to || triangle[2] == to) {
+			++removed;
+			continue;
+		}
+		const float *before[3];
+		const float *after[3];
+		for (int j = 0; j < 3; ++j) {
+			before[j] = simplifier->positions[triangle[j]];
+			after[j] = triangle[j] == from ? simplifier->positions[to] : before[j];
+		}
+		double normal_before[3];
+		double normal_after[3];
+		cross(before[0], before[1], before[2], normal_before);
+		cross(after[0], after[1], after[2], normal_after);
+		double dot = normal_before[0]*normal_after[0] + normal_before[1]*normal_after[1] + normal_before[2]*normal_after[2];
+		double lengths = sqrt((normal_before[0]*normal_before[0] + normal_before[1]*normal_before[1] + normal_before[2]*normal_before[2])*
+							  (normal_after[0]*normal_after[0] + normal_after[1]*normal_after[1] + normal_after[2]*normal_after[2]));
+		if (dot <= MIN_NORMAL_COSINE*lengths) {
+			return 1;
+		}
+	}
+	*removed_out = removed;
+	return 0;
+}
+
+static uint32_t gather_collapses(struct simplifier *simplifier, const uint32_t *indices, uint32_t index_count, double max_cost) {
+	uint32_t count = 0;
+	for (uint32_t i = 0; i < index_count; i += 3) {
+		for (int j = 0; j < 3; ++j) {
+			uint32_t a = indices[i + j];
+			uint32_t b = indices[i + (j + 1) % 3];
+			// Each interior edge comes up once from either triangle, one direction from each is enough
+			for (int direction = 0; direction < 2; ++direction) {
+				uint32_t from = direction ? b : a;
+				uint32_t to = direction ? a : b;
+				if (!is_allowed(simplifier, from, to)) {
+					continue;
+				}
+				struct quadric combined = simplifier->quadrics[from];
+				add_quadric(&combined, simplifier->quadrics + to);
+				double cost = quadric_error(&combined, simplifier->positions[to]);
+				if (cost <= max_cost) {
+					simplifier->collapses[count].cost = (float) cost;
+					simplifier->collapses[count].from = from;
+					simplifier->collapses[count].to = to;
+					++count;
+				}
+			}
+		}
+	}
+	return count;
+}
+
+static int try_init_simplifier(struct simplifier *simplifier, const struct mesh_vertex *vertices, uint32_t vertex_count, uint32_t index_count) {
+	simplifier->vertex_count = vertex_count;
+	simplifier->edge_capacity = 1;
+	while (simplifier->edge_capacity < 2*(size_t) index_count) {
+		simplifier->edge_capacity *= 2;
+	}
+	simplifier->positions = malloc(vertex_count*sizeof(*simplifier->positions));
+	simplifier->kinds = malloc(vertex_count);
+	simplifier->quadrics = malloc(vertex_count*sizeof(struct quadric));
+	simplifier->edges = malloc(simplifier->edge_capacity*sizeof(uint64_t));
+	simplifier->triangle_offsets = malloc(vertex_count*sizeof(uint32_t));
+	simplifier->triangle_counts = malloc(vertex_count*sizeof(uint32_t));
+	simplifier->triangles = malloc(index_count*sizeof(uint32_t));
+	simplifier->collapses = malloc(2*(size_t) index_count*sizeof(struct collapse));
+	simplifier->remap = malloc(vertex_count*sizeof(uint32_t));
+	simplifier->touched = malloc(vertex_count);
+	if (!simplifier->positions || !simplifier->kinds || !simplifier->quadrics || !simplifier->edges || !simplifier->triangle_offsets ||
+		!simplifier->triangle_counts || !simplifier->triangles || !simplifier->collapses || !simplifier->remap || !simplifier->touched) {
+		free_simplifier(simplifier);
+		return -1;
+	}
+	for (uint32_t i = 0; i < vertex_count; ++i) {
+		for (int j = 0; j < 3; ++j) {
+			simplifier->positions[i][j] = vertices[i].position[j]/MESH__POSITION_SCALE;
+		}
+	}
+	return 0;
+}
+
+// One round of the cheapest collapses that don't share vertices or triangles, returns the new index count
+static uint32_t collapse_round(struct simplifier *simplifier, uint32_t *indices, uint32_t index_count, uint32_t target_index_count,
+							   double max_cost, double *error) {
+	build_edges(simplifier, indices, index_count);
+	uint32_t collapse_count = gather_collapses(simplifier, indices, index_count, max_cost);
+	if (collapse_count == 0) {
+		return index_count;
+	}
+	qsort(simplifier->collapses, collapse_count, sizeof(struct collapse), compare_collapses);
+	build_adjacency(simplifier, indices, index_count);
+
+	for (uint32_t i = 0; i < simplifier->vertex_count; ++i) {
+		simplifier->remap[i] = i;
+	}
+	memset(simplifier->touched, 0, simplifier->vertex_count);
+	uint32_t triangles_needed = (index_count - target_index_count)/3;
+	uint32_t triangles_removed = 0;
+	for (uint32_t i = 0; i < collapse_count && triangles_removed < triangles_needed; ++i) {
+		const struct collapse *collapse = simplifier->collapses + i;
+		uint32_t removed;
+		if (simplifier->touched[collapse->from] || simplifier->touched[collapse->to] ||
+			flips(simplifier, indices, collapse->from, collapse->to, &removed)) {
+			continue;
+		}
+		simplifier->remap[collapse->from] = collapse->to;
+		add_quadric(simplifier->quadrics + collapse->to, simplifier->quadrics + collapse->from);
+		if (collapse->cost > *error) {
+			*error = collapse->cost;
+		}
+		triangles_removed += removed;
+
+		// Later collapses this round were checked against the triangles as they were
+		const uint32_t *triangles = simplifier->triangles + simplifier->triangle_offsets[collapse->from];
+		for (uint32_t j = 0; j < simplifier->triangle_counts[collapse->from]; ++j) {
+			const uint32_t *triangle = indices + 3*triangles[j];
+			simplifier->touched[triangle[0]] = 1;
+			simplifier->touched[triangle[1]] = 1;
+			simplifier->touched[triangle[2]] = 1;
+		}
+	}
+
+	uint32_t count = 0;
+	for (uint32_t i = 0; i < index_count; i += 3) {
+		uint32_t a = simplifier->remap[indices[i]];
+		uint32_t b = simplifier->remap[indices[i + 1]];
+		uint32_t c = simplifier->remap[indices[i + 2]];
+		if (a != b && b != c && c != a) {
+			indices[count++] = a;
+			indices[count++] = b;
+			indices[count++] = c;
+		}
+	}
+	return count;
+}
+
+int mesh_simplify__try_simplify(uint32_t *indices_out, const uint32_t *indices, uint32_t index_count, const struct mesh_vertex *vertices,
+								uint32_t vertex_count, uint32_t target_index_count, float target_error, uint32_t *index_count_out, float *error_out) {
+	*error_out = 0.0f;
+	*index_count_out = index_count;
+	if (indices_out != indices) {
+		memcpy(indices_out, indices, index_count*sizeof(uint32_t));
+	}
+	if (index_count <= target_index_count) {
+		return 0;
+	}
+	struct simplifier simplifier;
+	if (try_init_simplifier(&simplifier, vertices, vertex_count, index_count) < 0) {
+		return -1;
+	}
+	if (try_classify_vertices(&simplifier, vertices, indices_out, index_count) < 0) {
+		free_simplifier(&simplifier);
+		return -2;
+	}
+	init_quadrics(&simplifier, indices_out, index_count);
+
+	double max_cost = (double) target_error*target_error;
+	double error = 0.0;
+	uint32_t count = index_count;
+	while (count > target_index_count) {
+		uint32_t new_count = collapse_round(&simplifier, indices_out, count, target_index_count, max_cost, &error);
+		if (new_count == count) {
+			break;
+		}
+		count = new_count;
+	}
+	free_simplifier(&simplifier);
+	*index_count_out = count;
+	*error_out = (float) sqrt(error);
+	return 0;
+}
+
+int mesh_simplify__try_build_lods(const uint32_t *indices, uint32_t index_count, const struct mesh_vertex *vertices, uint32_t vertex_count,
+								  uint32_t **indices_out, uint32_t *index_count_out, struct mesh_lod *lods_out, uint32_t *lod_count_out) {
+	// Every level is at most MIN_LOD_REDUCTION of the one before, which bounds the total along with the copy the
+	// last attempt starts from
+	size_t capacity = (size_t) (index_count/(1.0f - MIN_LOD_REDUCTION)) + 3;
+	uint32_t *all = malloc(capacity*sizeof(uint32_t));
+	if (!all) {
+		return -1;
+	}
+	memcpy(all, indices, index_count*sizeof(uint32_t));
+	lods_out[0].first_index = 0;
+	lods_out[0].index_count = index_count;
+	lods_out[0].error = 0.0f;
+	uint32_t lod_count = 1;
+	uint32_t total = index_count;
+
+	while (lod_count < MESH__MAX_LODS) {
+		const struct mesh_lod *previous = lods_out + lod_count - 1;
+		uint32_t target = (uint32_t) (previous->index_count*MESH_SIMPLIFY__LOD_RATIO)/3*3;
+		// Errors add up along the chain, what is left for this level is the rest of the budget
+		float budget = MESH_SIMPLIFY__MAX_ERROR - previous->error;
+		uint32_t count;
+		float error;
+		if (target < 3 || budget <= 0.0f ||
+			mesh_simplify__try_simplify(all + total, all + previous->first_index, previous->index_count, vertices, vertex_count, target, budget,
+										&count, &error) < 0) {
+			break;
+		}
+		if (count < 3 || count > previous->index_count*MIN_LOD_REDUCTION) {
+			break;
+		}
+		if (mesh_optimize__try_vertex_cache(all + total, count, vertex_count) < 0) {
+			free(all);
+			return -2;
+		}
+		struct mesh_lod *lod = lods_out + lod_count++;
+		lod->first_index = total;
+		lod->index_count = count;
+		lod->error = previous->error + error;
+		total += count;
+	}
+	*indices_out = all;
+	*index_count_out = total;
+	*lod_count_out = lod_count;
+	return 0;
+}
@@ -0,0 +1,21 @@
+#pragma once
+
+#include <stdint.h>
+#include "mesh.h"
+
+// Each level aims for this fraction of the triangles of the level before
+#define MESH_SIMPLIFY__LOD_RATIO 0.5f
+// No level moves the surface further than this, relative to the bounding sphere's radius
+#define MESH_SIMPLIFY__MAX_ERROR 0.05f
+
+// Quadric error edge collapse down to target_index_count indices, stopping before a collapse would move the surface
+// further than target_error. Vertices only move onto other vertices, so the result indexes the same vertices.
+// Vertices on attribute seams stay put and open borders only shrink along themselves. indices_out may be indices.
+int mesh_simplify__try_simplify(uint32_t *indices_out, const uint32_t *indices, uint32_t index_count, const struct mesh_vertex *vertices,
+								uint32_t vertex_count, uint32_t target_index_count, float target_error, uint32_t *index_count_out, float *error_out);
+
+// The indices as given followed by simplified levels ordered for the vertex cache, all in one array allocated into
+// indices_out. Stops at MESH__MAX_LODS or when the next level doesn't get meaningfully smaller within
+// MESH_SIMPLIFY__MAX_ERROR.
+int mesh_simplify__try_build_lods(const uint32_t *indices, uint32_t index_count, const struct mesh_vertex *vertices, uint32_t vertex_count,
+								  uint32_t **indices_out, uint32_t *index_count_out, struct mesh_lod *lods_out, uint32_t *lod_count_out);
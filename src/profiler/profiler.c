@@ -0,0 +1,145 @@
+#include <stdio.h>
+#include <malloc.h>
+#include <pthread.h>
+#include <time.h>
+#include "profiler.h"
+
+#define RING_MASK (PROFILER__RING_CAPACITY - 1)
+
+static pthread_mutex_t threads_mutex = PTHREAD_MUTEX_INITIALIZER;
+static struct profiler_thread *threads[PROFILER__MAX_THREADS];
+static int thread_count;
+static __thread struct profiler_thread *current_thread;
+// Set once registration failed, so it isn't retried on every event
+static __thread int current_thread_failed;
+
+static uint64_t now_nanoseconds(void) {
+	struct timespec now;
+	clock_gettime(CLOCK_MONOTONIC, &now);
+	return (uint64_t) now.tv_sec*1000000000u + (uint64_t) now.tv_nsec;
+}
+
+// Thread records are never freed, an exporter may still read them after their thread exits
+static struct profiler_thread *register_thread(void) {
+	if (current_thread_failed) {
+		return 0;
+	}
+	struct profiler_thread *thread = malloc(sizeof(*thread));
+	if (!thread) {
+		current_thread_failed = 1;
+		return 0;
+	}
+	thread->name = 0;
+	thread->head = 0;
+	pthread_mutex_lock(&threads_mutex);
+	if (thread_count == PROFILER__MAX_THREADS) {
+		pthread_mutex_unlock(&threads_mutex);
+		free(thread);
+		current_thread_failed = 1;
+		return 0;
+	}
+	thread->id = thread_count;
+	threads[thread_count++] = thread;
+	pthread_mutex_unlock(&threads_mutex);
+	current_thread = thread;
+	return thread;
+}
+
+static void record(const char *name, enum profiler_event_type type) {
+	struct profiler_thread *thread = current_thread ? current_thread : register_thread();
+	if (!thread) {
+		return;
+	}
+	unsigned long head = thread->head;
+	struct profiler_event *event = thread->events + (head & RING_MASK);
+	event->name = name;
+	event->nanoseconds = now_nanoseconds();
+	event->type = type;
+	__atomic_store_n(&thread->head, head + 1, __ATOMIC_RELEASE);
+}
+
+void profiler__begin(const char *name) {
+	record(name, PROFILER__EVENT_BEGIN);
+}
+
+void profiler__end(const char *name) {
+	record(name, PROFILER__EVENT_END);
+}
+
+void profiler__set_thread_name(const char *name) {
+	struct profiler_thread *thread = current_thread ? current_thread : register_thread();
+	if (thread) {
+		__atomic_store_n(&thread->name, name, __ATOMIC_RELEASE);
+	}
+}
+
+// Copies the events still in the ring, returns how many
+static int copy_events(struct profiler_thread *thread, struct profiler_event *events_out) {
+	unsigned long head = __atomic_load_n(&thread->head, __ATOMIC_ACQUIRE);
+	unsigned long start = head > PROFILER__RING_CAPACITY ? head - PROFILER__RING_CAPACITY : 0;
+	for (unsigned long i = start; i < head; ++i) {
+		events_out[i - start] = thread->events[i & RING_MASK];
+	}
+	// Whatever the thread wrote meanwhile may have replaced the oldest copied events
+	__atomic_thread_fence(__ATOMIC_ACQUIRE);
+	unsigned long new_head = __atomic_load_n(&thread->head, __ATOMIC_RELAXED);
+	unsigned long valid_start = new_head > PROFILER__RING_CAPACITY ? new_head - PROFILER__RING_CAPACITY : 0;
+	if (valid_start > start) {
+		unsigned long skip = valid_start - start < head - start ? valid_start - start : head - start;
+		for (unsigned long i = skip; i < head - start; ++i) {
+			events_out[i - skip] = events_out[i];
+		}
+		return (int) (head - start - skip);
+	}
+	return (int) (head - start);
+}
+
+int profiler__try_export(const char *path) {
+	struct profiler_event *events = malloc(PROFILER__RING_CAPACITY*sizeof(*events));
+	if (!events) {
+		return -1;
+	}
+	FILE *file = fopen(path, "w");
+	if (!file) {
+		free(events);
+		return -2;
+	}
+
+	pthread_mutex_lock(&threads_mutex);
+	int count = thread_count;
+	pthread_mutex_unlock(&threads_mutex);
+
+	fprintf(file, "{\"traceEvents\":[");
+	int first = 1;
+	for (int i = 0; i < count; ++i) {
+		struct profiler_thread *thread = threads[i];
+		const char *name = __atomic_load_n(&thread->name, __ATOMIC_ACQUIRE);
+		if (name) {
+			fprintf(file, "%s\n{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":1,\"tid\":%d,\"args\":{\"name\":\"%s\"}}", first ? "" : ",", thread->id, name);
+			first = 0;
+		}
+
+		int event_count = copy_events(thread, events);
+		// Ends whose begin was overwritten would close zones that aren't open
+		int depth = 0;
+		for (int j = 0; j < event_count; ++j) {
+			if (events[j].type == PROFILER__EVENT_END) {
+				if (depth == 0) {
+					continue;
+				}
+				--depth;
+			} else {
+				++depth;
+			}
+			fprintf(file, "%s\n{\"name\":\"%s\",\"ph\":\"%s\",\"ts\":%.3f,\"pid\":1,\"tid\":%d}", first ? "" : ",", events[j].name,
+					events[j].type == PROFILER__EVENT_BEGIN ? "B" : "E", events[j].nanoseconds/1000.0, thread->id);
+			first = 0;
+		}
+	}
+	fprintf(file, "\n]}\n");
+	free(events);
+	if (fclose(file) != 0) {
+		return -3;
+	}
+	return 0;
+}
@@ -0,0 +1,45 @@
+#pragma once
+
+#include <stdint.h>
+
+// Events kept per thread, older ones are overwritten. Must be a power of two.
+#define PROFILER__RING_CAPACITY 16384
+#define PROFILER__MAX_THREADS 128
+
+// Zones compile to nothing without VULKAN_BASE_PROFILER. Names must be string literals, only the pointer is stored.
+#ifdef VULKAN_BASE_PROFILER
+#define PROFILER_BEGIN(name) profiler__begin(name)
+#define PROFILER_END(name) profiler__end(name)
+#define PROFILER_THREAD_NAME(name) profiler__set_thread_name(name)
+#else
+#define PROFILER_BEGIN(name) ((void) 0)
+#define PROFILER_END(name) ((void) 0)
+#define PROFILER_THREAD_NAME(name) ((void) 0)
+#endif
+
+enum profiler_event_type {
+	PROFILER__EVENT_BEGIN,
+	PROFILER__EVENT_END
+};
+
+struct profiler_event {
+	const char *name;
+	uint64_t nanoseconds;
+	enum profiler_event_type type;
+};
+
+// Written only by its own thread, head is published with release so an exporter can read behind it
+struct profiler_thread {
+	int id;
+	const char *name;
+	unsigned long head;
+	struct profiler_event events[PROFILER__RING_CAPACITY];
+};
+
+void profiler__begin(const char *name);
+void profiler__end(const char *name);
+void profiler__set_thread_name(const char *name);
+
+// Writes every thread's events as Chrome trace event JSON, for chrome://tracing or Perfetto.
+// Threads may keep recording, events they overwrite during the export are left out.
+int profiler__try_export(const char *path);
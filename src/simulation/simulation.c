@@ -0,0 +1,149 @@
+#include <malloc.h>
+#include <string.h>
+#include <time.h>
+#include "simulation.h"
+#include "../profiler/profiler.h"
+
+#define MAX_SPEED 0.2f
+
+double simulation__now(void) {
+	struct timespec now;
+	clock_gettime(CLOCK_MONOTONIC, &now);
+	return (double) now.tv_sec + now.tv_nsec*1e-9;
+}
+
+static unsigned int next_random(unsigned int *state) {
+	*state = *state*1664525u + 1013904223u;
+	return *state >> 8;
+}
+
+static float random_speed(unsigned int *state) {
+	return MAX_SPEED*((float) (next_random(state) & 0xFFFF)/0x8000 - 1.0f);
+}
+
+int simulation__try_init(struct simulation *this, const float (*positions)[2], int body_count, float bounds, double step_seconds, unsigned int seed) {
+	this->body_count = body_count;
+	this->bounds = bounds;
+	this->step_seconds = step_seconds;
+	this->step = 0;
+	this->bodies = malloc(body_count*sizeof(*this->bodies));
+	if (!this->bodies) {
+		return -1;
+	}
+	unsigned int random_state = seed;
+	for (int i = 0; i < body_count; ++i) {
+		this->bodies[i].position[0] = positions[i][0];
+		this->bodies[i].position[1] = positions[i][1];
+		this->bodies[i].velocity[0] = random_speed(&random_state);
+		this->bodies[i].velocity[1] = random_speed(&random_state);
+	}
+	if (triple_buffer__try_init(&this->snapshots, sizeof(struct simulation_snapshot) + 4*body_count*sizeof(float)) < 0) {
+		free(this->bodies);
+		return -2;
+	}
+	return 0;
+}
+
+void simulation__free(struct simulation *this) {
+	triple_buffer__free(&this->snapshots);
+	free(this->bodies);
+}
+
+static void advance(struct simulation *this) {
+	float dt = (float) this->step_seconds;
+	for (int i = 0; i < this->body_count; ++i) {
+		struct simulation_body *body = this->bodies + i;
+		for (int axis = 0; axis < 2; ++axis) {
+			body->position[axis] += body->velocity[axis]*dt;
+			if (body->position[axis] > this->bounds) {
+				body->position[axis] = 2.0f*this->bounds - body->position[axis];
+				body->velocity[axis] = -body->velocity[axis];
+			} else if (body->position[axis] < -this->bounds) {
+				body->position[axis] = -2.0f*this->bounds - body->position[axis];
+				body->velocity[axis] = -body->velocity[axis];
+			}
+		}
+	}
+	++this->step;
+}
+
+static void publish(struct simulation *this, const float *previous) {
+	struct simulation_snapshot *snapshot = triple_buffer__back(&this->snapshots);
+	snapshot->step = this->step;
+	snapshot->time = this->start_time + this->step*this->step_seconds;
+	snapshot->body_count = this->body_count;
+	memcpy(snapshot->positions, previous, 2*this->body_count*sizeof(float));
+	float *current = snapshot->positions + 2*this->body_count;
+	for (int i = 0; i < this->body_count; ++i) {
+		current[2*i + 0] = this->bodies[i].position[0];
+		current[2*i + 1] = this->bodies[i].position[1];
+	}
+	triple_buffer__publish(&this->snapshots);
+}
+
+static void *simulation_main(void *user_data) {
+	struct simulation *this = (struct simulation *) user_data;
+	PROFILER_THREAD_NAME("simulation");
+	float *previous = malloc(2*this->body_count*sizeof(float));
+	if (!previous) {
+		return 0;
+	}
+	while (!__atomic_load_n(&this->stop, __ATOMIC_ACQUIRE)) {
+		double now = simulation__now();
+		// Only the newest step gets published, intermediate ones are still simulated
+		int stepped = 0;
+		while (this->start_time + (this->step + 1)*this->step_seconds <= now) {
+			for (int i = 0; i < this->body_count; ++i) {
+				previous[2*i + 0] = this->bodies[i].position[0];
+				previous[2*i + 1] = this->bodies[i].position[1];
+			}
+			PROFILER_BEGIN("step");
+			advance(this);
+			PROFILER_END("step");
+			stepped = 1;
+		}
+		if (stepped) {
+			publish(this, previous);
+		}
+
+		double wait = this->start_time + (this->step + 1)*this->step_seconds - simulation__now();
+		if (wait > 0.0) {
+			struct timespec duration;
+			duration.tv_sec = (time_t) wait;
+			duration.tv_nsec = (long) ((wait - (double) duration.tv_sec)*1e9);
+			nanosleep(&duration, 0);
+		}
+	}
+	free(previous);
+	return 0;
+}
+
+int simulation__try_start(struct simulation *this) {
+	this->stop = 0;
+	this->start_time = simulation__now() - this->step*this->step_seconds;
+	if (pthread_create(&this->thread, 0, simulation_main, this) != 0) {
+		return -1;
+	}
+	return 0;
+}
+
+void simulation__stop(struct simulation *this) {
+	__atomic_store_n(&this->stop, 1, __ATOMIC_RELEASE);
+	pthread_join(this->thread, 0);
+}
+
+const struct simulation_snapshot *simulation__read(struct simulation *this) {
+	return triple_buffer__read(&this->snapshots);
+}
+
+void simulation__interpolate(const struct simulation_snapshot *snapshot, double step_seconds, double time, float (*positions_out)[2]) {
+	// The snapshot's step spans [time - step_seconds, time], rendering trails the simulation by up to one step
+	float alpha = (float) ((time - snapshot->time)/step_seconds);
+	alpha = alpha < 0.0f ? 0.0f : (alpha > 1.0f ? 1.0f : alpha);
+	const float *previous = snapshot->positions;
+	const float *current = snapshot->positions + 2*snapshot->body_count;
+	for (int i = 0; i < snapshot->body_count; ++i) {
+		positions_out[i][0] = previous[2*i + 0] + (current[2*i + 0] - previous[2*i + 0])*alpha;
+		positions_out[i][1] = previous[2*i + 1] + (current[2*i + 1] - previous[2*i + 1])*alpha;
+	}
+}
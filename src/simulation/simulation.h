@@ -0,0 +1,48 @@
+#pragma once
+
+#include <pthread.h>
+#include "triple_buffer.h"
+
+struct simulation_body {
+	float position[2];
+	float velocity[2];
+};
+
+// Positions before and after the step that ended at time, previous in positions[0..2*body_count) and
+// current in positions[2*body_count..4*body_count)
+struct simulation_snapshot {
+	long step;
+	double time;
+	int body_count;
+	float positions[];
+};
+
+// Steps bodies bouncing inside [-bounds, bounds] at a fixed rate on its own thread. Every step depends only on
+// the previous one, so the result is the same however the thread gets scheduled; if it falls behind it catches
+// up with more steps rather than longer ones.
+struct simulation {
+	struct simulation_body *bodies;
+	int body_count;
+	float bounds;
+	double step_seconds;
+	long step;
+	double start_time;
+	struct triple_buffer snapshots;
+	pthread_t thread;
+	int stop;
+};
+
+// Monotonic seconds, the clock snapshot times are on
+double simulation__now(void);
+
+// Velocities are derived from seed, so equal arguments give equal simulations
+int simulation__try_init(struct simulation *this, const float (*positions)[2], int body_count, float bounds, double step_seconds, unsigned int seed);
+void simulation__free(struct simulation *this);
+
+int simulation__try_start(struct simulation *this);
+void simulation__stop(struct simulation *this);
+
+// Never blocks, returns 0 until the first step is published
+const struct simulation_snapshot *simulation__read(struct simulation *this);
+// Interpolates the snapshot's positions for time, which is clamped to the snapshot's step
+void simulation__interpolate(const struct simulation_snapshot *snapshot, double step_seconds, double time, float (*positions_out)[2]);
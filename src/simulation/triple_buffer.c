@@ -0,0 +1,47 @@
+#include <malloc.h>
+#include "triple_buffer.h"
+
+#define TRIPLE_BUFFER__FRESH 4
+#define TRIPLE_BUFFER__INDEX_MASK 3
+
+int triple_buffer__try_init(struct triple_buffer *this, size_t slot_size) {
+	for (int i = 0; i < 3; ++i) {
+		this->slots[i] = malloc(slot_size);
+		if (!this->slots[i]) {
+			for (--i; i >= 0; --i) {
+				free(this->slots[i]);
+			}
+			return -1;
+		}
+	}
+	this->back = 0;
+	this->middle = 1;
+	this->front = 2;
+	this->has_front = 0;
+	return 0;
+}
+
+void triple_buffer__free(struct triple_buffer *this) {
+	for (int i = 0; i < 3; ++i) {
+		free(this->slots[i]);
+	}
+}
+
+void *triple_buffer__back(struct triple_buffer *this) {
+	return this->slots[this->back];
+}
+
+void triple_buffer__publish(struct triple_buffer *this) {
+	// Release makes the writes to the back slot visible to the consumer that swaps it in
+	int previous = __atomic_exchange_n(&this->middle, this->back | TRIPLE_BUFFER__FRESH, __ATOMIC_ACQ_REL);
+	this->back = previous & TRIPLE_BUFFER__INDEX_MASK;
+}
+
+const void *triple_buffer__read(struct triple_buffer *this) {
+	if (__atomic_load_n(&this->middle, __ATOMIC_RELAXED) & TRIPLE_BUFFER__FRESH) {
+		int previous = __atomic_exchange_n(&this->middle, this->front, __ATOMIC_ACQ_REL);
+		this->front = previous & TRIPLE_BUFFER__INDEX_MASK;
+		this->has_front = 1;
+	}
+	return this->has_front ? this->slots[this->front] : 0;
+}
@@ -0,0 +1,26 @@
+#pragma once
+
+#include <stddef.h>
+
+// Lock-free handoff of the newest value from one producer thread to one consumer thread. Neither side ever
+// waits: the producer overwrites values the consumer hasn't picked up yet and the consumer rereads the last
+// one until a newer one is published.
+struct triple_buffer {
+	void *slots[3];
+	int back;
+	int front;
+	// Index of the middle slot, with TRIPLE_BUFFER__FRESH set while it holds a value the consumer hasn't seen
+	int middle;
+	int has_front;
+};
+
+int triple_buffer__try_init(struct triple_buffer *this, size_t slot_size);
+void triple_buffer__free(struct triple_buffer *this);
+
+// Producer side, the slot to write the next value into
+void *triple_buffer__back(struct triple_buffer *this);
+void triple_buffer__publish(struct triple_buffer *this);
+
+// Consumer side, the newest published value or 0 if nothing has been published yet.
+// Stays valid until the next call.
+const void *triple_buffer__read(struct triple_buffer *this);
@@ -0,0 +1,192 @@
+#include <fcntl.h>
+#include <malloc.h>
+#include <stdio.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include "texture.h"
+
+#define PAGE_ALIGNMENT 4096
+
+static uint32_t tiles_for(uint32_t size) {
+	return (size + TEXTURE__TILE_CONTENT - 1)/TEXTURE__TILE_CONTENT;
+}
+
+static uint32_t init_mips(struct texture_mip *mips, uint32_t width, uint32_t height) {
+	uint32_t mip_count = 0;
+	uint32_t first_tile = 0;
+	while (mip_count < TEXTURE__MAX_MIPS) {
+		struct texture_mip *mip = mips + mip_count++;
+		mip->width = width;
+		mip->height = height;
+		mip->tiles_x = tiles_for(width);
+		mip->tiles_y = tiles_for(height);
+		mip->first_tile = first_tile;
+		first_tile += mip->tiles_x*mip->tiles_y;
+		if (mip->tiles_x == 1 && mip->tiles_y == 1) {
+			break;
+		}
+		width = width > 1 ? width/2 : 1;
+		height = height > 1 ? height/2 : 1;
+	}
+	return mip_count;
+}
+
+static int is_valid(const struct texture_header *header, size_t size) {
+	if (size < sizeof(*header) || header->magic != TEXTURE__MAGIC || header->version != TEXTURE__VERSION || header->file_size > size) {
+		return 0;
+	}
+	if (header->width == 0 || header->height == 0 || header->mip_count == 0 || header->mip_count > TEXTURE__MAX_MIPS) {
+		return 0;
+	}
+	// Readers index tiles through the levels, so they have to be exactly what the size gives
+	struct texture_mip mips[TEXTURE__MAX_MIPS];
+	uint32_t mip_count = init_mips(mips, header->width, header->height);
+	const struct texture_mip *last = mips + mip_count - 1;
+	if (mip_count != header->mip_count || memcmp(mips, header->mips, mip_count*sizeof(*mips)) != 0 ||
+		last->first_tile + 1 != header->tile_count) {
+		return 0;
+	}
+	return header->tile_offset >= sizeof(*header) && header->tile_offset % PAGE_ALIGNMENT == 0 &&
+		   header->tile_offset + (uint64_t) header->tile_count*TEXTURE__TILE_BYTES <= header->file_size;
+}
+
+int texture__try_map(struct texture *this, const char *path) {
+	int fd = open(path, O_RDONLY);
+	if (fd < 0) {
+		return -1;
+	}
+	struct stat stat_buffer;
+	if (fstat(fd, &stat_buffer) != 0 || stat_buffer.st_size < (off_t) sizeof(struct texture_header)) {
+		close(fd);
+		return -2;
+	}
+	size_t size = (size_t) stat_buffer.st_size;
+	void *mapping = mmap(0, size, PROT_READ, MAP_PRIVATE, fd, 0);
+	// The mapping keeps the file alive
+	close(fd);
+	if (mapping == MAP_FAILED) {
+		return -3;
+	}
+
+	const struct texture_header *header = (const struct texture_header *) mapping;
+	if (!is_valid(header, size)) {
+		munmap(mapping, size);
+		return -4;
+	}
+	// Tiles are read in whatever order they become visible, read-ahead would only page in neighbours
+	madvise(mapping, size, MADV_RANDOM);
+
+	this->width = header->width;
+	this->height = header->height;
+	this->mip_count = header->mip_count;
+	this->tile_count = header->tile_count;
+	memcpy(this->mips, header->mips, sizeof(this->mips));
+	this->tiles = (const unsigned char *) mapping + header->tile_offset;
+	this->mapping = mapping;
+	this->mapping_size = size;
+	return 0;
+}
+
+void texture__unmap(struct texture *this) {
+	munmap(this->mapping, this->mapping_size);
+}
+
+const unsigned char *texture__tile(const struct texture *this, uint32_t tile) {
+	return this->tiles + (size_t) tile*TEXTURE__TILE_BYTES;
+}
+
+// Averages 2x2 blocks, an odd last row or column is averaged with itself
+static void downsample(const unsigned char *source, uint32_t source_width, uint32_t source_height, unsigned char *destination, uint32_t width,
+					   uint32_t height) {
+	for (uint32_t y = 0; y < height; ++y) {
+		uint32_t y0 = 2*y < source_height ? 2*y : source_height - 1;
+		uint32_t y1 = y0 + 1 < source_height ? y0 + 1 : y0;
+		for (uint32_t x = 0; x < width; ++x) {
+			uint32_t x0 = 2*x < source_width ? 2*x : source_width - 1;
+			uint32_t x1 = x0 + 1 < source_width ? x0 + 1 : x0;
+			for (int c = 0; c < 4; ++c) {
+				uint32_t sum = source[((size_t) y0*source_width + x0)*4 + c] + source[((size_t) y0*source_width + x1)*4 + c] +
+							   source[((size_t) y1*source_width + x0)*4 + c] + source[((size_t) y1*source_width + x1)*4 + c];
+				destination[((size_t) y*width + x)*4 + c] = (unsigned char) ((sum + 2)/4);
+			}
+		}
+	}
+}
+
+// Texels outside the level, the border of edge tiles included, repeat the nearest edge texel
+static void copy_tile(const unsigned char *pixels, const struct texture_mip *mip, uint32_t tile_x, uint32_t tile_y, unsigned char *tile) {
+	int64_t origin_x = (int64_t) tile_x*TEXTURE__TILE_CONTENT - TEXTURE__TILE_BORDER;
+	int64_t origin_y = (int64_t) tile_y*TEXTURE__TILE_CONTENT - TEXTURE__TILE_BORDER;
+	for (int y = 0; y < TEXTURE__TILE_SIZE; ++y) {
+		int64_t source_y = origin_y + y;
+		source_y = source_y < 0 ? 0 : source_y >= mip->height ? mip->height - 1 : source_y;
+		for (int x = 0; x < TEXTURE__TILE_SIZE; ++x) {
+			int64_t source_x = origin_x + x;
+			source_x = source_x < 0 ? 0 : source_x >= mip->width ? mip->width - 1 : source_x;
+			memcpy(tile + (y*TEXTURE__TILE_SIZE + x)*4, pixels + ((size_t) source_y*mip->width + (size_t) source_x)*4, 4);
+		}
+	}
+}
+
+int texture__try_write(const char *path, const unsigned char *pixels, uint32_t width, uint32_t height) {
+	if (width == 0 || height == 0) {
+		return -1;
+	}
+	struct texture_header header;
+	memset(&header, 0, sizeof(header));
+	header.magic = TEXTURE__MAGIC;
+	header.version = TEXTURE__VERSION;
+	header.width = width;
+	header.height = height;
+	header.mip_count = init_mips(header.mips, width, height);
+	header.tile_count = header.mips[header.mip_count - 1].first_tile + 1;
+	header.tile_offset = PAGE_ALIGNMENT;
+	header.file_size = header.tile_offset + (uint64_t) header.tile_count*TEXTURE__TILE_BYTES;
+
+	// Only two levels are kept at a time, the one being tiled and the next one down
+	unsigned char *tile = malloc(TEXTURE__TILE_BYTES);
+	unsigned char *level = 0;
+	FILE *file = fopen(path, "wb");
+	if (!tile || !file) {
+		free(tile);
+		if (file) {
+			fclose(file);
+		}
+		return -2;
+	}
+	static const char padding[PAGE_ALIGNMENT];
+	int result = fwrite(&header, sizeof(header), 1, file) == 1;
+	result = result && fwrite(padding, 1, PAGE_ALIGNMENT - sizeof(header), file) == PAGE_ALIGNMENT - sizeof(header);
+
+	const unsigned char *current = pixels;
+	for (uint32_t i = 0; result && i < header.mip_count; ++i) {
+		const struct texture_mip *mip = header.mips + i;
+		for (uint32_t y = 0; result && y < mip->tiles_y; ++y) {
+			for (uint32_t x = 0; result && x < mip->tiles_x; ++x) {
+				copy_tile(current, mip, x, y, tile);
+				result = fwrite(tile, TEXTURE__TILE_BYTES, 1, file) == 1;
+			}
+		}
+		if (!result || i + 1 == header.mip_count) {
+			break;
+		}
+		const struct texture_mip *next = mip + 1;
+		unsigned char *next_level = malloc((size_t) next->width*next->height*4);
+		if (!next_level) {
+			result = 0;
+			break;
+		}
+		downsample(current, mip->width, mip->height, next_level, next->width, next->height);
+		free(level);
+		level = next_level;
+		current = level;
+	}
+	free(level);
+	free(tile);
+	if (fclose(file) != 0 || !result) {
+		return -3;
+	}
+	return 0;
+}
@@ -0,0 +1,56 @@
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+
+#define TEXTURE__MAGIC 0x58455454u
+#define TEXTURE__VERSION 1
+// Tiles are RGBA8 squares with a border copied from their neighbours, so filtering near an edge never reads
+// whatever tile sits next to it in a cache
+#define TEXTURE__TILE_SIZE 128
+#define TEXTURE__TILE_BORDER 4
+#define TEXTURE__TILE_CONTENT (TEXTURE__TILE_SIZE - 2*TEXTURE__TILE_BORDER)
+#define TEXTURE__TILE_BYTES (TEXTURE__TILE_SIZE*TEXTURE__TILE_SIZE*4)
+#define TEXTURE__MAX_MIPS 16
+
+// Each level halves the one before, the last one fits in a single tile
+struct texture_mip {
+	uint32_t width;
+	uint32_t height;
+	uint32_t tiles_x;
+	uint32_t tiles_y;
+	// Tiles of a level are stored row by row, after those of every finer level
+	uint32_t first_tile;
+};
+
+// Tiles follow the header at tile_offset, which is page aligned so every tile maps on its own pages
+struct texture_header {
+	uint32_t magic;
+	uint32_t version;
+	uint32_t width;
+	uint32_t height;
+	uint32_t mip_count;
+	uint32_t tile_count;
+	uint64_t tile_offset;
+	uint64_t file_size;
+	struct texture_mip mips[TEXTURE__MAX_MIPS];
+};
+
+struct texture {
+	uint32_t width;
+	uint32_t height;
+	uint32_t mip_count;
+	uint32_t tile_count;
+	struct texture_mip mips[TEXTURE__MAX_MIPS];
+	const unsigned char *tiles;
+	void *mapping;
+	size_t mapping_size;
+};
+
+// Maps a file written by texture__try_write, tiles are paged in as they are read until texture__unmap
+int texture__try_map(struct texture *this, const char *path);
+void texture__unmap(struct texture *this);
+
+const unsigned char *texture__tile(const struct texture *this, uint32_t tile);
+// Builds the levels from RGBA8 pixels with a box filter and writes them as tiles
+int texture__try_write(const char *path, const unsigned char *pixels, uint32_t width, uint32_t height);
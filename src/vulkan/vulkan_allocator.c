@@ -0,0 +1,216 @@
+#include <malloc.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include "vulkan_allocator.h"
+
+#define HEADER_SIZE 16
+#define MIN_BLOCK_SIZE 32
+#define HEAP_CLASS 0xFF
+
+// Sits right before every returned pointer, offset is from the start of the block or heap allocation
+struct header {
+	size_t size;
+	uint32_t offset;
+	uint8_t scope;
+	uint8_t size_class;
+};
+
+static struct header *get_header(void *memory) {
+	return (struct header *) ((char *) memory - HEADER_SIZE);
+}
+
+static int find_size_class(size_t needed) {
+	for (int i = 0; i < VULKAN_ALLOCATOR__SIZE_CLASSES; ++i) {
+		if (needed <= (size_t) MIN_BLOCK_SIZE << i) {
+			return i;
+		}
+	}
+	return -1;
+}
+
+// Called with the mutex held
+static char *try_allocate_block(struct vulkan_allocator *this, int size_class) {
+	char *block = this->free_lists[size_class];
+	if (block) {
+		this->free_lists[size_class] = *(void **) block;
+		return block;
+	}
+	size_t block_size = (size_t) MIN_BLOCK_SIZE << size_class;
+	// Blocks are aligned to their size, chunks start with the link to the previous chunk
+	size_t start = (this->chunk_used + block_size - 1) & ~(block_size - 1);
+	if (!this->chunks || start + block_size > VULKAN_ALLOCATOR__CHUNK_SIZE) {
+		void *chunk;
+		if (posix_memalign(&chunk, VULKAN_ALLOCATOR__CHUNK_SIZE, VULKAN_ALLOCATOR__CHUNK_SIZE) != 0) {
+			return 0;
+		}
+		*(void **) chunk = this->chunks;
+		this->chunks = chunk;
+		this->arena_bytes += VULKAN_ALLOCATOR__CHUNK_SIZE;
+		start = block_size;
+	}
+	this->chunk_used = start + block_size;
+	return this->chunks + start;
+}
+
+static void count_allocation(struct vulkan_allocator *this, struct header *header, int arena) {
+	struct vulkan_allocator_scope_stats *scope = this->scopes + header->scope;
+	__atomic_add_fetch(&scope->live_bytes, header->size, __ATOMIC_RELAXED);
+	__atomic_add_fetch(&scope->live_count, 1, __ATOMIC_RELAXED);
+	__atomic_add_fetch(&scope->allocations, 1, __ATOMIC_RELAXED);
+	__atomic_add_fetch(&scope->allocated_bytes, header->size, __ATOMIC_RELAXED);
+	if (arena) {
+		__atomic_add_fetch(&scope->arena_allocations, 1, __ATOMIC_RELAXED);
+	}
+}
+
+static void count_free(struct vulkan_allocator *this, struct header *header) {
+	struct vulkan_allocator_scope_stats *scope = this->scopes + header->scope;
+	__atomic_sub_fetch(&scope->live_bytes, header->size, __ATOMIC_RELAXED);
+	__atomic_sub_fetch(&scope->live_count, 1, __ATOMIC_RELAXED);
+}
+
+static void *VKAPI_CALL allocate(void *user_data, size_t size, size_t alignment, VkSystemAllocationScope scope) {
+	struct vulkan_allocator *this = (struct vulkan_allocator *) user_data;
+	if (size == 0) {
+		return 0;
+	}
+	size_t offset = alignment > HEADER_SIZE ? alignment : HEADER_SIZE;
+
+	char *block = 0;
+	int size_class = -1;
+	if (scope == VK_SYSTEM_ALLOCATION_SCOPE_COMMAND || scope == VK_SYSTEM_ALLOCATION_SCOPE_OBJECT) {
+		size_class = find_size_class(offset + size);
+	}
+	if (size_class >= 0) {
+		pthread_mutex_lock(&this->mutex);
+		block = try_allocate_block(this, size_class);
+		pthread_mutex_unlock(&this->mutex);
+		if (!block) {
+			return 0;
+		}
+	} else {
+		void *heap_block;
+		if (posix_memalign(&heap_block, offset, offset + size) != 0) {
+			return 0;
+		}
+		block = heap_block;
+	}
+
+	char *memory = block + offset;
+	struct header *header = get_header(memory);
+	header->size = size;
+	header->offset = (uint32_t) offset;
+	header->scope = (uint8_t) scope;
+	header->size_class = size_class >= 0 ? (uint8_t) size_class : HEAP_CLASS;
+	count_allocation(this, header, size_class >= 0);
+	return memory;
+}
+
+static void VKAPI_CALL free_memory(void *user_data, void *memory) {
+	struct vulkan_allocator *this = (struct vulkan_allocator *) user_data;
+	if (!memory) {
+		return;
+	}
+	struct header *header = get_header(memory);
+	count_free(this, header);
+	char *block = (char *) memory - header->offset;
+	if (header->size_class == HEAP_CLASS) {
+		free(block);
+		return;
+	}
+	pthread_mutex_lock(&this->mutex);
+	*(void **) block = this->free_lists[header->size_class];
+	this->free_lists[header->size_class] = block;
+	pthread_mutex_unlock(&this->mutex);
+}
+
+static void *VKAPI_CALL reallocate(void *user_data, void *original, size_t size, size_t alignment, VkSystemAllocationScope scope) {
+	struct vulkan_allocator *this = (struct vulkan_allocator *) user_data;
+	if (!original) {
+		return allocate(user_data, size, alignment, scope);
+	}
+	if (size == 0) {
+		free_memory(user_data, original);
+		return 0;
+	}
+	struct header *header = get_header(original);
+	// Grows or shrinks in place while the block still fits
+	if (header->size_class != HEAP_CLASS && header->offset + size <= (size_t) MIN_BLOCK_SIZE << header->size_class) {
+		count_free(this, header);
+		header->size = size;
+		count_allocation(this, header, 1);
+		return original;
+	}
+	void *memory = allocate(user_data, size, alignment, scope);
+	if (!memory) {
+		return 0;
+	}
+	memcpy(memory, original, header->size < size ? header->size : size);
+	free_memory(user_data, original);
+	return memory;
+}
+
+static void VKAPI_CALL internal_allocation(void *user_data, size_t size, VkInternalAllocationType type, VkSystemAllocationScope scope) {
+	struct vulkan_allocator *this = (struct vulkan_allocator *) user_data;
+	__atomic_add_fetch(&this->scopes[scope].internal_bytes, size, __ATOMIC_RELAXED);
+}
+
+static void VKAPI_CALL internal_free(void *user_data, size_t size, VkInternalAllocationType type, VkSystemAllocationScope scope) {
+	struct vulkan_allocator *this = (struct vulkan_allocator *) user_data;
+	__atomic_sub_fetch(&this->scopes[scope].internal_bytes, size, __ATOMIC_RELAXED);
+}
+
+int vulkan_allocator__try_init(struct vulkan_allocator *this) {
+	if (pthread_mutex_init(&this->mutex, 0) != 0) {
+		return -1;
+	}
+	for (int i = 0; i < VULKAN_ALLOCATOR__SIZE_CLASSES; ++i) {
+		this->free_lists[i] = 0;
+	}
+	this->chunks = 0;
+	this->chunk_used = 0;
+	this->arena_bytes = 0;
+	memset(this->scopes, 0, sizeof(this->scopes));
+
+	this->callbacks.pUserData = this;
+	this->callbacks.pfnAllocation = allocate;
+	this->callbacks.pfnReallocation = reallocate;
+	this->callbacks.pfnFree = free_memory;
+	this->callbacks.pfnInternalAllocation = internal_allocation;
+	this->callbacks.pfnInternalFree = internal_free;
+	return 0;
+}
+
+void vulkan_allocator__free(struct vulkan_allocator *this) {
+	while (this->chunks) {
+		char *next = *(void **) this->chunks;
+		free(this->chunks);
+		this->chunks = next;
+	}
+	pthread_mutex_destroy(&this->mutex);
+}
+
+void vulkan_allocator__read_stats(struct vulkan_allocator *this, struct vulkan_allocator_stats *stats_out) {
+	for (int i = 0; i < VULKAN_ALLOCATOR__SCOPE_COUNT; ++i) {
+		struct vulkan_allocator_scope_stats *scope = this->scopes + i;
+		struct vulkan_allocator_scope_stats *scope_out = stats_out->scopes + i;
+		scope_out->live_bytes = __atomic_load_n(&scope->live_bytes, __ATOMIC_RELAXED);
+		scope_out->live_count = __atomic_load_n(&scope->live_count, __ATOMIC_RELAXED);
+		scope_out->allocations = __atomic_load_n(&scope->allocations, __ATOMIC_RELAXED);
+		scope_out->allocated_bytes = __atomic_load_n(&scope->allocated_bytes, __ATOMIC_RELAXED);
+		scope_out->arena_allocations = __atomic_load_n(&scope->arena_allocations, __ATOMIC_RELAXED);
+		scope_out->internal_bytes = __atomic_load_n(&scope->internal_bytes, __ATOMIC_RELAXED);
+	}
+	pthread_mutex_lock(&this->mutex);
+	stats_out->arena_bytes = this->arena_bytes;
+	pthread_mutex_unlock(&this->mutex);
+}
+
+unsigned long vulkan_allocator__allocations(struct vulkan_allocator *this) {
+	unsigned long allocations = 0;
+	for (int i = 0; i < VULKAN_ALLOCATOR__SCOPE_COUNT; ++i) {
+		allocations += __atomic_load_n(&this->scopes[i].allocations, __ATOMIC_RELAXED);
+	}
+	return allocations;
+}
@@ -0,0 +1,44 @@
+#pragma once
+
+#include <vulkan/vulkan.h>
+#include <pthread.h>
+
+#define VULKAN_ALLOCATOR__SCOPE_COUNT (VK_SYSTEM_ALLOCATION_SCOPE_INSTANCE + 1)
+// Arena blocks are 32 << class bytes including the header, larger allocations go to the heap
+#define VULKAN_ALLOCATOR__SIZE_CLASSES 8
+#define VULKAN_ALLOCATOR__CHUNK_SIZE 65536
+
+// Counters are cumulative except the live ones, read them with vulkan_allocator__read_stats
+struct vulkan_allocator_scope_stats {
+	size_t live_bytes;
+	size_t live_count;
+	unsigned long allocations;
+	unsigned long allocated_bytes;
+	unsigned long arena_allocations;
+	// Reported by the driver through the internal allocation notifications, not allocated here
+	size_t internal_bytes;
+};
+
+struct vulkan_allocator_stats {
+	struct vulkan_allocator_scope_stats scopes[VULKAN_ALLOCATOR__SCOPE_COUNT];
+	size_t arena_bytes;
+};
+
+// Host allocator handed to every vkCreate*/vkDestroy* call. Command and object scope allocations, which drivers
+// make and free at a high rate, are served from free lists over 64 KiB chunks. Chunks are only returned in
+// vulkan_allocator__free, which must come after everything created with the callbacks has been destroyed.
+struct vulkan_allocator {
+	VkAllocationCallbacks callbacks;
+	pthread_mutex_t mutex;
+	void *free_lists[VULKAN_ALLOCATOR__SIZE_CLASSES];
+	char *chunks;
+	size_t chunk_used;
+	size_t arena_bytes;
+	struct vulkan_allocator_scope_stats scopes[VULKAN_ALLOCATOR__SCOPE_COUNT];
+};
+
+int vulkan_allocator__try_init(struct vulkan_allocator *this);
+void vulkan_allocator__free(struct vulkan_allocator *this);
+void vulkan_allocator__read_stats(struct vulkan_allocator *this, struct vulkan_allocator_stats *stats_out);
+// Allocations and reallocations so far over all scopes, cheap enough to read every frame
+unsigned long vulkan_allocator__allocations(struct vulkan_allocator *this);
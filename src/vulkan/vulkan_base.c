@@ -1,22 +1,26 @@
 #include "vulkan_base.h"
-#include "../file/file.h"
+#include "vulkan_device_select.h"
 #include <malloc.h>
 #include <stdio.h>
+#include <string.h>
 
 static void free_instance(struct vulkan_base *this) {
-	vkDestroyInstance(this->instance, 0);
+	vkDestroyInstance(this->instance, this->allocator);
+	vulkan_allocator__free(&this->host_allocator);
 }
 
 #ifdef VULKAN_BASE_VALIDATION
 static void free_debug_callback_to_instance(struct vulkan_base *this) {
 	PFN_vkDestroyDebugUtilsMessengerEXT func = (PFN_vkDestroyDebugUtilsMessengerEXT)vkGetInstanceProcAddr(this->instance, "vkDestroyDebugUtilsMessengerEXT");
-	func(this->instance, this->callback, 0);
+	func(this->instance, this->callback, this->allocator);
 	free_instance(this);
 }
 #endif
 
 static void free_from_window_surface(struct vulkan_base *this) {
-	vkDestroySurfaceKHR(this->instance, this->surface, 0);
+	if (this->surface != VK_NULL_HANDLE) {
+		vkDestroySurfaceKHR(this->instance, this->surface, this->allocator);
+	}
 #ifdef VULKAN_BASE_VALIDATION
 	free_debug_callback_to_instance(this);
 #else
@@ -25,12 +29,13 @@ static void free_from_window_surface(struct vulkan_base *this) {
 }
 
 static void free_from_device(struct vulkan_base *this) {
-	vkDestroyDevice(this->device, 0);
+	vulkan_memory_budget__free(&this->memory_budget);
+	vkDestroyDevice(this->device, this->allocator);
     free_from_window_surface(this);
 }
 
 static void free_from_command_pool(struct vulkan_base *this) {
-    vkDestroyCommandPool(this->device, this->command_pool, 0);
+    vkDestroyCommandPool(this->device, this->command_pool, this->allocator);
 	free_from_device(this);
 }
 
@@ -38,6 +43,20 @@ void vulkan_base__free(struct vulkan_base *this) {
 	free_from_command_pool(this);
 }
 
+static int has_instance_extension(const char *extension_name) {
+	uint32_t extension_count;
+	vkEnumerateInstanceExtensionProperties(0, &extension_count, 0);
+	VkExtensionProperties extensions[extension_count];
+	vkEnumerateInstanceExtensionProperties(0, &extension_count, extensions);
+
+	for (int i = 0; i < extension_count; ++i) {
+		if (strcmp(extensions[i].extensionName, extension_name) == 0) {
+			return 1;
+		}
+	}
+	return 0;
+}
+
 static int try_create_instance(struct vulkan_base *this, const char **extensions, int extension_count) {
 	VkApplicationInfo app_info;
 	app_info.sType = VK_STRUCTURE_TYPE_APPLICATION_INFO;
@@ -46,36 +65,62 @@ static int try_create_instance(struct vulkan_base *this, const char **extensions
 	app_info.pEngineName = 0;
 	app_info.engineVersion = 0;
 	app_info.pNext = 0;
-	app_info.apiVersion = VK_API_VERSION_1_1;
+
+	// Ask for 1.3 only when the loader knows about it, so dynamic rendering can be used from core
+	this->api_version = VK_API_VERSION_1_1;
+	PFN_vkEnumerateInstanceVersion enumerate_instance_version = (PFN_vkEnumerateInstanceVersion) vkGetInstanceProcAddr(0, "vkEnumerateInstanceVersion");
+	uint32_t instance_version;
+	if (enumerate_instance_version && enumerate_instance_version(&instance_version) == VK_SUCCESS && instance_version >= VK_API_VERSION_1_3) {
+		this->api_version = VK_API_VERSION_1_3;
+	}
+	app_info.apiVersion = this->api_version;
 
 	VkInstanceCreateInfo create_info;
 	create_info.sType = VK_STRUCTURE_TYPE_INSTANCE_CREATE_INFO;
 	create_info.pApplicationInfo = &app_info;
 #ifdef VULKAN_BASE_VALIDATION
+	int debug_utils = 1;
+#elif defined(VULKAN_BASE_PROFILER)
+	// Only wanted for labels, so go without where it's missing
+	int debug_utils = has_instance_extension(VK_EXT_DEBUG_UTILS_EXTENSION_NAME);
+#else
+	int debug_utils = 0;
+#endif
 	const char *new_extensions[extension_count + 1];
 	int i = 0;
 	for (; i < extension_count; ++i) {
 		new_extensions[i] = extensions[i];
 	}
-	new_extensions[i] = VK_EXT_DEBUG_UTILS_EXTENSION_NAME;
-	create_info.enabledExtensionCount = (uint32_t) extension_count + 1;
+	if (debug_utils) {
+		new_extensions[i++] = VK_EXT_DEBUG_UTILS_EXTENSION_NAME;
+	}
+	create_info.enabledExtensionCount = (uint32_t) i;
 	create_info.ppEnabledExtensionNames = new_extensions;
-
+#ifdef VULKAN_BASE_VALIDATION
 	const char *validation_layers[1] = {"VK_LAYER_LUNARG_standard_validation"};
 	create_info.enabledLayerCount = 1;
 	create_info.ppEnabledLayerNames = validation_layers;
 #else
-	create_info.enabledExtensionCount = (uint32_t) extension_count;
-	create_info.ppEnabledExtensionNames = extensions;
 	create_info.enabledLayerCount = 0;
 	create_info.ppEnabledLayerNames = 0;
 #endif
 	create_info.pNext = 0;
 	create_info.flags = 0;
 
-	if (vkCreateInstance(&create_info, 0, &this->instance) != VK_SUCCESS) {
+	if (vkCreateInstance(&create_info, this->allocator, &this->instance) != VK_SUCCESS) {
 		return -1;
 	}
+
+	this->cmd_begin_label = 0;
+	this->cmd_end_label = 0;
+	this->queue_begin_label = 0;
+	this->queue_end_label = 0;
+	if (debug_utils) {
+		this->cmd_begin_label = (PFN_vkCmdBeginDebugUtilsLabelEXT) vkGetInstanceProcAddr(this->instance, "vkCmdBeginDebugUtilsLabelEXT");
+		this->cmd_end_label = (PFN_vkCmdEndDebugUtilsLabelEXT) vkGetInstanceProcAddr(this->instance, "vkCmdEndDebugUtilsLabelEXT");
+		this->queue_begin_label = (PFN_vkQueueBeginDebugUtilsLabelEXT) vkGetInstanceProcAddr(this->instance, "vkQueueBeginDebugUtilsLabelEXT");
+		this->queue_end_label = (PFN_vkQueueEndDebugUtilsLabelEXT) vkGetInstanceProcAddr(this->instance, "vkQueueEndDebugUtilsLabelEXT");
+	}
 	return 0;
 }
 
@@ -91,36 +136,27 @@ static VKAPI_ATTR VkBool32 VKAPI_CALL debug_callback(
 }
 #endif
 
-static int try_create_device(struct vulkan_base *this) {
-	this->queue_family_index = -1;
-	uint32_t device_count;
-	vkEnumeratePhysicalDevices(this->instance, &device_count, 0);
-	VkPhysicalDevice devices[device_count];
-	vkEnumeratePhysicalDevices(this->instance, &device_count, devices);
-
-	for (int i = 0; i < device_count; ++i) {
-		VkPhysicalDevice current_device = devices[i];
-
-		uint32_t queue_family_count = 0;
-		vkGetPhysicalDeviceQueueFamilyProperties(current_device, &queue_family_count, 0);
-		VkQueueFamilyProperties queue_family_propertiess[queue_family_count];
-		vkGetPhysicalDeviceQueueFamilyProperties(current_device, &queue_family_count, queue_family_propertiess);
-
-		for (int j = 0; j < queue_family_count; ++j) {
-			VkBool32 present_support;
-			vkGetPhysicalDeviceSurfaceSupportKHR(current_device, (uint32_t) j, this->surface, &present_support);
-
-			if (queue_family_propertiess[j].queueCount > 0 && queue_family_propertiess[j].queueFlags & VK_QUEUE_GRAPHICS_BIT && present_support) {
-				this->queue_family_index = j;
-				this->physical_device = current_device;
-				goto break_first;
-			}
+static int has_device_extension(VkPhysicalDevice physical_device, const char *extension_name) {
+	uint32_t extension_count;
+	vkEnumerateDeviceExtensionProperties(physical_device, 0, &extension_count, 0);
+	VkExtensionProperties extensions[extension_count];
+	vkEnumerateDeviceExtensionProperties(physical_device, 0, &extension_count, extensions);
+
+	for (int i = 0; i < extension_count; ++i) {
+		if (strcmp(extensions[i].extensionName, extension_name) == 0) {
+			return 1;
 		}
 	}
-	break_first:
-	if (this->queue_family_index == -1) {
+	return 0;
+}
+
+static int try_create_device(struct vulkan_base *this, int flags) {
+	struct vulkan_device_select device_select;
+	if (vulkan_device_select__try_pick(&device_select, this->instance, this->surface, flags & VULKAN_BASE__FLAG_BENCHMARK_DEVICES, this->allocator) < 0) {
 		return -1;
 	}
+	this->physical_device = device_select.physical_device;
+	this->queue_family_index = device_select.queue_family_index;
 
 	VkDeviceQueueCreateInfo queue_create_info;
 	queue_create_info.sType = VK_STRUCTURE_TYPE_DEVICE_QUEUE_CREATE_INFO;
@@ -131,18 +167,61 @@ static int try_create_device(struct vulkan_base *this) {
 	queue_create_info.queueCount = 1;
 	queue_create_info.queueFamilyIndex = (uint32_t) this->queue_family_index;
 
-	VkPhysicalDeviceFeatures device_features = {0};
+	vkGetPhysicalDeviceProperties(this->physical_device, &this->properties);
+	vkGetPhysicalDeviceMemoryProperties(this->physical_device, &this->memory_properties);
+
+	VkPhysicalDeviceFeatures supported_features;
+	vkGetPhysicalDeviceFeatures(this->physical_device, &supported_features);
+	memset(&this->enabled_features, 0, sizeof(this->enabled_features));
+	this->enabled_features.multiDrawIndirect = supported_features.multiDrawIndirect;
+	this->enabled_features.drawIndirectFirstInstance = supported_features.drawIndirectFirstInstance;
+	this->enabled_features.pipelineStatisticsQuery = supported_features.pipelineStatisticsQuery;
+	this->enabled_features.fragmentStoresAndAtomics = supported_features.fragmentStoresAndAtomics;
+
+	const char *device_extensions[6];
+	uint32_t device_extension_count = 0;
+	if (this->surface != VK_NULL_HANDLE) {
+		device_extensions[device_extension_count++] = VK_KHR_SWAPCHAIN_EXTENSION_NAME;
+	}
+	int draw_indirect_count = has_device_extension(this->physical_device, VK_KHR_DRAW_INDIRECT_COUNT_EXTENSION_NAME);
+	if (draw_indirect_count) {
+		device_extensions[device_extension_count++] = VK_KHR_DRAW_INDIRECT_COUNT_EXTENSION_NAME;
+	}
+	int memory_budget = has_device_extension(this->physical_device, VK_EXT_MEMORY_BUDGET_EXTENSION_NAME);
+	if (memory_budget) {
+		device_extensions[device_extension_count++] = VK_EXT_MEMORY_BUDGET_EXTENSION_NAME;
+	}
+
+	this->dynamic_rendering = 0;
+	int dynamic_rendering_core = this->api_version >= VK_API_VERSION_1_3 && this->properties.apiVersion >= VK_API_VERSION_1_3;
+	VkPhysicalDeviceDynamicRenderingFeatures dynamic_rendering_features;
+	dynamic_rendering_features.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_DYNAMIC_RENDERING_FEATURES;
+	dynamic_rendering_features.pNext = 0;
+	dynamic_rendering_features.dynamicRendering = VK_FALSE;
+	if ((flags & VULKAN_BASE__FLAG_DYNAMIC_RENDERING) &&
+		(dynamic_rendering_core || has_device_extension(this->physical_device, VK_KHR_DYNAMIC_RENDERING_EXTENSION_NAME))) {
+		VkPhysicalDeviceFeatures2 features2;
+		features2.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_FEATURES_2;
+		features2.pNext = &dynamic_rendering_features;
+		vkGetPhysicalDeviceFeatures2(this->physical_device, &features2);
+		this->dynamic_rendering = dynamic_rendering_features.dynamicRendering == VK_TRUE;
+	}
+	if (this->dynamic_rendering && !dynamic_rendering_core) {
+		// Dependencies of the extension that are not already core in 1.1
+		device_extensions[device_extension_count++] = VK_KHR_DYNAMIC_RENDERING_EXTENSION_NAME;
+		device_extensions[device_extension_count++] = VK_KHR_DEPTH_STENCIL_RESOLVE_EXTENSION_NAME;
+		device_extensions[device_extension_count++] = VK_KHR_CREATE_RENDERPASS_2_EXTENSION_NAME;
+	}
 
 	VkDeviceCreateInfo device_create_info;
 	device_create_info.sType = VK_STRUCTURE_TYPE_DEVICE_CREATE_INFO;
 	device_create_info.pQueueCreateInfos = &queue_create_info;
 	device_create_info.queueCreateInfoCount = 1;
-	device_create_info.pEnabledFeatures = &device_features;
-	const char *device_extensions[] = { VK_KHR_SWAPCHAIN_EXTENSION_NAME };
-	device_create_info.enabledExtensionCount = 1;
+	device_create_info.pEnabledFeatures = &this->enabled_features;
+	device_create_info.enabledExtensionCount = device_extension_count;
 	device_create_info.ppEnabledExtensionNames = device_extensions;
 	device_create_info.flags = 0;
-	device_create_info.pNext = 0;
+	device_create_info.pNext = this->dynamic_rendering ? &dynamic_rendering_features : 0;
 #ifdef VULKAN_BASE_VALIDATION
 	const char *validation_layers[1] = { "VK_LAYER_LUNARG_standard_validation" };
 	device_create_info.enabledLayerCount = 1;
@@ -152,10 +231,26 @@ static int try_create_device(struct vulkan_base *this) {
 	device_create_info.ppEnabledLayerNames = 0;
 #endif
 
-	if (vkCreateDevice(this->physical_device, &device_create_info, 0, &this->device) != VK_SUCCESS) {
+	if (vkCreateDevice(this->physical_device, &device_create_info, this->allocator, &this->device) != VK_SUCCESS) {
 		return -2;
 	}
+	if (vulkan_memory_budget__try_init(&this->memory_budget, this->physical_device, memory_budget) < 0) {
+		vkDestroyDevice(this->device, this->allocator);
+		return -3;
+	}
 	vkGetDeviceQueue(this->device, (uint32_t) this->queue_family_index, 0, &this->queue);
+
+	this->cmd_draw_indexed_indirect_count = 0;
+	if (draw_indirect_count) {
+		this->cmd_draw_indexed_indirect_count = (PFN_vkCmdDrawIndexedIndirectCountKHR) vkGetDeviceProcAddr(this->device, "vkCmdDrawIndexedIndirectCountKHR");
+	}
+
+	this->cmd_begin_rendering = 0;
+	this->cmd_end_rendering = 0;
+	if (this->dynamic_rendering) {
+		this->cmd_begin_rendering = (PFN_vkCmdBeginRenderingKHR) vkGetDeviceProcAddr(this->device, dynamic_rendering_core ? "vkCmdBeginRendering" : "vkCmdBeginRenderingKHR");
+		this->cmd_end_rendering = (PFN_vkCmdEndRenderingKHR) vkGetDeviceProcAddr(this->device, dynamic_rendering_core ? "vkCmdEndRendering" : "vkCmdEndRenderingKHR");
+	}
 	return 0;
 }
 
@@ -163,19 +258,26 @@ static int try_create_command_pool(struct vulkan_base *this) {
 	VkCommandPoolCreateInfo create_info;
 	create_info.sType = VK_STRUCTURE_TYPE_COMMAND_POOL_CREATE_INFO;
 	create_info.pNext = 0;
-	create_info.flags = 0;
+	// Scenes culled on the CPU record their command buffers again every frame
+	create_info.flags = VK_COMMAND_POOL_CREATE_RESET_COMMAND_BUFFER_BIT;
 	create_info.queueFamilyIndex = (uint32_t) this->queue_family_index;
 
-	if (vkCreateCommandPool(this->device, &create_info, 0, &this->command_pool) != VK_SUCCESS) {
+	if (vkCreateCommandPool(this->device, &create_info, this->allocator, &this->command_pool) != VK_SUCCESS) {
 		return -1;
 	}
 	return 0;
 }
 
-int vulkan_base__try_init(struct vulkan_base *this, const char **extensions, int extension_count, struct vulkan_base__create_surface callback) {
+int vulkan_base__try_init(struct vulkan_base *this, const char **extensions, int extension_count, int flags, struct vulkan_base__create_surface callback) {
 	int result;
+	this->pipeline_cache = VK_NULL_HANDLE;
+	if (vulkan_allocator__try_init(&this->host_allocator) < 0) {
+		return -6;
+	}
+	this->allocator = &this->host_allocator.callbacks;
 	result = try_create_instance(this, extensions, extension_count);
 	if (result < 0) {
+		vulkan_allocator__free(&this->host_allocator);
 		return -1;
 	}
 #ifdef VULKAN_BASE_VALIDATION
@@ -189,12 +291,13 @@ int vulkan_base__try_init(struct vulkan_base *this, const char **extensions, int
 	create_info.pNext = 0;
 
 	PFN_vkCreateDebugUtilsMessengerEXT func = (PFN_vkCreateDebugUtilsMessengerEXT)vkGetInstanceProcAddr(this->instance, "vkCreateDebugUtilsMessengerEXT");
-	if (func(this->instance, &create_info, 0, &this->callback) != VK_SUCCESS) {
+	if (func(this->instance, &create_info, this->allocator, &this->callback) != VK_SUCCESS) {
 		free_instance(this);
 		return -2;
 	}
 #endif
-	if (callback.create_window_surface(callback.user_data, this->instance, &this->surface) != VK_SUCCESS) {
+	this->surface = VK_NULL_HANDLE;
+	if (callback.create_window_surface && callback.create_window_surface(callback.user_data, this->instance, &this->surface) != VK_SUCCESS) {
 #ifdef VULKAN_BASE_VALIDATION
 		free_debug_callback_to_instance(this);
 #else
@@ -203,7 +306,7 @@ int vulkan_base__try_init(struct vulkan_base *this, const char **extensions, int
 		return -3;
 	}
 
-	result = try_create_device(this);
+	result = try_create_device(this, flags);
 	if (result < 0) {
         free_from_window_surface(this);
 		return -4;
@@ -217,3 +320,172 @@ int vulkan_base__try_init(struct vulkan_base *this, const char **extensions, int
 	return 0;
 }
 
+static char *shader_file_names[VULKAN_BASE__SHADER_COUNT] = {
+	"shaders/vert.spv",
+	"shaders/frag.spv",
+	"shaders/cull.spv",
+	"shaders/virtual_texture.spv"
+};
+
+int vulkan_base__try_load_files(struct vulkan_base *this) {
+	for (int i = 0; i < VULKAN_BASE__SHADER_COUNT; ++i) {
+		this->shaders[i] = file__try_read(shader_file_names[i]);
+		if (this->shaders[i].result < 0) {
+			for (--i; i >= 0; --i) {
+				free(this->shaders[i].malloc_bytes);
+			}
+			return -1;
+		}
+	}
+	this->pipeline_cache_file = file__try_read(VULKAN_BASE__PIPELINE_CACHE_FILE);
+	return 0;
+}
+
+void vulkan_base__free_files(struct vulkan_base *this) {
+	if (this->pipeline_cache_file.result == 0) {
+		free(this->pipeline_cache_file.malloc_bytes);
+	}
+	for (int i = 0; i < VULKAN_BASE__SHADER_COUNT; ++i) {
+		free(this->shaders[i].malloc_bytes);
+	}
+}
+
+int vulkan_base__try_init_pipeline_cache(struct vulkan_base *this) {
+	VkPipelineCacheCreateInfo create_info;
+	create_info.sType = VK_STRUCTURE_TYPE_PIPELINE_CACHE_CREATE_INFO;
+	create_info.pNext = 0;
+	create_info.flags = 0;
+	// The driver checks the header and ignores data from another device or driver version
+	create_info.initialDataSize = this->pipeline_cache_file.result == 0 ? (size_t) this->pipeline_cache_file.length : 0;
+	create_info.pInitialData = this->pipeline_cache_file.result == 0 ? this->pipeline_cache_file.malloc_bytes : 0;
+	if (vkCreatePipelineCache(this->device, &create_info, this->allocator, &this->pipeline_cache) != VK_SUCCESS) {
+		this->pipeline_cache = VK_NULL_HANDLE;
+		return -1;
+	}
+	return 0;
+}
+
+void vulkan_base__free_pipeline_cache(struct vulkan_base *this) {
+	size_t size;
+	if (vkGetPipelineCacheData(this->device, this->pipeline_cache, &size, 0) == VK_SUCCESS && size > 0) {
+		char *data = malloc(size);
+		if (data) {
+			if (vkGetPipelineCacheData(this->device, this->pipeline_cache, &size, data) == VK_SUCCESS) {
+				file__try_write(VULKAN_BASE__PIPELINE_CACHE_FILE, data, (long) size);
+			}
+			free(data);
+		}
+	}
+	vkDestroyPipelineCache(this->device, this->pipeline_cache, this->allocator);
+	this->pipeline_cache = VK_NULL_HANDLE;
+}
+
+static void fill_label(VkDebugUtilsLabelEXT *label, const char *name) {
+	label->sType = VK_STRUCTURE_TYPE_DEBUG_UTILS_LABEL_EXT;
+	label->pNext = 0;
+	label->pLabelName = name;
+	label->color[0] = 0.0f;
+	label->color[1] = 0.0f;
+	label->color[2] = 0.0f;
+	label->color[3] = 0.0f;
+}
+
+void vulkan_base__cmd_begin_label(struct vulkan_base *this, VkCommandBuffer command_buffer, const char *name) {
+	if (this->cmd_begin_label) {
+		VkDebugUtilsLabelEXT label;
+		fill_label(&label, name);
+		this->cmd_begin_label(command_buffer, &label);
+	}
+}
+
+void vulkan_base__cmd_end_label(struct vulkan_base *this, VkCommandBuffer command_buffer) {
+	if (this->cmd_end_label) {
+		this->cmd_end_label(command_buffer);
+	}
+}
+
+void vulkan_base__queue_begin_label(struct vulkan_base *this, const char *name) {
+	if (this->queue_begin_label) {
+		VkDebugUtilsLabelEXT label;
+		fill_label(&label, name);
+		this->queue_begin_label(this->queue, &label);
+	}
+}
+
+void vulkan_base__queue_end_label(struct vulkan_base *this) {
+	if (this->queue_end_label) {
+		this->queue_end_label(this->queue);
+	}
+}
+
+int vulkan_base__find_memory_type(struct vulkan_base *this, uint32_t type_bits, VkMemoryPropertyFlags properties) {
+	for (uint32_t i = 0; i < this->memory_properties.memoryTypeCount; ++i) {
+		if ((type_bits & (1u << i)) && (this->memory_properties.memoryTypes[i].propertyFlags & properties) == properties) {
+			return (int) i;
+		}
+	}
+	return -1;
+}
+
+int vulkan_base__try_create_buffer(struct vulkan_base *this, VkDeviceSize size, VkBufferUsageFlags usage, VkMemoryPropertyFlags properties, VkBuffer *buffer_out, VkDeviceMemory *memory_out) {
+	VkBufferCreateInfo create_info;
+	create_info.sType = VK_STRUCTURE_TYPE_BUFFER_CREATE_INFO;
+	create_info.pNext = 0;
+	create_info.flags = 0;
+	create_info.size = size;
+	create_info.usage = usage;
+	create_info.sharingMode = VK_SHARING_MODE_EXCLUSIVE;
+	create_info.queueFamilyIndexCount = 0;
+	create_info.pQueueFamilyIndices = 0;
+
+	if (vkCreateBuffer(this->device, &create_info, this->allocator, buffer_out) != VK_SUCCESS) {
+		return -1;
+	}
+
+	VkMemoryRequirements requirements;
+	vkGetBufferMemoryRequirements(this->device, *buffer_out, &requirements);
+	int memory_type = vulkan_base__find_memory_type(this, requirements.memoryTypeBits, properties);
+	if (memory_type < 0) {
+		vkDestroyBuffer(this->device, *buffer_out, this->allocator);
+		return -2;
+	}
+
+	VkMemoryAllocateInfo allocate_info;
+	allocate_info.sType = VK_STRUCTURE_TYPE_MEMORY_ALLOCATE_INFO;
+	allocate_info.pNext = 0;
+	allocate_info.allocationSize = requirements.size;
+	allocate_info.memoryTypeIndex = (uint32_t) memory_type;
+
+	if (vulkan_base__try_allocate_memory(this, &allocate_info, memory_out) < 0) {
+		vkDestroyBuffer(this->device, *buffer_out, this->allocator);
+		return -3;
+	}
+
+	if (vkBindBufferMemory(this->device, *buffer_out, *memory_out, 0) != VK_SUCCESS) {
+		vulkan_base__free_memory(this, *memory_out);
+		vkDestroyBuffer(this->device, *buffer_out, this->allocator);
+		return -4;
+	}
+	return 0;
+}
+
+void vulkan_base__free_buffer(struct vulkan_base *this, VkBuffer buffer, VkDeviceMemory memory) {
+	vkDestroyBuffer(this->device, buffer, this->allocator);
+	vulkan_base__free_memory(this, memory);
+}
+
+int vulkan_base__try_allocate_memory(struct vulkan_base *this, const VkMemoryAllocateInfo *allocate_info, VkDeviceMemory *memory_out) {
+	if (vkAllocateMemory(this->device, allocate_info, this->allocator, memory_out) != VK_SUCCESS) {
+		return -1;
+	}
+	if (vulkan_memory_budget__try_track(&this->memory_budget, *memory_out, allocate_info->allocationSize, allocate_info->memoryTypeIndex) < 0) {
+		vkFreeMemory(this->device, *memory_out, this->allocator);
+		return -2;
+	}
+	return 0;
+}
+
+void vulkan_base__free_memory(struct vulkan_base *this, VkDeviceMemory memory) {
+	vulkan_memory_budget__untrack(&this->memory_budget, memory);
+	vkFreeMemory(this->device, memory, this->allocator);
+}
@@ -1,8 +1,26 @@
 #pragma once
 
 #include <vulkan/vulkan.h>
+#include "../file/file.h"
+#include "vulkan_allocator.h"
+#include "vulkan_memory_budget.h"
+
+#define VULKAN_BASE__FLAG_DYNAMIC_RENDERING 1
+#define VULKAN_BASE__FLAG_BENCHMARK_DEVICES 2
+#define VULKAN_BASE__PIPELINE_CACHE_FILE "pipeline.cache"
+
+enum vulkan_base_shader {
+	VULKAN_BASE__SHADER_VERT,
+	VULKAN_BASE__SHADER_FRAG,
+	VULKAN_BASE__SHADER_CULL,
+	VULKAN_BASE__SHADER_VIRTUAL_TEXTURE,
+	VULKAN_BASE__SHADER_COUNT
+};
 
 struct vulkan_base {
+	// Passed as pAllocator to everything created on the instance and device, points at host_allocator
+	const VkAllocationCallbacks *allocator;
+	struct vulkan_allocator host_allocator;
 	VkInstance instance;
 	VkPhysicalDevice physical_device;
 	VkDevice device;
@@ -10,16 +28,57 @@ struct vulkan_base {
 	int queue_family_index;
 	VkSurfaceKHR surface;
 	VkCommandPool command_pool;
+	VkPhysicalDeviceProperties properties;
+	VkPhysicalDeviceMemoryProperties memory_properties;
+	VkPhysicalDeviceFeatures enabled_features;
+	struct vulkan_memory_budget memory_budget;
+	PFN_vkCmdDrawIndexedIndirectCountKHR cmd_draw_indexed_indirect_count;
+	uint32_t api_version;
+	int dynamic_rendering;
+	PFN_vkCmdBeginRenderingKHR cmd_begin_rendering;
+	PFN_vkCmdEndRenderingKHR cmd_end_rendering;
+	// Null unless debug utils are enabled, which VULKAN_BASE_VALIDATION and VULKAN_BASE_PROFILER do
+	PFN_vkCmdBeginDebugUtilsLabelEXT cmd_begin_label;
+	PFN_vkCmdEndDebugUtilsLabelEXT cmd_end_label;
+	PFN_vkQueueBeginDebugUtilsLabelEXT queue_begin_label;
+	PFN_vkQueueEndDebugUtilsLabelEXT queue_end_label;
 #ifdef VULKAN_BASE_VALIDATION
 	VkDebugUtilsMessengerEXT callback;
 #endif
+
+	// Set up by vulkan_base__try_load_files, which only reads files and may run concurrently with try_init
+	struct file__try_read shaders[VULKAN_BASE__SHADER_COUNT];
+	struct file__try_read pipeline_cache_file;
+	VkPipelineCache pipeline_cache;
 };
 
 void vulkan_base__free(struct vulkan_base *this);
 
+// A null create_window_surface gives a headless device without swapchain support
 struct vulkan_base__create_surface {
     VkResult (*create_window_surface)(void *user_data, VkInstance instance, VkSurfaceKHR *surface_out);
     void *user_data;
 };
 
-int vulkan_base__try_init(struct vulkan_base *this, const char **extensions, int extension_count, struct vulkan_base__create_surface callback);
+int vulkan_base__try_init(struct vulkan_base *this, const char **extensions, int extension_count, int flags, struct vulkan_base__create_surface callback);
+
+// Reads the shaders and the saved pipeline cache, a missing pipeline cache is not an error
+int vulkan_base__try_load_files(struct vulkan_base *this);
+void vulkan_base__free_files(struct vulkan_base *this);
+// Needs both try_init and try_load_files, pipelines are created without a cache until this is called
+int vulkan_base__try_init_pipeline_cache(struct vulkan_base *this);
+// Saves the pipeline cache for the next run
+void vulkan_base__free_pipeline_cache(struct vulkan_base *this);
+
+// Debug utils labels for GPU captures and profilers, these do nothing without debug utils
+void vulkan_base__cmd_begin_label(struct vulkan_base *this, VkCommandBuffer command_buffer, const char *name);
+void vulkan_base__cmd_end_label(struct vulkan_base *this, VkCommandBuffer command_buffer);
+void vulkan_base__queue_begin_label(struct vulkan_base *this, const char *name);
+void vulkan_base__queue_end_label(struct vulkan_base *this);
+
+int vulkan_base__find_memory_type(struct vulkan_base *this, uint32_t type_bits, VkMemoryPropertyFlags properties);
+int vulkan_base__try_create_buffer(struct vulkan_base *this, VkDeviceSize size, VkBufferUsageFlags usage, VkMemoryPropertyFlags properties, VkBuffer *buffer_out, VkDeviceMemory *memory_out);
+void vulkan_base__free_buffer(struct vulkan_base *this, VkBuffer buffer, VkDeviceMemory memory);
+// vkAllocateMemory and vkFreeMemory with the allocation counted against memory_budget
+int vulkan_base__try_allocate_memory(struct vulkan_base *this, const VkMemoryAllocateInfo *allocate_info, VkDeviceMemory *memory_out);
+void vulkan_base__free_memory(struct vulkan_base *this, VkDeviceMemory memory);
\ No newline at end of file
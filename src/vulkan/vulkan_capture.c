@@ -0,0 +1,324 @@
+#include <malloc.h>
+#include <string.h>
+#include "vulkan_capture.h"
+#include "../profiler/profiler.h"
+
+static int find_oldest_slot(struct vulkan_capture *this, enum vulkan_capture_slot_state state) {
+	int oldest = -1;
+	for (int i = 0; i < VULKAN_CAPTURE__SLOTS; ++i) {
+		if (this->slots[i].state == state && (oldest < 0 || this->slots[i].frame < this->slots[oldest].frame)) {
+			oldest = i;
+		}
+	}
+	return oldest;
+}
+
+static void *writer_main(void *user_data) {
+	struct vulkan_capture *this = (struct vulkan_capture *) user_data;
+	PROFILER_THREAD_NAME("capture writer");
+
+	pthread_mutex_lock(&this->mutex);
+	while (1) {
+		int slot_index = find_oldest_slot(this, VULKAN_CAPTURE__SLOT_WRITING);
+		if (slot_index < 0) {
+			if (this->stop) {
+				break;
+			}
+			pthread_cond_wait(&this->cond, &this->mutex);
+			continue;
+		}
+		struct vulkan_capture_slot *slot = this->slots + slot_index;
+		VkExtent2D extent = this->extent;
+		VkFormat format = this->format;
+		size_t size = (size_t) this->slot_size;
+		pthread_mutex_unlock(&this->mutex);
+
+		// Only this thread touches the files and a slot in the writing state
+		PROFILER_BEGIN("write_frame");
+		if (fwrite(slot->pixels, 1, size, this->raw_file) == size) {
+			fprintf(this->index_file, "%ld %f %u %u %d %ld\n", slot->frame, slot->time, extent.width, extent.height, (int) format, this->raw_offset);
+			this->raw_offset += (long) size;
+		}
+		PROFILER_END("write_frame");
+
+		pthread_mutex_lock(&this->mutex);
+		slot->state = VULKAN_CAPTURE__SLOT_FREE;
+		++this->written;
+		pthread_cond_broadcast(&this->cond);
+	}
+	pthread_mutex_unlock(&this->mutex);
+	return 0;
+}
+
+int vulkan_capture__try_init(struct vulkan_capture *this, struct vulkan_base *base, const char *path) {
+	this->base = base;
+	this->swapchain = 0;
+	this->command_buffers = 0;
+	this->raw_offset = 0;
+	this->stop = 0;
+	this->frames = 0;
+	this->written = 0;
+	this->dropped = 0;
+	for (int i = 0; i < VULKAN_CAPTURE__SLOTS; ++i) {
+		this->slots[i].state = VULKAN_CAPTURE__SLOT_FREE;
+	}
+
+	char file_name[1024];
+	snprintf(file_name, sizeof(file_name), "%s.raw", path);
+	this->raw_file = fopen(file_name, "wb");
+	if (!this->raw_file) {
+		return -1;
+	}
+	snprintf(file_name, sizeof(file_name), "%s.idx", path);
+	this->index_file = fopen(file_name, "w");
+	if (!this->index_file) {
+		fclose(this->raw_file);
+		return -2;
+	}
+	fprintf(this->index_file, "# frame time width height vk_format offset\n");
+
+	if (pthread_mutex_init(&this->mutex, 0) != 0) {
+		fclose(this->index_file);
+		fclose(this->raw_file);
+		return -3;
+	}
+	if (pthread_cond_init(&this->cond, 0) != 0) {
+		pthread_mutex_destroy(&this->mutex);
+		fclose(this->index_file);
+		fclose(this->raw_file);
+		return -4;
+	}
+	if (pthread_create(&this->writer, 0, writer_main, this) != 0) {
+		pthread_cond_destroy(&this->cond);
+		pthread_mutex_destroy(&this->mutex);
+		fclose(this->index_file);
+		fclose(this->raw_file);
+		return -5;
+	}
+	return 0;
+}
+
+void vulkan_capture__free(struct vulkan_capture *this) {
+	pthread_mutex_lock(&this->mutex);
+	this->stop = 1;
+	pthread_cond_broadcast(&this->cond);
+	pthread_mutex_unlock(&this->mutex);
+	pthread_join(this->writer, 0);
+
+	printf("Captured %ld of %ld frames, dropped %ld\n", this->written, this->frames, this->dropped);
+	pthread_cond_destroy(&this->cond);
+	pthread_mutex_destroy(&this->mutex);
+	fclose(this->index_file);
+	fclose(this->raw_file);
+}
+
+static void free_slots_below(struct vulkan_capture *this, int i) {
+	for (--i; i >= 0; --i) {
+		vkUnmapMemory(this->base->device, this->slots[i].memory);
+		vulkan_base__free_buffer(this->base, this->slots[i].buffer, this->slots[i].memory);
+	}
+}
+
+static int try_create_slots(struct vulkan_capture *this) {
+	// Cached memory is much faster for the writer to read, coherent is the fallback
+	this->coherent = 0;
+	int i = 0;
+	for (; i < VULKAN_CAPTURE__SLOTS; ++i) {
+		struct vulkan_capture_slot *slot = this->slots + i;
+		if (!this->coherent && vulkan_base__try_create_buffer(this->base, this->slot_size, VK_BUFFER_USAGE_TRANSFER_DST_BIT,
+															  VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_CACHED_BIT,
+															  &slot->buffer, &slot->memory) < 0) {
+			if (i > 0) {
+				free_slots_below(this, i);
+				return -1;
+			}
+			this->coherent = 1;
+		}
+		if (this->coherent && vulkan_base__try_create_buffer(this->base, this->slot_size, VK_BUFFER_USAGE_TRANSFER_DST_BIT,
+															 VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT,
+															 &slot->buffer, &slot->memory) < 0) {
+			free_slots_below(this, i);
+			return -1;
+		}
+		if (vkMapMemory(this->base->device, slot->memory, 0, VK_WHOLE_SIZE, 0, (void **) &slot->pixels) != VK_SUCCESS) {
+			vulkan_base__free_buffer(this->base, slot->buffer, slot->memory);
+			free_slots_below(this, i);
+			return -2;
+		}
+		slot->state = VULKAN_CAPTURE__SLOT_FREE;
+	}
+	return 0;
+}
+
+static void record_copy(struct vulkan_capture *this, VkCommandBuffer command_buffer, VkImage image, struct vulkan_capture_slot *slot) {
+	VkImageMemoryBarrier image_barrier;
+	image_barrier.sType = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER;
+	image_barrier.pNext = 0;
+	image_barrier.srcAccessMask = VK_ACCESS_COLOR_ATTACHMENT_WRITE_BIT;
+	image_barrier.dstAccessMask = VK_ACCESS_TRANSFER_READ_BIT;
+	image_barrier.oldLayout = VK_IMAGE_LAYOUT_PRESENT_SRC_KHR;
+	image_barrier.newLayout = VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL;
+	image_barrier.srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+	image_barrier.dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+	image_barrier.image = image;
+	image_barrier.subresourceRange.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
+	image_barrier.subresourceRange.baseMipLevel = 0;
+	image_barrier.subresourceRange.levelCount = 1;
+	image_barrier.subresourceRange.baseArrayLayer = 0;
+	image_barrier.subresourceRange.layerCount = 1;
+	// The frame's command buffer left the image ready to present
+	vkCmdPipelineBarrier(command_buffer, VK_PIPELINE_STAGE_ALL_COMMANDS_BIT, VK_PIPELINE_STAGE_TRANSFER_BIT, 0, 0, 0, 0, 0, 1, &image_barrier);
+
+	VkBufferImageCopy region;
+	region.bufferOffset = 0;
+	region.bufferRowLength = 0;
+	region.bufferImageHeight = 0;
+	region.imageSubresource.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
+	region.imageSubresource.mipLevel = 0;
+	region.imageSubresource.baseArrayLayer = 0;
+	region.imageSubresource.layerCount = 1;
+	region.imageOffset.x = 0;
+	region.imageOffset.y = 0;
+	region.imageOffset.z = 0;
+	region.imageExtent.width = this->extent.width;
+	region.imageExtent.height = this->extent.height;
+	region.imageExtent.depth = 1;
+	vkCmdCopyImageToBuffer(command_buffer, image, VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL, slot->buffer, 1, &region);
+
+	image_barrier.srcAccessMask = 0;
+	image_barrier.dstAccessMask = 0;
+	image_barrier.oldLayout = VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL;
+	image_barrier.newLayout = VK_IMAGE_LAYOUT_PRESENT_SRC_KHR;
+
+	VkBufferMemoryBarrier buffer_barrier;
+	buffer_barrier.sType = VK_STRUCTURE_TYPE_BUFFER_MEMORY_BARRIER;
+	buffer_barrier.pNext = 0;
+	buffer_barrier.srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+	buffer_barrier.dstAccessMask = VK_ACCESS_HOST_READ_BIT;
+	buffer_barrier.srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+	buffer_barrier.dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+	buffer_barrier.buffer = slot->buffer;
+	buffer_barrier.offset = 0;
+	buffer_barrier.size = VK_WHOLE_SIZE;
+	vkCmdPipelineBarrier(command_buffer, VK_PIPELINE_STAGE_TRANSFER_BIT, VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT | VK_PIPELINE_STAGE_HOST_BIT, 0,
+						 0, 0, 1, &buffer_barrier, 1, &image_barrier);
+}
+
+static int try_record_command_buffers(struct vulkan_capture *this) {
+	uint32_t count = this->swapchain->image_count*VULKAN_CAPTURE__SLOTS;
+	this->command_buffers = malloc(count*sizeof(*this->command_buffers));
+	if (!this->command_buffers) {
+		return -1;
+	}
+
+	VkCommandBufferAllocateInfo allocate_info;
+	allocate_info.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_ALLOCATE_INFO;
+	allocate_info.pNext = 0;
+	allocate_info.commandPool = this->base->command_pool;
+	allocate_info.level = VK_COMMAND_BUFFER_LEVEL_PRIMARY;
+	allocate_info.commandBufferCount = count;
+
+	if (vkAllocateCommandBuffers(this->base->device, &allocate_info, this->command_buffers) != VK_SUCCESS) {
+		free(this->command_buffers);
+		return -2;
+	}
+
+	// One per image and slot, so nothing is recorded while capturing
+	for (uint32_t i = 0; i < count; ++i) {
+		VkCommandBufferBeginInfo begin_info;
+		begin_info.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO;
+		begin_info.pNext = 0;
+		begin_info.flags = VK_COMMAND_BUFFER_USAGE_SIMULTANEOUS_USE_BIT;
+		begin_info.pInheritanceInfo = 0;
+
+		if (vkBeginCommandBuffer(this->command_buffers[i], &begin_info) != VK_SUCCESS) {
+			vkFreeCommandBuffers(this->base->device, this->base->command_pool, count, this->command_buffers);
+			free(this->command_buffers);
+			return -3;
+		}
+		record_copy(this, this->command_buffers[i], this->swapchain->images[i/VULKAN_CAPTURE__SLOTS], this->slots + i%VULKAN_CAPTURE__SLOTS);
+		if (vkEndCommandBuffer(this->command_buffers[i]) != VK_SUCCESS) {
+			vkFreeCommandBuffers(this->base->device, this->base->command_pool, count, this->command_buffers);
+			free(this->command_buffers);
+			return -4;
+		}
+	}
+	return 0;
+}
+
+int vulkan_capture__try_init_targets(struct vulkan_capture *this, struct vulkan_swapchain *swapchain) {
+	if (!(swapchain->image_usage & VK_IMAGE_USAGE_TRANSFER_SRC_BIT)) {
+		return -1;
+	}
+	this->swapchain = swapchain;
+	this->extent = swapchain->extent;
+	this->format = swapchain->surface_format.format;
+	this->slot_size = (VkDeviceSize) this->extent.width*this->extent.height*4;
+
+	if (try_create_slots(this) < 0) {
+		return -2;
+	}
+	if (try_record_command_buffers(this) < 0) {
+		free_slots_below(this, VULKAN_CAPTURE__SLOTS);
+		return -3;
+	}
+	return 0;
+}
+
+void vulkan_capture__free_targets(struct vulkan_capture *this) {
+	for (int i = 0; i < VULKAN_CAPTURE__SLOTS; ++i) {
+		if (this->slots[i].state == VULKAN_CAPTURE__SLOT_IN_FLIGHT) {
+			vulkan_capture__complete(this, this->slots[i].resources_index);
+		}
+	}
+	pthread_mutex_lock(&this->mutex);
+	while (find_oldest_slot(this, VULKAN_CAPTURE__SLOT_WRITING) >= 0) {
+		pthread_cond_wait(&this->cond, &this->mutex);
+	}
+	pthread_mutex_unlock(&this->mutex);
+
+	vkFreeCommandBuffers(this->base->device, this->base->command_pool, this->swapchain->image_count*VULKAN_CAPTURE__SLOTS, this->command_buffers);
+	free(this->command_buffers);
+	free_slots_below(this, VULKAN_CAPTURE__SLOTS);
+}
+
+VkCommandBuffer vulkan_capture__begin_frame(struct vulkan_capture *this, uint32_t image_index, int resources_index, double time) {
+	++this->frames;
+	pthread_mutex_lock(&this->mutex);
+	int slot_index = find_oldest_slot(this, VULKAN_CAPTURE__SLOT_FREE);
+	if (slot_index < 0) {
+		++this->dropped;
+		pthread_mutex_unlock(&this->mutex);
+		return VK_NULL_HANDLE;
+	}
+	struct vulkan_capture_slot *slot = this->slots + slot_index;
+	slot->state = VULKAN_CAPTURE__SLOT_IN_FLIGHT;
+	pthread_mutex_unlock(&this->mutex);
+
+	slot->resources_index = resources_index;
+	slot->frame = this->frames - 1;
+	slot->time = time;
+	return this->command_buffers[image_index*VULKAN_CAPTURE__SLOTS + slot_index];
+}
+
+void vulkan_capture__complete(struct vulkan_capture *this, int resources_index) {
+	for (int i = 0; i < VULKAN_CAPTURE__SLOTS; ++i) {
+		struct vulkan_capture_slot *slot = this->slots + i;
+		if (slot->state != VULKAN_CAPTURE__SLOT_IN_FLIGHT || slot->resources_index != resources_index) {
+			continue;
+		}
+		if (!this->coherent) {
+			VkMappedMemoryRange range;
+			range.sType = VK_STRUCTURE_TYPE_MAPPED_MEMORY_RANGE;
+			range.pNext = 0;
+			range.memory = slot->memory;
+			range.offset = 0;
+			range.size = VK_WHOLE_SIZE;
+			vkInvalidateMappedMemoryRanges(this->base->device, 1, &range);
+		}
+		pthread_mutex_lock(&this->mutex);
+		slot->state = VULKAN_CAPTURE__SLOT_WRITING;
+		pthread_cond_broadcast(&this->cond);
+		pthread_mutex_unlock(&this->mutex);
+	}
+}
@@ -0,0 +1,64 @@
+#pragma once
+
+#include <stdio.h>
+#include <pthread.h>
+#include <vulkan/vulkan.h>
+#include "vulkan_base.h"
+#include "vulkan_swapchain.h"
+
+#define VULKAN_CAPTURE__SLOTS 4
+
+enum vulkan_capture_slot_state {
+	VULKAN_CAPTURE__SLOT_FREE,
+	VULKAN_CAPTURE__SLOT_IN_FLIGHT,
+	VULKAN_CAPTURE__SLOT_WRITING
+};
+
+struct vulkan_capture_slot {
+	VkBuffer buffer;
+	VkDeviceMemory memory;
+	unsigned char *pixels;
+	enum vulkan_capture_slot_state state;
+	int resources_index;
+	long frame;
+	double time;
+};
+
+// Copies presented images into host-visible slots that a writer thread streams to disk.
+// Frames are dropped instead of waiting when every slot is still in flight or being written.
+struct vulkan_capture {
+	struct vulkan_base *base;
+	struct vulkan_swapchain *swapchain;
+	FILE *raw_file;
+	FILE *index_file;
+	long raw_offset;
+
+	struct vulkan_capture_slot slots[VULKAN_CAPTURE__SLOTS];
+	VkDeviceSize slot_size;
+	VkExtent2D extent;
+	VkFormat format;
+	int coherent;
+	VkCommandBuffer *command_buffers;
+
+	pthread_t writer;
+	pthread_mutex_t mutex;
+	pthread_cond_t cond;
+	int stop;
+
+	long frames;
+	long written;
+	long dropped;
+};
+
+int vulkan_capture__try_init(struct vulkan_capture *this, struct vulkan_base *base, const char *path);
+void vulkan_capture__free(struct vulkan_capture *this);
+
+// The swapchain images need VK_IMAGE_USAGE_TRANSFER_SRC_BIT
+int vulkan_capture__try_init_targets(struct vulkan_capture *this, struct vulkan_swapchain *swapchain);
+// The device must be idle
+void vulkan_capture__free_targets(struct vulkan_capture *this);
+
+// Returns a command buffer to submit after the frame's own, or VK_NULL_HANDLE if the frame is dropped
+VkCommandBuffer vulkan_capture__begin_frame(struct vulkan_capture *this, uint32_t image_index, int resources_index, double time);
+// Call once the fence of resources_index has been waited on
+void vulkan_capture__complete(struct vulkan_capture *this, int resources_index);
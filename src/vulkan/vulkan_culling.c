@@ -0,0 +1,652 @@
+#include <malloc.h>
+#include <string.h>
+#include "vulkan_culling.h"
+
+#define WORKGROUP_SIZE 64
+#define DESCRIPTOR_COUNT 5
+// The only dynamic one, at the offset of the view being culled
+#define OBJECT_LOD_BINDING 4
+// A level of detail is used while its error covers at most this much of the screen
+#define LOD_PIXEL_ERROR 1.0f
+// Switching to a coarser level needs this much margin below LOD_PIXEL_ERROR, so objects at the edge don't flicker
+#define LOD_HYSTERESIS 0.25f
+
+struct cull_push_constants {
+	float frustum_planes[6][4];
+	uint32_t object_count;
+	uint32_t lod_count;
+	float lod_pixels_per_unit;
+	float lod_pixel_error;
+	float lod_hysteresis;
+};
+
+// Clip space, where Vulkan keeps z between 0 and 1
+static const float default_frustum_planes[6][4] = {
+	{ 1.0f, 0.0f, 0.0f, 1.0f },
+	{ -1.0f, 0.0f, 0.0f, 1.0f },
+	{ 0.0f, 1.0f, 0.0f, 1.0f },
+	{ 0.0f, -1.0f, 0.0f, 1.0f },
+	{ 0.0f, 0.0f, 1.0f, 0.0f },
+	{ 0.0f, 0.0f, -1.0f, 1.0f }
+};
+
+static void free_buffers(struct vulkan_culling *this) {
+	vkUnmapMemory(this->base->device, this->object_lod_memory);
+	vulkan_base__free_buffer(this->base, this->object_lod_buffer, this->object_lod_memory);
+	vulkan_base__free_buffer(this->base, this->lod_buffer, this->lod_memory);
+	vkUnmapMemory(this->base->device, this->object_memory);
+	vulkan_base__free_buffer(this->base, this->count_buffer, this->count_memory);
+	vulkan_base__free_buffer(this->base, this->indirect_buffer, this->indirect_memory);
+	vulkan_base__free_buffer(this->base, this->object_buffer, this->object_memory);
+}
+
+static void free_from_descriptor_set(struct vulkan_culling *this) {
+	vkDestroyDescriptorPool(this->base->device, this->descriptor_pool, this->base->allocator);
+	vkDestroyDescriptorSetLayout(this->base->device, this->descriptor_set_layout, this->base->allocator);
+	free_buffers(this);
+}
+
+static void free_from_pipeline(struct vulkan_culling *this) {
+	if (this->gpu_driven) {
+		vkDestroyPipeline(this->base->device, this->pipeline, this->base->allocator);
+		vkDestroyPipelineLayout(this->base->device, this->pipeline_layout, this->base->allocator);
+		free_from_descriptor_set(this);
+	} else {
+		free_buffers(this);
+	}
+}
+
+void vulkan_culling__free(struct vulkan_culling *this) {
+	vulkan_culling__free_updates(this);
+	free_from_pipeline(this);
+	free(this->views);
+	free(this->host_objects);
+}
+
+static int try_create_lod_buffers(struct vulkan_culling *this) {
+	VkMemoryPropertyFlags host_memory = VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT;
+
+	VkDeviceSize lods_size = this->mesh->lod_count*sizeof(struct mesh_lod);
+	if (vulkan_base__try_create_buffer(this->base, lods_size, VK_BUFFER_USAGE_STORAGE_BUFFER_BIT, host_memory, &this->lod_buffer, &this->lod_memory) < 0) {
+		return -1;
+	}
+	void *lods;
+	if (vkMapMemory(this->base->device, this->lod_memory, 0, VK_WHOLE_SIZE, 0, &lods) != VK_SUCCESS) {
+		vulkan_base__free_buffer(this->base, this->lod_buffer, this->lod_memory);
+		return -2;
+	}
+	memcpy(lods, this->mesh->lods, (size_t) lods_size);
+	vkUnmapMemory(this->base->device, this->lod_memory);
+
+	// Host visible so the levels start at full detail without a fill, and so CPU culling can keep its own in it. Each
+	// view's slice starts at an offset the descriptor can be bound at.
+	VkDeviceSize alignment = this->base->properties.limits.minStorageBufferOffsetAlignment;
+	VkDeviceSize stride = (this->object_count*sizeof(uint32_t) + alignment - 1)/alignment*alignment;
+	if (vulkan_base__try_create_buffer(this->base, stride*(VkDeviceSize) this->view_count, VK_BUFFER_USAGE_STORAGE_BUFFER_BIT, host_memory,
+									   &this->object_lod_buffer, &this->object_lod_memory) < 0) {
+		vulkan_base__free_buffer(this->base, this->lod_buffer, this->lod_memory);
+		return -3;
+	}
+	unsigned char *object_lods;
+	if (vkMapMemory(this->base->device, this->object_lod_memory, 0, VK_WHOLE_SIZE, 0, (void **) &object_lods) != VK_SUCCESS) {
+		vulkan_base__free_buffer(this->base, this->object_lod_buffer, this->object_lod_memory);
+		vulkan_base__free_buffer(this->base, this->lod_buffer, this->lod_memory);
+		return -4;
+	}
+	memset(object_lods, 0, (size_t) (stride*(VkDeviceSize) this->view_count));
+	for (int i = 0; i < this->view_count; ++i) {
+		struct vulkan_culling_view *view = this->views + i;
+		view->culling = this;
+		view->lod_pixels_per_unit = 0.0f;
+		view->object_lods = (uint32_t *) (object_lods + (VkDeviceSize) i*stride);
+		view->object_lod_offset = (uint32_t) ((VkDeviceSize) i*stride);
+	}
+	return 0;
+}
+
+static int try_create_buffers(struct vulkan_culling *this, const struct vulkan_culling_object *objects) {
+	VkMemoryPropertyFlags host_memory = VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT;
+
+	if (vulkan_base__try_create_buffer(this->base, this->object_count*sizeof(*objects),
+									   VK_BUFFER_USAGE_STORAGE_BUFFER_BIT | VK_BUFFER_USAGE_VERTEX_BUFFER_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT, host_memory,
+									   &this->object_buffer, &this->object_memory) < 0) {
+		return -1;
+	}
+	if (vkMapMemory(this->base->device, this->object_memory, 0, VK_WHOLE_SIZE, 0, (void **) &this->objects) != VK_SUCCESS) {
+		vulkan_base__free_buffer(this->base, this->object_buffer, this->object_memory);
+		return -2;
+	}
+	memcpy(this->objects, objects, this->object_count*sizeof(*objects));
+
+	if (vulkan_base__try_create_buffer(this->base, this->object_count*sizeof(VkDrawIndexedIndirectCommand),
+									   VK_BUFFER_USAGE_STORAGE_BUFFER_BIT | VK_BUFFER_USAGE_INDIRECT_BUFFER_BIT, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT,
+									   &this->indirect_buffer, &this->indirect_memory) < 0) {
+		vkUnmapMemory(this->base->device, this->object_memory);
+		vulkan_base__free_buffer(this->base, this->object_buffer, this->object_memory);
+		return -3;
+	}
+
+	if (vulkan_base__try_create_buffer(this->base, sizeof(uint32_t),
+									   VK_BUFFER_USAGE_STORAGE_BUFFER_BIT | VK_BUFFER_USAGE_INDIRECT_BUFFER_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT,
+									   VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, &this->count_buffer, &this->count_memory) < 0) {
+		vulkan_base__free_buffer(this->base, this->indirect_buffer, this->indirect_memory);
+		vkUnmapMemory(this->base->device, this->object_memory);
+		vulkan_base__free_buffer(this->base, this->object_buffer, this->object_memory);
+		return -4;
+	}
+
+	if (try_create_lod_buffers(this) < 0) {
+		vulkan_base__free_buffer(this->base, this->count_buffer, this->count_memory);
+		vulkan_base__free_buffer(this->base, this->indirect_buffer, this->indirect_memory);
+		vkUnmapMemory(this->base->device, this->object_memory);
+		vulkan_base__free_buffer(this->base, this->object_buffer, this->object_memory);
+		return -5;
+	}
+
+	return 0;
+}
+
+static int try_create_descriptor_set(struct vulkan_culling *this) {
+	VkDescriptorSetLayoutBinding bindings[DESCRIPTOR_COUNT];
+	for (uint32_t i = 0; i < DESCRIPTOR_COUNT; ++i) {
+		bindings[i].binding = i;
+		bindings[i].descriptorType = i == OBJECT_LOD_BINDING ? VK_DESCRIPTOR_TYPE_STORAGE_BUFFER_DYNAMIC : VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
+		bindings[i].descriptorCount = 1;
+		bindings[i].stageFlags = VK_SHADER_STAGE_COMPUTE_BIT;
+		bindings[i].pImmutableSamplers = 0;
+	}
+
+	VkDescriptorSetLayoutCreateInfo layout_create_info;
+	layout_create_info.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_LAYOUT_CREATE_INFO;
+	layout_create_info.pNext = 0;
+	layout_create_info.flags = 0;
+	layout_create_info.bindingCount = DESCRIPTOR_COUNT;
+	layout_create_info.pBindings = bindings;
+
+	if (vkCreateDescriptorSetLayout(this->base->device, &layout_create_info, this->base->allocator, &this->descriptor_set_layout) != VK_SUCCESS) {
+		return -1;
+	}
+
+	VkDescriptorPoolSize pool_sizes[2];
+	pool_sizes[0].type = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
+	pool_sizes[0].descriptorCount = DESCRIPTOR_COUNT - 1;
+	pool_sizes[1].type = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER_DYNAMIC;
+	pool_sizes[1].descriptorCount = 1;
+
+	VkDescriptorPoolCreateInfo pool_create_info;
+	pool_create_info.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_POOL_CREATE_INFO;
+	pool_create_info.pNext = 0;
+	pool_create_info.flags = 0;
+	pool_create_info.maxSets = 1;
+	pool_create_info.poolSizeCount = 2;
+	pool_create_info.pPoolSizes = pool_sizes;
+
+	if (vkCreateDescriptorPool(this->base->device, &pool_create_info, this->base->allocator, &this->descriptor_pool) != VK_SUCCESS) {
+		vkDestroyDescriptorSetLayout(this->base->device, this->descriptor_set_layout, this->base->allocator);
+		return -2;
+	}
+
+	VkDescriptorSetAllocateInfo allocate_info;
+	allocate_info.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_ALLOCATE_INFO;
+	allocate_info.pNext = 0;
+	allocate_info.descriptorPool = this->descriptor_pool;
+	allocate_info.descriptorSetCount = 1;
+	allocate_info.pSetLayouts = &this->descriptor_set_layout;
+
+	if (vkAllocateDescriptorSets(this->base->device, &allocate_info, &this->descriptor_set) != VK_SUCCESS) {
+		vkDestroyDescriptorPool(this->base->device, this->descriptor_pool, this->base->allocator);
+		vkDestroyDescriptorSetLayout(this->base->device, this->descriptor_set_layout, this->base->allocator);
+		return -3;
+	}
+
+	VkDescriptorBufferInfo buffer_infos[DESCRIPTOR_COUNT];
+	buffer_infos[0].buffer = this->object_buffer;
+	buffer_infos[1].buffer = this->indirect_buffer;
+	buffer_infos[2].buffer = this->count_buffer;
+	buffer_infos[3].buffer = this->lod_buffer;
+	buffer_infos[4].buffer = this->object_lod_buffer;
+
+	VkWriteDescriptorSet writes[DESCRIPTOR_COUNT];
+	for (uint32_t i = 0; i < DESCRIPTOR_COUNT; ++i) {
+		buffer_infos[i].offset = 0;
+		buffer_infos[i].range = i == OBJECT_LOD_BINDING ? this->object_count*sizeof(uint32_t) : VK_WHOLE_SIZE;
+
+		writes[i].sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
+		writes[i].pNext = 0;
+		writes[i].dstSet = this->descriptor_set;
+		writes[i].dstBinding = i;
+		writes[i].dstArrayElement = 0;
+		writes[i].descriptorCount = 1;
+		writes[i].descriptorType = bindings[i].descriptorType;
+		writes[i].pImageInfo = 0;
+		writes[i].pBufferInfo = buffer_infos + i;
+		writes[i].pTexelBufferView = 0;
+	}
+	vkUpdateDescriptorSets(this->base->device, DESCRIPTOR_COUNT, writes, 0, 0);
+	return 0;
+}
+
+static int try_create_pipeline(struct vulkan_culling *this) {
+	struct file__try_read *shader_read = this->base->shaders + VULKAN_BASE__SHADER_CULL;
+	VkShaderModuleCreateInfo module_create_info;
+	module_create_info.sType = VK_STRUCTURE_TYPE_SHADER_MODULE_CREATE_INFO;
+	module_create_info.pNext = 0;
+	module_create_info.flags = 0;
+	module_create_info.pCode = (uint32_t *) shader_read->malloc_bytes;
+	module_create_info.codeSize = (size_t) shader_read->length;
+
+	VkShaderModule shader_module;
+	if (vkCreateShaderModule(this->base->device, &module_create_info, this->base->allocator, &shader_module) != VK_SUCCESS) {
+		return -2;
+	}
+
+	VkPushConstantRange push_constant_range;
+	push_constant_range.stageFlags = VK_SHADER_STAGE_COMPUTE_BIT;
+	push_constant_range.offset = 0;
+	push_constant_range.size = sizeof(struct cull_push_constants);
+
+	VkPipelineLayoutCreateInfo layout_create_info;
+	layout_create_info.sType = VK_STRUCTURE_TYPE_PIPELINE_LAYOUT_CREATE_INFO;
+	layout_create_info.pNext = 0;
+	layout_create_info.flags = 0;
+	layout_create_info.setLayoutCount = 1;
+	layout_create_info.pSetLayouts = &this->descriptor_set_layout;
+	layout_create_info.pushConstantRangeCount = 1;
+	layout_create_info.pPushConstantRanges = &push_constant_range;
+
+	if (vkCreatePipelineLayout(this->base->device, &layout_create_info, this->base->allocator, &this->pipeline_layout) != VK_SUCCESS) {
+		vkDestroyShaderModule(this->base->device, shader_module, this->base->allocator);
+		return -3;
+	}
+
+	VkBool32 compact = (VkBool32) this->compact;
+	VkSpecializationMapEntry specialization_entry;
+	specialization_entry.constantID = 0;
+	specialization_entry.offset = 0;
+	specialization_entry.size = sizeof(compact);
+
+	VkSpecializationInfo specialization_info;
+	specialization_info.mapEntryCount = 1;
+	specialization_info.pMapEntries = &specialization_entry;
+	specialization_info.dataSize = sizeof(compact);
+	specialization_info.pData = &compact;
+
+	VkComputePipelineCreateInfo pipeline_create_info;
+	pipeline_create_info.sType = VK_STRUCTURE_TYPE_COMPUTE_PIPELINE_CREATE_INFO;
+	pipeline_create_info.pNext = 0;
+	pipeline_create_info.flags = 0;
+	pipeline_create_info.stage.sType = VK_STRUCTURE_TYPE_PIPELINE_SHADER_STAGE_CREATE_INFO;
+	pipeline_create_info.stage.pNext = 0;
+	pipeline_create_info.stage.flags = 0;
+	pipeline_create_info.stage.stage = VK_SHADER_STAGE_COMPUTE_BIT;
+	pipeline_create_info.stage.module = shader_module;
+	pipeline_create_info.stage.pName = "main";
+	pipeline_create_info.stage.pSpecializationInfo = &specialization_info;
+	pipeline_create_info.layout = this->pipeline_layout;
+	pipeline_create_info.basePipelineHandle = VK_NULL_HANDLE;
+	pipeline_create_info.basePipelineIndex = -1;
+
+	if (vkCreateComputePipelines(this->base->device, this->base->pipeline_cache, 1, &pipeline_create_info, this->base->allocator, &this->pipeline) != VK_SUCCESS) {
+		vkDestroyPipelineLayout(this->base->device, this->pipeline_layout, this->base->allocator);
+		vkDestroyShaderModule(this->base->device, shader_module, this->base->allocator);
+		return -4;
+	}
+	vkDestroyShaderModule(this->base->device, shader_module, this->base->allocator);
+	return 0;
+}
+
+int vulkan_culling__try_init(struct vulkan_culling *this, struct vulkan_base *base, const struct vulkan_mesh *mesh, const struct vulkan_culling_object *objects,
+							 uint32_t object_count, int view_count) {
+	this->base = base;
+	this->mesh = mesh;
+	this->object_count = object_count;
+	this->gpu_driven = base->enabled_features.drawIndirectFirstInstance == VK_TRUE;
+	this->compact = base->cmd_draw_indexed_indirect_count && base->enabled_features.multiDrawIndirect == VK_TRUE;
+	this->update_count = 0;
+	memcpy(this->frustum_planes, default_frustum_planes, sizeof(this->frustum_planes));
+	this->view_count = view_count;
+	this->views = malloc(view_count*sizeof(*this->views));
+	this->host_objects = malloc(object_count*sizeof(*objects));
+	if (!this->views || !this->host_objects) {
+		free(this->views);
+		free(this->host_objects);
+		return -1;
+	}
+	memcpy(this->host_objects, objects, object_count*sizeof(*objects));
+
+	int result = try_create_buffers(this, objects);
+	if (result < 0) {
+		free(this->views);
+		free(this->host_objects);
+		return -2;
+	}
+	if (!this->gpu_driven) {
+		return 0;
+	}
+
+	result = try_create_descriptor_set(this);
+	if (result < 0) {
+		free_buffers(this);
+		free(this->views);
+		free(this->host_objects);
+		return -3;
+	}
+
+	result = try_create_pipeline(this);
+	if (result < 0) {
+		free_from_descriptor_set(this);
+		free(this->views);
+		free(this->host_objects);
+		return -4;
+	}
+	return 0;
+}
+
+int vulkan_culling__try_init_grid(struct vulkan_culling *this, struct vulkan_base *base, const struct vulkan_mesh *mesh, int grid_size, int view_count) {
+	struct vulkan_culling_object *objects = malloc((size_t) (grid_size*grid_size)*sizeof(*objects));
+	if (!objects) {
+		return -1;
+	}
+	float spacing = 2.4f/grid_size;
+	for (int y = 0; y < grid_size; ++y) {
+		for (int x = 0; x < grid_size; ++x) {
+			struct vulkan_culling_object *object = objects + y*grid_size + x;
+			object->center[0] = -1.2f + (x + 0.5f)*spacing;
+			object->center[1] = -1.2f + (y + 0.5f)*spacing;
+			object->center[2] = 0.0f;
+			object->radius = 0.5f*spacing;
+		}
+	}
+	int result = vulkan_culling__try_init(this, base, mesh, objects, (uint32_t) (grid_size*grid_size), view_count);
+	free(objects);
+	return result < 0 ? -2 : 0;
+}
+
+static void record_update(struct vulkan_culling *this, VkCommandBuffer command_buffer, VkBuffer update_buffer) {
+	VkPipelineStageFlags read_stages = VK_PIPELINE_STAGE_VERTEX_INPUT_BIT;
+	VkAccessFlags read_access = VK_ACCESS_VERTEX_ATTRIBUTE_READ_BIT;
+	if (this->gpu_driven) {
+		read_stages |= VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT;
+		read_access |= VK_ACCESS_SHADER_READ_BIT;
+	}
+	// Earlier frames must be done reading before the copy overwrites the objects
+	vkCmdPipelineBarrier(command_buffer, read_stages, VK_PIPELINE_STAGE_TRANSFER_BIT, 0, 0, 0, 0, 0, 0, 0);
+
+	VkBufferCopy region;
+	region.srcOffset = 0;
+	region.dstOffset = 0;
+	region.size = this->object_count*sizeof(struct vulkan_culling_object);
+	vkCmdCopyBuffer(command_buffer, update_buffer, this->object_buffer, 1, &region);
+
+	VkBufferMemoryBarrier barrier;
+	barrier.sType = VK_STRUCTURE_TYPE_BUFFER_MEMORY_BARRIER;
+	barrier.pNext = 0;
+	barrier.srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+	barrier.dstAccessMask = read_access;
+	barrier.srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+	barrier.dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+	barrier.buffer = this->object_buffer;
+	barrier.offset = 0;
+	barrier.size = VK_WHOLE_SIZE;
+	vkCmdPipelineBarrier(command_buffer, VK_PIPELINE_STAGE_TRANSFER_BIT, read_stages, 0, 0, 0, 1, &barrier, 0, 0);
+}
+
+static void free_updates_below(struct vulkan_culling *this, int i) {
+	for (--i; i >= 0; --i) {
+		vkUnmapMemory(this->base->device, this->update_memories[i]);
+		vulkan_base__free_buffer(this->base, this->update_buffers[i], this->update_memories[i]);
+	}
+	free(this->update_command_buffers);
+	free(this->update_objects);
+	free(this->update_memories);
+	free(this->update_buffers);
+}
+
+void vulkan_culling__free_updates(struct vulkan_culling *this) {
+	if (this->update_count == 0) {
+		return;
+	}
+	vkFreeCommandBuffers(this->base->device, this->base->command_pool, (uint32_t) this->update_count, this->update_command_buffers);
+	free_updates_below(this, this->update_count);
+	this->update_count = 0;
+}
+
+int vulkan_culling__try_init_updates(struct vulkan_culling *this, int resource_count) {
+	this->update_buffers = malloc(resource_count*sizeof(*this->update_buffers));
+	this->update_memories = malloc(resource_count*sizeof(*this->update_memories));
+	this->update_objects = malloc(resource_count*sizeof(*this->update_objects));
+	this->update_command_buffers = malloc(resource_count*sizeof(*this->update_command_buffers));
+	if (!this->update_buffers || !this->update_memories || !this->update_objects || !this->update_command_buffers) {
+		free_updates_below(this, 0);
+		return -1;
+	}
+
+	VkDeviceSize size = this->object_count*sizeof(struct vulkan_culling_object);
+	for (int i = 0; i < resource_count; ++i) {
+		if (vulkan_base__try_create_buffer(this->base, size, VK_BUFFER_USAGE_TRANSFER_SRC_BIT,
+										   VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT,
+										   this->update_buffers + i, this->update_memories + i) < 0) {
+			free_updates_below(this, i);
+			return -2;
+		}
+		if (vkMapMemory(this->base->device, this->update_memories[i], 0, VK_WHOLE_SIZE, 0, (void **) (this->update_objects + i)) != VK_SUCCESS) {
+			vulkan_base__free_buffer(this->base, this->update_buffers[i], this->update_memories[i]);
+			free_updates_below(this, i);
+			return -3;
+		}
+	}
+
+	VkCommandBufferAllocateInfo allocate_info;
+	allocate_info.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_ALLOCATE_INFO;
+	allocate_info.pNext = 0;
+	allocate_info.commandPool = this->base->command_pool;
+	allocate_info.level = VK_COMMAND_BUFFER_LEVEL_PRIMARY;
+	allocate_info.commandBufferCount = (uint32_t) resource_count;
+	if (vkAllocateCommandBuffers(this->base->device, &allocate_info, this->update_command_buffers) != VK_SUCCESS) {
+		free_updates_below(this, resource_count);
+		return -4;
+	}
+
+	VkCommandBufferBeginInfo begin_info;
+	begin_info.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO;
+	begin_info.pNext = 0;
+	begin_info.flags = 0;
+	begin_info.pInheritanceInfo = 0;
+	for (int i = 0; i < resource_count; ++i) {
+		if (vkBeginCommandBuffer(this->update_command_buffers[i], &begin_info) != VK_SUCCESS) {
+			vkFreeCommandBuffers(this->base->device, this->base->command_pool, (uint32_t) resource_count, this->update_command_buffers);
+			free_updates_below(this, resource_count);
+			return -5;
+		}
+		record_update(this, this->update_command_buffers[i], this->update_buffers[i]);
+		if (vkEndCommandBuffer(this->update_command_buffers[i]) != VK_SUCCESS) {
+			vkFreeCommandBuffers(this->base->device, this->base->command_pool, (uint32_t) resource_count, this->update_command_buffers);
+			free_updates_below(this, resource_count);
+			return -6;
+		}
+	}
+	this->update_count = resource_count;
+	return 0;
+}
+
+VkCommandBuffer vulkan_culling__update_objects(struct vulkan_culling *this, int resources_index, const struct vulkan_culling_object *objects) {
+	memcpy(this->update_objects[resources_index], objects, this->object_count*sizeof(*objects));
+	memcpy(this->host_objects, objects, this->object_count*sizeof(*objects));
+	return this->update_command_buffers[resources_index];
+}
+
+void vulkan_culling__set_lod_scale(struct vulkan_culling *this, int view, float pixels_per_unit) {
+	this->views[view].lod_pixels_per_unit = pixels_per_unit;
+}
+
+// Errors grow with the level, so this is the last level within max_pixels
+static uint32_t coarsest_lod(const struct vulkan_mesh *mesh, float radius_pixels, float max_pixels) {
+	uint32_t lod = 0;
+	while (lod + 1 < mesh->lod_count && mesh->lods[lod + 1].error*radius_pixels <= max_pixels) {
+		++lod;
+	}
+	return lod;
+}
+
+// Mirrors cull.comp, finer levels are taken right away and coarser ones only with room to spare
+static uint32_t select_lod(const struct vulkan_culling_view *view, const struct vulkan_culling_object *object, uint32_t current) {
+	const struct vulkan_mesh *mesh = view->culling->mesh;
+	float radius_pixels = object->radius*view->lod_pixels_per_unit;
+	uint32_t lod = coarsest_lod(mesh, radius_pixels, LOD_PIXEL_ERROR);
+	if (lod < current) {
+		return lod;
+	}
+	uint32_t relaxed = coarsest_lod(mesh, radius_pixels, LOD_PIXEL_ERROR*(1.0f - LOD_HYSTERESIS));
+	return relaxed > current ? relaxed : current;
+}
+
+static int is_visible(struct vulkan_culling *this, const struct vulkan_culling_object *object) {
+	for (int i = 0; i < 6; ++i) {
+		const float *plane = this->frustum_planes[i];
+		float distance = plane[0]*object->center[0] + plane[1]*object->center[1] + plane[2]*object->center[2] + plane[3];
+		if (distance < -object->radius) {
+			return 0;
+		}
+	}
+	return 1;
+}
+
+static void record_reset(void *user_data, VkCommandBuffer command_buffer) {
+	struct vulkan_culling *this = (struct vulkan_culling *) user_data;
+	vkCmdFillBuffer(command_buffer, this->count_buffer, 0, sizeof(uint32_t), 0);
+}
+
+static void record_cull(void *user_data, VkCommandBuffer command_buffer) {
+	struct vulkan_culling_view *view = (struct vulkan_culling_view *) user_data;
+	struct vulkan_culling *this = view->culling;
+
+	struct cull_push_constants push_constants;
+	memcpy(push_constants.frustum_planes, this->frustum_planes, sizeof(push_constants.frustum_planes));
+	push_constants.object_count = this->object_count;
+	push_constants.lod_count = this->mesh->lod_count;
+	push_constants.lod_pixels_per_unit = view->lod_pixels_per_unit;
+	push_constants.lod_pixel_error = LOD_PIXEL_ERROR;
+	push_constants.lod_hysteresis = LOD_HYSTERESIS;
+
+	vkCmdBindPipeline(command_buffer, VK_PIPELINE_BIND_POINT_COMPUTE, this->pipeline);
+	vkCmdBindDescriptorSets(command_buffer, VK_PIPELINE_BIND_POINT_COMPUTE, this->pipeline_layout, 0, 1, &this->descriptor_set, 1, &view->object_lod_offset);
+	vkCmdPushConstants(command_buffer, this->pipeline_layout, VK_SHADER_STAGE_COMPUTE_BIT, 0, sizeof(push_constants), &push_constants);
+	vkCmdDispatch(command_buffer, (this->object_count + WORKGROUP_SIZE - 1)/WORKGROUP_SIZE, 1, 1);
+}
+
+int vulkan_culling__try_add_passes(struct vulkan_culling *this, struct vulkan_render_graph *graph, int view) {
+	this->graph_object_buffer = vulkan_render_graph__import_buffer(graph, this->object_buffer, 0);
+	this->graph_vertex_buffer = vulkan_render_graph__import_buffer(graph, this->mesh->vertex_buffer, 0);
+	this->graph_index_buffer = vulkan_render_graph__import_buffer(graph, this->mesh->index_buffer, 0);
+	if (this->graph_object_buffer < 0 || this->graph_vertex_buffer < 0 || this->graph_index_buffer < 0) {
+		return -1;
+	}
+
+	if (!this->gpu_driven) {
+		return 0;
+	}
+	// The previous frame may still be reading the draw commands
+	this->graph_indirect_buffer = vulkan_render_graph__import_buffer(graph, this->indirect_buffer, VK_PIPELINE_STAGE_DRAW_INDIRECT_BIT);
+	this->graph_count_buffer = vulkan_render_graph__import_buffer(graph, this->count_buffer, VK_PIPELINE_STAGE_DRAW_INDIRECT_BIT);
+	// The previous frame's cull may still be updating the levels of detail in place
+	this->graph_object_lod_buffer = vulkan_render_graph__import_buffer(graph, this->object_lod_buffer, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT);
+	if (this->graph_indirect_buffer < 0 || this->graph_count_buffer < 0 || this->graph_object_lod_buffer < 0) {
+		return -2;
+	}
+	// Read back by the next frame's cull
+	vulkan_render_graph__set_output(graph, this->graph_object_lod_buffer, VULKAN_RENDER_GRAPH__USAGE_STORAGE_READ_WRITE);
+
+	if (this->compact) {
+		int reset_pass = vulkan_render_graph__add_pass(graph, "reset_draw_count", record_reset, this);
+		if (reset_pass < 0 || vulkan_render_graph__access(graph, reset_pass, this->graph_count_buffer, VULKAN_RENDER_GRAPH__USAGE_TRANSFER_DST) < 0) {
+			return -3;
+		}
+	}
+
+	int cull_pass = vulkan_render_graph__add_pass(graph, "cull", record_cull, this->views + view);
+	if (cull_pass < 0) {
+		return -4;
+	}
+	int result = vulkan_render_graph__access(graph, cull_pass, this->graph_object_buffer, VULKAN_RENDER_GRAPH__USAGE_STORAGE_READ);
+	result |= vulkan_render_graph__access(graph, cull_pass, this->graph_indirect_buffer, VULKAN_RENDER_GRAPH__USAGE_STORAGE_WRITE);
+	if (this->compact) {
+		result |= vulkan_render_graph__access(graph, cull_pass, this->graph_count_buffer, VULKAN_RENDER_GRAPH__USAGE_STORAGE_READ_WRITE);
+	}
+	result |= vulkan_render_graph__access(graph, cull_pass, this->graph_object_lod_buffer, VULKAN_RENDER_GRAPH__USAGE_STORAGE_READ_WRITE);
+	if (result < 0) {
+		return -5;
+	}
+	return 0;
+}
+
+int vulkan_culling__try_add_draw_accesses(struct vulkan_culling *this, struct vulkan_render_graph *graph, int pass) {
+	int result = vulkan_render_graph__access(graph, pass, this->graph_object_buffer, VULKAN_RENDER_GRAPH__USAGE_VERTEX);
+	result |= vulkan_render_graph__access(graph, pass, this->graph_vertex_buffer, VULKAN_RENDER_GRAPH__USAGE_VERTEX);
+	result |= vulkan_render_graph__access(graph, pass, this->graph_index_buffer, VULKAN_RENDER_GRAPH__USAGE_INDEX);
+	if (this->gpu_driven) {
+		result |= vulkan_render_graph__access(graph, pass, this->graph_indirect_buffer, VULKAN_RENDER_GRAPH__USAGE_INDIRECT);
+	}
+	if (this->compact) {
+		result |= vulkan_render_graph__access(graph, pass, this->graph_count_buffer, VULKAN_RENDER_GRAPH__USAGE_INDIRECT);
+	}
+	if (result < 0) {
+		return -1;
+	}
+	return 0;
+}
+
+void vulkan_culling__bind_mesh(struct vulkan_culling *this, VkCommandBuffer command_buffer) {
+	// Binding 0 is per instance, binding 1 per vertex
+	VkBuffer vertex_buffers[2] = { this->object_buffer, this->mesh->vertex_buffer };
+	VkDeviceSize offsets[2] = { 0, 0 };
+	vkCmdBindVertexBuffers(command_buffer, 0, 2, vertex_buffers, offsets);
+	vkCmdBindIndexBuffer(command_buffer, this->mesh->index_buffer, 0, this->mesh->index_type);
+}
+
+void vulkan_culling__record_draw(struct vulkan_culling *this, VkCommandBuffer command_buffer) {
+	if (!this->gpu_driven) {
+		return;
+	}
+	vulkan_culling__bind_mesh(this, command_buffer);
+
+	uint32_t stride = sizeof(VkDrawIndexedIndirectCommand);
+	if (this->compact) {
+		this->base->cmd_draw_indexed_indirect_count(command_buffer, this->indirect_buffer, 0, this->count_buffer, 0, this->object_count, stride);
+	} else if (this->base->enabled_features.multiDrawIndirect) {
+		vkCmdDrawIndexedIndirect(command_buffer, this->indirect_buffer, 0, this->object_count, stride);
+	} else {
+		for (uint32_t i = 0; i < this->object_count; ++i) {
+			vkCmdDrawIndexedIndirect(command_buffer, this->indirect_buffer, i*stride, 1, stride);
+		}
+	}
+}
+
+int vulkan_culling__try_push_draws(struct vulkan_culling *this, int view, struct vulkan_draw_list *draw_list, struct vulkan_culling_object *instances,
+								   uint32_t pass, uint32_t pipeline) {
+	uint32_t *object_lods = this->views[view].object_lods;
+	uint32_t instance_counts[MESH__MAX_LODS];
+	memset(instance_counts, 0, sizeof(instance_counts));
+	for (uint32_t i = 0; i < this->object_count; ++i) {
+		if (!is_visible(this, this->host_objects + i)) {
+			continue;
+		}
+		object_lods[i] = select_lod(this->views + view, this->host_objects + i, object_lods[i]);
+		instances[object_lods[i]*this->object_count + instance_counts[object_lods[i]]++] = this->host_objects[i];
+	}
+
+	// The same draws every time, so lists recorded in place only take new instance counts
+	struct vulkan_draw_item item;
+	item.vertex_offset = 0;
+	for (uint32_t lod = 0; lod < this->mesh->lod_count; ++lod) {
+		item.key = VULKAN_DRAW_LIST__KEY(pass, pipeline, 0, lod);
+		item.index_count = this->mesh->lods[lod].index_count;
+		item.first_index = this->mesh->lods[lod].first_index;
+		item.first_instance = lod*this->object_count;
+		item.instance_count = instance_counts[lod];
+		item.push_constant = lod;
+		if (vulkan_draw_list__try_push(draw_list, &item) < 0) {
+			return -1;
+		}
+	}
+	return 0;
+}
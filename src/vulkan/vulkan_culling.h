@@ -0,0 +1,104 @@
+#pragma once
+
+#include <vulkan/vulkan.h>
+#include "vulkan_base.h"
+#include "vulkan_render_graph.h"
+#include "vulkan_mesh.h"
+#include "vulkan_draw_list.h"
+
+#define VULKAN_CULLING__DEFAULT_GRID_SIZE 32
+
+struct vulkan_culling_object {
+	float center[3];
+	float radius;
+};
+
+struct vulkan_culling;
+
+// The levels of detail of one scene drawing the objects. Each keeps its own, or scenes of different sizes would keep
+// switching the same objects back and forth against each other's hysteresis.
+struct vulkan_culling_view {
+	struct vulkan_culling *culling;
+	// Objects are drawn without perspective, so this turns their radius into their size on screen
+	float lod_pixels_per_unit;
+	// Level of detail each object was last drawn with, kept from frame to frame for hysteresis
+	uint32_t *object_lods;
+	// Where object_lods starts in the culling's object_lod_buffer
+	uint32_t object_lod_offset;
+};
+
+struct vulkan_culling {
+	struct vulkan_base *base;
+	// Every object is an instance of this mesh
+	const struct vulkan_mesh *mesh;
+	uint32_t object_count;
+	int gpu_driven;
+	int compact;
+	// Pushed to the cull shader when it is recorded, so they stay fixed for the command buffers' lifetime
+	float frustum_planes[6][4];
+	int view_count;
+	struct vulkan_culling_view *views;
+
+	struct vulkan_culling_object *objects;
+	// The objects of the latest update, read when culling on the CPU. The object buffer may still be in use by an
+	// earlier frame's copy.
+	struct vulkan_culling_object *host_objects;
+	VkBuffer object_buffer;
+	VkDeviceMemory object_memory;
+	VkBuffer indirect_buffer;
+	VkDeviceMemory indirect_memory;
+	VkBuffer count_buffer;
+	VkDeviceMemory count_memory;
+	VkBuffer lod_buffer;
+	VkDeviceMemory lod_memory;
+	// A slice of every view's object_lods, bound at the view's offset
+	VkBuffer object_lod_buffer;
+	VkDeviceMemory object_lod_memory;
+
+	VkDescriptorSetLayout descriptor_set_layout;
+	VkDescriptorPool descriptor_pool;
+	VkDescriptorSet descriptor_set;
+	VkPipelineLayout pipeline_layout;
+	VkPipeline pipeline;
+
+	// Per frame resource staging copies of the objects, see vulkan_culling__update_objects
+	int update_count;
+	VkBuffer *update_buffers;
+	VkDeviceMemory *update_memories;
+	struct vulkan_culling_object **update_objects;
+	VkCommandBuffer *update_command_buffers;
+
+	// Resources in the graph being built, a culling shared by several graphs is added to one at a time
+	int graph_object_buffer;
+	int graph_vertex_buffer;
+	int graph_index_buffer;
+	int graph_indirect_buffer;
+	int graph_count_buffer;
+	int graph_object_lod_buffer;
+};
+
+// Shared by view_count scenes, each passing its own view to the functions below that take one
+int vulkan_culling__try_init(struct vulkan_culling *this, struct vulkan_base *base, const struct vulkan_mesh *mesh, const struct vulkan_culling_object *objects,
+							 uint32_t object_count, int view_count);
+// grid_size*grid_size instances of mesh, which has to outlive the culling, filling a little more than the screen
+int vulkan_culling__try_init_grid(struct vulkan_culling *this, struct vulkan_base *base, const struct vulkan_mesh *mesh, int grid_size, int view_count);
+void vulkan_culling__free(struct vulkan_culling *this);
+
+int vulkan_culling__try_init_updates(struct vulkan_culling *this, int resource_count);
+void vulkan_culling__free_updates(struct vulkan_culling *this);
+// Returns a command buffer that copies objects into the object buffer, to submit ahead of the frame's own.
+// The fence of resources_index must have been waited on. Draws culled on the CPU afterwards use the new objects, the
+// copy has to be submitted ahead of them.
+VkCommandBuffer vulkan_culling__update_objects(struct vulkan_culling *this, int resources_index, const struct vulkan_culling_object *objects);
+
+// Takes effect for draws recorded after it
+void vulkan_culling__set_lod_scale(struct vulkan_culling *this, int view, float pixels_per_unit);
+int vulkan_culling__try_add_passes(struct vulkan_culling *this, struct vulkan_render_graph *graph, int view);
+int vulkan_culling__try_add_draw_accesses(struct vulkan_culling *this, struct vulkan_render_graph *graph, int pass);
+void vulkan_culling__bind_mesh(struct vulkan_culling *this, VkCommandBuffer command_buffer);
+// Binds the mesh and draws with the bound pipeline when culling on the GPU, otherwise does nothing
+void vulkan_culling__record_draw(struct vulkan_culling *this, VkCommandBuffer command_buffer);
+// Culls on the CPU, writing the visible objects of each level of detail into its slice of instances, object_count
+// long. Pushes one draw per level, without instances too, with keys for pass and pipeline.
+int vulkan_culling__try_push_draws(struct vulkan_culling *this, int view, struct vulkan_draw_list *draw_list, struct vulkan_culling_object *instances,
+								   uint32_t pass, uint32_t pipeline);
@@ -0,0 +1,444 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <ctype.h>
+#include "vulkan_device_select.h"
+
+#define MAX_UINT64 0xFFFFFFFFFFFFFFFF
+#define MAX_CACHE_ENTRIES 32
+#define BENCHMARK_BUFFER_SIZE (64*1024*1024)
+#define BENCHMARK_MIN_NANOSECONDS 10000000.0
+#define BENCHMARK_MAX_ITERATIONS 1024
+
+struct candidate {
+	VkPhysicalDevice physical_device;
+	int queue_family_index;
+	VkPhysicalDeviceProperties properties;
+	char uuid[2*VK_UUID_SIZE + 1];
+	double score;
+};
+
+struct cache_entry {
+	char uuid[2*VK_UUID_SIZE + 1];
+	uint32_t driver_version;
+	double gigabytes_per_second;
+};
+
+static int find_queue_family(VkPhysicalDevice physical_device, VkSurfaceKHR surface) {
+	uint32_t queue_family_count = 0;
+	vkGetPhysicalDeviceQueueFamilyProperties(physical_device, &queue_family_count, 0);
+	VkQueueFamilyProperties queue_family_propertiess[queue_family_count];
+	vkGetPhysicalDeviceQueueFamilyProperties(physical_device, &queue_family_count, queue_family_propertiess);
+
+	for (int i = 0; i < queue_family_count; ++i) {
+		VkBool32 present_support = VK_TRUE;
+		if (surface != VK_NULL_HANDLE) {
+			vkGetPhysicalDeviceSurfaceSupportKHR(physical_device, (uint32_t) i, surface, &present_support);
+		}
+		if (queue_family_propertiess[i].queueCount > 0 && queue_family_propertiess[i].queueFlags & VK_QUEUE_GRAPHICS_BIT && present_support) {
+			return i;
+		}
+	}
+	return -1;
+}
+
+static void get_uuid(struct candidate *candidate) {
+	VkPhysicalDeviceIDProperties id_properties;
+	memset(&id_properties, 0, sizeof(id_properties));
+	if (candidate->properties.apiVersion >= VK_API_VERSION_1_1) {
+		id_properties.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_ID_PROPERTIES;
+		id_properties.pNext = 0;
+		VkPhysicalDeviceProperties2 properties2;
+		properties2.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_PROPERTIES_2;
+		properties2.pNext = &id_properties;
+		vkGetPhysicalDeviceProperties2(candidate->physical_device, &properties2);
+	}
+	for (int i = 0; i < VK_UUID_SIZE; ++i) {
+		sprintf(candidate->uuid + 2*i, "%02x", id_properties.deviceUUID[i]);
+	}
+}
+
+// Accepts the UUID with or without dashes, in either case
+static int matches_override(const char *override, struct candidate *candidate) {
+	char uuid[2*VK_UUID_SIZE + 1];
+	int length = 0;
+	for (const char *c = override; *c && length < 2*VK_UUID_SIZE; ++c) {
+		if (*c != '-') {
+			uuid[length++] = (char) tolower((unsigned char) *c);
+		}
+	}
+	uuid[length] = 0;
+	if (length == 2*VK_UUID_SIZE && strcmp(uuid, candidate->uuid) == 0) {
+		return 1;
+	}
+	return strstr(candidate->properties.deviceName, override) != 0;
+}
+
+static double score_device(struct candidate *candidate) {
+	double score = 0.0;
+	switch (candidate->properties.deviceType) {
+		case VK_PHYSICAL_DEVICE_TYPE_DISCRETE_GPU: score += 4000.0; break;
+		case VK_PHYSICAL_DEVICE_TYPE_INTEGRATED_GPU: score += 2000.0; break;
+		case VK_PHYSICAL_DEVICE_TYPE_VIRTUAL_GPU: score += 1000.0; break;
+		case VK_PHYSICAL_DEVICE_TYPE_CPU: score += 100.0; break;
+		default: break;
+	}
+
+	// Device local memory, capped so a huge heap can't outweigh the device type
+	VkPhysicalDeviceMemoryProperties memory_properties;
+	vkGetPhysicalDeviceMemoryProperties(candidate->physical_device, &memory_properties);
+	double device_local_gigabytes = 0.0;
+	for (uint32_t i = 0; i < memory_properties.memoryHeapCount; ++i) {
+		if (memory_properties.memoryHeaps[i].flags & VK_MEMORY_HEAP_DEVICE_LOCAL_BIT) {
+			device_local_gigabytes += memory_properties.memoryHeaps[i].size/(1024.0*1024.0*1024.0);
+		}
+	}
+	score += 100.0*(device_local_gigabytes < 16.0 ? device_local_gigabytes : 16.0);
+
+	VkPhysicalDeviceLimits *limits = &candidate->properties.limits;
+	score += limits->maxImageDimension2D/1024.0;
+	score += limits->maxComputeWorkGroupInvocations/256.0;
+
+	// Features the renderer has faster paths for
+	VkPhysicalDeviceFeatures features;
+	vkGetPhysicalDeviceFeatures(candidate->physical_device, &features);
+	score += features.drawIndirectFirstInstance ? 500.0 : 0.0;
+	score += features.multiDrawIndirect ? 200.0 : 0.0;
+	return score;
+}
+
+static int find_memory_type(VkPhysicalDevice physical_device, uint32_t type_bits, VkMemoryPropertyFlags properties) {
+	VkPhysicalDeviceMemoryProperties memory_properties;
+	vkGetPhysicalDeviceMemoryProperties(physical_device, &memory_properties);
+	for (uint32_t i = 0; i < memory_properties.memoryTypeCount; ++i) {
+		if ((type_bits & (1u << i)) && (memory_properties.memoryTypes[i].propertyFlags & properties) == properties) {
+			return (int) i;
+		}
+	}
+	return -1;
+}
+
+struct benchmark {
+	const VkAllocationCallbacks *allocator;
+	VkDevice device;
+	VkQueue queue;
+	VkCommandPool command_pool;
+	VkCommandBuffer command_buffer;
+	VkBuffer buffer;
+	VkDeviceMemory memory;
+	VkQueryPool query_pool;
+	VkFence fence;
+};
+
+static void free_benchmark(struct benchmark *benchmark) {
+	if (benchmark->device == VK_NULL_HANDLE) {
+		return;
+	}
+	if (benchmark->fence != VK_NULL_HANDLE) {
+		vkDestroyFence(benchmark->device, benchmark->fence, benchmark->allocator);
+	}
+	if (benchmark->query_pool != VK_NULL_HANDLE) {
+		vkDestroyQueryPool(benchmark->device, benchmark->query_pool, benchmark->allocator);
+	}
+	if (benchmark->buffer != VK_NULL_HANDLE) {
+		vkDestroyBuffer(benchmark->device, benchmark->buffer, benchmark->allocator);
+	}
+	if (benchmark->memory != VK_NULL_HANDLE) {
+		vkFreeMemory(benchmark->device, benchmark->memory, benchmark->allocator);
+	}
+	if (benchmark->command_pool != VK_NULL_HANDLE) {
+		vkDestroyCommandPool(benchmark->device, benchmark->command_pool, benchmark->allocator);
+	}
+	vkDestroyDevice(benchmark->device, benchmark->allocator);
+}
+
+static int try_create_benchmark(struct benchmark *benchmark, struct candidate *candidate) {
+	VkDeviceQueueCreateInfo queue_create_info;
+	queue_create_info.sType = VK_STRUCTURE_TYPE_DEVICE_QUEUE_CREATE_INFO;
+	queue_create_info.pNext = 0;
+	queue_create_info.flags = 0;
+	const float queue_priority = 1.0f;
+	queue_create_info.pQueuePriorities = &queue_priority;
+	queue_create_info.queueCount = 1;
+	queue_create_info.queueFamilyIndex = (uint32_t) candidate->queue_family_index;
+
+	VkDeviceCreateInfo device_create_info;
+	memset(&device_create_info, 0, sizeof(device_create_info));
+	device_create_info.sType = VK_STRUCTURE_TYPE_DEVICE_CREATE_INFO;
+	device_create_info.queueCreateInfoCount = 1;
+	device_create_info.pQueueCreateInfos = &queue_create_info;
+	benchmark->command_pool = VK_NULL_HANDLE;
+	benchmark->buffer = VK_NULL_HANDLE;
+	benchmark->memory = VK_NULL_HANDLE;
+	benchmark->query_pool = VK_NULL_HANDLE;
+	benchmark->fence = VK_NULL_HANDLE;
+	if (vkCreateDevice(candidate->physical_device, &device_create_info, benchmark->allocator, &benchmark->device) != VK_SUCCESS) {
+		benchmark->device = VK_NULL_HANDLE;
+		return -1;
+	}
+	vkGetDeviceQueue(benchmark->device, (uint32_t) candidate->queue_family_index, 0, &benchmark->queue);
+
+	VkCommandPoolCreateInfo pool_create_info;
+	pool_create_info.sType = VK_STRUCTURE_TYPE_COMMAND_POOL_CREATE_INFO;
+	pool_create_info.pNext = 0;
+	pool_create_info.flags = VK_COMMAND_POOL_CREATE_RESET_COMMAND_BUFFER_BIT;
+	pool_create_info.queueFamilyIndex = (uint32_t) candidate->queue_family_index;
+	if (vkCreateCommandPool(benchmark->device, &pool_create_info, benchmark->allocator, &benchmark->command_pool) != VK_SUCCESS) {
+		benchmark->command_pool = VK_NULL_HANDLE;
+		return -2;
+	}
+
+	VkCommandBufferAllocateInfo allocate_info;
+	allocate_info.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_ALLOCATE_INFO;
+	allocate_info.pNext = 0;
+	allocate_info.commandPool = benchmark->command_pool;
+	allocate_info.level = VK_COMMAND_BUFFER_LEVEL_PRIMARY;
+	allocate_info.commandBufferCount = 1;
+	if (vkAllocateCommandBuffers(benchmark->device, &allocate_info, &benchmark->command_buffer) != VK_SUCCESS) {
+		return -3;
+	}
+
+	VkBufferCreateInfo buffer_create_info;
+	buffer_create_info.sType = VK_STRUCTURE_TYPE_BUFFER_CREATE_INFO;
+	buffer_create_info.pNext = 0;
+	buffer_create_info.flags = 0;
+	buffer_create_info.size = BENCHMARK_BUFFER_SIZE;
+	buffer_create_info.usage = VK_BUFFER_USAGE_TRANSFER_DST_BIT;
+	buffer_create_info.sharingMode = VK_SHARING_MODE_EXCLUSIVE;
+	buffer_create_info.queueFamilyIndexCount = 0;
+	buffer_create_info.pQueueFamilyIndices = 0;
+	if (vkCreateBuffer(benchmark->device, &buffer_create_info, benchmark->allocator, &benchmark->buffer) != VK_SUCCESS) {
+		benchmark->buffer = VK_NULL_HANDLE;
+		return -4;
+	}
+
+	VkMemoryRequirements requirements;
+	vkGetBufferMemoryRequirements(benchmark->device, benchmark->buffer, &requirements);
+	int memory_type = find_memory_type(candidate->physical_device, requirements.memoryTypeBits, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT);
+	if (memory_type < 0) {
+		return -5;
+	}
+	VkMemoryAllocateInfo memory_allocate_info;
+	memory_allocate_info.sType = VK_STRUCTURE_TYPE_MEMORY_ALLOCATE_INFO;
+	memory_allocate_info.pNext = 0;
+	memory_allocate_info.allocationSize = requirements.size;
+	memory_allocate_info.memoryTypeIndex = (uint32_t) memory_type;
+	if (vkAllocateMemory(benchmark->device, &memory_allocate_info, benchmark->allocator, &benchmark->memory) != VK_SUCCESS) {
+		benchmark->memory = VK_NULL_HANDLE;
+		return -6;
+	}
+	if (vkBindBufferMemory(benchmark->device, benchmark->buffer, benchmark->memory, 0) != VK_SUCCESS) {
+		return -7;
+	}
+
+	VkQueryPoolCreateInfo query_pool_create_info;
+	query_pool_create_info.sType = VK_STRUCTURE_TYPE_QUERY_POOL_CREATE_INFO;
+	query_pool_create_info.pNext = 0;
+	query_pool_create_info.flags = 0;
+	query_pool_create_info.queryType = VK_QUERY_TYPE_TIMESTAMP;
+	query_pool_create_info.queryCount = 2;
+	query_pool_create_info.pipelineStatistics = 0;
+	if (vkCreateQueryPool(benchmark->device, &query_pool_create_info, benchmark->allocator, &benchmark->query_pool) != VK_SUCCESS) {
+		benchmark->query_pool = VK_NULL_HANDLE;
+		return -8;
+	}
+
+	VkFenceCreateInfo fence_create_info;
+	fence_create_info.sType = VK_STRUCTURE_TYPE_FENCE_CREATE_INFO;
+	fence_create_info.pNext = 0;
+	fence_create_info.flags = 0;
+	if (vkCreateFence(benchmark->device, &fence_create_info, benchmark->allocator, &benchmark->fence) != VK_SUCCESS) {
+		benchmark->fence = VK_NULL_HANDLE;
+		return -9;
+	}
+	return 0;
+}
+
+static int try_time_fills(struct benchmark *benchmark, struct candidate *candidate, uint32_t valid_bits, int iterations, double *nanoseconds_out) {
+	VkCommandBufferBeginInfo begin_info;
+	begin_info.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO;
+	begin_info.pNext = 0;
+	begin_info.flags = VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT;
+	begin_info.pInheritanceInfo = 0;
+	if (vkBeginCommandBuffer(benchmark->command_buffer, &begin_info) != VK_SUCCESS) {
+		return -1;
+	}
+	vkCmdResetQueryPool(benchmark->command_buffer, benchmark->query_pool, 0, 2);
+	vkCmdWriteTimestamp(benchmark->command_buffer, VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT, benchmark->query_pool, 0);
+	// Each fill has to finish writing before the next starts, otherwise drivers may overlap or drop them
+	VkMemoryBarrier barrier;
+	barrier.sType = VK_STRUCTURE_TYPE_MEMORY_BARRIER;
+	barrier.pNext = 0;
+	barrier.srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+	barrier.dstAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+	for (int i = 0; i < iterations; ++i) {
+		if (i > 0) {
+			vkCmdPipelineBarrier(benchmark->command_buffer, VK_PIPELINE_STAGE_TRANSFER_BIT, VK_PIPELINE_STAGE_TRANSFER_BIT, 0, 1, &barrier, 0, 0, 0, 0);
+		}
+		vkCmdFillBuffer(benchmark->command_buffer, benchmark->buffer, 0, VK_WHOLE_SIZE, (uint32_t) i);
+	}
+	vkCmdWriteTimestamp(benchmark->command_buffer, VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT, benchmark->query_pool, 1);
+	if (vkEndCommandBuffer(benchmark->command_buffer) != VK_SUCCESS) {
+		return -2;
+	}
+
+	VkSubmitInfo submit_info;
+	memset(&submit_info, 0, sizeof(submit_info));
+	submit_info.sType = VK_STRUCTURE_TYPE_SUBMIT_INFO;
+	submit_info.commandBufferCount = 1;
+	submit_info.pCommandBuffers = &benchmark->command_buffer;
+	vkResetFences(benchmark->device, 1, &benchmark->fence);
+	if (vkQueueSubmit(benchmark->queue, 1, &submit_info, benchmark->fence) != VK_SUCCESS ||
+		vkWaitForFences(benchmark->device, 1, &benchmark->fence, VK_TRUE, MAX_UINT64) != VK_SUCCESS) {
+		return -3;
+	}
+
+	uint64_t timestamps[2];
+	if (vkGetQueryPoolResults(benchmark->device, benchmark->query_pool, 0, 2, sizeof(timestamps), timestamps, sizeof(*timestamps),
+							  VK_QUERY_RESULT_64_BIT | VK_QUERY_RESULT_WAIT_BIT) != VK_SUCCESS) {
+		return -4;
+	}
+	uint64_t mask = valid_bits >= 64 ? MAX_UINT64 : (((uint64_t) 1 << valid_bits) - 1);
+	uint64_t ticks = ((timestamps[1] & mask) - (timestamps[0] & mask)) & mask;
+	*nanoseconds_out = (double) ticks*candidate->properties.limits.timestampPeriod;
+	return 0;
+}
+
+// Fill bandwidth of device local memory, doubling the work until it takes long enough to time reliably
+static int try_benchmark(struct candidate *candidate, const VkAllocationCallbacks *allocator, double *gigabytes_per_second_out) {
+	uint32_t queue_family_count = 0;
+	vkGetPhysicalDeviceQueueFamilyProperties(candidate->physical_device, &queue_family_count, 0);
+	VkQueueFamilyProperties queue_family_propertiess[queue_family_count];
+	vkGetPhysicalDeviceQueueFamilyProperties(candidate->physical_device, &queue_family_count, queue_family_propertiess);
+	uint32_t valid_bits = queue_family_propertiess[candidate->queue_family_index].timestampValidBits;
+	if (valid_bits == 0) {
+		return -1;
+	}
+
+	struct benchmark benchmark;
+	benchmark.allocator = allocator;
+	if (try_create_benchmark(&benchmark, candidate) < 0) {
+		free_benchmark(&benchmark);
+		return -2;
+	}
+
+	int iterations = 1;
+	double nanoseconds = 0.0;
+	while (1) {
+		if (try_time_fills(&benchmark, candidate, valid_bits, iterations, &nanoseconds) < 0) {
+			free_benchmark(&benchmark);
+			return -3;
+		}
+		if (nanoseconds >= BENCHMARK_MIN_NANOSECONDS || iterations >= BENCHMARK_MAX_ITERATIONS) {
+			break;
+		}
+		iterations *= 2;
+	}
+	free_benchmark(&benchmark);
+	if (nanoseconds <= 0.0) {
+		return -4;
+	}
+	*gigabytes_per_second_out = (double) BENCHMARK_BUFFER_SIZE*iterations/nanoseconds;
+	return 0;
+}
+
+static int read_cache(struct cache_entry *entries) {
+	FILE *file = fopen(VULKAN_DEVICE_SELECT__CACHE_FILE, "r");
+	if (!file) {
+		return 0;
+	}
+	int count = 0;
+	while (count < MAX_CACHE_ENTRIES &&
+		   fscanf(file, "%32s %u %lf", entries[count].uuid, &entries[count].driver_version, &entries[count].gigabytes_per_second) == 3) {
+		++count;
+	}
+	fclose(file);
+	return count;
+}
+
+// Benchmark results are keyed by device UUID and driver version, a driver update invalidates them
+static int try_get_benchmark(struct candidate *candidate, const VkAllocationCallbacks *allocator, struct cache_entry *cache, int cache_count, double *gigabytes_per_second_out) {
+	for (int i = 0; i < cache_count; ++i) {
+		if (strcmp(cache[i].uuid, candidate->uuid) == 0 && cache[i].driver_version == candidate->properties.driverVersion) {
+			*gigabytes_per_second_out = cache[i].gigabytes_per_second;
+			return 0;
+		}
+	}
+	if (try_benchmark(candidate, allocator, gigabytes_per_second_out) < 0) {
+		return -1;
+	}
+	FILE *file = fopen(VULKAN_DEVICE_SELECT__CACHE_FILE, "a");
+	if (file) {
+		fprintf(file, "%s %u %f\n", candidate->uuid, candidate->properties.driverVersion, *gigabytes_per_second_out);
+		fclose(file);
+	}
+	return 0;
+}
+
+int vulkan_device_select__try_pick(struct vulkan_device_select *this, VkInstance instance, VkSurfaceKHR surface, int benchmark, const VkAllocationCallbacks *allocator) {
+	uint32_t device_count = 0;
+	if (vkEnumeratePhysicalDevices(instance, &device_count, 0) != VK_SUCCESS || device_count == 0) {
+		return -1;
+	}
+	VkPhysicalDevice devices[device_count];
+	vkEnumeratePhysicalDevices(instance, &device_count, devices);
+
+	struct candidate candidates[device_count];
+	int candidate_count = 0;
+	for (int i = 0; i < device_count; ++i) {
+		int queue_family_index = find_queue_family(devices[i], surface);
+		if (queue_family_index < 0) {
+			continue;
+		}
+		struct candidate *candidate = candidates + candidate_count++;
+		candidate->physical_device = devices[i];
+		candidate->queue_family_index = queue_family_index;
+		vkGetPhysicalDeviceProperties(devices[i], &candidate->properties);
+		get_uuid(candidate);
+		candidate->score = score_device(candidate);
+	}
+	if (candidate_count == 0) {
+		return -1;
+	}
+
+	if (benchmark) {
+		struct cache_entry cache[MAX_CACHE_ENTRIES];
+		int cache_count = read_cache(cache);
+		for (int i = 0; i < candidate_count; ++i) {
+			double gigabytes_per_second;
+			if (try_get_benchmark(candidates + i, allocator, cache, cache_count, &gigabytes_per_second) == 0) {
+				// Measured throughput outweighs everything guessed from the properties
+				candidates[i].score += 1000.0*gigabytes_per_second;
+				printf("Device %s: %.1f GB/s fill\n", candidates[i].properties.deviceName, gigabytes_per_second);
+			}
+		}
+	}
+
+	int best = 0;
+	for (int i = 0; i < candidate_count; ++i) {
+		printf("Device %s (%s): score %.0f\n", candidates[i].properties.deviceName, candidates[i].uuid, candidates[i].score);
+		if (candidates[i].score > candidates[best].score) {
+			best = i;
+		}
+	}
+
+	const char *override = getenv(VULKAN_DEVICE_SELECT__OVERRIDE_ENV);
+	if (override && *override) {
+		int found = 0;
+		for (int i = 0; i < candidate_count; ++i) {
+			if (matches_override(override, candidates + i)) {
+				best = i;
+				found = 1;
+				break;
+			}
+		}
+		if (!found) {
+			printf("No device matches %s=%s, using the best scored one\n", VULKAN_DEVICE_SELECT__OVERRIDE_ENV, override);
+		}
+	}
+
+	printf("Using device %s\n", candidates[best].properties.deviceName);
+	this->physical_device = candidates[best].physical_device;
+	this->queue_family_index = candidates[best].queue_family_index;
+	return 0;
+}
@@ -0,0 +1,17 @@
+#pragma once
+
+#include <vulkan/vulkan.h>
+
+#define VULKAN_DEVICE_SELECT__OVERRIDE_ENV "VULKAN_BASE_DEVICE"
+#define VULKAN_DEVICE_SELECT__CACHE_FILE "device_benchmark.cache"
+
+struct vulkan_device_select {
+	VkPhysicalDevice physical_device;
+	int queue_family_index;
+};
+
+// Picks the device with the highest score among those with a graphics queue that can present to surface
+// (any graphics queue if surface is VK_NULL_HANDLE). VULKAN_BASE_DEVICE set to a name substring or UUID
+// overrides the choice. With benchmark set, each candidate is timed once and the result cached on disk,
+// the benchmark devices are created with allocator.
+int vulkan_device_select__try_pick(struct vulkan_device_select *this, VkInstance instance, VkSurfaceKHR surface, int benchmark, const VkAllocationCallbacks *allocator);
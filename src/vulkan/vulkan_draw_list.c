@@ -0,0 +1,381 @@
+#include <malloc.h>
+#include <string.h>
+#include "vulkan_draw_list.h"
+
+#define UNBOUND 0xFFFFFFFFu
+
+// Merged draws waiting to go out as one multi-draw, starting at first in the frame's indirect buffer
+struct multi_draw {
+	uint32_t first;
+	uint32_t count;
+	VkDrawIndexedIndirectCommand single;
+};
+
+static int has_multi_draw(struct vulkan_draw_list *this) {
+	return this->base->enabled_features.multiDrawIndirect == VK_TRUE && this->base->enabled_features.drawIndirectFirstInstance == VK_TRUE;
+}
+
+static void free_items(struct vulkan_draw_list *this) {
+	free(this->scratch_order);
+	free(this->order);
+	free(this->scratch_keys);
+	free(this->keys);
+	free(this->items);
+}
+
+int vulkan_draw_list__try_init(struct vulkan_draw_list *this, struct vulkan_base *base, uint32_t capacity) {
+	this->base = base;
+	for (int i = 0; i < VULKAN_DRAW_LIST__MAX_PIPELINES; ++i) {
+		this->pipelines[i] = VK_NULL_HANDLE;
+		this->pipeline_layouts[i] = VK_NULL_HANDLE;
+	}
+	for (int i = 0; i < VULKAN_DRAW_LIST__MAX_MATERIALS; ++i) {
+		this->materials[i] = VK_NULL_HANDLE;
+	}
+	this->frame_count = 0;
+	this->instance_size = 0;
+	memset(&this->stats, 0, sizeof(this->stats));
+
+	this->capacity = capacity;
+	this->item_count = 0;
+	this->items = malloc(capacity*sizeof(*this->items));
+	this->keys = malloc(capacity*sizeof(*this->keys));
+	this->scratch_keys = malloc(capacity*sizeof(*this->scratch_keys));
+	this->order = malloc(capacity*sizeof(*this->order));
+	this->scratch_order = malloc(capacity*sizeof(*this->scratch_order));
+	if (!this->items || !this->keys || !this->scratch_keys || !this->order || !this->scratch_order) {
+		free_items(this);
+		return -1;
+	}
+	return 0;
+}
+
+void vulkan_draw_list__free(struct vulkan_draw_list *this) {
+	vulkan_draw_list__free_frames(this);
+	free_items(this);
+}
+
+static void free_frame(struct vulkan_draw_list *this, int frame) {
+	if (this->instance_size > 0) {
+		free(this->recorded_draws[frame]);
+		vkUnmapMemory(this->base->device, this->instance_memories[frame]);
+		vulkan_base__free_buffer(this->base, this->instance_buffers[frame], this->instance_memories[frame]);
+	}
+	vkUnmapMemory(this->base->device, this->indirect_memories[frame]);
+	vulkan_base__free_buffer(this->base, this->indirect_buffers[frame], this->indirect_memories[frame]);
+}
+
+static void free_frames_below(struct vulkan_draw_list *this, int i) {
+	for (--i; i >= 0; --i) {
+		free_frame(this, i);
+	}
+	free(this->recorded_draw_counts);
+	free(this->recorded_draws);
+	free(this->instances);
+	free(this->instance_memories);
+	free(this->instance_buffers);
+	free(this->indirect_commands);
+	free(this->indirect_memories);
+	free(this->indirect_buffers);
+}
+
+void vulkan_draw_list__free_frames(struct vulkan_draw_list *this) {
+	if (this->frame_count == 0) {
+		return;
+	}
+	free_frames_below(this, this->frame_count);
+	this->frame_count = 0;
+}
+
+static int try_create_mapped_buffer(struct vulkan_draw_list *this, VkDeviceSize size, VkBufferUsageFlags usage, VkBuffer *buffer_out, VkDeviceMemory *memory_out,
+									void **mapping_out) {
+	if (vulkan_base__try_create_buffer(this->base, size, usage, VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT, buffer_out,
+									   memory_out) < 0) {
+		return -1;
+	}
+	if (vkMapMemory(this->base->device, *memory_out, 0, VK_WHOLE_SIZE, 0, mapping_out) != VK_SUCCESS) {
+		vulkan_base__free_buffer(this->base, *buffer_out, *memory_out);
+		return -2;
+	}
+	return 0;
+}
+
+static int try_init_frame(struct vulkan_draw_list *this, int frame, uint32_t instance_capacity) {
+	// Every item could become its own command
+	if (try_create_mapped_buffer(this, this->capacity*sizeof(VkDrawIndexedIndirectCommand), VK_BUFFER_USAGE_INDIRECT_BUFFER_BIT, this->indirect_buffers + frame,
+								 this->indirect_memories + frame, (void **) (this->indirect_commands + frame)) < 0) {
+		return -1;
+	}
+	if (this->instance_size == 0) {
+		return 0;
+	}
+	if (try_create_mapped_buffer(this, (VkDeviceSize) instance_capacity*this->instance_size, VK_BUFFER_USAGE_VERTEX_BUFFER_BIT, this->instance_buffers + frame,
+								 this->instance_memories + frame, this->instances + frame) < 0) {
+		vkUnmapMemory(this->base->device, this->indirect_memories[frame]);
+		vulkan_base__free_buffer(this->base, this->indirect_buffers[frame], this->indirect_memories[frame]);
+		return -2;
+	}
+	this->recorded_draws[frame] = malloc(this->capacity*sizeof(**this->recorded_draws));
+	if (!this->recorded_draws[frame]) {
+		vkUnmapMemory(this->base->device, this->instance_memories[frame]);
+		vulkan_base__free_buffer(this->base, this->instance_buffers[frame], this->instance_memories[frame]);
+		vkUnmapMemory(this->base->device, this->indirect_memories[frame]);
+		vulkan_base__free_buffer(this->base, this->indirect_buffers[frame], this->indirect_memories[frame]);
+		return -3;
+	}
+	this->recorded_draw_counts[frame] = 0;
+	return 0;
+}
+
+int vulkan_draw_list__try_init_frames(struct vulkan_draw_list *this, int frame_count, uint32_t instance_size, uint32_t instance_capacity) {
+	// Without multi-draws or draws recorded in place there is nothing to keep per frame
+	if (!has_multi_draw(this) && instance_size == 0) {
+		return 0;
+	}
+	this->instance_size = instance_size;
+	this->indirect_buffers = malloc(frame_count*sizeof(*this->indirect_buffers));
+	this->indirect_memories = malloc(frame_count*sizeof(*this->indirect_memories));
+	this->indirect_commands = malloc(frame_count*sizeof(*this->indirect_commands));
+	this->instance_buffers = malloc(frame_count*sizeof(*this->instance_buffers));
+	this->instance_memories = malloc(frame_count*sizeof(*this->instance_memories));
+	this->instances = malloc(frame_count*sizeof(*this->instances));
+	this->recorded_draws = malloc(frame_count*sizeof(*this->recorded_draws));
+	this->recorded_draw_counts = malloc(frame_count*sizeof(*this->recorded_draw_counts));
+	if (!this->indirect_buffers || !this->indirect_memories || !this->indirect_commands || !this->instance_buffers || !this->instance_memories ||
+		!this->instances || !this->recorded_draws || !this->recorded_draw_counts) {
+		free_frames_below(this, 0);
+		return -1;
+	}
+	for (int i = 0; i < frame_count; ++i) {
+		if (try_init_frame(this, i, instance_capacity) < 0) {
+			free_frames_below(this, i);
+			return -2;
+		}
+	}
+	this->frame_count = frame_count;
+	return 0;
+}
+
+void vulkan_draw_list__set_pipeline(struct vulkan_draw_list *this, uint32_t index, VkPipeline pipeline, VkPipelineLayout layout) {
+	this->pipelines[index] = pipeline;
+	this->pipeline_layouts[index] = layout;
+}
+
+void vulkan_draw_list__set_material(struct vulkan_draw_list *this, uint32_t index, VkDescriptorSet descriptor_set) {
+	this->materials[index] = descriptor_set;
+}
+
+void vulkan_draw_list__reset(struct vulkan_draw_list *this) {
+	this->item_count = 0;
+}
+
+int vulkan_draw_list__try_push(struct vulkan_draw_list *this, const struct vulkan_draw_item *item) {
+	if (this->item_count == this->capacity) {
+		return -1;
+	}
+	this->items[this->item_count++] = *item;
+	return 0;
+}
+
+// Least significant digit first, so each pass is stable and items with equal keys keep the order they were pushed in
+void vulkan_draw_list__sort(struct vulkan_draw_list *this) {
+	for (uint32_t i = 0; i < this->item_count; ++i) {
+		this->keys[i] = this->items[i].key;
+		this->order[i] = i;
+	}
+	if (this->item_count < 2) {
+		return;
+	}
+	for (int shift = 0; shift < 64; shift += 8) {
+		uint32_t offsets[256];
+		memset(offsets, 0, sizeof(offsets));
+		for (uint32_t i = 0; i < this->item_count; ++i) {
+			++offsets[(this->keys[i] >> shift) & 0xFF];
+		}
+		// Depth is often narrower than its 32 bits and most lists have few passes, so skip digits every key shares
+		if (offsets[(this->keys[0] >> shift) & 0xFF] == this->item_count) {
+			continue;
+		}
+		uint32_t offset = 0;
+		for (int digit = 0; digit < 256; ++digit) {
+			uint32_t count = offsets[digit];
+			offsets[digit] = offset;
+			offset += count;
+		}
+		for (uint32_t i = 0; i < this->item_count; ++i) {
+			uint32_t position = offsets[(this->keys[i] >> shift) & 0xFF]++;
+			this->scratch_keys[position] = this->keys[i];
+			this->scratch_order[position] = this->order[i];
+		}
+		uint64_t *keys = this->keys;
+		this->keys = this->scratch_keys;
+		this->scratch_keys = keys;
+		uint32_t *order = this->order;
+		this->order = this->scratch_order;
+		this->scratch_order = order;
+	}
+}
+
+// Items merge while their instances follow on from the draw's so far
+static int can_merge(const struct vulkan_draw_item *draw, const struct vulkan_draw_item *next) {
+	return (next->key >> 32) == (draw->key >> 32) && next->index_count == draw->index_count && next->first_index == draw->first_index &&
+		   next->vertex_offset == draw->vertex_offset && next->first_instance == draw->first_instance + draw->instance_count &&
+		   next->push_constant == draw->push_constant;
+}
+
+// The draw of the sorted items from *i on that merge, *i moves past them
+static struct vulkan_draw_item next_draw(struct vulkan_draw_list *this, uint32_t *i) {
+	struct vulkan_draw_item draw = this->items[this->order[*i]];
+	for (++*i; *i < this->item_count && can_merge(&draw, this->items + this->order[*i]); ++*i) {
+		draw.instance_count += this->items[this->order[*i]].instance_count;
+	}
+	return draw;
+}
+
+// Everything but the instance count, which is all a write in place may change
+static int is_same_draw(const struct vulkan_draw_item *draw, const struct vulkan_draw_item *recorded) {
+	return (draw->key >> 32) == (recorded->key >> 32) && draw->index_count == recorded->index_count && draw->first_index == recorded->first_index &&
+		   draw->vertex_offset == recorded->vertex_offset && draw->first_instance == recorded->first_instance &&
+		   draw->push_constant == recorded->push_constant;
+}
+
+// Indirect draws can only start past instance 0 with drawIndirectFirstInstance, otherwise the draw's instances are bound
+// from its first one instead
+static int binds_instances(struct vulkan_draw_list *this) {
+	return this->base->enabled_features.drawIndirectFirstInstance != VK_TRUE;
+}
+
+static VkDrawIndexedIndirectCommand get_command(struct vulkan_draw_list *this, const struct vulkan_draw_item *draw, int in_place) {
+	VkDrawIndexedIndirectCommand command;
+	command.indexCount = draw->index_count;
+	command.instanceCount = draw->instance_count;
+	command.firstIndex = draw->first_index;
+	command.vertexOffset = draw->vertex_offset;
+	command.firstInstance = in_place && binds_instances(this) ? 0 : draw->first_instance;
+	return command;
+}
+
+static void flush_multi_draw(struct vulkan_draw_list *this, VkCommandBuffer command_buffer, int frame, int in_place, struct multi_draw *multi_draw) {
+	if (multi_draw->count == 0) {
+		return;
+	}
+	if (multi_draw->count == 1 && !in_place) {
+		// Its slot is left unused, reading it back from mapped memory could be slow
+		VkDrawIndexedIndirectCommand *single = &multi_draw->single;
+		vkCmdDrawIndexed(command_buffer, single->indexCount, single->instanceCount, single->firstIndex, single->vertexOffset, single->firstInstance);
+	} else {
+		uint32_t stride = sizeof(VkDrawIndexedIndirectCommand);
+		vkCmdDrawIndexedIndirect(command_buffer, this->indirect_buffers[frame], multi_draw->first*stride, multi_draw->count, stride);
+	}
+	++this->stats.draws;
+	multi_draw->first += multi_draw->count;
+	multi_draw->count = 0;
+}
+
+static void record(struct vulkan_draw_list *this, VkCommandBuffer command_buffer, int frame, int in_place) {
+	memset(&this->stats, 0, sizeof(this->stats));
+	this->stats.items = this->item_count;
+
+	int multi_draws = has_multi_draw(this);
+	int bind_instances = in_place && binds_instances(this);
+	// Drawn one at a time without the multiDrawIndirect feature
+	uint32_t max_multi_draw = multi_draws ? this->base->properties.limits.maxDrawIndirectCount : 1;
+	struct multi_draw multi_draw;
+	multi_draw.first = 0;
+	multi_draw.count = 0;
+	if (in_place && !bind_instances) {
+		VkDeviceSize offset = 0;
+		vkCmdBindVertexBuffers(command_buffer, VULKAN_DRAW_LIST__INSTANCE_BINDING, 1, this->instance_buffers + frame, &offset);
+	}
+
+	uint32_t bound_pipeline = UNBOUND;
+	uint32_t bound_material = UNBOUND;
+	int pushed = 0;
+	uint32_t push_constant = 0;
+	uint32_t i = 0;
+	while (i < this->item_count) {
+		const struct vulkan_draw_item *item = this->items + this->order[i];
+		uint32_t pipeline = VULKAN_DRAW_LIST__KEY_PIPELINE(item->key);
+		uint32_t material = VULKAN_DRAW_LIST__KEY_MATERIAL(item->key);
+		if (pipeline != bound_pipeline) {
+			flush_multi_draw(this, command_buffer, frame, in_place, &multi_draw);
+			vkCmdBindPipeline(command_buffer, VK_PIPELINE_BIND_POINT_GRAPHICS, this->pipelines[pipeline]);
+			++this->stats.pipeline_binds;
+			bound_pipeline = pipeline;
+			// The new layout may not be compatible with the old one
+			bound_material = UNBOUND;
+			pushed = 0;
+		}
+		if (material != bound_material) {
+			flush_multi_draw(this, command_buffer, frame, in_place, &multi_draw);
+			if (this->materials[material] != VK_NULL_HANDLE) {
+				vkCmdBindDescriptorSets(command_buffer, VK_PIPELINE_BIND_POINT_GRAPHICS, this->pipeline_layouts[pipeline], VULKAN_DRAW_LIST__MATERIAL_SET, 1,
+										this->materials + material, 0, 0);
+				++this->stats.descriptor_binds;
+			}
+			bound_material = material;
+		}
+		if (!pushed || item->push_constant != push_constant) {
+			flush_multi_draw(this, command_buffer, frame, in_place, &multi_draw);
+			vkCmdPushConstants(command_buffer, this->pipeline_layouts[pipeline], VULKAN_DRAW_LIST__PUSH_CONSTANT_STAGES, 0, sizeof(item->push_constant),
+							   &item->push_constant);
+			++this->stats.push_constant_updates;
+			pushed = 1;
+			push_constant = item->push_constant;
+		}
+
+		struct vulkan_draw_item draw = next_draw(this, &i);
+		if (!multi_draws && !in_place) {
+			vkCmdDrawIndexed(command_buffer, draw.index_count, draw.instance_count, draw.first_index, draw.vertex_offset, draw.first_instance);
+			++this->stats.draws;
+			continue;
+		}
+		if (bind_instances) {
+			flush_multi_draw(this, command_buffer, frame, in_place, &multi_draw);
+			VkDeviceSize offset = (VkDeviceSize) draw.first_instance*this->instance_size;
+			vkCmdBindVertexBuffers(command_buffer, VULKAN_DRAW_LIST__INSTANCE_BINDING, 1, this->instance_buffers + frame, &offset);
+		}
+		if (multi_draw.count == max_multi_draw) {
+			flush_multi_draw(this, command_buffer, frame, in_place, &multi_draw);
+		}
+		uint32_t slot = multi_draw.first + multi_draw.count++;
+		VkDrawIndexedIndirectCommand command = get_command(this, &draw, in_place);
+		if (multi_draw.count == 1) {
+			multi_draw.single = command;
+		}
+		this->indirect_commands[frame][slot] = command;
+		if (in_place) {
+			this->recorded_draws[frame][slot] = draw;
+		}
+	}
+	flush_multi_draw(this, command_buffer, frame, in_place, &multi_draw);
+	if (in_place) {
+		this->recorded_draw_counts[frame] = multi_draw.first;
+	}
+}
+
+void vulkan_draw_list__record(struct vulkan_draw_list *this, VkCommandBuffer command_buffer, int frame) {
+	record(this, command_buffer, frame, 0);
+}
+
+void vulkan_draw_list__record_in_place(struct vulkan_draw_list *this, VkCommandBuffer command_buffer, int frame) {
+	record(this, command_buffer, frame, 1);
+}
+
+int vulkan_draw_list__try_write_in_place(struct vulkan_draw_list *this, int frame) {
+	// In the order they were recorded, each draw has its own slot
+	uint32_t draw_count = 0;
+	uint32_t i = 0;
+	while (i < this->item_count) {
+		struct vulkan_draw_item draw = next_draw(this, &i);
+		if (draw_count == this->recorded_draw_counts[frame] || !is_same_draw(&draw, this->recorded_draws[frame] + draw_count)) {
+			return -1;
+		}
+		this->indirect_commands[frame][draw_count++] = get_command(this, &draw, 1);
+	}
+	if (draw_count != this->recorded_draw_counts[frame]) {
+		return -2;
+	}
+	this->stats.items = this->item_count;
+	return 0;
+}
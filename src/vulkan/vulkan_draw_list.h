@@ -0,0 +1,104 @@
+#pragma once
+
+#include <vulkan/vulkan.h>
+#include "vulkan_base.h"
+
+#define VULKAN_DRAW_LIST__MAX_PIPELINES 16
+#define VULKAN_DRAW_LIST__MAX_MATERIALS 64
+// Materials are bound to this set, set 0 is left for per-frame uniforms
+#define VULKAN_DRAW_LIST__MATERIAL_SET 1
+// Each item's push_constant goes to these stages at offset 0, the pipeline layouts need a range for it
+#define VULKAN_DRAW_LIST__PUSH_CONSTANT_STAGES VK_SHADER_STAGE_VERTEX_BIT
+// Lists recorded in place bind the frame's instances here, see vulkan_draw_list__record_in_place
+#define VULKAN_DRAW_LIST__INSTANCE_BINDING 0
+
+// Items sort by this key, most significant first: 4 bits of pass, 12 of pipeline, 16 of material and 32 of depth.
+// Pipeline and material index the draw list's tables. Pass and depth only order items, front to back for example.
+#define VULKAN_DRAW_LIST__KEY(pass, pipeline, material, depth) \
+	((uint64_t) (pass) << 60 | (uint64_t) (pipeline) << 48 | (uint64_t) (material) << 32 | (uint64_t) (uint32_t) (depth))
+#define VULKAN_DRAW_LIST__KEY_PIPELINE(key) ((uint32_t) ((key) >> 48) & 0xFFFu)
+#define VULKAN_DRAW_LIST__KEY_MATERIAL(key) ((uint32_t) ((key) >> 32) & 0xFFFFu)
+
+// An indexed draw from the vertex and index buffers bound when the list is recorded
+struct vulkan_draw_item {
+	uint64_t key;
+	uint32_t index_count;
+	uint32_t first_index;
+	int32_t vertex_offset;
+	uint32_t first_instance;
+	uint32_t instance_count;
+	// Small per-draw data such as a level of detail, pushed only when it differs from the previous draw's
+	uint32_t push_constant;
+};
+
+struct vulkan_draw_list_stats {
+	uint32_t items;
+	uint32_t draws;
+	uint32_t pipeline_binds;
+	uint32_t descriptor_binds;
+	uint32_t push_constant_updates;
+};
+
+// Items are pushed in any order each time the list is built, sorted by key, and recorded with state bound only when it
+// changes. Items with the same state and geometry whose instances follow on from each other become one instanced draw,
+// and runs with the same state become one multi-draw with the multiDrawIndirect and drawIndirectFirstInstance features.
+// Recorded in place instead, every draw reads its command from the frame's indirect buffer, so a list built again with
+// only other instance counts is written into the recorded command buffer without recording it again.
+struct vulkan_draw_list {
+	struct vulkan_base *base;
+	VkPipeline pipelines[VULKAN_DRAW_LIST__MAX_PIPELINES];
+	VkPipelineLayout pipeline_layouts[VULKAN_DRAW_LIST__MAX_PIPELINES];
+	// Bound to VULKAN_DRAW_LIST__MATERIAL_SET of the pipeline's layout, null for nothing to bind
+	VkDescriptorSet materials[VULKAN_DRAW_LIST__MAX_MATERIALS];
+
+	uint32_t capacity;
+	uint32_t item_count;
+	struct vulkan_draw_item *items;
+	// Sorting swaps these with their scratch buffers, order ends up holding the item indices in key order
+	uint64_t *keys;
+	uint64_t *scratch_keys;
+	uint32_t *order;
+	uint32_t *scratch_order;
+
+	// Multi-draw commands written while recording, one buffer per frame since recorded command buffers keep reading them
+	int frame_count;
+	VkBuffer *indirect_buffers;
+	VkDeviceMemory *indirect_memories;
+	VkDrawIndexedIndirectCommand **indirect_commands;
+	// Instances of instance_size bytes for lists recorded in place, written by the caller. Items' first_instance indexes
+	// the frame's instances.
+	uint32_t instance_size;
+	VkBuffer *instance_buffers;
+	VkDeviceMemory *instance_memories;
+	void **instances;
+	// The draws each frame was recorded with in place, which later writes have to match but for their instance counts
+	struct vulkan_draw_item **recorded_draws;
+	uint32_t *recorded_draw_counts;
+
+	// Of the last record
+	struct vulkan_draw_list_stats stats;
+};
+
+int vulkan_draw_list__try_init(struct vulkan_draw_list *this, struct vulkan_base *base, uint32_t capacity);
+void vulkan_draw_list__free(struct vulkan_draw_list *this);
+
+// Needed before recording, frame picks the buffers in vulkan_draw_list__record. Recording in place needs an instance_size
+// and room for instance_capacity instances.
+int vulkan_draw_list__try_init_frames(struct vulkan_draw_list *this, int frame_count, uint32_t instance_size, uint32_t instance_capacity);
+void vulkan_draw_list__free_frames(struct vulkan_draw_list *this);
+
+void vulkan_draw_list__set_pipeline(struct vulkan_draw_list *this, uint32_t index, VkPipeline pipeline, VkPipelineLayout layout);
+void vulkan_draw_list__set_material(struct vulkan_draw_list *this, uint32_t index, VkDescriptorSet descriptor_set);
+
+void vulkan_draw_list__reset(struct vulkan_draw_list *this);
+// Negative when the list is full
+int vulkan_draw_list__try_push(struct vulkan_draw_list *this, const struct vulkan_draw_item *item);
+void vulkan_draw_list__sort(struct vulkan_draw_list *this);
+// Records the sorted items inside a render pass, with the vertex and index buffers already bound
+void vulkan_draw_list__record(struct vulkan_draw_list *this, VkCommandBuffer command_buffer, int frame);
+// Same, but with every draw reading the frame's indirect buffer and the frame's instances bound to
+// VULKAN_DRAW_LIST__INSTANCE_BINDING
+void vulkan_draw_list__record_in_place(struct vulkan_draw_list *this, VkCommandBuffer command_buffer, int frame);
+// Writes the sorted items into the draws recorded in place, once the GPU is done with the frame. Negative when the draws
+// differ in more than their instance counts, the frame has to be recorded in place again then.
+int vulkan_draw_list__try_write_in_place(struct vulkan_draw_list *this, int frame);
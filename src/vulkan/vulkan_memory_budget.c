@@ -0,0 +1,157 @@
+#include <malloc.h>
+#include <string.h>
+#include "vulkan_memory_budget.h"
+
+int vulkan_memory_budget__try_init(struct vulkan_memory_budget *this, VkPhysicalDevice physical_device, int memory_budget_extension) {
+	if (pthread_mutex_init(&this->mutex, 0) != 0) {
+		return -1;
+	}
+	this->physical_device = physical_device;
+	this->memory_budget_extension = memory_budget_extension;
+	this->allocations = 0;
+	this->allocation_count = 0;
+	this->allocation_capacity = 0;
+	this->streamable_count = 0;
+
+	vkGetPhysicalDeviceMemoryProperties(physical_device, &this->memory_properties);
+	this->heap_count = this->memory_properties.memoryHeapCount;
+	for (uint32_t i = 0; i < this->heap_count; ++i) {
+		this->heaps[i].size = this->memory_properties.memoryHeaps[i].size;
+		this->heaps[i].budget = this->heaps[i].size;
+		this->heaps[i].usage = 0;
+		this->heaps[i].allocated = 0;
+	}
+	vulkan_memory_budget__update(this, 0);
+	return 0;
+}
+
+void vulkan_memory_budget__free(struct vulkan_memory_budget *this) {
+	free(this->allocations);
+	pthread_mutex_destroy(&this->mutex);
+}
+
+int vulkan_memory_budget__try_track(struct vulkan_memory_budget *this, VkDeviceMemory memory, VkDeviceSize size, uint32_t memory_type_index) {
+	pthread_mutex_lock(&this->mutex);
+	if (this->allocation_count == this->allocation_capacity) {
+		int capacity = this->allocation_capacity ? 2*this->allocation_capacity : 64;
+		struct vulkan_memory_allocation *allocations = realloc(this->allocations, capacity*sizeof(*allocations));
+		if (!allocations) {
+			pthread_mutex_unlock(&this->mutex);
+			return -1;
+		}
+		this->allocations = allocations;
+		this->allocation_capacity = capacity;
+	}
+	struct vulkan_memory_allocation *allocation = this->allocations + this->allocation_count++;
+	allocation->memory = memory;
+	allocation->size = size;
+	allocation->heap_index = this->memory_properties.memoryTypes[memory_type_index].heapIndex;
+	this->heaps[allocation->heap_index].allocated += size;
+	pthread_mutex_unlock(&this->mutex);
+	return 0;
+}
+
+void vulkan_memory_budget__untrack(struct vulkan_memory_budget *this, VkDeviceMemory memory) {
+	pthread_mutex_lock(&this->mutex);
+	for (int i = 0; i < this->allocation_count; ++i) {
+		if (this->allocations[i].memory == memory) {
+			this->heaps[this->allocations[i].heap_index].allocated -= this->allocations[i].size;
+			this->allocations[i] = this->allocations[--this->allocation_count];
+			break;
+		}
+	}
+	pthread_mutex_unlock(&this->mutex);
+}
+
+int vulkan_memory_budget__try_add_streamable(struct vulkan_memory_budget *this, struct vulkan_memory_streamable streamable) {
+	pthread_mutex_lock(&this->mutex);
+	if (this->streamable_count == VULKAN_MEMORY_BUDGET__MAX_STREAMABLES) {
+		pthread_mutex_unlock(&this->mutex);
+		return -1;
+	}
+	// Kept sorted by priority
+	int i = this->streamable_count++;
+	for (; i > 0 && this->streamables[i - 1].priority > streamable.priority; --i) {
+		this->streamables[i] = this->streamables[i - 1];
+	}
+	this->streamables[i] = streamable;
+	pthread_mutex_unlock(&this->mutex);
+	return 0;
+}
+
+void vulkan_memory_budget__remove_streamable(struct vulkan_memory_budget *this, void *user_data) {
+	pthread_mutex_lock(&this->mutex);
+	for (int i = 0; i < this->streamable_count; ++i) {
+		if (this->streamables[i].user_data == user_data) {
+			memmove(this->streamables + i, this->streamables + i + 1, (this->streamable_count - i - 1)*sizeof(this->streamables[0]));
+			--this->streamable_count;
+			break;
+		}
+	}
+	pthread_mutex_unlock(&this->mutex);
+}
+
+void vulkan_memory_budget__update(struct vulkan_memory_budget *this, struct vulkan_memory_budget_heap *heaps_out) {
+	VkPhysicalDeviceMemoryBudgetPropertiesEXT budget_properties;
+	budget_properties.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_MEMORY_BUDGET_PROPERTIES_EXT;
+	budget_properties.pNext = 0;
+	if (this->memory_budget_extension) {
+		VkPhysicalDeviceMemoryProperties2 properties;
+		properties.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_MEMORY_PROPERTIES_2;
+		properties.pNext = &budget_properties;
+		vkGetPhysicalDeviceMemoryProperties2(this->physical_device, &properties);
+	}
+
+	pthread_mutex_lock(&this->mutex);
+	for (uint32_t i = 0; i < this->heap_count; ++i) {
+		struct vulkan_memory_budget_heap *heap = this->heaps + i;
+		if (this->memory_budget_extension) {
+			heap->budget = budget_properties.heapBudget[i];
+			heap->usage = budget_properties.heapUsage[i];
+		} else {
+			// Other processes are invisible without the extension
+			heap->budget = heap->size;
+			heap->usage = heap->allocated;
+		}
+	}
+	if (heaps_out) {
+		memcpy(heaps_out, this->heaps, this->heap_count*sizeof(this->heaps[0]));
+	}
+	pthread_mutex_unlock(&this->mutex);
+}
+
+VkDeviceSize vulkan_memory_budget__enforce(struct vulkan_memory_budget *this) {
+	struct vulkan_memory_budget_heap heaps[VK_MAX_MEMORY_HEAPS];
+	vulkan_memory_budget__update(this, heaps);
+
+	// Streamables free memory through untrack, so they are called without the mutex held
+	pthread_mutex_lock(&this->mutex);
+	struct vulkan_memory_streamable streamables[VULKAN_MEMORY_BUDGET__MAX_STREAMABLES];
+	int streamable_count = this->streamable_count;
+	memcpy(streamables, this->streamables, streamable_count*sizeof(streamables[0]));
+	pthread_mutex_unlock(&this->mutex);
+
+	VkDeviceSize evicted = 0;
+	for (uint32_t i = 0; i < this->heap_count; ++i) {
+		VkDeviceSize usage = heaps[i].usage;
+		if (usage <= (VkDeviceSize) (heaps[i].budget*VULKAN_MEMORY_BUDGET__EVICT_THRESHOLD)) {
+			continue;
+		}
+		VkDeviceSize target = (VkDeviceSize) (heaps[i].budget*VULKAN_MEMORY_BUDGET__EVICT_TARGET);
+		for (int j = 0; j < streamable_count && usage > target; ++j) {
+			VkDeviceSize freed = streamables[j].try_evict(streamables[j].user_data, i, usage - target);
+			usage = freed < usage ? usage - freed : 0;
+			evicted += freed;
+		}
+	}
+	return evicted;
+}
+
+VkDeviceSize vulkan_memory_budget__headroom(struct vulkan_memory_budget *this, uint32_t heap_index) {
+	pthread_mutex_lock(&this->mutex);
+	struct vulkan_memory_budget_heap *heap = this->heaps + heap_index;
+	VkDeviceSize target = (VkDeviceSize) (heap->budget*VULKAN_MEMORY_BUDGET__EVICT_TARGET);
+	VkDeviceSize headroom = heap->usage < target ? target - heap->usage : 0;
+	pthread_mutex_unlock(&this->mutex);
+	return headroom;
+}
@@ -0,0 +1,67 @@
+#pragma once
+
+#include <vulkan/vulkan.h>
+#include <pthread.h>
+
+#define VULKAN_MEMORY_BUDGET__MAX_STREAMABLES 16
+// Fractions of a heap's budget, eviction starts above the threshold and goes on until usage is below the target
+#define VULKAN_MEMORY_BUDGET__EVICT_THRESHOLD 0.9
+#define VULKAN_MEMORY_BUDGET__EVICT_TARGET 0.8
+
+struct vulkan_memory_budget_heap {
+	VkDeviceSize size;
+	// From VK_EXT_memory_budget when available, otherwise the heap size and the application's own usage
+	VkDeviceSize budget;
+	VkDeviceSize usage;
+	// Allocated by this application through vulkan_memory_budget__try_track
+	VkDeviceSize allocated;
+};
+
+// A resource that can give memory back at a loss in quality, such as a texture cache dropping mip levels.
+// try_evict is asked to free at least bytes from the heap and returns how much it freed, it must not call
+// back into the budget except to track and untrack its own memory.
+struct vulkan_memory_streamable {
+	VkDeviceSize (*try_evict)(void *user_data, uint32_t heap_index, VkDeviceSize bytes);
+	void *user_data;
+	// Lower priorities are evicted first
+	int priority;
+};
+
+struct vulkan_memory_allocation {
+	VkDeviceMemory memory;
+	VkDeviceSize size;
+	uint32_t heap_index;
+};
+
+// Tracks device memory per heap and evicts streamable resources when a heap goes over budget, so running out of
+// memory on a shared machine lowers quality instead of paging. Safe to call from any thread.
+struct vulkan_memory_budget {
+	VkPhysicalDevice physical_device;
+	int memory_budget_extension;
+	pthread_mutex_t mutex;
+	VkPhysicalDeviceMemoryProperties memory_properties;
+	struct vulkan_memory_budget_heap heaps[VK_MAX_MEMORY_HEAPS];
+	uint32_t heap_count;
+	struct vulkan_memory_allocation *allocations;
+	int allocation_count;
+	int allocation_capacity;
+	struct vulkan_memory_streamable streamables[VULKAN_MEMORY_BUDGET__MAX_STREAMABLES];
+	int streamable_count;
+};
+
+// memory_budget_extension says whether VK_EXT_memory_budget is enabled on the device
+int vulkan_memory_budget__try_init(struct vulkan_memory_budget *this, VkPhysicalDevice physical_device, int memory_budget_extension);
+void vulkan_memory_budget__free(struct vulkan_memory_budget *this);
+
+int vulkan_memory_budget__try_track(struct vulkan_memory_budget *this, VkDeviceMemory memory, VkDeviceSize size, uint32_t memory_type_index);
+void vulkan_memory_budget__untrack(struct vulkan_memory_budget *this, VkDeviceMemory memory);
+
+int vulkan_memory_budget__try_add_streamable(struct vulkan_memory_budget *this, struct vulkan_memory_streamable streamable);
+void vulkan_memory_budget__remove_streamable(struct vulkan_memory_budget *this, void *user_data);
+
+// Queries the driver's current budget, heaps_out may be null
+void vulkan_memory_budget__update(struct vulkan_memory_budget *this, struct vulkan_memory_budget_heap *heaps_out);
+// Updates and evicts from every heap above the threshold, returns the bytes freed
+VkDeviceSize vulkan_memory_budget__enforce(struct vulkan_memory_budget *this);
+// Bytes that can still be allocated from the heap before reaching the eviction target, as of the last update
+VkDeviceSize vulkan_memory_budget__headroom(struct vulkan_memory_budget *this, uint32_t heap_index);
@@ -0,0 +1,138 @@
+#include <string.h>
+#include "vulkan_mesh.h"
+
+#define MAX_UINT64 0xFFFFFFFFFFFFFFFF
+
+void vulkan_mesh__free(struct vulkan_mesh *this) {
+	vulkan_base__free_buffer(this->base, this->index_buffer, this->index_memory);
+	vulkan_base__free_buffer(this->base, this->vertex_buffer, this->vertex_memory);
+}
+
+static void record_copy(struct vulkan_mesh *this, VkCommandBuffer command_buffer, VkBuffer staging_buffer, VkDeviceSize vertex_size, VkDeviceSize index_size) {
+	VkBufferCopy regions[2];
+	regions[0].srcOffset = 0;
+	regions[0].dstOffset = 0;
+	regions[0].size = vertex_size;
+	regions[1].srcOffset = vertex_size;
+	regions[1].dstOffset = 0;
+	regions[1].size = index_size;
+	vkCmdCopyBuffer(command_buffer, staging_buffer, this->vertex_buffer, 1, regions);
+	vkCmdCopyBuffer(command_buffer, staging_buffer, this->index_buffer, 1, regions + 1);
+
+	VkBufferMemoryBarrier barriers[2];
+	for (int i = 0; i < 2; ++i) {
+		barriers[i].sType = VK_STRUCTURE_TYPE_BUFFER_MEMORY_BARRIER;
+		barriers[i].pNext = 0;
+		barriers[i].srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+		barriers[i].srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+		barriers[i].dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+		barriers[i].offset = 0;
+		barriers[i].size = VK_WHOLE_SIZE;
+	}
+	barriers[0].dstAccessMask = VK_ACCESS_VERTEX_ATTRIBUTE_READ_BIT;
+	barriers[0].buffer = this->vertex_buffer;
+	barriers[1].dstAccessMask = VK_ACCESS_INDEX_READ_BIT;
+	barriers[1].buffer = this->index_buffer;
+	vkCmdPipelineBarrier(command_buffer, VK_PIPELINE_STAGE_TRANSFER_BIT, VK_PIPELINE_STAGE_VERTEX_INPUT_BIT, 0, 0, 0, 2, barriers, 0, 0);
+}
+
+static int try_submit_copy(struct vulkan_mesh *this, VkBuffer staging_buffer, VkDeviceSize vertex_size, VkDeviceSize index_size) {
+	VkCommandBufferAllocateInfo allocate_info;
+	allocate_info.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_ALLOCATE_INFO;
+	allocate_info.pNext = 0;
+	allocate_info.commandPool = this->base->command_pool;
+	allocate_info.level = VK_COMMAND_BUFFER_LEVEL_PRIMARY;
+	allocate_info.commandBufferCount = 1;
+
+	VkCommandBuffer command_buffer;
+	if (vkAllocateCommandBuffers(this->base->device, &allocate_info, &command_buffer) != VK_SUCCESS) {
+		return -1;
+	}
+
+	VkCommandBufferBeginInfo begin_info;
+	begin_info.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO;
+	begin_info.pNext = 0;
+	begin_info.flags = VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT;
+	begin_info.pInheritanceInfo = 0;
+	if (vkBeginCommandBuffer(command_buffer, &begin_info) != VK_SUCCESS) {
+		vkFreeCommandBuffers(this->base->device, this->base->command_pool, 1, &command_buffer);
+		return -2;
+	}
+	record_copy(this, command_buffer, staging_buffer, vertex_size, index_size);
+	if (vkEndCommandBuffer(command_buffer) != VK_SUCCESS) {
+		vkFreeCommandBuffers(this->base->device, this->base->command_pool, 1, &command_buffer);
+		return -3;
+	}
+
+	VkFenceCreateInfo fence_create_info;
+	fence_create_info.sType = VK_STRUCTURE_TYPE_FENCE_CREATE_INFO;
+	fence_create_info.pNext = 0;
+	fence_create_info.flags = 0;
+
+	VkFence fence;
+	if (vkCreateFence(this->base->device, &fence_create_info, this->base->allocator, &fence) != VK_SUCCESS) {
+		vkFreeCommandBuffers(this->base->device, this->base->command_pool, 1, &command_buffer);
+		return -4;
+	}
+
+	VkSubmitInfo submit_info;
+	memset(&submit_info, 0, sizeof(submit_info));
+	submit_info.sType = VK_STRUCTURE_TYPE_SUBMIT_INFO;
+	submit_info.commandBufferCount = 1;
+	submit_info.pCommandBuffers = &command_buffer;
+	int result = 0;
+	if (vkQueueSubmit(this->base->queue, 1, &submit_info, fence) != VK_SUCCESS ||
+		vkWaitForFences(this->base->device, 1, &fence, VK_TRUE, MAX_UINT64) != VK_SUCCESS) {
+		result = -5;
+	}
+	vkDestroyFence(this->base->device, fence, this->base->allocator);
+	vkFreeCommandBuffers(this->base->device, this->base->command_pool, 1, &command_buffer);
+	return result;
+}
+
+int vulkan_mesh__try_init(struct vulkan_mesh *this, struct vulkan_base *base, const struct mesh *mesh) {
+	this->base = base;
+	this->vertex_count = mesh->vertex_count;
+	this->index_count = mesh->index_count;
+	this->index_type = mesh->index_size == 2 ? VK_INDEX_TYPE_UINT16 : VK_INDEX_TYPE_UINT32;
+	this->lod_count = mesh->lod_count;
+	memcpy(this->lods, mesh->lods, sizeof(this->lods));
+	VkDeviceSize vertex_size = mesh->vertex_count*sizeof(struct mesh_vertex);
+	VkDeviceSize index_size = (VkDeviceSize) mesh->index_count*mesh->index_size;
+
+	// Index data goes right after the vertices, which keeps it aligned to the index size
+	VkBuffer staging_buffer;
+	VkDeviceMemory staging_memory;
+	if (vulkan_base__try_create_buffer(base, vertex_size + index_size, VK_BUFFER_USAGE_TRANSFER_SRC_BIT,
+									   VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT, &staging_buffer, &staging_memory) < 0) {
+		return -1;
+	}
+	unsigned char *staging;
+	if (vkMapMemory(base->device, staging_memory, 0, VK_WHOLE_SIZE, 0, (void **) &staging) != VK_SUCCESS) {
+		vulkan_base__free_buffer(base, staging_buffer, staging_memory);
+		return -2;
+	}
+	memcpy(staging, mesh->vertices, (size_t) vertex_size);
+	memcpy(staging + vertex_size, mesh->indices, (size_t) index_size);
+	vkUnmapMemory(base->device, staging_memory);
+
+	if (vulkan_base__try_create_buffer(base, vertex_size, VK_BUFFER_USAGE_VERTEX_BUFFER_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT,
+									   VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, &this->vertex_buffer, &this->vertex_memory) < 0) {
+		vulkan_base__free_buffer(base, staging_buffer, staging_memory);
+		return -3;
+	}
+	if (vulkan_base__try_create_buffer(base, index_size, VK_BUFFER_USAGE_INDEX_BUFFER_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT,
+									   VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, &this->index_buffer, &this->index_memory) < 0) {
+		vulkan_base__free_buffer(base, this->vertex_buffer, this->vertex_memory);
+		vulkan_base__free_buffer(base, staging_buffer, staging_memory);
+		return -4;
+	}
+
+	if (try_submit_copy(this, staging_buffer, vertex_size, index_size) < 0) {
+		vulkan_mesh__free(this);
+		vulkan_base__free_buffer(base, staging_buffer, staging_memory);
+		return -5;
+	}
+	vulkan_base__free_buffer(base, staging_buffer, staging_memory);
+	return 0;
+}
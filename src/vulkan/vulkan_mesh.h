@@ -0,0 +1,25 @@
+#pragma once
+
+#include <vulkan/vulkan.h>
+#include "vulkan_base.h"
+#include "../mesh/mesh.h"
+
+// A mesh copied into device local vertex and index buffers
+struct vulkan_mesh {
+	struct vulkan_base *base;
+	uint32_t vertex_count;
+	// Over every level of detail
+	uint32_t index_count;
+	VkIndexType index_type;
+	uint32_t lod_count;
+	struct mesh_lod lods[MESH__MAX_LODS];
+	VkBuffer vertex_buffer;
+	VkDeviceMemory vertex_memory;
+	VkBuffer index_buffer;
+	VkDeviceMemory index_memory;
+};
+
+// Uploads through a staging buffer and waits for the copy, so the mesh may be unmapped right after.
+// Uses the base's command pool, keep it on the thread that owns the pool.
+int vulkan_mesh__try_init(struct vulkan_mesh *this, struct vulkan_base *base, const struct mesh *mesh);
+void vulkan_mesh__free(struct vulkan_mesh *this);
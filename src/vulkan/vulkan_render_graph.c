@@ -0,0 +1,631 @@
+#include <string.h>
+#include "vulkan_render_graph.h"
+
+#define WRITE_ACCESS_MASK (VK_ACCESS_SHADER_WRITE_BIT | VK_ACCESS_COLOR_ATTACHMENT_WRITE_BIT | VK_ACCESS_DEPTH_STENCIL_ATTACHMENT_WRITE_BIT | VK_ACCESS_TRANSFER_WRITE_BIT | VK_ACCESS_HOST_WRITE_BIT | VK_ACCESS_MEMORY_WRITE_BIT)
+
+struct usage_info {
+	VkPipelineStageFlags stage;
+	VkAccessFlags access;
+	VkImageLayout layout;
+	int write;
+};
+
+static const struct usage_info usage_infos[] = {
+	[VULKAN_RENDER_GRAPH__USAGE_COLOR_ATTACHMENT] = {
+		VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT, VK_ACCESS_COLOR_ATTACHMENT_READ_BIT | VK_ACCESS_COLOR_ATTACHMENT_WRITE_BIT,
+		VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL, 1
+	},
+	[VULKAN_RENDER_GRAPH__USAGE_DEPTH_ATTACHMENT] = {
+		VK_PIPELINE_STAGE_EARLY_FRAGMENT_TESTS_BIT | VK_PIPELINE_STAGE_LATE_FRAGMENT_TESTS_BIT, VK_ACCESS_DEPTH_STENCIL_ATTACHMENT_READ_BIT | VK_ACCESS_DEPTH_STENCIL_ATTACHMENT_WRITE_BIT,
+		VK_IMAGE_LAYOUT_DEPTH_STENCIL_ATTACHMENT_OPTIMAL, 1
+	},
+	[VULKAN_RENDER_GRAPH__USAGE_SAMPLED] = {
+		VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT, VK_ACCESS_SHADER_READ_BIT, VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL, 0
+	},
+	[VULKAN_RENDER_GRAPH__USAGE_STORAGE_READ] = {
+		VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, VK_ACCESS_SHADER_READ_BIT, VK_IMAGE_LAYOUT_GENERAL, 0
+	},
+	[VULKAN_RENDER_GRAPH__USAGE_STORAGE_WRITE] = {
+		VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, VK_ACCESS_SHADER_WRITE_BIT, VK_IMAGE_LAYOUT_GENERAL, 1
+	},
+	[VULKAN_RENDER_GRAPH__USAGE_STORAGE_READ_WRITE] = {
+		VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, VK_ACCESS_SHADER_READ_BIT | VK_ACCESS_SHADER_WRITE_BIT, VK_IMAGE_LAYOUT_GENERAL, 1
+	},
+	[VULKAN_RENDER_GRAPH__USAGE_FRAGMENT_STORAGE_WRITE] = {
+		VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT, VK_ACCESS_SHADER_WRITE_BIT, VK_IMAGE_LAYOUT_GENERAL, 1
+	},
+	[VULKAN_RENDER_GRAPH__USAGE_INDIRECT] = {
+		VK_PIPELINE_STAGE_DRAW_INDIRECT_BIT, VK_ACCESS_INDIRECT_COMMAND_READ_BIT, VK_IMAGE_LAYOUT_UNDEFINED, 0
+	},
+	[VULKAN_RENDER_GRAPH__USAGE_VERTEX] = {
+		VK_PIPELINE_STAGE_VERTEX_INPUT_BIT, VK_ACCESS_VERTEX_ATTRIBUTE_READ_BIT, VK_IMAGE_LAYOUT_UNDEFINED, 0
+	},
+	[VULKAN_RENDER_GRAPH__USAGE_INDEX] = {
+		VK_PIPELINE_STAGE_VERTEX_INPUT_BIT, VK_ACCESS_INDEX_READ_BIT, VK_IMAGE_LAYOUT_UNDEFINED, 0
+	},
+	[VULKAN_RENDER_GRAPH__USAGE_TRANSFER_SRC] = {
+		VK_PIPELINE_STAGE_TRANSFER_BIT, VK_ACCESS_TRANSFER_READ_BIT, VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL, 0
+	},
+	[VULKAN_RENDER_GRAPH__USAGE_TRANSFER_DST] = {
+		VK_PIPELINE_STAGE_TRANSFER_BIT, VK_ACCESS_TRANSFER_WRITE_BIT, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, 1
+	},
+	[VULKAN_RENDER_GRAPH__USAGE_PRESENT] = {
+		VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT, 0, VK_IMAGE_LAYOUT_PRESENT_SRC_KHR, 0
+	},
+	[VULKAN_RENDER_GRAPH__USAGE_HOST_READ] = {
+		VK_PIPELINE_STAGE_HOST_BIT, VK_ACCESS_HOST_READ_BIT, VK_IMAGE_LAYOUT_GENERAL, 0
+	}
+};
+
+struct resource_state {
+	VkPipelineStageFlags write_stages;
+	VkAccessFlags write_access;
+	VkPipelineStageFlags read_stages;
+	VkPipelineStageFlags visible_stages;
+	VkAccessFlags visible_access;
+	VkImageLayout layout;
+};
+
+void vulkan_render_graph__init(struct vulkan_render_graph *this, struct vulkan_base *base) {
+	this->base = base;
+	this->resource_count = 0;
+	this->pass_count = 0;
+	this->barrier_count = 0;
+	this->transient_memory = VK_NULL_HANDLE;
+	this->transient_memory_size = 0;
+	this->statistics_pool = VK_NULL_HANDLE;
+	this->statistics_frame_count = 0;
+	this->statistics_frame = 0;
+}
+
+static void free_transient_images(struct vulkan_render_graph *this) {
+	for (int i = 0; i < this->resource_count; ++i) {
+		struct vulkan_render_graph_resource *resource = this->resources + i;
+		if (!resource->transient || resource->image == VK_NULL_HANDLE) {
+			continue;
+		}
+		if (resource->image_view != VK_NULL_HANDLE) {
+			vkDestroyImageView(this->base->device, resource->image_view, this->base->allocator);
+		}
+		vkDestroyImage(this->base->device, resource->image, this->base->allocator);
+		resource->image_view = VK_NULL_HANDLE;
+		resource->image = VK_NULL_HANDLE;
+	}
+	if (this->transient_memory != VK_NULL_HANDLE) {
+		vulkan_base__free_memory(this->base, this->transient_memory);
+		this->transient_memory = VK_NULL_HANDLE;
+	}
+}
+
+void vulkan_render_graph__free(struct vulkan_render_graph *this) {
+	if (this->statistics_pool != VK_NULL_HANDLE) {
+		vkDestroyQueryPool(this->base->device, this->statistics_pool, this->base->allocator);
+		this->statistics_pool = VK_NULL_HANDLE;
+	}
+	free_transient_images(this);
+	this->resource_count = 0;
+	this->pass_count = 0;
+	this->barrier_count = 0;
+}
+
+static struct vulkan_render_graph_resource *try_add_resource(struct vulkan_render_graph *this) {
+	if (this->resource_count == VULKAN_RENDER_GRAPH__MAX_RESOURCES) {
+		return 0;
+	}
+	struct vulkan_render_graph_resource *resource = this->resources + this->resource_count;
+	memset(resource, 0, sizeof(*resource));
+	resource->buffer = VK_NULL_HANDLE;
+	resource->image = VK_NULL_HANDLE;
+	resource->image_view = VK_NULL_HANDLE;
+	resource->initial_layout = VK_IMAGE_LAYOUT_UNDEFINED;
+	resource->first_pass = -1;
+	resource->last_pass = -1;
+	return resource;
+}
+
+int vulkan_render_graph__import_buffer(struct vulkan_render_graph *this, VkBuffer buffer, VkPipelineStageFlags initial_stage) {
+	struct vulkan_render_graph_resource *resource = try_add_resource(this);
+	if (!resource) {
+		return -1;
+	}
+	resource->buffer = buffer;
+	resource->initial_stage = initial_stage;
+	return this->resource_count++;
+}
+
+int vulkan_render_graph__import_image(struct vulkan_render_graph *this, VkImage image, VkImageView image_view, VkImageAspectFlags aspect, VkImageLayout initial_layout, VkPipelineStageFlags initial_stage) {
+	struct vulkan_render_graph_resource *resource = try_add_resource(this);
+	if (!resource) {
+		return -1;
+	}
+	resource->is_image = 1;
+	resource->image = image;
+	resource->image_view = image_view;
+	resource->aspect = aspect;
+	resource->initial_layout = initial_layout;
+	resource->initial_stage = initial_stage;
+	return this->resource_count++;
+}
+
+int vulkan_render_graph__create_image(struct vulkan_render_graph *this, VkFormat format, VkExtent2D extent, VkImageUsageFlags usage, VkImageAspectFlags aspect) {
+	struct vulkan_render_graph_resource *resource = try_add_resource(this);
+	if (!resource) {
+		return -1;
+	}
+	resource->is_image = 1;
+	resource->transient = 1;
+	resource->format = format;
+	resource->extent = extent;
+	resource->usage = usage;
+	resource->aspect = aspect;
+	return this->resource_count++;
+}
+
+void vulkan_render_graph__set_output(struct vulkan_render_graph *this, int resource, enum vulkan_render_graph_usage final_usage) {
+	this->resources[resource].output = 1;
+	this->resources[resource].final_usage = final_usage;
+}
+
+int vulkan_render_graph__add_pass(struct vulkan_render_graph *this, const char *name, void (*record)(void *user_data, VkCommandBuffer command_buffer), void *user_data) {
+	if (this->pass_count == VULKAN_RENDER_GRAPH__MAX_PASSES) {
+		return -1;
+	}
+	struct vulkan_render_graph_pass *pass = this->passes + this->pass_count;
+	pass->name = name;
+	pass->record = record;
+	pass->user_data = user_data;
+	pass->access_count = 0;
+	pass->kept = 0;
+	pass->culled = 0;
+	return this->pass_count++;
+}
+
+int vulkan_render_graph__access(struct vulkan_render_graph *this, int pass, int resource, enum vulkan_render_graph_usage usage) {
+	struct vulkan_render_graph_pass *graph_pass = this->passes + pass;
+	if (graph_pass->access_count == VULKAN_RENDER_GRAPH__MAX_PASS_ACCESSES) {
+		return -1;
+	}
+	graph_pass->accesses[graph_pass->access_count].resource = resource;
+	graph_pass->accesses[graph_pass->access_count].usage = usage;
+	++graph_pass->access_count;
+	return 0;
+}
+
+void vulkan_render_graph__keep_pass(struct vulkan_render_graph *this, int pass) {
+	this->passes[pass].kept = 1;
+}
+
+static void cull_passes(struct vulkan_render_graph *this) {
+	int needed[VULKAN_RENDER_GRAPH__MAX_RESOURCES];
+	for (int i = 0; i < this->resource_count; ++i) {
+		needed[i] = this->resources[i].output;
+	}
+
+	for (int i = this->pass_count - 1; i >= 0; --i) {
+		struct vulkan_render_graph_pass *pass = this->passes + i;
+		pass->culled = !pass->kept;
+		for (int j = 0; j < pass->access_count && pass->culled; ++j) {
+			if (usage_infos[pass->accesses[j].usage].write && needed[pass->accesses[j].resource]) {
+				pass->culled = 0;
+				break;
+			}
+		}
+		if (pass->culled) {
+			continue;
+		}
+		for (int j = 0; j < pass->access_count; ++j) {
+			needed[pass->accesses[j].resource] = 1;
+		}
+	}
+}
+
+static void compute_lifetimes(struct vulkan_render_graph *this) {
+	for (int i = 0; i < this->resource_count; ++i) {
+		this->resources[i].first_pass = -1;
+		this->resources[i].last_pass = -1;
+	}
+	for (int i = 0; i < this->pass_count; ++i) {
+		struct vulkan_render_graph_pass *pass = this->passes + i;
+		if (pass->culled) {
+			continue;
+		}
+		for (int j = 0; j < pass->access_count; ++j) {
+			struct vulkan_render_graph_resource *resource = this->resources + pass->accesses[j].resource;
+			if (resource->first_pass < 0) {
+				resource->first_pass = i;
+			}
+			resource->last_pass = i;
+		}
+	}
+}
+
+static int lifetimes_overlap(struct vulkan_render_graph_resource *a, struct vulkan_render_graph_resource *b) {
+	return !(a->last_pass < b->first_pass || b->last_pass < a->first_pass);
+}
+
+static int memory_overlaps(struct vulkan_render_graph_resource *a, struct vulkan_render_graph_resource *b) {
+	return a->memory_offset < b->memory_offset + b->memory_size && b->memory_offset < a->memory_offset + a->memory_size;
+}
+
+static int is_alive_transient(struct vulkan_render_graph_resource *resource) {
+	return resource->transient && resource->first_pass >= 0;
+}
+
+static int try_create_transient_images(struct vulkan_render_graph *this) {
+	VkDeviceSize alignments[VULKAN_RENDER_GRAPH__MAX_RESOURCES];
+	int placed[VULKAN_RENDER_GRAPH__MAX_RESOURCES];
+	int placed_count = 0;
+	uint32_t memory_type_bits = 0xFFFFFFFF;
+	this->transient_memory_size = 0;
+
+	for (int i = 0; i < this->resource_count; ++i) {
+		struct vulkan_render_graph_resource *resource = this->resources + i;
+		if (!is_alive_transient(resource)) {
+			continue;
+		}
+
+		VkImageCreateInfo create_info;
+		create_info.sType = VK_STRUCTURE_TYPE_IMAGE_CREATE_INFO;
+		create_info.pNext = 0;
+		create_info.flags = VK_IMAGE_CREATE_ALIAS_BIT;
+		create_info.imageType = VK_IMAGE_TYPE_2D;
+		create_info.format = resource->format;
+		create_info.extent.width = resource->extent.width;
+		create_info.extent.height = resource->extent.height;
+		create_info.extent.depth = 1;
+		create_info.mipLevels = 1;
+		create_info.arrayLayers = 1;
+		create_info.samples = VK_SAMPLE_COUNT_1_BIT;
+		create_info.tiling = VK_IMAGE_TILING_OPTIMAL;
+		create_info.usage = resource->usage;
+		create_info.sharingMode = VK_SHARING_MODE_EXCLUSIVE;
+		create_info.queueFamilyIndexCount = 0;
+		create_info.pQueueFamilyIndices = 0;
+		create_info.initialLayout = VK_IMAGE_LAYOUT_UNDEFINED;
+
+		if (vkCreateImage(this->base->device, &create_info, this->base->allocator, &resource->image) != VK_SUCCESS) {
+			resource->image = VK_NULL_HANDLE;
+			return -1;
+		}
+		VkMemoryRequirements requirements;
+		vkGetImageMemoryRequirements(this->base->device, resource->image, &requirements);
+		resource->memory_size = requirements.size;
+		alignments[i] = requirements.alignment;
+		memory_type_bits &= requirements.memoryTypeBits;
+	}
+
+	// Largest first, each at the lowest offset not used by an image that is alive at the same time
+	while (1) {
+		int largest = -1;
+		for (int i = 0; i < this->resource_count; ++i) {
+			struct vulkan_render_graph_resource *resource = this->resources + i;
+			if (!is_alive_transient(resource)) {
+				continue;
+			}
+			int is_placed = 0;
+			for (int j = 0; j < placed_count; ++j) {
+				is_placed |= placed[j] == i;
+			}
+			if (!is_placed && (largest < 0 || resource->memory_size > this->resources[largest].memory_size)) {
+				largest = i;
+			}
+		}
+		if (largest < 0) {
+			break;
+		}
+
+		struct vulkan_render_graph_resource *resource = this->resources + largest;
+		resource->memory_offset = 0;
+		for (int i = 0; i < placed_count; ++i) {
+			struct vulkan_render_graph_resource *other = this->resources + placed[i];
+			if (lifetimes_overlap(resource, other) && memory_overlaps(resource, other)) {
+				VkDeviceSize alignment = alignments[largest];
+				resource->memory_offset = (other->memory_offset + other->memory_size + alignment - 1)/alignment*alignment;
+				i = -1;
+			}
+		}
+		if (resource->memory_offset + resource->memory_size > this->transient_memory_size) {
+			this->transient_memory_size = resource->memory_offset + resource->memory_size;
+		}
+		placed[placed_count++] = largest;
+	}
+	if (placed_count == 0) {
+		return 0;
+	}
+
+	int memory_type = vulkan_base__find_memory_type(this->base, memory_type_bits, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT);
+	if (memory_type < 0) {
+		return -2;
+	}
+	VkMemoryAllocateInfo allocate_info;
+	allocate_info.sType = VK_STRUCTURE_TYPE_MEMORY_ALLOCATE_INFO;
+	allocate_info.pNext = 0;
+	allocate_info.allocationSize = this->transient_memory_size;
+	allocate_info.memoryTypeIndex = (uint32_t) memory_type;
+	if (vulkan_base__try_allocate_memory(this->base, &allocate_info, &this->transient_memory) < 0) {
+		this->transient_memory = VK_NULL_HANDLE;
+		return -3;
+	}
+
+	for (int i = 0; i < placed_count; ++i) {
+		struct vulkan_render_graph_resource *resource = this->resources + placed[i];
+		if (vkBindImageMemory(this->base->device, resource->image, this->transient_memory, resource->memory_offset) != VK_SUCCESS) {
+			return -4;
+		}
+
+		VkImageViewCreateInfo view_create_info;
+		view_create_info.sType = VK_STRUCTURE_TYPE_IMAGE_VIEW_CREATE_INFO;
+		view_create_info.pNext = 0;
+		view_create_info.flags = 0;
+		view_create_info.image = resource->image;
+		view_create_info.viewType = VK_IMAGE_VIEW_TYPE_2D;
+		view_create_info.format = resource->format;
+		view_create_info.components.r = VK_COMPONENT_SWIZZLE_IDENTITY;
+		view_create_info.components.g = VK_COMPONENT_SWIZZLE_IDENTITY;
+		view_create_info.components.b = VK_COMPONENT_SWIZZLE_IDENTITY;
+		view_create_info.components.a = VK_COMPONENT_SWIZZLE_IDENTITY;
+		view_create_info.subresourceRange.aspectMask = resource->aspect;
+		view_create_info.subresourceRange.baseMipLevel = 0;
+		view_create_info.subresourceRange.levelCount = 1;
+		view_create_info.subresourceRange.baseArrayLayer = 0;
+		view_create_info.subresourceRange.layerCount = 1;
+
+		if (vkCreateImageView(this->base->device, &view_create_info, this->base->allocator, &resource->image_view) != VK_SUCCESS) {
+			resource->image_view = VK_NULL_HANDLE;
+			return -5;
+		}
+	}
+	return 0;
+}
+
+static int try_add_barrier(struct vulkan_render_graph *this, int pass, int resource, VkAccessFlags src_access, VkAccessFlags dst_access, VkImageLayout old_layout, VkImageLayout new_layout) {
+	if (this->barrier_count == VULKAN_RENDER_GRAPH__MAX_BARRIERS) {
+		return -1;
+	}
+	struct vulkan_render_graph_barrier *barrier = this->barriers + this->barrier_count++;
+	barrier->pass = pass;
+	barrier->resource = resource;
+	barrier->src_access = src_access;
+	barrier->dst_access = dst_access;
+	barrier->old_layout = old_layout;
+	barrier->new_layout = new_layout;
+	return 0;
+}
+
+static int try_transition(struct vulkan_render_graph *this, struct resource_state *states, int pass, int resource, const struct usage_info *usage) {
+	struct resource_state *state = states + resource;
+	int is_image = this->resources[resource].is_image;
+
+	if (is_image && usage->layout != state->layout) {
+		this->src_stages[pass] |= state->write_stages | state->read_stages;
+		this->dst_stages[pass] |= usage->stage;
+		if (try_add_barrier(this, pass, resource, state->write_access, usage->access, state->layout, usage->layout) < 0) {
+			return -1;
+		}
+		state->layout = usage->layout;
+		state->write_stages = usage->stage;
+		state->write_access = usage->access & WRITE_ACCESS_MASK;
+		state->read_stages = 0;
+		state->visible_stages = usage->stage;
+		state->visible_access = usage->access;
+		return 0;
+	}
+
+	if (state->write_stages) {
+		int visible = (usage->stage & ~state->visible_stages) == 0 && (usage->access & ~state->visible_access) == 0;
+		if (!visible || usage->write) {
+			this->src_stages[pass] |= state->write_stages | (usage->write ? state->read_stages : 0);
+			this->dst_stages[pass] |= usage->stage;
+			if (try_add_barrier(this, pass, resource, state->write_access, usage->access, state->layout, state->layout) < 0) {
+				return -2;
+			}
+			state->visible_stages |= usage->stage;
+			state->visible_access |= usage->access;
+		}
+	} else if (usage->write && state->read_stages) {
+		// Write after read only needs an execution dependency
+		this->src_stages[pass] |= state->read_stages;
+		this->dst_stages[pass] |= usage->stage;
+	}
+
+	if (usage->write) {
+		state->write_stages = usage->stage;
+		state->write_access = usage->access & WRITE_ACCESS_MASK;
+		state->read_stages = 0;
+		state->visible_stages = 0;
+		state->visible_access = 0;
+	} else {
+		state->read_stages |= usage->stage;
+	}
+	return 0;
+}
+
+static int try_compute_barriers(struct vulkan_render_graph *this) {
+	struct resource_state states[VULKAN_RENDER_GRAPH__MAX_RESOURCES];
+	for (int i = 0; i < this->resource_count; ++i) {
+		struct vulkan_render_graph_resource *resource = this->resources + i;
+		memset(states + i, 0, sizeof(*states));
+		states[i].read_stages = resource->initial_stage;
+		states[i].layout = resource->transient ? VK_IMAGE_LAYOUT_UNDEFINED : resource->initial_layout;
+	}
+	for (int i = 0; i <= this->pass_count; ++i) {
+		this->src_stages[i] = 0;
+		this->dst_stages[i] = 0;
+	}
+	this->barrier_count = 0;
+
+	for (int i = 0; i < this->pass_count; ++i) {
+		struct vulkan_render_graph_pass *pass = this->passes + i;
+		if (pass->culled) {
+			continue;
+		}
+		for (int j = 0; j < pass->access_count; ++j) {
+			int resource = pass->accesses[j].resource;
+			// Aliased memory must be done with the previous images before it is reused
+			if (this->resources[resource].transient && this->resources[resource].first_pass == i) {
+				for (int k = 0; k < this->resource_count; ++k) {
+					struct vulkan_render_graph_resource *other = this->resources + k;
+					if (k != resource && is_alive_transient(other) && other->last_pass < i && memory_overlaps(this->resources + resource, other)) {
+						states[resource].read_stages |= states[k].write_stages | states[k].read_stages;
+						states[resource].write_access |= states[k].write_access;
+					}
+				}
+			}
+			if (try_transition(this, states, i, resource, usage_infos + pass->accesses[j].usage) < 0) {
+				return -1;
+			}
+		}
+	}
+
+	for (int i = 0; i < this->resource_count; ++i) {
+		if (this->resources[i].output && try_transition(this, states, this->pass_count, i, usage_infos + this->resources[i].final_usage) < 0) {
+			return -2;
+		}
+	}
+	return 0;
+}
+
+int vulkan_render_graph__try_compile(struct vulkan_render_graph *this) {
+	free_transient_images(this);
+	cull_passes(this);
+	compute_lifetimes(this);
+
+	if (try_create_transient_images(this) < 0) {
+		free_transient_images(this);
+		return -1;
+	}
+	if (try_compute_barriers(this) < 0) {
+		free_transient_images(this);
+		return -2;
+	}
+	return 0;
+}
+
+void vulkan_render_graph__set_image(struct vulkan_render_graph *this, int resource, VkImage image, VkImageView image_view) {
+	this->resources[resource].image = image;
+	this->resources[resource].image_view = image_view;
+}
+
+static void record_barriers(struct vulkan_render_graph *this, VkCommandBuffer command_buffer, int pass) {
+	if (!this->src_stages[pass] && !this->dst_stages[pass]) {
+		return;
+	}
+	VkImageMemoryBarrier image_barriers[VULKAN_RENDER_GRAPH__MAX_RESOURCES + VULKAN_RENDER_GRAPH__MAX_PASS_ACCESSES];
+	uint32_t image_barrier_count = 0;
+	VkBufferMemoryBarrier buffer_barriers[VULKAN_RENDER_GRAPH__MAX_RESOURCES + VULKAN_RENDER_GRAPH__MAX_PASS_ACCESSES];
+	uint32_t buffer_barrier_count = 0;
+
+	for (int i = 0; i < this->barrier_count; ++i) {
+		struct vulkan_render_graph_barrier *barrier = this->barriers + i;
+		if (barrier->pass != pass) {
+			continue;
+		}
+		struct vulkan_render_graph_resource *resource = this->resources + barrier->resource;
+		if (resource->is_image) {
+			VkImageMemoryBarrier *image_barrier = image_barriers + image_barrier_count++;
+			image_barrier->sType = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER;
+			image_barrier->pNext = 0;
+			image_barrier->srcAccessMask = barrier->src_access;
+			image_barrier->dstAccessMask = barrier->dst_access;
+			image_barrier->oldLayout = barrier->old_layout;
+			image_barrier->newLayout = barrier->new_layout;
+			image_barrier->srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+			image_barrier->dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+			image_barrier->image = resource->image;
+			image_barrier->subresourceRange.aspectMask = resource->aspect;
+			image_barrier->subresourceRange.baseMipLevel = 0;
+			image_barrier->subresourceRange.levelCount = VK_REMAINING_MIP_LEVELS;
+			image_barrier->subresourceRange.baseArrayLayer = 0;
+			image_barrier->subresourceRange.layerCount = VK_REMAINING_ARRAY_LAYERS;
+		} else {
+			VkBufferMemoryBarrier *buffer_barrier = buffer_barriers + buffer_barrier_count++;
+			buffer_barrier->sType = VK_STRUCTURE_TYPE_BUFFER_MEMORY_BARRIER;
+			buffer_barrier->pNext = 0;
+			buffer_barrier->srcAccessMask = barrier->src_access;
+			buffer_barrier->dstAccessMask = barrier->dst_access;
+			buffer_barrier->srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+			buffer_barrier->dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+			buffer_barrier->buffer = resource->buffer;
+			buffer_barrier->offset = 0;
+			buffer_barrier->size = VK_WHOLE_SIZE;
+		}
+	}
+
+	VkPipelineStageFlags src_stages = this->src_stages[pass] ? this->src_stages[pass] : VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT;
+	VkPipelineStageFlags dst_stages = this->dst_stages[pass] ? this->dst_stages[pass] : VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT;
+	vkCmdPipelineBarrier(command_buffer, src_stages, dst_stages, 0, 0, 0, buffer_barrier_count, buffer_barriers, image_barrier_count, image_barriers);
+}
+
+void vulkan_render_graph__record(struct vulkan_render_graph *this, VkCommandBuffer command_buffer) {
+	uint32_t first_query = (uint32_t) (this->statistics_frame*this->pass_count);
+	if (this->statistics_pool != VK_NULL_HANDLE) {
+		vkCmdResetQueryPool(command_buffer, this->statistics_pool, first_query, (uint32_t) this->pass_count);
+	}
+	for (int i = 0; i < this->pass_count; ++i) {
+		struct vulkan_render_graph_pass *pass = this->passes + i;
+		if (pass->culled) {
+			continue;
+		}
+		record_barriers(this, command_buffer, i);
+		vulkan_base__cmd_begin_label(this->base, command_buffer, pass->name);
+		if (this->statistics_pool != VK_NULL_HANDLE) {
+			vkCmdBeginQuery(command_buffer, this->statistics_pool, first_query + (uint32_t) i, 0);
+		}
+		pass->record(pass->user_data, command_buffer);
+		if (this->statistics_pool != VK_NULL_HANDLE) {
+			vkCmdEndQuery(command_buffer, this->statistics_pool, first_query + (uint32_t) i);
+		}
+		vulkan_base__cmd_end_label(this->base, command_buffer);
+	}
+	record_barriers(this, command_buffer, this->pass_count);
+}
+
+int vulkan_render_graph__try_init_statistics(struct vulkan_render_graph *this, int frame_count) {
+	this->statistics_frame_count = frame_count;
+	this->statistics_frame = 0;
+	if (this->base->enabled_features.pipelineStatisticsQuery != VK_TRUE || this->pass_count == 0) {
+		return 0;
+	}
+
+	VkQueryPoolCreateInfo create_info;
+	create_info.sType = VK_STRUCTURE_TYPE_QUERY_POOL_CREATE_INFO;
+	create_info.pNext = 0;
+	create_info.flags = 0;
+	create_info.queryType = VK_QUERY_TYPE_PIPELINE_STATISTICS;
+	create_info.queryCount = (uint32_t) (frame_count*this->pass_count);
+	create_info.pipelineStatistics = VULKAN_RENDER_GRAPH__STATISTICS;
+	if (vkCreateQueryPool(this->base->device, &create_info, this->base->allocator, &this->statistics_pool) != VK_SUCCESS) {
+		this->statistics_pool = VK_NULL_HANDLE;
+		return -1;
+	}
+	return 0;
+}
+
+void vulkan_render_graph__set_statistics_frame(struct vulkan_render_graph *this, int frame) {
+	this->statistics_frame = frame;
+}
+
+int vulkan_render_graph__get_statistics(struct vulkan_render_graph *this, struct vulkan_render_graph_statistics *statistics_out) {
+	if (this->statistics_pool == VK_NULL_HANDLE) {
+		return -1;
+	}
+	// The statistics followed by the availability
+	uint64_t results[sizeof(struct vulkan_render_graph_statistics)/sizeof(uint64_t) + 1];
+	for (int frame = 0; frame < this->statistics_frame_count; ++frame) {
+		int available = 1;
+		for (int i = 0; i < this->pass_count && available; ++i) {
+			if (this->passes[i].culled) {
+				continue;
+			}
+			uint32_t query = (uint32_t) (frame*this->pass_count + i);
+			VkResult result = vkGetQueryPoolResults(this->base->device, this->statistics_pool, query, 1, sizeof(results), results, sizeof(results),
+													VK_QUERY_RESULT_64_BIT | VK_QUERY_RESULT_WITH_AVAILABILITY_BIT);
+			available = (result == VK_SUCCESS || result == VK_NOT_READY) && results[sizeof(results)/sizeof(*results) - 1] != 0;
+			memcpy(statistics_out + i, results, sizeof(*statistics_out));
+		}
+		if (available) {
+			return 0;
+		}
+	}
+	return -2;
+}
@@ -0,0 +1,131 @@
+#pragma once
+
+#include <vulkan/vulkan.h>
+#include "vulkan_base.h"
+
+#define VULKAN_RENDER_GRAPH__MAX_RESOURCES 32
+#define VULKAN_RENDER_GRAPH__MAX_PASSES 32
+#define VULKAN_RENDER_GRAPH__MAX_PASS_ACCESSES 8
+#define VULKAN_RENDER_GRAPH__MAX_BARRIERS (VULKAN_RENDER_GRAPH__MAX_PASSES*VULKAN_RENDER_GRAPH__MAX_PASS_ACCESSES + VULKAN_RENDER_GRAPH__MAX_RESOURCES)
+
+enum vulkan_render_graph_usage {
+	VULKAN_RENDER_GRAPH__USAGE_COLOR_ATTACHMENT,
+	VULKAN_RENDER_GRAPH__USAGE_DEPTH_ATTACHMENT,
+	VULKAN_RENDER_GRAPH__USAGE_SAMPLED,
+	VULKAN_RENDER_GRAPH__USAGE_STORAGE_READ,
+	VULKAN_RENDER_GRAPH__USAGE_STORAGE_WRITE,
+	VULKAN_RENDER_GRAPH__USAGE_STORAGE_READ_WRITE,
+	// Storage writes from fragment shaders, the others are for compute
+	VULKAN_RENDER_GRAPH__USAGE_FRAGMENT_STORAGE_WRITE,
+	VULKAN_RENDER_GRAPH__USAGE_INDIRECT,
+	VULKAN_RENDER_GRAPH__USAGE_VERTEX,
+	VULKAN_RENDER_GRAPH__USAGE_INDEX,
+	VULKAN_RENDER_GRAPH__USAGE_TRANSFER_SRC,
+	VULKAN_RENDER_GRAPH__USAGE_TRANSFER_DST,
+	VULKAN_RENDER_GRAPH__USAGE_PRESENT,
+	VULKAN_RENDER_GRAPH__USAGE_HOST_READ
+};
+
+struct vulkan_render_graph_resource {
+	int is_image;
+	int transient;
+	int output;
+	enum vulkan_render_graph_usage final_usage;
+	VkBuffer buffer;
+	VkImage image;
+	VkImageView image_view;
+	VkImageAspectFlags aspect;
+	VkImageLayout initial_layout;
+	VkPipelineStageFlags initial_stage;
+
+	VkFormat format;
+	VkExtent2D extent;
+	VkImageUsageFlags usage;
+	VkDeviceSize memory_offset;
+	VkDeviceSize memory_size;
+	int first_pass;
+	int last_pass;
+};
+
+struct vulkan_render_graph_access {
+	int resource;
+	enum vulkan_render_graph_usage usage;
+};
+
+struct vulkan_render_graph_pass {
+	const char *name;
+	void (*record)(void *user_data, VkCommandBuffer command_buffer);
+	void *user_data;
+	struct vulkan_render_graph_access accesses[VULKAN_RENDER_GRAPH__MAX_PASS_ACCESSES];
+	int access_count;
+	// Passes with effects outside the graph's resources, never culled
+	int kept;
+	int culled;
+};
+
+struct vulkan_render_graph_barrier {
+	int pass;
+	int resource;
+	VkAccessFlags src_access;
+	VkAccessFlags dst_access;
+	VkImageLayout old_layout;
+	VkImageLayout new_layout;
+};
+
+// In the order Vulkan writes them for VULKAN_RENDER_GRAPH__STATISTICS
+struct vulkan_render_graph_statistics {
+	uint64_t vertex_invocations;
+	uint64_t clipping_invocations;
+	uint64_t clipping_primitives;
+	uint64_t fragment_invocations;
+	uint64_t compute_invocations;
+};
+
+#define VULKAN_RENDER_GRAPH__STATISTICS (VK_QUERY_PIPELINE_STATISTIC_VERTEX_SHADER_INVOCATIONS_BIT | VK_QUERY_PIPELINE_STATISTIC_CLIPPING_INVOCATIONS_BIT | \
+										 VK_QUERY_PIPELINE_STATISTIC_CLIPPING_PRIMITIVES_BIT | VK_QUERY_PIPELINE_STATISTIC_FRAGMENT_SHADER_INVOCATIONS_BIT | \
+										 VK_QUERY_PIPELINE_STATISTIC_COMPUTE_SHADER_INVOCATIONS_BIT)
+
+struct vulkan_render_graph {
+	struct vulkan_base *base;
+	struct vulkan_render_graph_resource resources[VULKAN_RENDER_GRAPH__MAX_RESOURCES];
+	int resource_count;
+	struct vulkan_render_graph_pass passes[VULKAN_RENDER_GRAPH__MAX_PASSES];
+	int pass_count;
+
+	struct vulkan_render_graph_barrier barriers[VULKAN_RENDER_GRAPH__MAX_BARRIERS];
+	int barrier_count;
+	VkPipelineStageFlags src_stages[VULKAN_RENDER_GRAPH__MAX_PASSES + 1];
+	VkPipelineStageFlags dst_stages[VULKAN_RENDER_GRAPH__MAX_PASSES + 1];
+	VkDeviceMemory transient_memory;
+	VkDeviceSize transient_memory_size;
+
+	// One query per pass for each frame, see vulkan_render_graph__try_init_statistics
+	VkQueryPool statistics_pool;
+	int statistics_frame_count;
+	int statistics_frame;
+};
+
+void vulkan_render_graph__init(struct vulkan_render_graph *this, struct vulkan_base *base);
+void vulkan_render_graph__free(struct vulkan_render_graph *this);
+
+int vulkan_render_graph__import_buffer(struct vulkan_render_graph *this, VkBuffer buffer, VkPipelineStageFlags initial_stage);
+int vulkan_render_graph__import_image(struct vulkan_render_graph *this, VkImage image, VkImageView image_view, VkImageAspectFlags aspect, VkImageLayout initial_layout, VkPipelineStageFlags initial_stage);
+int vulkan_render_graph__create_image(struct vulkan_render_graph *this, VkFormat format, VkExtent2D extent, VkImageUsageFlags usage, VkImageAspectFlags aspect);
+void vulkan_render_graph__set_output(struct vulkan_render_graph *this, int resource, enum vulkan_render_graph_usage final_usage);
+
+int vulkan_render_graph__add_pass(struct vulkan_render_graph *this, const char *name, void (*record)(void *user_data, VkCommandBuffer command_buffer), void *user_data);
+int vulkan_render_graph__access(struct vulkan_render_graph *this, int pass, int resource, enum vulkan_render_graph_usage usage);
+void vulkan_render_graph__keep_pass(struct vulkan_render_graph *this, int pass);
+
+int vulkan_render_graph__try_compile(struct vulkan_render_graph *this);
+void vulkan_render_graph__set_image(struct vulkan_render_graph *this, int resource, VkImage image, VkImageView image_view);
+void vulkan_render_graph__record(struct vulkan_render_graph *this, VkCommandBuffer command_buffer);
+
+// After try_compile, wraps every pass in a pipeline statistics query. Each of frame_count command buffers gets its own
+// queries so one can be read while another is in flight. Does nothing without the pipelineStatisticsQuery feature.
+int vulkan_render_graph__try_init_statistics(struct vulkan_render_graph *this, int frame_count);
+// Picks the queries the next record writes
+void vulkan_render_graph__set_statistics_frame(struct vulkan_render_graph *this, int frame);
+// Fills one entry per pass from the first frame whose results are all available, without waiting. Negative if there
+// are no statistics or no frame has finished since its queries were reset.
+int vulkan_render_graph__get_statistics(struct vulkan_render_graph *this, struct vulkan_render_graph_statistics *statistics_out);
@@ -0,0 +1,309 @@
+#include <malloc.h>
+#include <string.h>
+#include "vulkan_scene.h"
+
+// Draw list key fields
+#define MAIN_PASS 0
+#define GRAPHICS_PIPELINE 0
+// Room for more blocks than the one frame_uniforms needs
+#define UNIFORM_FRAME_SIZE 1024
+#define MAX_UINT64 0xFFFFFFFFFFFFFFFF
+
+// The same block of the image's region every time, so the offset its command buffer was recorded with stays valid
+static uint32_t write_frame_uniforms(struct vulkan_scene *this, int image_index) {
+	vulkan_uniform_ring__begin_frame(&this->uniform_ring, image_index);
+	uint32_t offset;
+	void *block = vulkan_uniform_ring__allocate(&this->uniform_ring, sizeof(this->frame_uniforms), &offset);
+	memcpy(block, &this->frame_uniforms, sizeof(this->frame_uniforms));
+	return offset;
+}
+
+// Can't fill up, it has room for a draw per level of detail
+static void build_draws(struct vulkan_scene *this, int image_index) {
+	vulkan_draw_list__reset(&this->draw_list);
+	vulkan_culling__try_push_draws(this->culling, this->culling_view, &this->draw_list, this->draw_list.instances[image_index], MAIN_PASS, GRAPHICS_PIPELINE);
+	vulkan_draw_list__sort(&this->draw_list);
+}
+
+static void record_draws(struct vulkan_scene *this, VkCommandBuffer command_buffer) {
+	// Every pipeline shares the layout, so set 0 stays bound across them
+	uint32_t uniform_offset = write_frame_uniforms(this, this->record_image_index);
+	vkCmdBindDescriptorSets(command_buffer, VK_PIPELINE_BIND_POINT_GRAPHICS, this->swapchain->pipeline_layout, 0, 1, &this->uniform_ring.descriptor_set, 1,
+							&uniform_offset);
+	if (this->culling->gpu_driven) {
+		if (this->texture) {
+			vkCmdBindPipeline(command_buffer, VK_PIPELINE_BIND_POINT_GRAPHICS, this->swapchain->texture_pipeline);
+			vkCmdBindDescriptorSets(command_buffer, VK_PIPELINE_BIND_POINT_GRAPHICS, this->swapchain->pipeline_layout, VULKAN_DRAW_LIST__MATERIAL_SET, 1,
+									&this->texture->descriptor_set, 0, 0);
+		} else {
+			vkCmdBindPipeline(command_buffer, VK_PIPELINE_BIND_POINT_GRAPHICS, this->swapchain->graphics_pipeline);
+		}
+		// The levels are picked on the device, so every draw shows as level 0
+		uint32_t lod = 0;
+		vkCmdPushConstants(command_buffer, this->swapchain->pipeline_layout, VULKAN_DRAW_LIST__PUSH_CONSTANT_STAGES, 0, sizeof(lod), &lod);
+		vulkan_culling__record_draw(this->culling, command_buffer);
+		return;
+	}
+	// Written in place for each frame by vulkan_scene__try_update_frame
+	build_draws(this, this->record_image_index);
+	vulkan_culling__bind_mesh(this->culling, command_buffer);
+	vulkan_draw_list__record_in_place(&this->draw_list, command_buffer, this->record_image_index);
+}
+
+static void record_main_pass(void *user_data, VkCommandBuffer command_buffer) {
+	struct vulkan_scene *this = (struct vulkan_scene *) user_data;
+
+	VkOffset2D render_area_offset;
+	render_area_offset.x = 0;
+	render_area_offset.y = 0;
+
+	VkClearValue clear_value;
+	clear_value.color.float32[0] = 0.0f;
+	clear_value.color.float32[1] = 0.0f;
+	clear_value.color.float32[2] = 0.0f;
+	clear_value.color.float32[3] = 1.0f;
+	clear_value.depthStencil.depth = 0.0f;
+	clear_value.depthStencil.stencil = 0;
+
+	if (this->base->dynamic_rendering) {
+		VkRenderingAttachmentInfo color_attachment;
+		color_attachment.sType = VK_STRUCTURE_TYPE_RENDERING_ATTACHMENT_INFO;
+		color_attachment.pNext = 0;
+		color_attachment.imageView = this->swapchain->imageviews[this->record_image_index];
+		color_attachment.imageLayout = VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL;
+		color_attachment.resolveMode = VK_RESOLVE_MODE_NONE;
+		color_attachment.resolveImageView = VK_NULL_HANDLE;
+		color_attachment.resolveImageLayout = VK_IMAGE_LAYOUT_UNDEFINED;
+		color_attachment.loadOp = VK_ATTACHMENT_LOAD_OP_CLEAR;
+		color_attachment.storeOp = VK_ATTACHMENT_STORE_OP_STORE;
+		color_attachment.clearValue = clear_value;
+
+		VkRenderingInfo rendering_info;
+		rendering_info.sType = VK_STRUCTURE_TYPE_RENDERING_INFO;
+		rendering_info.pNext = 0;
+		rendering_info.flags = 0;
+		rendering_info.renderArea.offset = render_area_offset;
+		rendering_info.renderArea.extent = this->swapchain->extent;
+		rendering_info.layerCount = 1;
+		rendering_info.viewMask = 0;
+		rendering_info.colorAttachmentCount = 1;
+		rendering_info.pColorAttachments = &color_attachment;
+		rendering_info.pDepthAttachment = 0;
+		rendering_info.pStencilAttachment = 0;
+
+		this->base->cmd_begin_rendering(command_buffer, &rendering_info);
+		record_draws(this, command_buffer);
+		this->base->cmd_end_rendering(command_buffer);
+		return;
+	}
+
+	VkRenderPassBeginInfo render_pass_begin_info;
+	render_pass_begin_info.sType = VK_STRUCTURE_TYPE_RENDER_PASS_BEGIN_INFO;
+	render_pass_begin_info.pNext = 0;
+	render_pass_begin_info.renderPass = this->swapchain->render_pass;
+	render_pass_begin_info.framebuffer = this->swapchain->framebuffers[this->record_image_index];
+	render_pass_begin_info.renderArea.offset = render_area_offset;
+	render_pass_begin_info.renderArea.extent = this->swapchain->extent;
+	render_pass_begin_info.clearValueCount = 1;
+	render_pass_begin_info.pClearValues = &clear_value;
+
+	vkCmdBeginRenderPass(command_buffer, &render_pass_begin_info, VK_SUBPASS_CONTENTS_INLINE);
+	record_draws(this, command_buffer);
+	vkCmdEndRenderPass(command_buffer);
+}
+
+static void record_readback_pass(void *user_data, VkCommandBuffer command_buffer) {
+	struct vulkan_scene *this = (struct vulkan_scene *) user_data;
+
+	VkBufferImageCopy region;
+	region.bufferOffset = 0;
+	region.bufferRowLength = 0;
+	region.bufferImageHeight = 0;
+	region.imageSubresource.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
+	region.imageSubresource.mipLevel = 0;
+	region.imageSubresource.baseArrayLayer = 0;
+	region.imageSubresource.layerCount = 1;
+	region.imageOffset.x = 0;
+	region.imageOffset.y = 0;
+	region.imageOffset.z = 0;
+	region.imageExtent.width = this->swapchain->extent.width;
+	region.imageExtent.height = this->swapchain->extent.height;
+	region.imageExtent.depth = 1;
+
+	vkCmdCopyImageToBuffer(command_buffer, this->swapchain->images[this->record_image_index], VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL,
+						   this->swapchain->readback_buffer, 1, &region);
+}
+
+static int try_build_render_graph(struct vulkan_scene *this) {
+	vulkan_render_graph__init(&this->render_graph, this->base);
+	if (vulkan_culling__try_add_passes(this->culling, &this->render_graph, this->culling_view) < 0) {
+		return -1;
+	}
+
+	this->swapchain_image_resource = vulkan_render_graph__import_image(&this->render_graph, VK_NULL_HANDLE, VK_NULL_HANDLE, VK_IMAGE_ASPECT_COLOR_BIT,
+																	   VK_IMAGE_LAYOUT_UNDEFINED, VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT);
+	int main_pass = vulkan_render_graph__add_pass(&this->render_graph, "main", record_main_pass, this);
+	if (this->swapchain_image_resource < 0 || main_pass < 0) {
+		return -2;
+	}
+	if (vulkan_render_graph__access(&this->render_graph, main_pass, this->swapchain_image_resource, VULKAN_RENDER_GRAPH__USAGE_COLOR_ATTACHMENT) < 0 ||
+		vulkan_culling__try_add_draw_accesses(this->culling, &this->render_graph, main_pass) < 0) {
+		return -3;
+	}
+	if (this->texture && vulkan_virtual_texture__try_add_feedback(this->texture, &this->render_graph, main_pass) < 0) {
+		return -3;
+	}
+
+	if (this->swapchain->offscreen) {
+		this->readback_buffer_resource = vulkan_render_graph__import_buffer(&this->render_graph, this->swapchain->readback_buffer, VK_PIPELINE_STAGE_HOST_BIT);
+		int readback_pass = vulkan_render_graph__add_pass(&this->render_graph, "readback", record_readback_pass, this);
+		if (this->readback_buffer_resource < 0 || readback_pass < 0) {
+			return -4;
+		}
+		if (vulkan_render_graph__access(&this->render_graph, readback_pass, this->swapchain_image_resource, VULKAN_RENDER_GRAPH__USAGE_TRANSFER_SRC) < 0 ||
+			vulkan_render_graph__access(&this->render_graph, readback_pass, this->readback_buffer_resource, VULKAN_RENDER_GRAPH__USAGE_TRANSFER_DST) < 0) {
+			return -5;
+		}
+		vulkan_render_graph__set_output(&this->render_graph, this->readback_buffer_resource, VULKAN_RENDER_GRAPH__USAGE_HOST_READ);
+	} else {
+		vulkan_render_graph__set_output(&this->render_graph, this->swapchain_image_resource, VULKAN_RENDER_GRAPH__USAGE_PRESENT);
+	}
+
+	if (vulkan_render_graph__try_compile(&this->render_graph) < 0) {
+		return -6;
+	}
+	if (vulkan_render_graph__try_init_statistics(&this->render_graph, (int) this->swapchain->image_count) < 0) {
+		return -7;
+	}
+	return 0;
+}
+
+static int try_record_command_buffer(struct vulkan_scene *this, int image_index) {
+	// Clip space is two units high
+	vulkan_culling__set_lod_scale(this->culling, this->culling_view, 0.5f*(float) this->swapchain->extent.height);
+
+	VkCommandBufferBeginInfo command_begin_info;
+	command_begin_info.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO;
+	command_begin_info.pNext = 0;
+	command_begin_info.pInheritanceInfo = 0;
+	command_begin_info.flags = VK_COMMAND_BUFFER_USAGE_SIMULTANEOUS_USE_BIT;
+
+	if (vkBeginCommandBuffer(this->swapchain->command_buffers[image_index], &command_begin_info) != VK_SUCCESS) {
+		return -1;
+	}
+
+	this->record_image_index = image_index;
+	vulkan_render_graph__set_image(&this->render_graph, this->swapchain_image_resource, this->swapchain->images[image_index],
+								   this->swapchain->imageviews[image_index]);
+	vulkan_render_graph__set_statistics_frame(&this->render_graph, image_index);
+	vulkan_render_graph__record(&this->render_graph, this->swapchain->command_buffers[image_index]);
+
+	if (vkEndCommandBuffer(this->swapchain->command_buffers[image_index]) != VK_SUCCESS) {
+		return -2;
+	}
+	return 0;
+}
+
+static int try_record_command_buffers(struct vulkan_scene *this) {
+	for (int i = 0; i < this->swapchain->image_count; ++i) {
+		if (try_record_command_buffer(this, i) < 0) {
+			return -1;
+		}
+	}
+	return 0;
+}
+
+int vulkan_scene__try_init(struct vulkan_scene *this, struct vulkan_base *base, struct vulkan_swapchain *swapchain, struct vulkan_culling *culling,
+						   int culling_view) {
+	this->base = base;
+	this->swapchain = swapchain;
+	this->culling = culling;
+	this->culling_view = culling_view;
+	this->texture = 0;
+	memset(&this->frame_uniforms, 0, sizeof(this->frame_uniforms));
+	for (int i = 0; i < 4; ++i) {
+		this->frame_uniforms.view_projection[i*5] = 1.0f;
+	}
+	if (vulkan_draw_list__try_init(&this->draw_list, base, culling->mesh->lod_count) < 0) {
+		return -1;
+	}
+	return 0;
+}
+
+void vulkan_scene__free(struct vulkan_scene *this) {
+	vulkan_draw_list__free(&this->draw_list);
+}
+
+void vulkan_scene__set_texture(struct vulkan_scene *this, struct vulkan_virtual_texture *texture) {
+	this->texture = texture;
+}
+
+int vulkan_scene__try_init_graph(struct vulkan_scene *this) {
+	if (try_build_render_graph(this) < 0) {
+		vulkan_render_graph__free(&this->render_graph);
+		return -1;
+	}
+	if (this->texture) {
+		vulkan_draw_list__set_pipeline(&this->draw_list, GRAPHICS_PIPELINE, this->swapchain->texture_pipeline, this->swapchain->pipeline_layout);
+		vulkan_draw_list__set_material(&this->draw_list, 0, this->texture->descriptor_set);
+	} else {
+		vulkan_draw_list__set_pipeline(&this->draw_list, GRAPHICS_PIPELINE, this->swapchain->graphics_pipeline, this->swapchain->pipeline_layout);
+	}
+	// A slice of instances per level of detail when culling on the CPU
+	uint32_t instance_size = this->culling->gpu_driven ? 0 : sizeof(struct vulkan_culling_object);
+	if (vulkan_draw_list__try_init_frames(&this->draw_list, (int) this->swapchain->image_count, instance_size,
+										  this->culling->mesh->lod_count*this->culling->object_count) < 0) {
+		vulkan_render_graph__free(&this->render_graph);
+		return -2;
+	}
+	if (vulkan_uniform_ring__try_init(&this->uniform_ring, this->base, this->swapchain->uniform_set_layout, sizeof(this->frame_uniforms),
+									  UNIFORM_FRAME_SIZE, (int) this->swapchain->image_count) < 0) {
+		vulkan_draw_list__free_frames(&this->draw_list);
+		vulkan_render_graph__free(&this->render_graph);
+		return -3;
+	}
+	this->image_fences = malloc(this->swapchain->image_count*sizeof(*this->image_fences));
+	if (!this->image_fences) {
+		vulkan_uniform_ring__free(&this->uniform_ring);
+		vulkan_draw_list__free_frames(&this->draw_list);
+		vulkan_render_graph__free(&this->render_graph);
+		return -4;
+	}
+	for (uint32_t i = 0; i < this->swapchain->image_count; ++i) {
+		this->image_fences[i] = VK_NULL_HANDLE;
+	}
+	if (try_record_command_buffers(this) < 0) {
+		free(this->image_fences);
+		vulkan_uniform_ring__free(&this->uniform_ring);
+		vulkan_draw_list__free_frames(&this->draw_list);
+		vulkan_render_graph__free(&this->render_graph);
+		return -5;
+	}
+	return 0;
+}
+
+void vulkan_scene__free_graph(struct vulkan_scene *this) {
+	free(this->image_fences);
+	vulkan_uniform_ring__free(&this->uniform_ring);
+	vulkan_draw_list__free_frames(&this->draw_list);
+	vulkan_render_graph__free(&this->render_graph);
+}
+
+int vulkan_scene__try_update_frame(struct vulkan_scene *this, uint32_t image_index, VkFence fence) {
+	// Usually signaled long ago, images are acquired in turn
+	VkFence *image_fence = this->image_fences + image_index;
+	if (*image_fence != VK_NULL_HANDLE && *image_fence != fence) {
+		vkWaitForFences(this->base->device, 1, image_fence, VK_TRUE, MAX_UINT64);
+	}
+	*image_fence = fence;
+	// Culled on the CPU, the draws follow the objects through the instances and counts written in place. The image is
+	// only recorded again if the draws changed, which writes the uniforms too.
+	if (!this->culling->gpu_driven) {
+		build_draws(this, (int) image_index);
+		if (vulkan_draw_list__try_write_in_place(&this->draw_list, (int) image_index) < 0) {
+			return try_record_command_buffer(this, (int) image_index) < 0 ? -1 : 0;
+		}
+	}
+	write_frame_uniforms(this, (int) image_index);
+	return 0;
+}
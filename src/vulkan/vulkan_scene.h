@@ -0,0 +1,58 @@
+#pragma once
+
+#include <vulkan/vulkan.h>
+#include "vulkan_base.h"
+#include "vulkan_swapchain.h"
+#include "vulkan_culling.h"
+#include "vulkan_render_graph.h"
+#include "vulkan_mesh.h"
+#include "vulkan_draw_list.h"
+#include "vulkan_virtual_texture.h"
+
+// The Frame block of shader.vert, in std140 layout
+struct vulkan_scene_frame_uniforms {
+	// Column major, culling treats object space as clip space so it only makes sense with the identity for now
+	float view_projection[16];
+	// Blends in a color per level of detail, from 0 to 1
+	float lod_tint;
+	float padding[3];
+};
+
+struct vulkan_scene {
+	struct vulkan_base *base;
+	struct vulkan_swapchain *swapchain;
+	// Shared by every scene showing the same objects, and their passes are added to each scene's graph
+	struct vulkan_culling *culling;
+	// The culling's view this scene picks levels of detail with, no other scene may use it
+	int culling_view;
+	// Objects culled on the CPU, a draw per level of detail recorded in place and written again for each frame. GPU
+	// culling draws them all with one indirect draw.
+	struct vulkan_draw_list draw_list;
+	// Null unless set, objects are shaded from it with the swapchain's texture_pipeline
+	struct vulkan_virtual_texture *texture;
+	struct vulkan_render_graph render_graph;
+	// Written into the uniform ring when recording and by vulkan_scene__try_update_frame
+	struct vulkan_scene_frame_uniforms frame_uniforms;
+	// A region per swapchain image, which its command buffer reads
+	struct vulkan_uniform_ring uniform_ring;
+	// Signaled once the last submit of each image's command buffer is done, null before the first
+	VkFence *image_fences;
+	int swapchain_image_resource;
+	int readback_buffer_resource;
+	int record_image_index;
+};
+
+// Draws the objects of culling, which has to outlive the scene, with levels of detail kept in culling_view
+int vulkan_scene__try_init(struct vulkan_scene *this, struct vulkan_base *base, struct vulkan_swapchain *swapchain, struct vulkan_culling *culling,
+						   int culling_view);
+void vulkan_scene__free(struct vulkan_scene *this);
+// Before init_graph, the swapchain needs the texture's descriptor set layout as its texture_set_layout
+void vulkan_scene__set_texture(struct vulkan_scene *this, struct vulkan_virtual_texture *texture);
+
+// Builds the render graph for the current swapchain and records one command buffer per image
+int vulkan_scene__try_init_graph(struct vulkan_scene *this);
+void vulkan_scene__free_graph(struct vulkan_scene *this);
+// Writes frame_uniforms for the image's next submit, once the previous submit of the image is done. fence has to
+// signal when the next one is. Culling on the CPU also writes the draws of the image's command buffer in place, so they
+// follow the culling's latest objects.
+int vulkan_scene__try_update_frame(struct vulkan_scene *this, uint32_t image_index, VkFence fence);
@@ -1,39 +1,51 @@
 #include <malloc.h>
 #include "vulkan_swapchain.h"
-#include "../file/file.h"
+#include "vulkan_culling.h"
 
 #define PIPELINE_SAMPLES VK_SAMPLE_COUNT_1_BIT
 #define PREFERRED_IMAGE_COUNT 4
 
 static void free_swapchain(struct vulkan_swapchain *this) {
-    vkDestroySwapchainKHR(this->base->device, this->swapchain, 0);
+    if (this->offscreen) {
+        vkUnmapMemory(this->base->device, this->readback_memory);
+        vulkan_base__free_buffer(this->base, this->readback_buffer, this->readback_memory);
+        vkDestroyImage(this->base->device, this->images[0], this->base->allocator);
+        vulkan_base__free_memory(this->base, this->image_memory);
+    } else {
+        vkDestroySwapchainKHR(this->base->device, this->swapchain, this->base->allocator);
+    }
     free(this->images);
 }
 
 static void free_from_image_views(struct vulkan_swapchain *this) {
     for (int i = 0; i < this->image_count; ++i) {
-        vkDestroyImageView(this->base->device, this->imageviews[i], 0);
+        vkDestroyImageView(this->base->device, this->imageviews[i], this->base->allocator);
     }
     free(this->imageviews);
     free_swapchain(this);
 }
 
 static void free_from_render_pass(struct vulkan_swapchain *this) {
-    vkDestroyRenderPass(this->base->device, this->render_pass, 0);
+    if (this->render_pass != VK_NULL_HANDLE) {
+        vkDestroyRenderPass(this->base->device, this->render_pass, this->base->allocator);
+    }
     free_from_image_views(this);
 }
 
 static void free_from_graphics_pipeline(struct vulkan_swapchain *this) {
-    vkDestroyPipeline(this->base->device, this->graphics_pipeline, 0);
-    vkDestroyPipelineLayout(this->base->device, this->pipeline_layout, 0);
+    vkDestroyPipeline(this->base->device, this->texture_pipeline, this->base->allocator);
+    vkDestroyPipeline(this->base->device, this->graphics_pipeline, this->base->allocator);
+    vkDestroyPipelineLayout(this->base->device, this->pipeline_layout, this->base->allocator);
     free_from_render_pass(this);
 }
 
 static void free_from_framebuffers(struct vulkan_swapchain *this) {
-    for (int i = 0; i < this->image_count; ++i) {
-        vkDestroyFramebuffer(this->base->device, this->framebuffers[i], 0);
+    if (this->framebuffers) {
+        for (int i = 0; i < this->image_count; ++i) {
+            vkDestroyFramebuffer(this->base->device, this->framebuffers[i], this->base->allocator);
+        }
+        free(this->framebuffers);
     }
-    free(this->framebuffers);
     free_from_graphics_pipeline(this);
 }
 
@@ -48,12 +60,13 @@ struct try_query_swapchain {
     VkPresentModeKHR best_present_mode;
     uint32_t best_image_count;
     VkSurfaceFormatKHR best_surface_format;
+    VkImageUsageFlags supported_usage;
 }
 static try_query_swapchain(struct vulkan_swapchain *this) {
     struct try_query_swapchain result;
 
     VkSurfaceCapabilitiesKHR capabilities;
-    vkGetPhysicalDeviceSurfaceCapabilitiesKHR(this->base->physical_device, this->base->surface, &capabilities);
+    vkGetPhysicalDeviceSurfaceCapabilitiesKHR(this->base->physical_device, this->surface, &capabilities);
 
     if (capabilities.maxImageCount < PREFERRED_IMAGE_COUNT) {
         result.best_image_count = capabilities.maxImageCount;
@@ -61,12 +74,13 @@ static try_query_swapchain(struct vulkan_swapchain *this) {
         result.best_image_count = PREFERRED_IMAGE_COUNT;
     }
 
+    result.supported_usage = capabilities.supportedUsageFlags;
     result.best_present_mode = VK_PRESENT_MODE_FIFO_KHR; // Always supported
 
     uint32_t present_mode_count;
-    vkGetPhysicalDeviceSurfacePresentModesKHR(this->base->physical_device, this->base->surface, &present_mode_count, 0);
+    vkGetPhysicalDeviceSurfacePresentModesKHR(this->base->physical_device, this->surface, &present_mode_count, 0);
     VkPresentModeKHR present_modes[present_mode_count];
-    vkGetPhysicalDeviceSurfacePresentModesKHR(this->base->physical_device, this->base->surface, &present_mode_count, present_modes);
+    vkGetPhysicalDeviceSurfacePresentModesKHR(this->base->physical_device, this->surface, &present_mode_count, present_modes);
 
     for (int i = 0; i < present_mode_count; ++i) {
         VkPresentModeKHR present_mode = present_modes[i];
@@ -80,13 +94,13 @@ static try_query_swapchain(struct vulkan_swapchain *this) {
     }
 
     uint32_t surface_format_count;
-    vkGetPhysicalDeviceSurfaceFormatsKHR(this->base->physical_device, this->base->surface, &surface_format_count, 0);
+    vkGetPhysicalDeviceSurfaceFormatsKHR(this->base->physical_device, this->surface, &surface_format_count, 0);
     if (surface_format_count < 1) {
         result.result = -1;
         return result;
     }
     VkSurfaceFormatKHR surface_formats[surface_format_count];
-    vkGetPhysicalDeviceSurfaceFormatsKHR(this->base->physical_device, this->base->surface, &surface_format_count, surface_formats);
+    vkGetPhysicalDeviceSurfaceFormatsKHR(this->base->physical_device, this->surface, &surface_format_count, surface_formats);
     if (surface_formats[0].format == VK_FORMAT_UNDEFINED) {
         result.best_surface_format.format = VK_FORMAT_B8G8R8A8_UNORM;
         result.best_surface_format.colorSpace = VK_COLOR_SPACE_SRGB_NONLINEAR_KHR;
@@ -105,18 +119,101 @@ static try_query_swapchain(struct vulkan_swapchain *this) {
     return result;
 }
 
+static int try_create_offscreen_image(struct vulkan_swapchain *this, int width, int height) {
+    this->surface_format.format = VK_FORMAT_R8G8B8A8_UNORM;
+    this->surface_format.colorSpace = VK_COLOR_SPACE_SRGB_NONLINEAR_KHR;
+    this->extent.width = (uint32_t) width;
+    this->extent.height = (uint32_t) height;
+    this->image_count = 1;
+    this->images = malloc(sizeof(*this->images));
+    if (!this->images) {
+        return -1;
+    }
+
+    VkImageCreateInfo create_info;
+    create_info.sType = VK_STRUCTURE_TYPE_IMAGE_CREATE_INFO;
+    create_info.pNext = 0;
+    create_info.flags = 0;
+    create_info.imageType = VK_IMAGE_TYPE_2D;
+    create_info.format = this->surface_format.format;
+    create_info.extent.width = this->extent.width;
+    create_info.extent.height = this->extent.height;
+    create_info.extent.depth = 1;
+    create_info.mipLevels = 1;
+    create_info.arrayLayers = 1;
+    create_info.samples = PIPELINE_SAMPLES;
+    create_info.tiling = VK_IMAGE_TILING_OPTIMAL;
+    create_info.usage = VK_IMAGE_USAGE_COLOR_ATTACHMENT_BIT | VK_IMAGE_USAGE_TRANSFER_SRC_BIT;
+    create_info.sharingMode = VK_SHARING_MODE_EXCLUSIVE;
+    create_info.queueFamilyIndexCount = 0;
+    create_info.pQueueFamilyIndices = 0;
+    create_info.initialLayout = VK_IMAGE_LAYOUT_UNDEFINED;
+
+    if (vkCreateImage(this->base->device, &create_info, this->base->allocator, this->images) != VK_SUCCESS) {
+        free(this->images);
+        return -2;
+    }
+
+    VkMemoryRequirements requirements;
+    vkGetImageMemoryRequirements(this->base->device, this->images[0], &requirements);
+    int memory_type = vulkan_base__find_memory_type(this->base, requirements.memoryTypeBits, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT);
+    if (memory_type < 0) {
+        vkDestroyImage(this->base->device, this->images[0], this->base->allocator);
+        free(this->images);
+        return -3;
+    }
+
+    VkMemoryAllocateInfo allocate_info;
+    allocate_info.sType = VK_STRUCTURE_TYPE_MEMORY_ALLOCATE_INFO;
+    allocate_info.pNext = 0;
+    allocate_info.allocationSize = requirements.size;
+    allocate_info.memoryTypeIndex = (uint32_t) memory_type;
+
+    if (vulkan_base__try_allocate_memory(this->base, &allocate_info, &this->image_memory) < 0) {
+        vkDestroyImage(this->base->device, this->images[0], this->base->allocator);
+        free(this->images);
+        return -4;
+    }
+    if (vkBindImageMemory(this->base->device, this->images[0], this->image_memory, 0) != VK_SUCCESS) {
+        vulkan_base__free_memory(this->base, this->image_memory);
+        vkDestroyImage(this->base->device, this->images[0], this->base->allocator);
+        free(this->images);
+        return -5;
+    }
+
+    VkDeviceSize readback_size = (VkDeviceSize) this->extent.width*this->extent.height*4;
+    if (vulkan_base__try_create_buffer(this->base, readback_size, VK_BUFFER_USAGE_TRANSFER_DST_BIT,
+                                       VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT,
+                                       &this->readback_buffer, &this->readback_memory) < 0) {
+        vulkan_base__free_memory(this->base, this->image_memory);
+        vkDestroyImage(this->base->device, this->images[0], this->base->allocator);
+        free(this->images);
+        return -6;
+    }
+    if (vkMapMemory(this->base->device, this->readback_memory, 0, VK_WHOLE_SIZE, 0, (void **) &this->readback_pixels) != VK_SUCCESS) {
+        vulkan_base__free_buffer(this->base, this->readback_buffer, this->readback_memory);
+        vulkan_base__free_memory(this->base, this->image_memory);
+        vkDestroyImage(this->base->device, this->images[0], this->base->allocator);
+        free(this->images);
+        return -7;
+    }
+    return 0;
+}
+
 static int try_create_swapchain(struct vulkan_swapchain *this, int window_width, int window_height) {
     struct try_query_swapchain query = try_query_swapchain(this);
     if (query.result < 0) {
         return -1;
     }
     this->surface_format = query.best_surface_format;
+    // Drop optional usage the surface can't do, color attachment is always supported
+    this->image_usage &= query.supported_usage | VK_IMAGE_USAGE_COLOR_ATTACHMENT_BIT;
 
     this->extent.width = (uint32_t) window_width;
     this->extent.height = (uint32_t) window_height;
     VkSwapchainCreateInfoKHR create_info;
     create_info.sType = VK_STRUCTURE_TYPE_SWAPCHAIN_CREATE_INFO_KHR;
-    create_info.surface = this->base->surface;
+    create_info.surface = this->surface;
     create_info.minImageCount = query.best_image_count;
     create_info.pNext = 0;
     create_info.flags = 0;
@@ -124,7 +221,7 @@ static int try_create_swapchain(struct vulkan_swapchain *this, int window_width,
     create_info.imageColorSpace = this->surface_format.colorSpace;
     create_info.imageExtent = this->extent;
     create_info.imageArrayLayers = 1;
-    create_info.imageUsage = VK_IMAGE_USAGE_COLOR_ATTACHMENT_BIT; // TODO depends on application
+    create_info.imageUsage = this->image_usage;
     create_info.imageSharingMode = VK_SHARING_MODE_EXCLUSIVE;
     create_info.queueFamilyIndexCount = 0;
     create_info.pQueueFamilyIndices = 0;
@@ -134,7 +231,7 @@ static int try_create_swapchain(struct vulkan_swapchain *this, int window_width,
     create_info.clipped = VK_TRUE;
     create_info.oldSwapchain = VK_NULL_HANDLE;
 
-    if (vkCreateSwapchainKHR(this->base->device, &create_info, 0, &this->swapchain) != VK_SUCCESS) {
+    if (vkCreateSwapchainKHR(this->base->device, &create_info, this->base->allocator, &this->swapchain) != VK_SUCCESS) {
         return -2;
     }
 
@@ -171,7 +268,7 @@ static int try_create_image_views(struct vulkan_swapchain *this) {
         create_info.subresourceRange.baseArrayLayer = 0;
         create_info.subresourceRange.layerCount = 1;
 
-        if (vkCreateImageView(this->base->device, &create_info, 0, this->imageviews + i) != VK_SUCCESS) {
+        if (vkCreateImageView(this->base->device, &create_info, this->base->allocator, this->imageviews + i) != VK_SUCCESS) {
             free(this->imageviews);
             return -2;
         }
@@ -180,6 +277,11 @@ static int try_create_image_views(struct vulkan_swapchain *this) {
 }
 
 static int try_create_render_pass(struct vulkan_swapchain *this) {
+    if (this->base->dynamic_rendering) {
+        this->render_pass = VK_NULL_HANDLE;
+        return 0;
+    }
+
     VkAttachmentDescription attachment_description;
     attachment_description.format = this->surface_format.format;
     attachment_description.samples = PIPELINE_SAMPLES;
@@ -187,8 +289,8 @@ static int try_create_render_pass(struct vulkan_swapchain *this) {
     attachment_description.storeOp = VK_ATTACHMENT_STORE_OP_STORE;
     attachment_description.stencilLoadOp = VK_ATTACHMENT_LOAD_OP_DONT_CARE;
     attachment_description.stencilStoreOp = VK_ATTACHMENT_STORE_OP_DONT_CARE;
-    attachment_description.initialLayout = VK_IMAGE_LAYOUT_UNDEFINED;
-    attachment_description.finalLayout = VK_IMAGE_LAYOUT_PRESENT_SRC_KHR;
+    attachment_description.initialLayout = VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL; // Transitions are done by the render graph
+    attachment_description.finalLayout = VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL;
     attachment_description.flags = 0;
 
     VkAttachmentReference attachment_reference;
@@ -207,16 +309,6 @@ static int try_create_render_pass(struct vulkan_swapchain *this) {
     subpass_description.pPreserveAttachments = 0;
     subpass_description.pDepthStencilAttachment = 0;
 
-    //TODO dependency experimental
-    VkSubpassDependency dependency;
-    dependency.srcSubpass = VK_SUBPASS_EXTERNAL;
-    dependency.dstSubpass = 0;
-    dependency.srcStageMask = VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT;
-    dependency.srcAccessMask = 0;
-    dependency.dstStageMask = VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT;
-    dependency.dstAccessMask = VK_ACCESS_COLOR_ATTACHMENT_READ_BIT | VK_ACCESS_COLOR_ATTACHMENT_WRITE_BIT;
-    dependency.dependencyFlags = 0;
-
     VkRenderPassCreateInfo create_info;
     create_info.sType = VK_STRUCTURE_TYPE_RENDER_PASS_CREATE_INFO;
     create_info.flags = 0;
@@ -225,10 +317,10 @@ static int try_create_render_pass(struct vulkan_swapchain *this) {
     create_info.pAttachments = &attachment_description;
     create_info.subpassCount = 1;
     create_info.pSubpasses = &subpass_description;
-    create_info.dependencyCount = 1;
-    create_info.pDependencies = &dependency;
+    create_info.dependencyCount = 0;
+    create_info.pDependencies = 0;
 
-    if (vkCreateRenderPass(this->base->device, &create_info, 0, &this->render_pass) != VK_SUCCESS) {
+    if (vkCreateRenderPass(this->base->device, &create_info, this->base->allocator, &this->render_pass) != VK_SUCCESS) {
         return -1;
     }
     return 0;
@@ -242,7 +334,7 @@ static int try_create_shader_module(struct vulkan_swapchain *this, const char *c
     create_info.pCode = (uint32_t *) code;
     create_info.codeSize = (size_t) length;
 
-    if (vkCreateShaderModule(this->base->device, &create_info, 0, out_shader_module) != VK_SUCCESS) {
+    if (vkCreateShaderModule(this->base->device, &create_info, this->base->allocator, out_shader_module) != VK_SUCCESS) {
         return -1;
     }
     return 0;
@@ -250,12 +342,20 @@ static int try_create_shader_module(struct vulkan_swapchain *this, const char *c
 
 static int try_create_graphics_pipeline(struct vulkan_swapchain *this) {
     VkShaderModule vert_shader_module;
-    if (try_create_shader_module(this, this->vert_shader.bytes, this->vert_shader.length, &vert_shader_module) < 0) {
+    if (try_create_shader_module(this, this->base->shaders[VULKAN_BASE__SHADER_VERT].malloc_bytes, this->base->shaders[VULKAN_BASE__SHADER_VERT].length, &vert_shader_module) < 0) {
         return -1;
     }
     VkShaderModule frag_shader_module;
-    if (try_create_shader_module(this, this->frag_shader.bytes, this->frag_shader.length, &frag_shader_module) < 0) {
-        vkDestroyShaderModule(this->base->device, vert_shader_module, 0);
+    if (try_create_shader_module(this, this->base->shaders[VULKAN_BASE__SHADER_FRAG].malloc_bytes, this->base->shaders[VULKAN_BASE__SHADER_FRAG].length, &frag_shader_module) < 0) {
+        vkDestroyShaderModule(this->base->device, vert_shader_module, this->base->allocator);
+        return -2;
+    }
+    VkShaderModule texture_shader_module = VK_NULL_HANDLE;
+    if (this->texture_set_layout != VK_NULL_HANDLE &&
+        try_create_shader_module(this, this->base->shaders[VULKAN_BASE__SHADER_VIRTUAL_TEXTURE].malloc_bytes, this->base->shaders[VULKAN_BASE__SHADER_VIRTUAL_TEXTURE].length,
+                                 &texture_shader_module) < 0) {
+        vkDestroyShaderModule(this->base->device, vert_shader_module, this->base->allocator);
+        vkDestroyShaderModule(this->base->device, frag_shader_module, this->base->allocator);
         return -2;
     }
 
@@ -279,14 +379,36 @@ static int try_create_graphics_pipeline(struct vulkan_swapchain *this) {
 
     VkPipelineShaderStageCreateInfo shader_stages[] = {vert_shader_create_info, frag_shader_create_info};
 
+    VkVertexInputBindingDescription binding_descriptions[2];
+    binding_descriptions[0].binding = 0;
+    binding_descriptions[0].stride = sizeof(struct vulkan_culling_object);
+    binding_descriptions[0].inputRate = VK_VERTEX_INPUT_RATE_INSTANCE;
+    binding_descriptions[1].binding = 1;
+    binding_descriptions[1].stride = sizeof(struct mesh_vertex);
+    binding_descriptions[1].inputRate = VK_VERTEX_INPUT_RATE_VERTEX;
+
+    VkVertexInputAttributeDescription attribute_descriptions[3];
+    attribute_descriptions[0].location = 0;
+    attribute_descriptions[0].binding = 0;
+    attribute_descriptions[0].format = VK_FORMAT_R32G32B32A32_SFLOAT;
+    attribute_descriptions[0].offset = 0;
+    attribute_descriptions[1].location = 1;
+    attribute_descriptions[1].binding = 1;
+    attribute_descriptions[1].format = VK_FORMAT_R16G16B16A16_SINT;
+    attribute_descriptions[1].offset = offsetof(struct mesh_vertex, position);
+    attribute_descriptions[2].location = 2;
+    attribute_descriptions[2].binding = 1;
+    attribute_descriptions[2].format = VK_FORMAT_R8G8B8A8_SNORM;
+    attribute_descriptions[2].offset = offsetof(struct mesh_vertex, normal);
+
     VkPipelineVertexInputStateCreateInfo vertex_input_create_info;
     vertex_input_create_info.sType = VK_STRUCTURE_TYPE_PIPELINE_VERTEX_INPUT_STATE_CREATE_INFO;
     vertex_input_create_info.flags = 0;
     vertex_input_create_info.pNext = 0;
-    vertex_input_create_info.vertexBindingDescriptionCount = 0;
-    vertex_input_create_info.pVertexBindingDescriptions = 0;
-    vertex_input_create_info.vertexAttributeDescriptionCount = 0;
-    vertex_input_create_info.pVertexAttributeDescriptions = 0;
+    vertex_input_create_info.vertexBindingDescriptionCount = 2;
+    vertex_input_create_info.pVertexBindingDescriptions = binding_descriptions;
+    vertex_input_create_info.vertexAttributeDescriptionCount = 3;
+    vertex_input_create_info.pVertexAttributeDescriptions = attribute_descriptions;
 
     VkPipelineInputAssemblyStateCreateInfo pipeline_input_assembly_create_info;
     pipeline_input_assembly_create_info.sType = VK_STRUCTURE_TYPE_PIPELINE_INPUT_ASSEMBLY_STATE_CREATE_INFO;
@@ -369,24 +491,43 @@ static int try_create_graphics_pipeline(struct vulkan_swapchain *this) {
     color_blend_state_create_info.flags = 0;
     color_blend_state_create_info.pNext = 0;
 
+    VkDescriptorSetLayout set_layouts[2];
+    set_layouts[0] = this->uniform_set_layout;
+    set_layouts[VULKAN_DRAW_LIST__MATERIAL_SET] = this->texture_set_layout;
+
+    VkPushConstantRange push_constant_range;
+    push_constant_range.stageFlags = VULKAN_DRAW_LIST__PUSH_CONSTANT_STAGES;
+    push_constant_range.offset = 0;
+    push_constant_range.size = sizeof(uint32_t);
+
     VkPipelineLayoutCreateInfo pipeline_layout_create_info;
     pipeline_layout_create_info.sType = VK_STRUCTURE_TYPE_PIPELINE_LAYOUT_CREATE_INFO;
-    pipeline_layout_create_info.setLayoutCount = 0;
-    pipeline_layout_create_info.pSetLayouts = 0;
-    pipeline_layout_create_info.pushConstantRangeCount = 0;
-    pipeline_layout_create_info.pPushConstantRanges = 0;
+    pipeline_layout_create_info.setLayoutCount = this->texture_set_layout != VK_NULL_HANDLE ? 2 : 1;
+    pipeline_layout_create_info.pSetLayouts = set_layouts;
+    pipeline_layout_create_info.pushConstantRangeCount = 1;
+    pipeline_layout_create_info.pPushConstantRanges = &push_constant_range;
     pipeline_layout_create_info.pNext = 0;
     pipeline_layout_create_info.flags = 0;
 
-    if (vkCreatePipelineLayout(this->base->device, &pipeline_layout_create_info, 0, &this->pipeline_layout) != VK_SUCCESS) {
-        vkDestroyShaderModule(this->base->device, vert_shader_module, 0);
-        vkDestroyShaderModule(this->base->device, frag_shader_module, 0);
+    if (vkCreatePipelineLayout(this->base->device, &pipeline_layout_create_info, this->base->allocator, &this->pipeline_layout) != VK_SUCCESS) {
+        vkDestroyShaderModule(this->base->device, texture_shader_module, this->base->allocator);
+        vkDestroyShaderModule(this->base->device, vert_shader_module, this->base->allocator);
+        vkDestroyShaderModule(this->base->device, frag_shader_module, this->base->allocator);
         return -3;
     }
 
+    VkPipelineRenderingCreateInfo rendering_create_info;
+    rendering_create_info.sType = VK_STRUCTURE_TYPE_PIPELINE_RENDERING_CREATE_INFO;
+    rendering_create_info.pNext = 0;
+    rendering_create_info.viewMask = 0;
+    rendering_create_info.colorAttachmentCount = 1;
+    rendering_create_info.pColorAttachmentFormats = &this->surface_format.format;
+    rendering_create_info.depthAttachmentFormat = VK_FORMAT_UNDEFINED;
+    rendering_create_info.stencilAttachmentFormat = VK_FORMAT_UNDEFINED;
+
     VkGraphicsPipelineCreateInfo pipeline_create_info;
     pipeline_create_info.sType = VK_STRUCTURE_TYPE_GRAPHICS_PIPELINE_CREATE_INFO;
-    pipeline_create_info.pNext = 0;
+    pipeline_create_info.pNext = this->base->dynamic_rendering ? &rendering_create_info : 0;
     pipeline_create_info.flags = 0;
     pipeline_create_info.stageCount = 2;
     pipeline_create_info.pStages = shader_stages;
@@ -405,19 +546,40 @@ static int try_create_graphics_pipeline(struct vulkan_swapchain *this) {
     pipeline_create_info.basePipelineIndex = -1;
     pipeline_create_info.pTessellationState = 0;
 
-    if (vkCreateGraphicsPipelines(this->base->device, VK_NULL_HANDLE, 1, &pipeline_create_info, 0, &this->graphics_pipeline) != VK_SUCCESS) {
-        vkDestroyPipelineLayout(this->base->device, this->pipeline_layout, 0);
-        vkDestroyShaderModule(this->base->device, vert_shader_module, 0);
-        vkDestroyShaderModule(this->base->device, frag_shader_module, 0);
+    if (vkCreateGraphicsPipelines(this->base->device, this->base->pipeline_cache, 1, &pipeline_create_info, this->base->allocator, &this->graphics_pipeline) != VK_SUCCESS) {
+        vkDestroyPipelineLayout(this->base->device, this->pipeline_layout, this->base->allocator);
+        vkDestroyShaderModule(this->base->device, texture_shader_module, this->base->allocator);
+        vkDestroyShaderModule(this->base->device, vert_shader_module, this->base->allocator);
+        vkDestroyShaderModule(this->base->device, frag_shader_module, this->base->allocator);
         return -4;
     }
 
-    vkDestroyShaderModule(this->base->device, vert_shader_module, 0);
-    vkDestroyShaderModule(this->base->device, frag_shader_module, 0);
+    this->texture_pipeline = VK_NULL_HANDLE;
+    if (texture_shader_module != VK_NULL_HANDLE) {
+        shader_stages[1].module = texture_shader_module;
+        if (vkCreateGraphicsPipelines(this->base->device, this->base->pipeline_cache, 1, &pipeline_create_info, this->base->allocator, &this->texture_pipeline) != VK_SUCCESS) {
+            vkDestroyPipeline(this->base->device, this->graphics_pipeline, this->base->allocator);
+            vkDestroyPipelineLayout(this->base->device, this->pipeline_layout, this->base->allocator);
+            vkDestroyShaderModule(this->base->device, texture_shader_module, this->base->allocator);
+            vkDestroyShaderModule(this->base->device, vert_shader_module, this->base->allocator);
+            vkDestroyShaderModule(this->base->device, frag_shader_module, this->base->allocator);
+            return -5;
+        }
+        shader_stages[1].module = frag_shader_module;
+    }
+
+    vkDestroyShaderModule(this->base->device, texture_shader_module, this->base->allocator);
+    vkDestroyShaderModule(this->base->device, vert_shader_module, this->base->allocator);
+    vkDestroyShaderModule(this->base->device, frag_shader_module, this->base->allocator);
     return 0;
 }
 
 static int try_create_framebuffers(struct vulkan_swapchain *this) {
+    if (this->base->dynamic_rendering) {
+        this->framebuffers = 0;
+        return 0;
+    }
+
     this->framebuffers = malloc(this->image_count*sizeof(*this->framebuffers));
     if (!this->framebuffers) {
         return -1;
@@ -435,7 +597,7 @@ static int try_create_framebuffers(struct vulkan_swapchain *this) {
         create_info.flags = 0;
         create_info.pNext = 0;
 
-        if (vkCreateFramebuffer(this->base->device, &create_info, 0, this->framebuffers + i) != VK_SUCCESS) {
+        if (vkCreateFramebuffer(this->base->device, &create_info, this->base->allocator, this->framebuffers + i) != VK_SUCCESS) {
             free(this->framebuffers);
             return -2;
         }
@@ -464,25 +626,18 @@ static int try_create_command_buffers(struct vulkan_swapchain *this) {
 }
 
 void vulkan_swapchain__free(struct vulkan_swapchain *this) {
-    free(this->vert_shader.bytes);
-    free(this->frag_shader.bytes);
+    vkDestroyDescriptorSetLayout(this->base->device, this->uniform_set_layout, this->base->allocator);
 }
 
+// The shaders come from base, which must have loaded its files
 int vulkan_swapchain__try_init(struct vulkan_swapchain *this, struct vulkan_base *base) {
     this->base = base;
-    struct file__try_read vert_read = file__try_read("shaders/vert.spv");
-    if (vert_read.result < 0) {
+    this->surface = base->surface;
+    this->image_usage = VK_IMAGE_USAGE_COLOR_ATTACHMENT_BIT;
+    this->texture_set_layout = VK_NULL_HANDLE;
+    if (vulkan_uniform_ring__try_create_set_layout(base, VK_SHADER_STAGE_VERTEX_BIT, &this->uniform_set_layout) < 0) {
         return -1;
     }
-    this->vert_shader.length = vert_read.length;
-    this->vert_shader.bytes = vert_read.malloc_bytes;
-    struct file__try_read frag_read = file__try_read("shaders/frag.spv");
-    if (frag_read.result < 0) {
-        free(vert_read.malloc_bytes);
-        return -2;
-    }
-    this->frag_shader.length = frag_read.length;
-    this->frag_shader.bytes = frag_read.malloc_bytes;
     return 0;
 }
 
@@ -490,41 +645,81 @@ void vulkan_swapchain__free_swapchain(struct vulkan_swapchain *this) {
     free_from_command_buffers(this);
 }
 
-int vulkan_swapchain__try_init_swapchain(struct vulkan_swapchain *this, int window_width, int window_height) {
-    int result;
-    result = try_create_swapchain(this, window_width, window_height);
-    if (result < 0) {
+int vulkan_swapchain__try_recreate_pipelines(struct vulkan_swapchain *this) {
+    vkDestroyPipeline(this->base->device, this->texture_pipeline, this->base->allocator);
+    vkDestroyPipeline(this->base->device, this->graphics_pipeline, this->base->allocator);
+    vkDestroyPipelineLayout(this->base->device, this->pipeline_layout, this->base->allocator);
+    if (try_create_graphics_pipeline(this) < 0) {
+        // Left for free_swapchain, which destroys null handles as a no-op
+        this->texture_pipeline = VK_NULL_HANDLE;
+        this->graphics_pipeline = VK_NULL_HANDLE;
+        this->pipeline_layout = VK_NULL_HANDLE;
         return -1;
     }
+    return 0;
+}
 
+static int try_create_from_image_views(struct vulkan_swapchain *this) {
+    int result;
     result = try_create_image_views(this);
     if (result < 0) {
         free_swapchain(this);
-        return -2;
+        return -1;
     }
 
     result = try_create_render_pass(this);
     if (result < 0) {
         free_from_image_views(this);
-        return -3;
+        return -2;
     }
 
     result = try_create_graphics_pipeline(this);
     if (result < 0) {
         free_from_render_pass(this);
-        return -4;
+        return -3;
     }
 
     result = try_create_framebuffers(this);
     if (result < 0) {
         free_from_graphics_pipeline(this);
-        return -5;
+        return -4;
     }
 
     result = try_create_command_buffers(this);
     if (result < 0) {
         free_from_framebuffers(this);
-        return -6;
+        return -5;
     }
     return 0;
 }
+
+int vulkan_swapchain__try_init_swapchain(struct vulkan_swapchain *this, int window_width, int window_height) {
+    this->offscreen = 0;
+    int result;
+    result = try_create_swapchain(this, window_width, window_height);
+    if (result < 0) {
+        return -1;
+    }
+
+    result = try_create_from_image_views(this);
+    if (result < 0) {
+        return result - 1;
+    }
+    return 0;
+}
+
+int vulkan_swapchain__try_init_offscreen(struct vulkan_swapchain *this, int width, int height) {
+    this->offscreen = 1;
+    this->swapchain = VK_NULL_HANDLE;
+    int result;
+    result = try_create_offscreen_image(this, width, height);
+    if (result < 0) {
+        return -1;
+    }
+
+    result = try_create_from_image_views(this);
+    if (result < 0) {
+        return result - 1;
+    }
+    return 0;
+}
\ No newline at end of file
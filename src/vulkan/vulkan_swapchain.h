@@ -2,17 +2,15 @@
 
 #include <vulkan/vulkan.h>
 #include "vulkan_base.h"
-
-struct vulkan_swapchain_shader {
-    long length;
-    char *bytes;
-};
+#include "vulkan_uniform_ring.h"
 
 struct vulkan_swapchain {
     struct vulkan_base *base;
-    struct vulkan_swapchain_shader vert_shader;
-    struct vulkan_swapchain_shader frag_shader;
 
+    // Defaults to the base's surface, set before init_swapchain to present to another window
+    VkSurfaceKHR surface;
+    VkImageUsageFlags image_usage;
+    int offscreen;
     VkSwapchainKHR swapchain;
     VkExtent2D extent;
     VkSurfaceFormatKHR surface_format;
@@ -20,14 +18,31 @@ struct vulkan_swapchain {
     VkImage *images;
     VkImageView *imageviews;
     VkRenderPass render_pass;
+    // Set 0 of the pipeline layout, a vulkan_uniform_ring of per-frame blocks for the vertex shader
+    VkDescriptorSetLayout uniform_set_layout;
+    // Null by default, set before init_swapchain to make it set 1 and create texture_pipeline
+    VkDescriptorSetLayout texture_set_layout;
+    // Also has a range of push constants for vulkan_draw_list
     VkPipelineLayout pipeline_layout;
     VkPipeline graphics_pipeline;
+    // Shades with a vulkan_virtual_texture bound as set 1, null without a texture_set_layout
+    VkPipeline texture_pipeline;
     VkFramebuffer *framebuffers;
     VkCommandBuffer *command_buffers;
+
+    // Offscreen render target, rendered into images[0] and copied to readback_pixels
+    VkDeviceMemory image_memory;
+    VkBuffer readback_buffer;
+    VkDeviceMemory readback_memory;
+    unsigned char *readback_pixels;
 };
 
 int vulkan_swapchain__try_init(struct vulkan_swapchain *this, struct vulkan_base *base);
 void vulkan_swapchain__free(struct vulkan_swapchain *this);
 
 int vulkan_swapchain__try_init_swapchain(struct vulkan_swapchain *this, int window_width, int window_height);
-void vulkan_swapchain__free_swapchain(struct vulkan_swapchain *this);
\ No newline at end of file
+int vulkan_swapchain__try_init_offscreen(struct vulkan_swapchain *this, int width, int height);
+void vulkan_swapchain__free_swapchain(struct vulkan_swapchain *this);
+// Creates the pipelines again with the base's current pipeline cache. Command buffers recorded with the old ones are
+// invalid afterwards, and on failure the swapchain can only be freed.
+int vulkan_swapchain__try_recreate_pipelines(struct vulkan_swapchain *this);
\ No newline at end of file
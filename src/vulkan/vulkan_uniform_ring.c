@@ -0,0 +1,124 @@
+#include "vulkan_uniform_ring.h"
+
+static VkDeviceSize align_up(VkDeviceSize size, VkDeviceSize alignment) {
+	return (size + alignment - 1)/alignment*alignment;
+}
+
+int vulkan_uniform_ring__try_create_set_layout(struct vulkan_base *base, VkShaderStageFlags stages, VkDescriptorSetLayout *layout_out) {
+	VkDescriptorSetLayoutBinding binding;
+	binding.binding = 0;
+	binding.descriptorType = VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER_DYNAMIC;
+	binding.descriptorCount = 1;
+	binding.stageFlags = stages;
+	binding.pImmutableSamplers = 0;
+
+	VkDescriptorSetLayoutCreateInfo create_info;
+	create_info.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_LAYOUT_CREATE_INFO;
+	create_info.pNext = 0;
+	create_info.flags = 0;
+	create_info.bindingCount = 1;
+	create_info.pBindings = &binding;
+
+	if (vkCreateDescriptorSetLayout(base->device, &create_info, base->allocator, layout_out) != VK_SUCCESS) {
+		return -1;
+	}
+	return 0;
+}
+
+static int try_create_descriptor_set(struct vulkan_uniform_ring *this, VkDescriptorSetLayout layout) {
+	VkDescriptorPoolSize pool_size;
+	pool_size.type = VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER_DYNAMIC;
+	pool_size.descriptorCount = 1;
+
+	VkDescriptorPoolCreateInfo pool_create_info;
+	pool_create_info.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_POOL_CREATE_INFO;
+	pool_create_info.pNext = 0;
+	pool_create_info.flags = 0;
+	pool_create_info.maxSets = 1;
+	pool_create_info.poolSizeCount = 1;
+	pool_create_info.pPoolSizes = &pool_size;
+
+	if (vkCreateDescriptorPool(this->base->device, &pool_create_info, this->base->allocator, &this->descriptor_pool) != VK_SUCCESS) {
+		return -1;
+	}
+
+	VkDescriptorSetAllocateInfo allocate_info;
+	allocate_info.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_ALLOCATE_INFO;
+	allocate_info.pNext = 0;
+	allocate_info.descriptorPool = this->descriptor_pool;
+	allocate_info.descriptorSetCount = 1;
+	allocate_info.pSetLayouts = &layout;
+
+	if (vkAllocateDescriptorSets(this->base->device, &allocate_info, &this->descriptor_set) != VK_SUCCESS) {
+		vkDestroyDescriptorPool(this->base->device, this->descriptor_pool, this->base->allocator);
+		return -2;
+	}
+
+	VkDescriptorBufferInfo buffer_info;
+	buffer_info.buffer = this->buffer;
+	buffer_info.offset = 0;
+	buffer_info.range = this->block_size;
+
+	VkWriteDescriptorSet write;
+	write.sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
+	write.pNext = 0;
+	write.dstSet = this->descriptor_set;
+	write.dstBinding = 0;
+	write.dstArrayElement = 0;
+	write.descriptorCount = 1;
+	write.descriptorType = VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER_DYNAMIC;
+	write.pImageInfo = 0;
+	write.pBufferInfo = &buffer_info;
+	write.pTexelBufferView = 0;
+	vkUpdateDescriptorSets(this->base->device, 1, &write, 0, 0);
+	return 0;
+}
+
+int vulkan_uniform_ring__try_init(struct vulkan_uniform_ring *this, struct vulkan_base *base, VkDescriptorSetLayout layout, VkDeviceSize block_size,
+								  VkDeviceSize frame_size, int frame_count) {
+	this->base = base;
+	this->block_size = block_size;
+	this->alignment = base->properties.limits.minUniformBufferOffsetAlignment;
+	// Every region starts aligned, and each keeps room for a whole block at its last offset
+	this->frame_size = align_up(frame_size < block_size ? block_size : frame_size, this->alignment);
+	this->frame_count = frame_count;
+	this->frame = 0;
+	this->offset = 0;
+
+	// Coherent, so writes need no flush before the submit that reads them
+	if (vulkan_base__try_create_buffer(base, this->frame_size*(VkDeviceSize) frame_count, VK_BUFFER_USAGE_UNIFORM_BUFFER_BIT,
+									   VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT, &this->buffer, &this->memory) < 0) {
+		return -1;
+	}
+	if (vkMapMemory(base->device, this->memory, 0, VK_WHOLE_SIZE, 0, (void **) &this->mapping) != VK_SUCCESS) {
+		vulkan_base__free_buffer(base, this->buffer, this->memory);
+		return -2;
+	}
+	if (try_create_descriptor_set(this, layout) < 0) {
+		vkUnmapMemory(base->device, this->memory);
+		vulkan_base__free_buffer(base, this->buffer, this->memory);
+		return -3;
+	}
+	return 0;
+}
+
+void vulkan_uniform_ring__free(struct vulkan_uniform_ring *this) {
+	vkDestroyDescriptorPool(this->base->device, this->descriptor_pool, this->base->allocator);
+	vkUnmapMemory(this->base->device, this->memory);
+	vulkan_base__free_buffer(this->base, this->buffer, this->memory);
+}
+
+void vulkan_uniform_ring__begin_frame(struct vulkan_uniform_ring *this, int frame) {
+	this->frame = frame;
+	this->offset = 0;
+}
+
+void *vulkan_uniform_ring__allocate(struct vulkan_uniform_ring *this, VkDeviceSize size, uint32_t *dynamic_offset_out) {
+	if (size > this->block_size || this->offset + this->block_size > this->frame_size) {
+		return 0;
+	}
+	VkDeviceSize offset = (VkDeviceSize) this->frame*this->frame_size + this->offset;
+	this->offset = align_up(this->offset + size, this->alignment);
+	*dynamic_offset_out = (uint32_t) offset;
+	return this->mapping + offset;
+}
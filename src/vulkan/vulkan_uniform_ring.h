@@ -0,0 +1,39 @@
+#pragma once
+
+#include <vulkan/vulkan.h>
+#include "vulkan_base.h"
+
+// Uniform blocks sub-allocated linearly from one persistently mapped buffer, which has a region per frame so the host
+// can write one frame's blocks while the GPU reads another's. Shaders see every block through the same dynamic uniform
+// buffer descriptor and the offset given when binding it picks one, so nothing is allocated and no descriptor written
+// once the ring is set up.
+struct vulkan_uniform_ring {
+	struct vulkan_base *base;
+	VkDeviceSize block_size;
+	VkDeviceSize alignment;
+	VkDeviceSize frame_size;
+	int frame_count;
+	VkBuffer buffer;
+	VkDeviceMemory memory;
+	unsigned char *mapping;
+	VkDescriptorPool descriptor_pool;
+	VkDescriptorSet descriptor_set;
+
+	// Where the next block of the current frame goes
+	int frame;
+	VkDeviceSize offset;
+};
+
+// One dynamic uniform buffer at binding 0, for pipeline layouts and vulkan_uniform_ring__try_init
+int vulkan_uniform_ring__try_create_set_layout(struct vulkan_base *base, VkShaderStageFlags stages, VkDescriptorSetLayout *layout_out);
+
+// Shaders see blocks of block_size bytes, as many as fit in frame_size bytes can be allocated each frame
+int vulkan_uniform_ring__try_init(struct vulkan_uniform_ring *this, struct vulkan_base *base, VkDescriptorSetLayout layout, VkDeviceSize block_size,
+								  VkDeviceSize frame_size, int frame_count);
+void vulkan_uniform_ring__free(struct vulkan_uniform_ring *this);
+
+// Allocations start over at the beginning of frame's region, the GPU has to be done with what was written there before
+void vulkan_uniform_ring__begin_frame(struct vulkan_uniform_ring *this, int frame);
+// Null when the frame's region is full, otherwise size bytes of at most block_size to write the block into.
+// dynamic_offset_out is for binding descriptor_set.
+void *vulkan_uniform_ring__allocate(struct vulkan_uniform_ring *this, VkDeviceSize size, uint32_t *dynamic_offset_out);
@@ -0,0 +1,816 @@
+#include <malloc.h>
+#include <string.h>
+#include "vulkan_virtual_texture.h"
+
+#define MAX_UINT64 0xFFFFFFFFFFFFFFFF
+#define NO_TILE 0xFFFFFFFFu
+#define DESCRIPTOR_COUNT 3
+// Requests reach the host a few frames late, so slots are only reused once nothing asked for them in this many
+#define EVICT_AFTER_FRAMES 8
+// Slot 0 is taken for good, a smaller cache could hold nothing else
+#define MIN_CACHE_SIDE 2
+
+// Start of the indirection buffer, followed by an entry per tile that is zero or 1 + its cache slot.
+// Matches virtual_texture.frag.
+struct indirection_header {
+	uint32_t mip_count;
+	uint32_t cache_side;
+	struct texture_mip mips[TEXTURE__MAX_MIPS];
+};
+
+static void free_cache(struct vulkan_virtual_texture *this) {
+	vkDestroySampler(this->base->device, this->sampler, this->base->allocator);
+	vkDestroyImageView(this->base->device, this->cache_image_view, this->base->allocator);
+	vkDestroyImage(this->base->device, this->cache_image, this->base->allocator);
+	vulkan_base__free_memory(this->base, this->cache_memory);
+}
+
+static void free_from_buffers(struct vulkan_virtual_texture *this) {
+	vkUnmapMemory(this->base->device, this->upload_memory);
+	vulkan_base__free_buffer(this->base, this->upload_buffer, this->upload_memory);
+	vkUnmapMemory(this->base->device, this->feedback_memory);
+	vulkan_base__free_buffer(this->base, this->feedback_buffer, this->feedback_memory);
+	vulkan_base__free_buffer(this->base, this->indirection_buffer, this->indirection_memory);
+	free_cache(this);
+}
+
+static void free_from_descriptor_set(struct vulkan_virtual_texture *this) {
+	vkDestroyDescriptorPool(this->base->device, this->descriptor_pool, this->base->allocator);
+	vkDestroyDescriptorSetLayout(this->base->device, this->descriptor_set_layout, this->base->allocator);
+	free_from_buffers(this);
+}
+
+static void free_from_tables(struct vulkan_virtual_texture *this) {
+	free(this->slots);
+	free(this->tile_loading);
+	free(this->tile_requested);
+	free(this->tile_slots);
+	free_from_descriptor_set(this);
+}
+
+void vulkan_virtual_texture__free(struct vulkan_virtual_texture *this) {
+	vulkan_memory_budget__remove_streamable(&this->base->memory_budget, this);
+	vulkan_virtual_texture__free_updates(this);
+	// Loads write into the upload buffer
+	job_system__wait(this->job_system, &this->pending_loads);
+	free_from_tables(this);
+}
+
+// Leaves most of the headroom to everything else, and the image has to stay within the device's limits
+static uint32_t fit_cache_side(struct vulkan_virtual_texture *this, uint32_t cache_side) {
+	while (cache_side > 1 && cache_side*TEXTURE__TILE_SIZE > this->base->properties.limits.maxImageDimension2D) {
+		cache_side /= 2;
+	}
+	int memory_type = vulkan_base__find_memory_type(this->base, 0xFFFFFFFFu, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT);
+	if (memory_type < 0) {
+		return cache_side;
+	}
+	uint32_t heap_index = this->base->memory_properties.memoryTypes[memory_type].heapIndex;
+	vulkan_memory_budget__update(&this->base->memory_budget, 0);
+	VkDeviceSize headroom = vulkan_memory_budget__headroom(&this->base->memory_budget, heap_index);
+	while (cache_side > MIN_CACHE_SIDE && (VkDeviceSize) cache_side*cache_side*TEXTURE__TILE_BYTES > headroom/2) {
+		cache_side /= 2;
+	}
+	return cache_side;
+}
+
+static int try_create_cache(struct vulkan_virtual_texture *this) {
+	VkImageCreateInfo create_info;
+	create_info.sType = VK_STRUCTURE_TYPE_IMAGE_CREATE_INFO;
+	create_info.pNext = 0;
+	create_info.flags = 0;
+	create_info.imageType = VK_IMAGE_TYPE_2D;
+	create_info.format = VK_FORMAT_R8G8B8A8_UNORM;
+	create_info.extent.width = this->cache_side*TEXTURE__TILE_SIZE;
+	create_info.extent.height = this->cache_side*TEXTURE__TILE_SIZE;
+	create_info.extent.depth = 1;
+	create_info.mipLevels = 1;
+	create_info.arrayLayers = 1;
+	create_info.samples = VK_SAMPLE_COUNT_1_BIT;
+	create_info.tiling = VK_IMAGE_TILING_OPTIMAL;
+	create_info.usage = VK_IMAGE_USAGE_SAMPLED_BIT | VK_IMAGE_USAGE_TRANSFER_DST_BIT;
+	create_info.sharingMode = VK_SHARING_MODE_EXCLUSIVE;
+	create_info.queueFamilyIndexCount = 0;
+	create_info.pQueueFamilyIndices = 0;
+	create_info.initialLayout = VK_IMAGE_LAYOUT_UNDEFINED;
+
+	if (vkCreateImage(this->base->device, &create_info, this->base->allocator, &this->cache_image) != VK_SUCCESS) {
+		return -1;
+	}
+
+	VkMemoryRequirements requirements;
+	vkGetImageMemoryRequirements(this->base->device, this->cache_image, &requirements);
+	int memory_type = vulkan_base__find_memory_type(this->base, requirements.memoryTypeBits, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT);
+	if (memory_type < 0) {
+		vkDestroyImage(this->base->device, this->cache_image, this->base->allocator);
+		return -2;
+	}
+
+	VkMemoryAllocateInfo allocate_info;
+	allocate_info.sType = VK_STRUCTURE_TYPE_MEMORY_ALLOCATE_INFO;
+	allocate_info.pNext = 0;
+	allocate_info.allocationSize = requirements.size;
+	allocate_info.memoryTypeIndex = (uint32_t) memory_type;
+
+	if (vulkan_base__try_allocate_memory(this->base, &allocate_info, &this->cache_memory) < 0) {
+		vkDestroyImage(this->base->device, this->cache_image, this->base->allocator);
+		return -3;
+	}
+	if (vkBindImageMemory(this->base->device, this->cache_image, this->cache_memory, 0) != VK_SUCCESS) {
+		vulkan_base__free_memory(this->base, this->cache_memory);
+		vkDestroyImage(this->base->device, this->cache_image, this->base->allocator);
+		return -4;
+	}
+	this->cache_heap_index = this->base->memory_properties.memoryTypes[memory_type].heapIndex;
+	this->cache_bytes = requirements.size;
+
+	VkImageViewCreateInfo view_create_info;
+	view_create_info.sType = VK_STRUCTURE_TYPE_IMAGE_VIEW_CREATE_INFO;
+	view_create_info.pNext = 0;
+	view_create_info.flags = 0;
+	view_create_info.image = this->cache_image;
+	view_create_info.viewType = VK_IMAGE_VIEW_TYPE_2D;
+	view_create_info.format = create_info.format;
+	view_create_info.components.r = VK_COMPONENT_SWIZZLE_IDENTITY;
+	view_create_info.components.g = VK_COMPONENT_SWIZZLE_IDENTITY;
+	view_create_info.components.b = VK_COMPONENT_SWIZZLE_IDENTITY;
+	view_create_info.components.a = VK_COMPONENT_SWIZZLE_IDENTITY;
+	view_create_info.subresourceRange.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
+	view_create_info.subresourceRange.baseMipLevel = 0;
+	view_create_info.subresourceRange.levelCount = 1;
+	view_create_info.subresourceRange.baseArrayLayer = 0;
+	view_create_info.subresourceRange.layerCount = 1;
+
+	if (vkCreateImageView(this->base->device, &view_create_info, this->base->allocator, &this->cache_image_view) != VK_SUCCESS) {
+		vulkan_base__free_memory(this->base, this->cache_memory);
+		vkDestroyImage(this->base->device, this->cache_image, this->base->allocator);
+		return -5;
+	}
+
+	// Levels come from the indirection, the cache itself has one. Borders keep linear filtering inside each tile.
+	VkSamplerCreateInfo sampler_create_info;
+	memset(&sampler_create_info, 0, sizeof(sampler_create_info));
+	sampler_create_info.sType = VK_STRUCTURE_TYPE_SAMPLER_CREATE_INFO;
+	sampler_create_info.magFilter = VK_FILTER_LINEAR;
+	sampler_create_info.minFilter = VK_FILTER_LINEAR;
+	sampler_create_info.mipmapMode = VK_SAMPLER_MIPMAP_MODE_NEAREST;
+	sampler_create_info.addressModeU = VK_SAMPLER_ADDRESS_MODE_CLAMP_TO_EDGE;
+	sampler_create_info.addressModeV = VK_SAMPLER_ADDRESS_MODE_CLAMP_TO_EDGE;
+	sampler_create_info.addressModeW = VK_SAMPLER_ADDRESS_MODE_CLAMP_TO_EDGE;
+	sampler_create_info.anisotropyEnable = VK_FALSE;
+	sampler_create_info.maxAnisotropy = 1.0f;
+	sampler_create_info.compareOp = VK_COMPARE_OP_NEVER;
+	sampler_create_info.borderColor = VK_BORDER_COLOR_FLOAT_OPAQUE_BLACK;
+	sampler_create_info.unnormalizedCoordinates = VK_FALSE;
+
+	if (vkCreateSampler(this->base->device, &sampler_create_info, this->base->allocator, &this->sampler) != VK_SUCCESS) {
+		vkDestroyImageView(this->base->device, this->cache_image_view, this->base->allocator);
+		vulkan_base__free_memory(this->base, this->cache_memory);
+		vkDestroyImage(this->base->device, this->cache_image, this->base->allocator);
+		return -6;
+	}
+	return 0;
+}
+
+static int try_create_buffers(struct vulkan_virtual_texture *this) {
+	VkMemoryPropertyFlags host_memory = VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT;
+
+	VkDeviceSize indirection_size = sizeof(struct indirection_header) + this->texture->tile_count*sizeof(uint32_t);
+	if (vulkan_base__try_create_buffer(this->base, indirection_size, VK_BUFFER_USAGE_STORAGE_BUFFER_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT,
+									   VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, &this->indirection_buffer, &this->indirection_memory) < 0) {
+		return -1;
+	}
+
+	// The host reads every request on each update, which is much faster from cached memory
+	VkDeviceSize feedback_size = this->texture->tile_count*sizeof(uint32_t);
+	if (vulkan_base__try_create_buffer(this->base, feedback_size, VK_BUFFER_USAGE_STORAGE_BUFFER_BIT, host_memory | VK_MEMORY_PROPERTY_HOST_CACHED_BIT,
+									   &this->feedback_buffer, &this->feedback_memory) < 0 &&
+		vulkan_base__try_create_buffer(this->base, feedback_size, VK_BUFFER_USAGE_STORAGE_BUFFER_BIT, host_memory,
+									   &this->feedback_buffer, &this->feedback_memory) < 0) {
+		vulkan_base__free_buffer(this->base, this->indirection_buffer, this->indirection_memory);
+		return -2;
+	}
+	if (vkMapMemory(this->base->device, this->feedback_memory, 0, VK_WHOLE_SIZE, 0, (void **) &this->requests) != VK_SUCCESS) {
+		vulkan_base__free_buffer(this->base, this->feedback_buffer, this->feedback_memory);
+		vulkan_base__free_buffer(this->base, this->indirection_buffer, this->indirection_memory);
+		return -3;
+	}
+	memset(this->requests, 0, (size_t) feedback_size);
+
+	if (vulkan_base__try_create_buffer(this->base, VULKAN_VIRTUAL_TEXTURE__UPLOAD_SLOTS*TEXTURE__TILE_BYTES, VK_BUFFER_USAGE_TRANSFER_SRC_BIT, host_memory,
+									   &this->upload_buffer, &this->upload_memory) < 0) {
+		vkUnmapMemory(this->base->device, this->feedback_memory);
+		vulkan_base__free_buffer(this->base, this->feedback_buffer, this->feedback_memory);
+		vulkan_base__free_buffer(this->base, this->indirection_buffer, this->indirection_memory);
+		return -4;
+	}
+	if (vkMapMemory(this->base->device, this->upload_memory, 0, VK_WHOLE_SIZE, 0, (void **) &this->upload_tiles) != VK_SUCCESS) {
+		vulkan_base__free_buffer(this->base, this->upload_buffer, this->upload_memory);
+		vkUnmapMemory(this->base->device, this->feedback_memory);
+		vulkan_base__free_buffer(this->base, this->feedback_buffer, this->feedback_memory);
+		vulkan_base__free_buffer(this->base, this->indirection_buffer, this->indirection_memory);
+		return -5;
+	}
+	return 0;
+}
+
+static int try_create_descriptor_set(struct vulkan_virtual_texture *this) {
+	VkDescriptorSetLayoutBinding bindings[DESCRIPTOR_COUNT];
+	for (uint32_t i = 0; i < DESCRIPTOR_COUNT; ++i) {
+		bindings[i].binding = i;
+		bindings[i].descriptorType = i == 0 ? VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER : VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
+		bindings[i].descriptorCount = 1;
+		bindings[i].stageFlags = VK_SHADER_STAGE_FRAGMENT_BIT;
+		bindings[i].pImmutableSamplers = 0;
+	}
+
+	VkDescriptorSetLayoutCreateInfo layout_create_info;
+	layout_create_info.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_LAYOUT_CREATE_INFO;
+	layout_create_info.pNext = 0;
+	layout_create_info.flags = 0;
+	layout_create_info.bindingCount = DESCRIPTOR_COUNT;
+	layout_create_info.pBindings = bindings;
+
+	if (vkCreateDescriptorSetLayout(this->base->device, &layout_create_info, this->base->allocator, &this->descriptor_set_layout) != VK_SUCCESS) {
+		return -1;
+	}
+
+	VkDescriptorPoolSize pool_sizes[2];
+	pool_sizes[0].type = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER;
+	pool_sizes[0].descriptorCount = 1;
+	pool_sizes[1].type = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
+	pool_sizes[1].descriptorCount = DESCRIPTOR_COUNT - 1;
+
+	VkDescriptorPoolCreateInfo pool_create_info;
+	pool_create_info.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_POOL_CREATE_INFO;
+	pool_create_info.pNext = 0;
+	pool_create_info.flags = 0;
+	pool_create_info.maxSets = 1;
+	pool_create_info.poolSizeCount = 2;
+	pool_create_info.pPoolSizes = pool_sizes;
+
+	if (vkCreateDescriptorPool(this->base->device, &pool_create_info, this->base->allocator, &this->descriptor_pool) != VK_SUCCESS) {
+		vkDestroyDescriptorSetLayout(this->base->device, this->descriptor_set_layout, this->base->allocator);
+		return -2;
+	}
+
+	VkDescriptorSetAllocateInfo allocate_info;
+	allocate_info.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_ALLOCATE_INFO;
+	allocate_info.pNext = 0;
+	allocate_info.descriptorPool = this->descriptor_pool;
+	allocate_info.descriptorSetCount = 1;
+	allocate_info.pSetLayouts = &this->descriptor_set_layout;
+
+	if (vkAllocateDescriptorSets(this->base->device, &allocate_info, &this->descriptor_set) != VK_SUCCESS) {
+		vkDestroyDescriptorPool(this->base->device, this->descriptor_pool, this->base->allocator);
+		vkDestroyDescriptorSetLayout(this->base->device, this->descriptor_set_layout, this->base->allocator);
+		return -3;
+	}
+
+	VkDescriptorImageInfo image_info;
+	image_info.sampler = this->sampler;
+	image_info.imageView = this->cache_image_view;
+	image_info.imageLayout = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL;
+
+	VkDescriptorBufferInfo buffer_infos[DESCRIPTOR_COUNT - 1];
+	buffer_infos[0].buffer = this->indirection_buffer;
+	buffer_infos[1].buffer = this->feedback_buffer;
+
+	VkWriteDescriptorSet writes[DESCRIPTOR_COUNT];
+	for (uint32_t i = 0; i < DESCRIPTOR_COUNT; ++i) {
+		writes[i].sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
+		writes[i].pNext = 0;
+		writes[i].dstSet = this->descriptor_set;
+		writes[i].dstBinding = i;
+		writes[i].dstArrayElement = 0;
+		writes[i].descriptorCount = 1;
+		writes[i].descriptorType = bindings[i].descriptorType;
+		writes[i].pImageInfo = 0;
+		writes[i].pBufferInfo = 0;
+		writes[i].pTexelBufferView = 0;
+		if (i == 0) {
+			writes[i].pImageInfo = &image_info;
+		} else {
+			buffer_infos[i - 1].offset = 0;
+			buffer_infos[i - 1].range = VK_WHOLE_SIZE;
+			writes[i].pBufferInfo = buffer_infos + i - 1;
+		}
+	}
+	vkUpdateDescriptorSets(this->base->device, DESCRIPTOR_COUNT, writes, 0, 0);
+	return 0;
+}
+
+// Points binding 0 at a new cache image, command buffers that bound the set before have to be recorded again
+static void update_cache_descriptor(struct vulkan_virtual_texture *this) {
+	VkDescriptorImageInfo image_info;
+	image_info.sampler = this->sampler;
+	image_info.imageView = this->cache_image_view;
+	image_info.imageLayout = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL;
+
+	VkWriteDescriptorSet write;
+	write.sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
+	write.pNext = 0;
+	write.dstSet = this->descriptor_set;
+	write.dstBinding = 0;
+	write.dstArrayElement = 0;
+	write.descriptorCount = 1;
+	write.descriptorType = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER;
+	write.pImageInfo = &image_info;
+	write.pBufferInfo = 0;
+	write.pTexelBufferView = 0;
+	vkUpdateDescriptorSets(this->base->device, 1, &write, 0, 0);
+}
+
+static int try_init_tables(struct vulkan_virtual_texture *this) {
+	this->tile_slots = malloc(this->texture->tile_count*sizeof(*this->tile_slots));
+	this->tile_requested = calloc(this->texture->tile_count, sizeof(*this->tile_requested));
+	this->tile_loading = calloc(this->texture->tile_count, sizeof(*this->tile_loading));
+	this->slots = malloc(this->slot_count*sizeof(*this->slots));
+	if (!this->tile_slots || !this->tile_requested || !this->tile_loading || !this->slots) {
+		free(this->slots);
+		free(this->tile_loading);
+		free(this->tile_requested);
+		free(this->tile_slots);
+		return -1;
+	}
+	for (uint32_t i = 0; i < this->texture->tile_count; ++i) {
+		this->tile_slots[i] = -1;
+	}
+	for (uint32_t i = 0; i < this->slot_count; ++i) {
+		this->slots[i].tile = NO_TILE;
+		this->slots[i].last_used = 0;
+	}
+	for (int i = 0; i < VULKAN_VIRTUAL_TEXTURE__UPLOAD_SLOTS; ++i) {
+		this->uploads[i].texture = this;
+		this->uploads[i].state = VULKAN_VIRTUAL_TEXTURE__UPLOAD_FREE;
+	}
+	return 0;
+}
+
+// Moves the cache and the indirection between being read by fragment shaders and written by transfers
+static void record_barriers(struct vulkan_virtual_texture *this, VkCommandBuffer command_buffer, int to_transfer, VkImageLayout old_layout) {
+	VkImageMemoryBarrier image_barrier;
+	image_barrier.sType = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER;
+	image_barrier.pNext = 0;
+	image_barrier.srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+	image_barrier.dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+	image_barrier.image = this->cache_image;
+	image_barrier.subresourceRange.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
+	image_barrier.subresourceRange.baseMipLevel = 0;
+	image_barrier.subresourceRange.levelCount = 1;
+	image_barrier.subresourceRange.baseArrayLayer = 0;
+	image_barrier.subresourceRange.layerCount = 1;
+
+	VkBufferMemoryBarrier buffer_barrier;
+	buffer_barrier.sType = VK_STRUCTURE_TYPE_BUFFER_MEMORY_BARRIER;
+	buffer_barrier.pNext = 0;
+	buffer_barrier.srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+	buffer_barrier.dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+	buffer_barrier.buffer = this->indirection_buffer;
+	buffer_barrier.offset = 0;
+	buffer_barrier.size = VK_WHOLE_SIZE;
+
+	VkPipelineStageFlags src_stage, dst_stage;
+	if (to_transfer) {
+		// Earlier frames only have to be done reading, there is nothing of theirs to make visible
+		image_barrier.srcAccessMask = 0;
+		image_barrier.dstAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+		image_barrier.oldLayout = old_layout;
+		image_barrier.newLayout = VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL;
+		src_stage = VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT;
+		dst_stage = VK_PIPELINE_STAGE_TRANSFER_BIT;
+	} else {
+		image_barrier.srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+		image_barrier.dstAccessMask = VK_ACCESS_SHADER_READ_BIT;
+		image_barrier.oldLayout = VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL;
+		image_barrier.newLayout = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL;
+		src_stage = VK_PIPELINE_STAGE_TRANSFER_BIT;
+		dst_stage = VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT;
+	}
+	buffer_barrier.srcAccessMask = image_barrier.srcAccessMask;
+	buffer_barrier.dstAccessMask = image_barrier.dstAccessMask;
+	vkCmdPipelineBarrier(command_buffer, src_stage, dst_stage, 0, 0, 0, 1, &buffer_barrier, 1, &image_barrier);
+}
+
+static void record_tile_copy(struct vulkan_virtual_texture *this, VkCommandBuffer command_buffer, VkBuffer buffer, VkDeviceSize offset, uint32_t slot) {
+	VkBufferImageCopy region;
+	region.bufferOffset = offset;
+	region.bufferRowLength = 0;
+	region.bufferImageHeight = 0;
+	region.imageSubresource.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
+	region.imageSubresource.mipLevel = 0;
+	region.imageSubresource.baseArrayLayer = 0;
+	region.imageSubresource.layerCount = 1;
+	region.imageOffset.x = (int32_t) ((slot % this->cache_side)*TEXTURE__TILE_SIZE);
+	region.imageOffset.y = (int32_t) ((slot/this->cache_side)*TEXTURE__TILE_SIZE);
+	region.imageOffset.z = 0;
+	region.imageExtent.width = TEXTURE__TILE_SIZE;
+	region.imageExtent.height = TEXTURE__TILE_SIZE;
+	region.imageExtent.depth = 1;
+	vkCmdCopyBufferToImage(command_buffer, buffer, this->cache_image, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, 1, &region);
+}
+
+static void record_entry(struct vulkan_virtual_texture *this, VkCommandBuffer command_buffer, uint32_t tile, uint32_t entry) {
+	vkCmdUpdateBuffer(command_buffer, this->indirection_buffer, sizeof(struct indirection_header) + tile*sizeof(uint32_t), sizeof(entry), &entry);
+}
+
+// The single tile of the last level goes into slot 0 for good, so every lookup finds something
+static void record_first_upload(struct vulkan_virtual_texture *this, VkCommandBuffer command_buffer, VkBuffer staging_buffer, VkDeviceSize indirection_size) {
+	record_barriers(this, command_buffer, 1, VK_IMAGE_LAYOUT_UNDEFINED);
+	VkBufferCopy region;
+	region.srcOffset = 0;
+	region.dstOffset = 0;
+	region.size = indirection_size;
+	vkCmdCopyBuffer(command_buffer, staging_buffer, this->indirection_buffer, 1, &region);
+	record_tile_copy(this, command_buffer, staging_buffer, indirection_size, 0);
+	record_barriers(this, command_buffer, 0, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL);
+}
+
+static int try_submit_first_upload(struct vulkan_virtual_texture *this, VkBuffer staging_buffer, VkDeviceSize indirection_size) {
+	VkCommandBufferAllocateInfo allocate_info;
+	allocate_info.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_ALLOCATE_INFO;
+	allocate_info.pNext = 0;
+	allocate_info.commandPool = this->base->command_pool;
+	allocate_info.level = VK_COMMAND_BUFFER_LEVEL_PRIMARY;
+	allocate_info.commandBufferCount = 1;
+
+	VkCommandBuffer command_buffer;
+	if (vkAllocateCommandBuffers(this->base->device, &allocate_info, &command_buffer) != VK_SUCCESS) {
+		return -1;
+	}
+
+	VkCommandBufferBeginInfo begin_info;
+	begin_info.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO;
+	begin_info.pNext = 0;
+	begin_info.flags = VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT;
+	begin_info.pInheritanceInfo = 0;
+	if (vkBeginCommandBuffer(command_buffer, &begin_info) != VK_SUCCESS) {
+		vkFreeCommandBuffers(this->base->device, this->base->command_pool, 1, &command_buffer);
+		return -2;
+	}
+	record_first_upload(this, command_buffer, staging_buffer, indirection_size);
+	if (vkEndCommandBuffer(command_buffer) != VK_SUCCESS) {
+		vkFreeCommandBuffers(this->base->device, this->base->command_pool, 1, &command_buffer);
+		return -3;
+	}
+
+	VkFenceCreateInfo fence_create_info;
+	fence_create_info.sType = VK_STRUCTURE_TYPE_FENCE_CREATE_INFO;
+	fence_create_info.pNext = 0;
+	fence_create_info.flags = 0;
+
+	VkFence fence;
+	if (vkCreateFence(this->base->device, &fence_create_info, this->base->allocator, &fence) != VK_SUCCESS) {
+		vkFreeCommandBuffers(this->base->device, this->base->command_pool, 1, &command_buffer);
+		return -4;
+	}
+
+	VkSubmitInfo submit_info;
+	memset(&submit_info, 0, sizeof(submit_info));
+	submit_info.sType = VK_STRUCTURE_TYPE_SUBMIT_INFO;
+	submit_info.commandBufferCount = 1;
+	submit_info.pCommandBuffers = &command_buffer;
+	int result = 0;
+	if (vkQueueSubmit(this->base->queue, 1, &submit_info, fence) != VK_SUCCESS ||
+		vkWaitForFences(this->base->device, 1, &fence, VK_TRUE, MAX_UINT64) != VK_SUCCESS) {
+		result = -5;
+	}
+	vkDestroyFence(this->base->device, fence, this->base->allocator);
+	vkFreeCommandBuffers(this->base->device, this->base->command_pool, 1, &command_buffer);
+	return result;
+}
+
+static int try_upload_first(struct vulkan_virtual_texture *this) {
+	const struct texture *texture = this->texture;
+	VkDeviceSize indirection_size = sizeof(struct indirection_header) + texture->tile_count*sizeof(uint32_t);
+	VkBuffer staging_buffer;
+	VkDeviceMemory staging_memory;
+	if (vulkan_base__try_create_buffer(this->base, indirection_size + TEXTURE__TILE_BYTES, VK_BUFFER_USAGE_TRANSFER_SRC_BIT,
+									   VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT, &staging_buffer, &staging_memory) < 0) {
+		return -1;
+	}
+	unsigned char *staging;
+	if (vkMapMemory(this->base->device, staging_memory, 0, VK_WHOLE_SIZE, 0, (void **) &staging) != VK_SUCCESS) {
+		vulkan_base__free_buffer(this->base, staging_buffer, staging_memory);
+		return -2;
+	}
+	struct indirection_header header;
+	memset(&header, 0, sizeof(header));
+	header.mip_count = texture->mip_count;
+	header.cache_side = this->cache_side;
+	memcpy(header.mips, texture->mips, sizeof(header.mips));
+	memcpy(staging, &header, sizeof(header));
+	uint32_t *entries = (uint32_t *) (staging + sizeof(header));
+	memset(entries, 0, texture->tile_count*sizeof(uint32_t));
+	uint32_t last_tile = texture->tile_count - 1;
+	entries[last_tile] = 1;
+	memcpy(staging + indirection_size, texture__tile(texture, last_tile), TEXTURE__TILE_BYTES);
+	vkUnmapMemory(this->base->device, staging_memory);
+
+	int result = try_submit_first_upload(this, staging_buffer, indirection_size);
+	vulkan_base__free_buffer(this->base, staging_buffer, staging_memory);
+	if (result < 0) {
+		return -3;
+	}
+	this->tile_slots[last_tile] = 0;
+	this->slots[0].tile = last_tile;
+	this->stats.resident = 1;
+	return 0;
+}
+
+// Replaces the cache with one of cache_side, starting over from the last level's tile like init does
+static int try_resize_cache(struct vulkan_virtual_texture *this, uint32_t cache_side) {
+	// Frames in flight sample the old cache and may still copy into it
+	vkDeviceWaitIdle(this->base->device);
+	VkImage image = this->cache_image;
+	VkDeviceMemory memory = this->cache_memory;
+	VkImageView image_view = this->cache_image_view;
+	VkSampler sampler = this->sampler;
+	uint32_t old_side = this->cache_side;
+	VkDeviceSize old_bytes = this->cache_bytes;
+	this->cache_side = cache_side;
+	if (try_create_cache(this) < 0) {
+		this->cache_image = image;
+		this->cache_memory = memory;
+		this->cache_image_view = image_view;
+		this->sampler = sampler;
+		this->cache_side = old_side;
+		this->cache_bytes = old_bytes;
+		return -1;
+	}
+	vkDestroySampler(this->base->device, sampler, this->base->allocator);
+	vkDestroyImageView(this->base->device, image_view, this->base->allocator);
+	vkDestroyImage(this->base->device, image, this->base->allocator);
+	vulkan_base__free_memory(this->base, memory);
+	this->slot_count = cache_side*cache_side;
+	update_cache_descriptor(this);
+	this->cache_resized = 1;
+
+	for (uint32_t i = 0; i < this->texture->tile_count; ++i) {
+		if (this->tile_slots[i] >= 0) {
+			this->tile_slots[i] = -1;
+			++this->stats.evicted;
+		}
+	}
+	for (uint32_t i = 0; i < this->slot_count; ++i) {
+		this->slots[i].tile = NO_TILE;
+		this->slots[i].last_used = 0;
+	}
+	for (int i = 0; i < VULKAN_VIRTUAL_TEXTURE__UPLOAD_SLOTS; ++i) {
+		if (this->uploads[i].state == VULKAN_VIRTUAL_TEXTURE__UPLOAD_COPYING) {
+			this->uploads[i].state = VULKAN_VIRTUAL_TEXTURE__UPLOAD_FREE;
+		}
+	}
+	this->stats.resident = 0;
+	if (try_upload_first(this) < 0) {
+		return -2;
+	}
+	return 0;
+}
+
+// Halves the cache until it gives back about bytes. What the fragment shaders asked for recently streams in again
+// at the new size, so this trades sharpness for memory rather than dropping slots that would only be refilled.
+static VkDeviceSize try_evict(void *user_data, uint32_t heap_index, VkDeviceSize bytes) {
+	struct vulkan_virtual_texture *this = (struct vulkan_virtual_texture *) user_data;
+	if (heap_index != this->cache_heap_index || this->cache_side <= MIN_CACHE_SIDE) {
+		return 0;
+	}
+	uint32_t cache_side = this->cache_side;
+	do {
+		cache_side /= 2;
+	} while (cache_side > MIN_CACHE_SIDE && (VkDeviceSize) (this->slot_count - cache_side*cache_side)*TEXTURE__TILE_BYTES < bytes);
+
+	VkDeviceSize old_bytes = this->cache_bytes;
+	// Once the old cache is gone its memory is back even if the new one could not be filled
+	if (try_resize_cache(this, cache_side) == -1) {
+		return 0;
+	}
+	return this->cache_bytes < old_bytes ? old_bytes - this->cache_bytes : 0;
+}
+
+int vulkan_virtual_texture__try_init(struct vulkan_virtual_texture *this, struct vulkan_base *base, const struct texture *texture,
+									 struct job_system *job_system, uint32_t cache_side) {
+	this->base = base;
+	this->texture = texture;
+	this->job_system = job_system;
+	this->cache_side = fit_cache_side(this, cache_side);
+	this->slot_count = this->cache_side*this->cache_side;
+	this->pending_loads = 0;
+	this->frame = 0;
+	this->update_count = 0;
+	this->cache_resized = 0;
+	memset(&this->stats, 0, sizeof(this->stats));
+
+	if (try_create_cache(this) < 0) {
+		return -1;
+	}
+	if (try_create_buffers(this) < 0) {
+		free_cache(this);
+		return -2;
+	}
+	if (try_create_descriptor_set(this) < 0) {
+		free_from_buffers(this);
+		return -3;
+	}
+	if (try_init_tables(this) < 0) {
+		free_from_descriptor_set(this);
+		return -4;
+	}
+	if (try_upload_first(this) < 0) {
+		free_from_tables(this);
+		return -5;
+	}
+	// Cheaper to lose than anything drawn without streaming
+	struct vulkan_memory_streamable streamable;
+	streamable.try_evict = try_evict;
+	streamable.user_data = this;
+	streamable.priority = 0;
+	if (vulkan_memory_budget__try_add_streamable(&base->memory_budget, streamable) < 0) {
+		free_from_tables(this);
+		return -6;
+	}
+	return 0;
+}
+
+void vulkan_virtual_texture__free_updates(struct vulkan_virtual_texture *this) {
+	if (this->update_count == 0) {
+		return;
+	}
+	vkFreeCommandBuffers(this->base->device, this->command_pool, (uint32_t) this->update_count, this->update_command_buffers);
+	vkDestroyCommandPool(this->base->device, this->command_pool, this->base->allocator);
+	free(this->update_command_buffers);
+	this->update_count = 0;
+}
+
+int vulkan_virtual_texture__try_init_updates(struct vulkan_virtual_texture *this, int resource_count) {
+	this->update_command_buffers = malloc(resource_count*sizeof(*this->update_command_buffers));
+	if (!this->update_command_buffers) {
+		return -1;
+	}
+
+	VkCommandPoolCreateInfo pool_create_info;
+	pool_create_info.sType = VK_STRUCTURE_TYPE_COMMAND_POOL_CREATE_INFO;
+	pool_create_info.pNext = 0;
+	pool_create_info.flags = VK_COMMAND_POOL_CREATE_RESET_COMMAND_BUFFER_BIT | VK_COMMAND_POOL_CREATE_TRANSIENT_BIT;
+	pool_create_info.queueFamilyIndex = (uint32_t) this->base->queue_family_index;
+	if (vkCreateCommandPool(this->base->device, &pool_create_info, this->base->allocator, &this->command_pool) != VK_SUCCESS) {
+		free(this->update_command_buffers);
+		return -2;
+	}
+
+	VkCommandBufferAllocateInfo allocate_info;
+	allocate_info.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_ALLOCATE_INFO;
+	allocate_info.pNext = 0;
+	allocate_info.commandPool = this->command_pool;
+	allocate_info.level = VK_COMMAND_BUFFER_LEVEL_PRIMARY;
+	allocate_info.commandBufferCount = (uint32_t) resource_count;
+	if (vkAllocateCommandBuffers(this->base->device, &allocate_info, this->update_command_buffers) != VK_SUCCESS) {
+		vkDestroyCommandPool(this->base->device, this->command_pool, this->base->allocator);
+		free(this->update_command_buffers);
+		return -3;
+	}
+	this->update_count = resource_count;
+	return 0;
+}
+
+static void load_tile_job(void *user_data) {
+	struct vulkan_virtual_texture_upload *upload = (struct vulkan_virtual_texture_upload *) user_data;
+	struct vulkan_virtual_texture *this = upload->texture;
+	// Page faults on the mapping happen here, off the render thread
+	size_t offset = (size_t) (upload - this->uploads)*TEXTURE__TILE_BYTES;
+	memcpy(this->upload_tiles + offset, texture__tile(this->texture, upload->tile), TEXTURE__TILE_BYTES);
+	__atomic_store_n(&upload->state, VULKAN_VIRTUAL_TEXTURE__UPLOAD_READY, __ATOMIC_RELEASE);
+}
+
+// Coarser levels go first, they cover more of the screen and stand in for the finer ones until those arrive
+static void read_feedback(struct vulkan_virtual_texture *this) {
+	int upload = 0;
+	this->stats.requested = 0;
+	for (uint32_t mip = this->texture->mip_count; mip-- > 0;) {
+		uint32_t first_tile = this->texture->mips[mip].first_tile;
+		uint32_t end_tile = first_tile + this->texture->mips[mip].tiles_x*this->texture->mips[mip].tiles_y;
+		for (uint32_t tile = first_tile; tile < end_tile; ++tile) {
+			// A request written between the load and the store is lost, the shader makes it again next frame
+			if (__atomic_load_n(this->requests + tile, __ATOMIC_RELAXED) == 0) {
+				continue;
+			}
+			__atomic_store_n(this->requests + tile, 0, __ATOMIC_RELAXED);
+			this->tile_requested[tile] = this->frame;
+			++this->stats.requested;
+			if (this->tile_slots[tile] >= 0) {
+				this->slots[this->tile_slots[tile]].last_used = this->frame;
+				continue;
+			}
+			if (this->tile_loading[tile]) {
+				continue;
+			}
+			while (upload < VULKAN_VIRTUAL_TEXTURE__UPLOAD_SLOTS && this->uploads[upload].state != VULKAN_VIRTUAL_TEXTURE__UPLOAD_FREE) {
+				++upload;
+			}
+			if (upload == VULKAN_VIRTUAL_TEXTURE__UPLOAD_SLOTS) {
+				continue;
+			}
+			this->uploads[upload].tile = tile;
+			this->uploads[upload].state = VULKAN_VIRTUAL_TEXTURE__UPLOAD_LOADING;
+			this->tile_loading[tile] = 1;
+			job_system__run(this->job_system, load_tile_job, this->uploads + upload, &this->pending_loads);
+		}
+	}
+}
+
+// A free slot, otherwise the least recently used one nothing asked for lately. Slot 0 keeps the last level.
+static int take_slot(struct vulkan_virtual_texture *this) {
+	int oldest = -1;
+	for (uint32_t i = 1; i < this->slot_count; ++i) {
+		const struct vulkan_virtual_texture_slot *slot = this->slots + i;
+		if (slot->tile == NO_TILE) {
+			return (int) i;
+		}
+		if (slot->last_used + EVICT_AFTER_FRAMES <= this->frame && (oldest < 0 || slot->last_used < this->slots[oldest].last_used)) {
+			oldest = (int) i;
+		}
+	}
+	return oldest;
+}
+
+VkCommandBuffer vulkan_virtual_texture__update(struct vulkan_virtual_texture *this, int resources_index) {
+	++this->frame;
+	for (int i = 0; i < VULKAN_VIRTUAL_TEXTURE__UPLOAD_SLOTS; ++i) {
+		struct vulkan_virtual_texture_upload *upload = this->uploads + i;
+		if (upload->state == VULKAN_VIRTUAL_TEXTURE__UPLOAD_COPYING && upload->resources_index == resources_index) {
+			upload->state = VULKAN_VIRTUAL_TEXTURE__UPLOAD_FREE;
+		}
+	}
+	read_feedback(this);
+
+	VkCommandBuffer command_buffer = this->update_command_buffers[resources_index];
+	int copy_count = 0;
+	int cache_full = 0;
+	for (int i = 0; i < VULKAN_VIRTUAL_TEXTURE__UPLOAD_SLOTS; ++i) {
+		struct vulkan_virtual_texture_upload *upload = this->uploads + i;
+		if (__atomic_load_n(&upload->state, __ATOMIC_ACQUIRE) != VULKAN_VIRTUAL_TEXTURE__UPLOAD_READY) {
+			continue;
+		}
+		if (this->tile_requested[upload->tile] + EVICT_AFTER_FRAMES <= this->frame) {
+			upload->state = VULKAN_VIRTUAL_TEXTURE__UPLOAD_FREE;
+			this->tile_loading[upload->tile] = 0;
+			continue;
+		}
+		// Stays ready until something can be evicted
+		int slot_index = cache_full || copy_count == VULKAN_VIRTUAL_TEXTURE__MAX_UPLOADS_PER_FRAME ? -1 : take_slot(this);
+		if (slot_index < 0) {
+			cache_full = 1;
+			continue;
+		}
+		if (copy_count == 0) {
+			VkCommandBufferBeginInfo begin_info;
+			begin_info.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO;
+			begin_info.pNext = 0;
+			begin_info.flags = VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT;
+			begin_info.pInheritanceInfo = 0;
+			if (vkBeginCommandBuffer(command_buffer, &begin_info) != VK_SUCCESS) {
+				return VK_NULL_HANDLE;
+			}
+			record_barriers(this, command_buffer, 1, VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL);
+		}
+
+		struct vulkan_virtual_texture_slot *slot = this->slots + slot_index;
+		if (slot->tile != NO_TILE) {
+			this->tile_slots[slot->tile] = -1;
+			record_entry(this, command_buffer, slot->tile, 0);
+			++this->stats.evicted;
+		} else {
+			++this->stats.resident;
+		}
+		record_tile_copy(this, command_buffer, this->upload_buffer, (VkDeviceSize) i*TEXTURE__TILE_BYTES, (uint32_t) slot_index);
+		record_entry(this, command_buffer, upload->tile, (uint32_t) slot_index + 1);
+		slot->tile = upload->tile;
+		slot->last_used = this->frame;
+		this->tile_slots[upload->tile] = slot_index;
+		this->tile_loading[upload->tile] = 0;
+		upload->state = VULKAN_VIRTUAL_TEXTURE__UPLOAD_COPYING;
+		upload->resources_index = resources_index;
+		++this->stats.loaded;
+		++copy_count;
+	}
+	if (copy_count == 0) {
+		return VK_NULL_HANDLE;
+	}
+	record_barriers(this, command_buffer, 0, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL);
+	if (vkEndCommandBuffer(command_buffer) != VK_SUCCESS) {
+		return VK_NULL_HANDLE;
+	}
+	return command_buffer;
+}
+
+int vulkan_virtual_texture__try_add_feedback(struct vulkan_virtual_texture *this, struct vulkan_render_graph *graph, int pass) {
+	int resource = vulkan_render_graph__import_buffer(graph, this->feedback_buffer, VK_PIPELINE_STAGE_HOST_BIT);
+	if (resource < 0) {
+		return -1;
+	}
+	if (vulkan_render_graph__access(graph, pass, resource, VULKAN_RENDER_GRAPH__USAGE_FRAGMENT_STORAGE_WRITE) < 0) {
+		return -2;
+	}
+	vulkan_render_graph__set_output(graph, resource, VULKAN_RENDER_GRAPH__USAGE_HOST_READ);
+	return 0;
+}
@@ -0,0 +1,112 @@
+#pragma once
+
+#include <vulkan/vulkan.h>
+#include "vulkan_base.h"
+#include "vulkan_render_graph.h"
+#include "../texture/texture.h"
+#include "../job/job_system.h"
+
+#define VULKAN_VIRTUAL_TEXTURE__DEFAULT_CACHE_SIDE 16
+// Tiles being read from the file or waiting to be copied into the cache
+#define VULKAN_VIRTUAL_TEXTURE__UPLOAD_SLOTS 32
+#define VULKAN_VIRTUAL_TEXTURE__MAX_UPLOADS_PER_FRAME 16
+
+enum vulkan_virtual_texture_upload_state {
+	VULKAN_VIRTUAL_TEXTURE__UPLOAD_FREE,
+	VULKAN_VIRTUAL_TEXTURE__UPLOAD_LOADING,
+	VULKAN_VIRTUAL_TEXTURE__UPLOAD_READY,
+	VULKAN_VIRTUAL_TEXTURE__UPLOAD_COPYING
+};
+
+struct vulkan_virtual_texture_upload {
+	struct vulkan_virtual_texture *texture;
+	uint32_t tile;
+	// Set to READY by the loading job
+	enum vulkan_virtual_texture_upload_state state;
+	// Frame resource whose command buffer copies it
+	int resources_index;
+};
+
+// A tile sized region of the cache image
+struct vulkan_virtual_texture_slot {
+	uint32_t tile;
+	long last_used;
+};
+
+struct vulkan_virtual_texture_stats {
+	uint32_t resident;
+	uint32_t requested;
+	long loaded;
+	long evicted;
+};
+
+// Streams the tiles of a texture into a cache image of cache_side*cache_side tiles, so device memory stays bounded
+// by the cache no matter how large the texture is. Fragment shaders look tiles up through an indirection buffer,
+// falling back to coarser levels while finer ones are missing, and write the tiles they want into a host visible
+// feedback buffer. Each update reads the feedback, starts loading missing tiles from the mapped file on the job
+// system, and copies tiles that finished loading into the least recently used cache slots. The texture is a
+// streamable of the base's memory budget, which halves the cache when its heap runs over.
+struct vulkan_virtual_texture {
+	struct vulkan_base *base;
+	const struct texture *texture;
+	struct job_system *job_system;
+	uint32_t cache_side;
+	uint32_t slot_count;
+
+	VkImage cache_image;
+	VkDeviceMemory cache_memory;
+	uint32_t cache_heap_index;
+	VkDeviceSize cache_bytes;
+	// Set when the memory budget shrank the cache, which points the descriptor set at a new image. Whoever
+	// recorded command buffers binding it has to record them again and clear this.
+	int cache_resized;
+	VkImageView cache_image_view;
+	VkSampler sampler;
+	VkBuffer indirection_buffer;
+	VkDeviceMemory indirection_memory;
+	// One per tile, nonzero when a shader wanted it since the host last looked
+	uint32_t *requests;
+	VkBuffer feedback_buffer;
+	VkDeviceMemory feedback_memory;
+	unsigned char *upload_tiles;
+	VkBuffer upload_buffer;
+	VkDeviceMemory upload_memory;
+
+	VkDescriptorSetLayout descriptor_set_layout;
+	VkDescriptorPool descriptor_pool;
+	VkDescriptorSet descriptor_set;
+
+	// Cache slot of each tile, or -1
+	int32_t *tile_slots;
+	// Frame each tile was last requested in, loads nobody wants anymore are dropped instead of copied
+	long *tile_requested;
+	unsigned char *tile_loading;
+	struct vulkan_virtual_texture_slot *slots;
+	struct vulkan_virtual_texture_upload uploads[VULKAN_VIRTUAL_TEXTURE__UPLOAD_SLOTS];
+	int pending_loads;
+	long frame;
+
+	// Recorded on every update, so they get a pool of their own
+	int update_count;
+	VkCommandPool command_pool;
+	VkCommandBuffer *update_command_buffers;
+
+	struct vulkan_virtual_texture_stats stats;
+};
+
+// The texture has to stay mapped until free. cache_side shrinks to fit the device local heap's headroom.
+// Uses the base's command pool for the first upload and again whenever the cache shrinks, so keep init, updates
+// and vulkan_memory_budget__enforce on the thread that owns the pool.
+int vulkan_virtual_texture__try_init(struct vulkan_virtual_texture *this, struct vulkan_base *base, const struct texture *texture,
+									 struct job_system *job_system, uint32_t cache_side);
+// Waits for loads still running, the device must be idle
+void vulkan_virtual_texture__free(struct vulkan_virtual_texture *this);
+
+int vulkan_virtual_texture__try_init_updates(struct vulkan_virtual_texture *this, int resource_count);
+void vulkan_virtual_texture__free_updates(struct vulkan_virtual_texture *this);
+// Returns a command buffer that copies newly loaded tiles into the cache, to submit ahead of the frame's own, or
+// VK_NULL_HANDLE if there is nothing to copy. The fence of resources_index must have been waited on.
+VkCommandBuffer vulkan_virtual_texture__update(struct vulkan_virtual_texture *this, int resources_index);
+
+// For a pass that draws with the texture's descriptor set, makes its requests visible to the host after the frame
+int vulkan_virtual_texture__try_add_feedback(struct vulkan_virtual_texture *this, struct vulkan_render_graph *graph, int pass);
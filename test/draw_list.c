@@ -0,0 +1,329 @@
+#include <malloc.h>
+#include <stdio.h>
+#include <stdint.h>
+#include <string.h>
+#include "../src/vulkan/vulkan_draw_list.h"
+
+// Fake buffers are host memory whose address is the memory handle, the recorded commands are logged in order
+#define SORT_ITEMS 1000
+#define MAX_RECORDED 16
+#define INSTANCE_SIZE 16
+#define INSTANCE_CAPACITY 8
+#define STRIDE ((VkDeviceSize) sizeof(VkDrawIndexedIndirectCommand))
+// Handles of the pipelines, layouts, materials and command buffer, above the ones the fakes hand out
+#define FAKE_HANDLE 1000
+#define COMMAND_BUFFER ((VkCommandBuffer) (uintptr_t) (FAKE_HANDLE + 5))
+
+struct recorded_draw {
+	int indirect;
+	VkDeviceSize offset;
+	uint32_t draw_count;
+	uint32_t instance_count;
+	uint32_t first_instance;
+};
+
+static uintptr_t next_handle = 1;
+static int live_buffers;
+static int pipeline_binds;
+static int descriptor_binds;
+static int push_constant_updates;
+static uint32_t pushed_constants[MAX_RECORDED];
+static struct recorded_draw recorded_draws[MAX_RECORDED];
+static int recorded_draw_count;
+static VkDeviceSize instance_offsets[MAX_RECORDED];
+static int instance_bind_count;
+
+VKAPI_ATTR void VKAPI_CALL vkCmdBindPipeline(VkCommandBuffer command_buffer, VkPipelineBindPoint bind_point, VkPipeline pipeline) {
+	++pipeline_binds;
+}
+
+VKAPI_ATTR void VKAPI_CALL vkCmdBindDescriptorSets(VkCommandBuffer command_buffer, VkPipelineBindPoint bind_point, VkPipelineLayout layout, uint32_t first_set,
+												   uint32_t set_count, const VkDescriptorSet *sets, uint32_t dynamic_offset_count, const uint32_t *dynamic_offsets) {
+	++descriptor_binds;
+}
+
+VKAPI_ATTR void VKAPI_CALL vkCmdPushConstants(VkCommandBuffer command_buffer, VkPipelineLayout layout, VkShaderStageFlags stages, uint32_t offset, uint32_t size,
+											  const void *values) {
+	if (push_constant_updates < MAX_RECORDED) {
+		memcpy(pushed_constants + push_constant_updates, values, sizeof(uint32_t));
+	}
+	++push_constant_updates;
+}
+
+VKAPI_ATTR void VKAPI_CALL vkCmdBindVertexBuffers(VkCommandBuffer command_buffer, uint32_t first_binding, uint32_t binding_count, const VkBuffer *buffers,
+												  const VkDeviceSize *offsets) {
+	if (first_binding == VULKAN_DRAW_LIST__INSTANCE_BINDING && instance_bind_count < MAX_RECORDED) {
+		instance_offsets[instance_bind_count++] = offsets[0];
+	}
+}
+
+VKAPI_ATTR void VKAPI_CALL vkCmdDrawIndexed(VkCommandBuffer command_buffer, uint32_t index_count, uint32_t instance_count, uint32_t first_index, int32_t vertex_offset,
+											uint32_t first_instance) {
+	if (recorded_draw_count == MAX_RECORDED) {
+		return;
+	}
+	struct recorded_draw *draw = recorded_draws + recorded_draw_count++;
+	draw->indirect = 0;
+	draw->offset = 0;
+	draw->draw_count = 1;
+	draw->instance_count = instance_count;
+	draw->first_instance = first_instance;
+}
+
+VKAPI_ATTR void VKAPI_CALL vkCmdDrawIndexedIndirect(VkCommandBuffer command_buffer, VkBuffer buffer, VkDeviceSize offset, uint32_t draw_count, uint32_t stride) {
+	if (recorded_draw_count == MAX_RECORDED) {
+		return;
+	}
+	struct recorded_draw *draw = recorded_draws + recorded_draw_count++;
+	draw->indirect = 1;
+	draw->offset = offset;
+	draw->draw_count = draw_count;
+	draw->instance_count = 0;
+	draw->first_instance = 0;
+}
+
+VKAPI_ATTR VkResult VKAPI_CALL vkMapMemory(VkDevice device, VkDeviceMemory memory, VkDeviceSize offset, VkDeviceSize size, VkMemoryMapFlags flags, void **data) {
+	*data = (void *) (uintptr_t) memory;
+	return VK_SUCCESS;
+}
+
+VKAPI_ATTR void VKAPI_CALL vkUnmapMemory(VkDevice device, VkDeviceMemory memory) {
+}
+
+// The draw list only reaches the base for its per-frame buffers, so it is not linked either
+int vulkan_base__try_create_buffer(struct vulkan_base *this, VkDeviceSize size, VkBufferUsageFlags usage, VkMemoryPropertyFlags properties, VkBuffer *buffer_out,
+								   VkDeviceMemory *memory_out) {
+	void *bytes = calloc(1, (size_t) size);
+	if (!bytes) {
+		return -1;
+	}
+	*buffer_out = (VkBuffer) (uintptr_t) next_handle++;
+	*memory_out = (VkDeviceMemory) (uintptr_t) bytes;
+	++live_buffers;
+	return 0;
+}
+
+void vulkan_base__free_buffer(struct vulkan_base *this, VkBuffer buffer, VkDeviceMemory memory) {
+	free((void *) (uintptr_t) memory);
+	--live_buffers;
+}
+
+static void clear_recorded() {
+	pipeline_binds = 0;
+	descriptor_binds = 0;
+	push_constant_updates = 0;
+	recorded_draw_count = 0;
+	instance_bind_count = 0;
+}
+
+static void push(struct vulkan_draw_list *list, uint64_t key, uint32_t first_instance, uint32_t instance_count, uint32_t push_constant) {
+	struct vulkan_draw_item item;
+	item.key = key;
+	item.index_count = 36;
+	item.first_index = 0;
+	item.vertex_offset = 0;
+	item.first_instance = first_instance;
+	item.instance_count = instance_count;
+	item.push_constant = push_constant;
+	vulkan_draw_list__try_push(list, &item);
+}
+
+static int expect(int condition, const char *what) {
+	if (!condition) {
+		printf("Failed: %s\n", what);
+	}
+	return condition ? 0 : 1;
+}
+
+static int expect_draw(int index, int indirect, VkDeviceSize offset, uint32_t draw_count, uint32_t instance_count, uint32_t first_instance, const char *what) {
+	struct recorded_draw *draw = recorded_draws + index;
+	return expect(index < recorded_draw_count && draw->indirect == indirect && draw->offset == offset && draw->draw_count == draw_count &&
+				  draw->instance_count == instance_count && draw->first_instance == first_instance, what);
+}
+
+static int test_keys() {
+	int failed = 0;
+	failed += expect(VULKAN_DRAW_LIST__KEY(0xF, 0xFFF, 0xFFFF, 0xFFFFFFFFu) == UINT64_MAX, "the fields fill all 64 bits");
+	failed += expect(VULKAN_DRAW_LIST__KEY(1, 2, 3, 4) == 0x1002000300000004ull, "pass, pipeline, material and depth take 4, 12, 16 and 32 bits");
+	uint64_t key = VULKAN_DRAW_LIST__KEY(0xF, 0xABC, 0x1234, -1);
+	failed += expect(VULKAN_DRAW_LIST__KEY_PIPELINE(key) == 0xABC && VULKAN_DRAW_LIST__KEY_MATERIAL(key) == 0x1234, "pipeline and material read back");
+	failed += expect(VULKAN_DRAW_LIST__KEY_MATERIAL(VULKAN_DRAW_LIST__KEY(0, 0, 0, -1)) == 0, "a negative depth stays out of the material");
+	failed += expect(VULKAN_DRAW_LIST__KEY_PIPELINE(VULKAN_DRAW_LIST__KEY(0xF, 0, 0xFFFF, 0)) == 0, "pass and material stay out of the pipeline");
+	return failed;
+}
+
+static int test_sort(struct vulkan_base *base) {
+	struct vulkan_draw_list list;
+	if (vulkan_draw_list__try_init(&list, base, SORT_ITEMS) < 0) {
+		return expect(0, "init the sort list");
+	}
+	// Few distinct values per field, so many keys are equal and some digits are shared by every key
+	uint32_t random = 1;
+	for (uint32_t i = 0; i < SORT_ITEMS; ++i) {
+		random = random*1664525u + 1013904223u;
+		uint32_t depth = (random >> 8) & 0x3F;
+		if (random & 0x80000000u) {
+			depth |= 0x12340000u;
+		}
+		push(&list, VULKAN_DRAW_LIST__KEY((random >> 28) & 0x3, (random >> 20) & 0x7, 0, depth), i, 1, 0);
+	}
+	vulkan_draw_list__sort(&list);
+
+	int failed = 0;
+	int sorted = 1;
+	int stable = 1;
+	uint32_t seen[SORT_ITEMS];
+	memset(seen, 0, sizeof(seen));
+	for (uint32_t i = 0; i < SORT_ITEMS; ++i) {
+		seen[list.order[i]] = 1;
+		if (list.keys[i] != list.items[list.order[i]].key) {
+			sorted = 0;
+		}
+		if (i > 0 && list.keys[i - 1] > list.keys[i]) {
+			sorted = 0;
+		}
+		if (i > 0 && list.keys[i - 1] == list.keys[i] && list.order[i - 1] > list.order[i]) {
+			stable = 0;
+		}
+	}
+	int permutation = 1;
+	for (uint32_t i = 0; i < SORT_ITEMS; ++i) {
+		permutation &= seen[i];
+	}
+	failed += expect(sorted, "the radix sort orders the items by key");
+	failed += expect(stable, "items with equal keys keep the order they were pushed in");
+	failed += expect(permutation, "every item is sorted exactly once");
+	vulkan_draw_list__free(&list);
+	return failed;
+}
+
+// Without multi-draws every merged draw goes out directly, with binds only where the state changes
+static int test_record(struct vulkan_base *base) {
+	struct vulkan_draw_list list;
+	if (vulkan_draw_list__try_init(&list, base, 16) < 0) {
+		return expect(0, "init the list to record");
+	}
+	vulkan_draw_list__set_pipeline(&list, 0, (VkPipeline) (uintptr_t) FAKE_HANDLE, (VkPipelineLayout) (uintptr_t) (FAKE_HANDLE + 1));
+	vulkan_draw_list__set_pipeline(&list, 1, (VkPipeline) (uintptr_t) (FAKE_HANDLE + 2), (VkPipelineLayout) (uintptr_t) (FAKE_HANDLE + 3));
+	vulkan_draw_list__set_material(&list, 1, (VkDescriptorSet) (uintptr_t) (FAKE_HANDLE + 4));
+
+	// Pushed out of order, the sort brings the first pipeline's items together
+	push(&list, VULKAN_DRAW_LIST__KEY(0, 1, 1, 1), 12, 1, 7);
+	push(&list, VULKAN_DRAW_LIST__KEY(0, 0, 0, 0), 0, 1, 0);
+	push(&list, VULKAN_DRAW_LIST__KEY(0, 1, 0, 0), 10, 1, 0);
+	push(&list, VULKAN_DRAW_LIST__KEY(0, 0, 0, 0), 1, 2, 0);
+	push(&list, VULKAN_DRAW_LIST__KEY(0, 0, 0, 0), 3, 1, 0);
+	push(&list, VULKAN_DRAW_LIST__KEY(0, 0, 0, 0), 5, 1, 0);
+	push(&list, VULKAN_DRAW_LIST__KEY(0, 1, 1, 0), 11, 1, 0);
+	vulkan_draw_list__sort(&list);
+	clear_recorded();
+	vulkan_draw_list__record(&list, COMMAND_BUFFER, 0);
+
+	int failed = 0;
+	failed += expect_draw(0, 0, 0, 1, 4, 0, "items whose instances follow on merge into one instanced draw");
+	failed += expect_draw(1, 0, 0, 1, 1, 5, "a gap in the instances starts a new draw");
+	failed += expect_draw(2, 0, 0, 1, 1, 10, "the second pipeline draws after the first");
+	failed += expect_draw(3, 0, 0, 1, 1, 11, "instances that follow on don't merge across materials");
+	failed += expect_draw(4, 0, 0, 1, 1, 12, "instances don't merge across push constants");
+	failed += expect(recorded_draw_count == 5 && list.stats.draws == 5 && list.stats.items == 7, "seven items make five draws");
+	failed += expect(pipeline_binds == 2 && list.stats.pipeline_binds == 2, "each pipeline is bound once");
+	failed += expect(descriptor_binds == 1 && list.stats.descriptor_binds == 1, "only materials with a descriptor set are bound");
+	failed += expect(push_constant_updates == 3 && pushed_constants[0] == 0 && pushed_constants[1] == 0 && pushed_constants[2] == 7,
+					 "push constants go out for a new pipeline or a new value");
+	vulkan_draw_list__free(&list);
+	return failed;
+}
+
+// Runs of draws with the same state become multi-draws of at most maxDrawIndirectCount, a lone draw goes out directly
+static int test_multi_draw(struct vulkan_base *base) {
+	base->enabled_features.multiDrawIndirect = VK_TRUE;
+	base->enabled_features.drawIndirectFirstInstance = VK_TRUE;
+	base->properties.limits.maxDrawIndirectCount = 2;
+	struct vulkan_draw_list list;
+	if (vulkan_draw_list__try_init(&list, base, 8) < 0) {
+		return expect(0, "init the multi-draw list");
+	}
+	if (vulkan_draw_list__try_init_frames(&list, 2, 0, 0) < 0) {
+		vulkan_draw_list__free(&list);
+		return expect(0, "init the multi-draw frames");
+	}
+	push(&list, VULKAN_DRAW_LIST__KEY(0, 0, 0, 0), 0, 1, 0);
+	push(&list, VULKAN_DRAW_LIST__KEY(0, 0, 0, 0), 2, 1, 0);
+	push(&list, VULKAN_DRAW_LIST__KEY(0, 0, 0, 0), 4, 3, 0);
+	vulkan_draw_list__sort(&list);
+	clear_recorded();
+	vulkan_draw_list__record(&list, COMMAND_BUFFER, 1);
+
+	int failed = 0;
+	failed += expect_draw(0, 1, 0, 2, 0, 0, "a run of draws with the same state becomes one multi-draw");
+	failed += expect_draw(1, 0, 0, 1, 3, 4, "the rest of a full multi-draw goes out directly when it is one draw");
+	failed += expect(list.indirect_commands[1][0].firstInstance == 0 && list.indirect_commands[1][1].firstInstance == 2 &&
+					 list.indirect_commands[1][1].instanceCount == 1, "the multi-draw reads the frame's commands");
+	vulkan_draw_list__free(&list);
+	failed += expect(live_buffers == 0, "free gives back the frames' buffers");
+	base->enabled_features.multiDrawIndirect = VK_FALSE;
+	base->enabled_features.drawIndirectFirstInstance = VK_FALSE;
+	return failed;
+}
+
+// Without drawIndirectFirstInstance each draw binds its instances, and later writes only change the instance counts
+static int test_in_place(struct vulkan_base *base) {
+	struct vulkan_draw_list list;
+	if (vulkan_draw_list__try_init(&list, base, 4) < 0) {
+		return expect(0, "init the list recorded in place");
+	}
+	if (vulkan_draw_list__try_init_frames(&list, 2, INSTANCE_SIZE, INSTANCE_CAPACITY) < 0) {
+		vulkan_draw_list__free(&list);
+		return expect(0, "init the frames recorded in place");
+	}
+	push(&list, VULKAN_DRAW_LIST__KEY(0, 0, 0, 1), 4, 1, 1);
+	push(&list, VULKAN_DRAW_LIST__KEY(0, 0, 0, 0), 0, 2, 0);
+	vulkan_draw_list__sort(&list);
+	clear_recorded();
+	vulkan_draw_list__record_in_place(&list, COMMAND_BUFFER, 1);
+
+	int failed = 0;
+	failed += expect_draw(0, 1, 0, 1, 0, 0, "the first draw reads the first command");
+	failed += expect_draw(1, 1, STRIDE, 1, 0, 0, "each draw reads a command of its own");
+	failed += expect(instance_bind_count == 2 && instance_offsets[0] == 0 && instance_offsets[1] == 4*INSTANCE_SIZE, "each draw binds its first instance");
+	VkDrawIndexedIndirectCommand *commands = list.indirect_commands[1];
+	failed += expect(commands[0].instanceCount == 2 && commands[1].instanceCount == 1 && commands[1].firstInstance == 0,
+					 "the commands start at the bound instance");
+
+	vulkan_draw_list__reset(&list);
+	push(&list, VULKAN_DRAW_LIST__KEY(0, 0, 0, 0), 0, 3, 0);
+	push(&list, VULKAN_DRAW_LIST__KEY(0, 0, 0, 1), 4, 0, 1);
+	vulkan_draw_list__sort(&list);
+	clear_recorded();
+	failed += expect(vulkan_draw_list__try_write_in_place(&list, 1) == 0 && recorded_draw_count == 0, "new instance counts are written without recording");
+	failed += expect(commands[0].instanceCount == 3 && commands[1].instanceCount == 0, "the written counts replace the recorded ones");
+
+	vulkan_draw_list__reset(&list);
+	push(&list, VULKAN_DRAW_LIST__KEY(0, 0, 0, 0), 0, 3, 0);
+	push(&list, VULKAN_DRAW_LIST__KEY(0, 0, 0, 1), 5, 1, 1);
+	vulkan_draw_list__sort(&list);
+	failed += expect(vulkan_draw_list__try_write_in_place(&list, 1) < 0, "draws starting at another instance have to be recorded again");
+
+	vulkan_draw_list__reset(&list);
+	push(&list, VULKAN_DRAW_LIST__KEY(0, 0, 0, 0), 0, 3, 0);
+	vulkan_draw_list__sort(&list);
+	failed += expect(vulkan_draw_list__try_write_in_place(&list, 1) < 0, "fewer draws have to be recorded again");
+	vulkan_draw_list__free(&list);
+	failed += expect(live_buffers == 0, "free gives back the instance buffers");
+	return failed;
+}
+
+int main() {
+	struct vulkan_base base;
+	memset(&base, 0, sizeof(base));
+	int failed = test_keys();
+	failed += test_sort(&base);
+	failed += test_record(&base);
+	failed += test_multi_draw(&base);
+	failed += test_in_place(&base);
+	if (failed) {
+		return 1;
+	}
+	printf("Draw list sorts, merges and skips binds as expected\n");
+	return 0;
+}
@@ -0,0 +1,371 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include "../src/vulkan/vulkan_base.h"
+#include "../src/vulkan/vulkan_swapchain.h"
+#include "../src/vulkan/vulkan_scene.h"
+#include "../src/file/file.h"
+#include "../src/job/job_system.h"
+#include "../src/texture/texture.h"
+
+#define MAX_UINT64 0xFFFFFFFFFFFFFFFF
+#define WIDTH 256
+#define HEIGHT 256
+// A pixel differs if any channel is off by more than this, the image differs if more than 1/1000 of the pixels do
+#define CHANNEL_TOLERANCE 8
+#define MAX_DIFFERING_PIXELS (WIDTH*HEIGHT/1000)
+
+struct variant {
+	const char *name;
+	int vulkan_flags;
+};
+
+static const struct variant variants[] = {
+	{ "render_pass", 0 },
+	{ "dynamic_rendering", VULKAN_BASE__FLAG_DYNAMIC_RENDERING }
+};
+
+enum try_render {
+	TRY_RENDER__UNSUPPORTED = 1
+};
+
+// A disc whose levels of detail skip every other rim vertex of the level before, so the objects below pick
+// different levels by size. The errors are how far each polygon's edges fall inside the unit circle.
+#define DISC_SEGMENTS 32
+#define DISC_LODS 4
+#define DISC_INDICES (3*(DISC_SEGMENTS + DISC_SEGMENTS/2 + DISC_SEGMENTS/4 + DISC_SEGMENTS/8))
+#define PI 3.14159265358979f
+
+struct disc {
+	struct mesh_vertex vertices[DISC_SEGMENTS + 1];
+	uint16_t indices[DISC_INDICES];
+};
+
+static void init_disc(struct disc *this, struct mesh *mesh_out) {
+	this->vertices[0] = (struct mesh_vertex) { { 0, 0, 0, 0 }, { 0, 0, 127, 0 } };
+	for (int i = 0; i < DISC_SEGMENTS; ++i) {
+		float angle = 2.0f*PI*(float) i/DISC_SEGMENTS;
+		struct mesh_vertex *vertex = this->vertices + 1 + i;
+		vertex->position[0] = (int16_t) (32767.0f*cosf(angle));
+		vertex->position[1] = (int16_t) (32767.0f*sinf(angle));
+		vertex->position[2] = 0;
+		vertex->position[3] = 0;
+		vertex->normal[0] = (int8_t) (127.0f*cosf(angle));
+		vertex->normal[1] = (int8_t) (127.0f*sinf(angle));
+		vertex->normal[2] = 64;
+		vertex->normal[3] = 0;
+	}
+
+	mesh_out->vertex_count = DISC_SEGMENTS + 1;
+	mesh_out->index_count = DISC_INDICES;
+	mesh_out->index_size = 2;
+	mesh_out->vertices = this->vertices;
+	mesh_out->indices = this->indices;
+	mesh_out->lod_count = DISC_LODS;
+	memset(mesh_out->lods, 0, sizeof(mesh_out->lods));
+	mesh_out->mapping = 0;
+	mesh_out->mapping_size = 0;
+	uint32_t index = 0;
+	for (int lod = 0; lod < DISC_LODS; ++lod) {
+		int step = 1 << lod;
+		int segments = DISC_SEGMENTS/step;
+		mesh_out->lods[lod].first_index = index;
+		mesh_out->lods[lod].index_count = (uint32_t) (3*segments);
+		mesh_out->lods[lod].error = 1.0f - cosf(PI/(float) segments);
+		for (int i = 0; i < segments; ++i) {
+			this->indices[index++] = 0;
+			this->indices[index++] = (uint16_t) (1 + i*step);
+			this->indices[index++] = (uint16_t) (1 + (i + 1)*step%DISC_SEGMENTS);
+		}
+	}
+}
+
+// Rows of shrinking discs so each row ends on another level, with columns past both edges of the screen so some are
+// culled and some are clipped
+#define ROWS 4
+#define COLUMNS 10
+static const float row_radii[ROWS] = { 0.14f, 0.08f, 0.04f, 0.015f };
+static const float column_x[COLUMNS] = { -1.5f, -1.05f, -0.75f, -0.45f, -0.15f, 0.15f, 0.45f, 0.75f, 1.05f, 1.5f };
+
+static void init_objects(struct vulkan_culling_object *objects) {
+	for (int y = 0; y < ROWS; ++y) {
+		for (int x = 0; x < COLUMNS; ++x) {
+			struct vulkan_culling_object *object = objects + y*COLUMNS + x;
+			object->center[0] = column_x[x];
+			object->center[1] = -0.75f + 0.5f*(float) y;
+			object->center[2] = 0.5f;
+			object->radius = row_radii[y];
+		}
+	}
+}
+
+// A checkerboard small enough for a single tile, which the virtual texture makes resident at init, so the first frame
+// is already fully textured
+#define TEXTURE_SIDE 64
+#define TEXTURE_PATH "golden_image.texture"
+
+static int try_write_texture(void) {
+	unsigned char pixels[TEXTURE_SIDE*TEXTURE_SIDE*4];
+	for (int y = 0; y < TEXTURE_SIDE; ++y) {
+		for (int x = 0; x < TEXTURE_SIDE; ++x) {
+			unsigned char *pixel = pixels + 4*(y*TEXTURE_SIDE + x);
+			int light = ((x/8) + (y/8)) & 1;
+			pixel[0] = light ? 230 : 40;
+			pixel[1] = light ? 200 : 60;
+			pixel[2] = light ? 160 : 120;
+			pixel[3] = 255;
+		}
+	}
+	return texture__try_write(TEXTURE_PATH, pixels, TEXTURE_SIDE, TEXTURE_SIDE);
+}
+
+// Renders one frame of the scene headless into an offscreen image and copies it out as RGB. The frame goes through
+// the same path as a window's: culled, with levels of detail, textured and with its uniforms written into the ring.
+static int try_render(const struct variant *variant, struct job_system *job_system, const struct texture *texture, unsigned char *rgb_out) {
+	struct vulkan_base base;
+	struct vulkan_swapchain swapchain;
+	struct vulkan_mesh mesh;
+	struct vulkan_virtual_texture virtual_texture;
+	struct vulkan_culling culling;
+	struct vulkan_scene scene;
+
+	struct vulkan_base__create_surface headless;
+	headless.create_window_surface = 0;
+	headless.user_data = 0;
+	if (vulkan_base__try_load_files(&base) < 0) {
+		return -8;
+	}
+	if (vulkan_base__try_init(&base, 0, 0, variant->vulkan_flags, headless) < 0) {
+		vulkan_base__free_files(&base);
+		return -1;
+	}
+	int result = 0;
+	// Without feedback writes the texture is left off, which would not match the reference
+	if (((variant->vulkan_flags & VULKAN_BASE__FLAG_DYNAMIC_RENDERING) && !base.dynamic_rendering) || !base.enabled_features.fragmentStoresAndAtomics) {
+		result = TRY_RENDER__UNSUPPORTED;
+		goto free_base;
+	}
+	printf("%s: %s\n", variant->name, base.properties.deviceName);
+
+	if (vulkan_swapchain__try_init(&swapchain, &base) < 0) {
+		result = -2;
+		goto free_base;
+	}
+	struct disc disc;
+	struct mesh disc_mesh;
+	init_disc(&disc, &disc_mesh);
+	if (vulkan_mesh__try_init(&mesh, &base, &disc_mesh) < 0) {
+		result = -9;
+		goto free_swapchain;
+	}
+	if (vulkan_virtual_texture__try_init(&virtual_texture, &base, texture, job_system, VULKAN_VIRTUAL_TEXTURE__DEFAULT_CACHE_SIDE) < 0) {
+		result = -10;
+		goto free_mesh;
+	}
+	swapchain.texture_set_layout = virtual_texture.descriptor_set_layout;
+	struct vulkan_culling_object objects[ROWS*COLUMNS];
+	init_objects(objects);
+	if (vulkan_culling__try_init(&culling, &base, &mesh, objects, ROWS*COLUMNS, 1) < 0) {
+		result = -3;
+		goto free_texture;
+	}
+	if (vulkan_scene__try_init(&scene, &base, &swapchain, &culling, 0) < 0) {
+		result = -3;
+		goto free_culling;
+	}
+	vulkan_scene__set_texture(&scene, &virtual_texture);
+	scene.frame_uniforms.lod_tint = 0.5f;
+	if (vulkan_swapchain__try_init_offscreen(&swapchain, WIDTH, HEIGHT) < 0) {
+		result = -4;
+		goto free_scene;
+	}
+	if (vulkan_scene__try_init_graph(&scene) < 0) {
+		result = -5;
+		goto free_offscreen;
+	}
+
+	VkFenceCreateInfo fence_create_info;
+	fence_create_info.sType = VK_STRUCTURE_TYPE_FENCE_CREATE_INFO;
+	fence_create_info.pNext = 0;
+	fence_create_info.flags = 0;
+	VkFence fence;
+	if (vkCreateFence(base.device, &fence_create_info, base.allocator, &fence) != VK_SUCCESS) {
+		result = -6;
+		goto free_graph;
+	}
+
+	VkSubmitInfo submit_info;
+	submit_info.sType = VK_STRUCTURE_TYPE_SUBMIT_INFO;
+	submit_info.pNext = 0;
+	submit_info.waitSemaphoreCount = 0;
+	submit_info.pWaitSemaphores = 0;
+	submit_info.pWaitDstStageMask = 0;
+	submit_info.commandBufferCount = 1;
+	submit_info.pCommandBuffers = swapchain.command_buffers;
+	submit_info.signalSemaphoreCount = 0;
+	submit_info.pSignalSemaphores = 0;
+
+	if (vulkan_scene__try_update_frame(&scene, 0, fence) < 0) {
+		result = -11;
+	} else if (vkQueueSubmit(base.queue, 1, &submit_info, fence) != VK_SUCCESS ||
+			   vkWaitForFences(base.device, 1, &fence, VK_TRUE, MAX_UINT64) != VK_SUCCESS) {
+		result = -7;
+	} else {
+		for (int i = 0; i < WIDTH*HEIGHT; ++i) {
+			rgb_out[3*i + 0] = swapchain.readback_pixels[4*i + 0];
+			rgb_out[3*i + 1] = swapchain.readback_pixels[4*i + 1];
+			rgb_out[3*i + 2] = swapchain.readback_pixels[4*i + 2];
+		}
+	}
+	vkDestroyFence(base.device, fence, base.allocator);
+
+	free_graph:
+	vulkan_scene__free_graph(&scene);
+	free_offscreen:
+	vulkan_swapchain__free_swapchain(&swapchain);
+	free_scene:
+	vulkan_scene__free(&scene);
+	free_culling:
+	vulkan_culling__free(&culling);
+	free_texture:
+	vulkan_virtual_texture__free(&virtual_texture);
+	free_mesh:
+	vulkan_mesh__free(&mesh);
+	free_swapchain:
+	vulkan_swapchain__free(&swapchain);
+	free_base:
+	vulkan_base__free(&base);
+	vulkan_base__free_files(&base);
+	return result;
+}
+
+static int try_write_ppm(char *file_name, const unsigned char *rgb) {
+	char header[32];
+	int header_length = sprintf(header, "P6\n%d %d\n255\n", WIDTH, HEIGHT);
+	long length = header_length + WIDTH*HEIGHT*3;
+	char *bytes = malloc((size_t) length);
+	if (!bytes) {
+		return -1;
+	}
+	memcpy(bytes, header, (size_t) header_length);
+	memcpy(bytes + header_length, rgb, WIDTH*HEIGHT*3);
+	int result = file__try_write(file_name, bytes, length);
+	free(bytes);
+	return result < 0 ? -2 : 0;
+}
+
+// Returns the reference pixels inside the malloc'ed file, or 0 if it is missing or not a WIDTH x HEIGHT PPM
+static const unsigned char *try_read_ppm(char *file_name, char **malloc_bytes_out) {
+	struct file__try_read read = file__try_read(file_name);
+	if (read.result < 0) {
+		return 0;
+	}
+	int width, height, max_value, header_length;
+	char *header = malloc((size_t) read.length + 1);
+	if (!header) {
+		free(read.malloc_bytes);
+		return 0;
+	}
+	memcpy(header, read.malloc_bytes, (size_t) read.length);
+	header[read.length] = 0;
+	int matched = sscanf(header, "P6 %d %d %d%n", &width, &height, &max_value, &header_length);
+	free(header);
+	if (matched != 3 || width != WIDTH || height != HEIGHT || max_value != 255 || read.length - header_length - 1 != WIDTH*HEIGHT*3) {
+		free(read.malloc_bytes);
+		return 0;
+	}
+	*malloc_bytes_out = read.malloc_bytes;
+	return (const unsigned char *) read.malloc_bytes + header_length + 1;
+}
+
+static int count_differing_pixels(const unsigned char *a, const unsigned char *b) {
+	int count = 0;
+	for (int i = 0; i < WIDTH*HEIGHT; ++i) {
+		for (int c = 0; c < 3; ++c) {
+			if (abs(a[3*i + c] - b[3*i + c]) > CHANNEL_TOLERANCE) {
+				++count;
+				break;
+			}
+		}
+	}
+	return count;
+}
+
+// A new reference only comes from an explicit --update-reference, written to the working directory so it can be
+// looked at before it replaces the one in the source tree
+int main(int argc, char **argv) {
+	int update_reference = argc == 3 && strcmp(argv[2], "--update-reference") == 0;
+	if (argc < 2 || (argc == 3 && !update_reference) || argc > 3) {
+		printf("Usage: %s <reference directory> [--update-reference]\n", argv[0]);
+		return -1;
+	}
+	char reference_path[1024];
+	snprintf(reference_path, sizeof(reference_path), "%s/scene.ppm", argv[1]);
+
+	char *reference_bytes = 0;
+	const unsigned char *reference = update_reference ? 0 : try_read_ppm(reference_path, &reference_bytes);
+	if (!update_reference && !reference) {
+		printf("Missing or invalid reference %s, render one with --update-reference and commit it\n", reference_path);
+		return 1;
+	}
+	unsigned char *rgb = malloc(WIDTH*HEIGHT*3);
+	if (!rgb) {
+		free(reference_bytes);
+		return -2;
+	}
+	struct job_system job_system;
+	if (job_system__try_init(&job_system, -1) < 0) {
+		free(rgb);
+		free(reference_bytes);
+		return -3;
+	}
+	struct texture texture;
+	if (try_write_texture() < 0 || texture__try_map(&texture, TEXTURE_PATH) < 0) {
+		printf("Could not write the texture %s\n", TEXTURE_PATH);
+		job_system__free(&job_system);
+		free(rgb);
+		free(reference_bytes);
+		return -4;
+	}
+
+	int failed = 0;
+	for (int i = 0; i < sizeof(variants)/sizeof(*variants); ++i) {
+		int result = try_render(variants + i, &job_system, &texture, rgb);
+		if (result == TRY_RENDER__UNSUPPORTED) {
+			printf("%s: not supported, skipped\n", variants[i].name);
+			continue;
+		} else if (result < 0) {
+			printf("%s: rendering failed (%d)\n", variants[i].name, result);
+			failed = 1;
+			continue;
+		}
+
+		// Every variant has to match the same reference, so the first one that renders writes it
+		if (update_reference) {
+			if (try_write_ppm("scene.ppm", rgb) < 0) {
+				printf("Could not write scene.ppm\n");
+				failed = 1;
+			} else {
+				printf("Wrote scene.ppm from %s, copy it to %s once it looks right\n", variants[i].name, reference_path);
+			}
+			break;
+		}
+
+		int differing = count_differing_pixels(reference, rgb);
+		if (differing > MAX_DIFFERING_PIXELS) {
+			char actual_path[256];
+			snprintf(actual_path, sizeof(actual_path), "%s.actual.ppm", variants[i].name);
+			try_write_ppm(actual_path, rgb);
+			printf("%s: %d pixels differ from the reference, wrote %s\n", variants[i].name, differing, actual_path);
+			failed = 1;
+		} else {
+			printf("%s: matches the reference (%d pixels differ)\n", variants[i].name, differing);
+		}
+	}
+	texture__unmap(&texture);
+	job_system__free(&job_system);
+	free(rgb);
+	free(reference_bytes);
+	return failed ? 1 : 0;
+}
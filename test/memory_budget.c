@@ -0,0 +1,127 @@
+#include <stdio.h>
+#include <stdint.h>
+#include "../src/vulkan/vulkan_memory_budget.h"
+
+// A fake device with one device local heap, so eviction can be driven without a driver
+#define MIB (1024ull*1024ull)
+#define HEAP_SIZE (1024*MIB)
+#define FIXED_SIZE (700*MIB)
+#define CHUNK_SIZE (16*MIB)
+#define CHUNKS 10
+
+VKAPI_ATTR void VKAPI_CALL vkGetPhysicalDeviceMemoryProperties(VkPhysicalDevice physical_device, VkPhysicalDeviceMemoryProperties *properties) {
+	properties->memoryTypeCount = 1;
+	properties->memoryTypes[0].propertyFlags = VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT;
+	properties->memoryTypes[0].heapIndex = 0;
+	properties->memoryHeapCount = 1;
+	properties->memoryHeaps[0].size = HEAP_SIZE;
+	properties->memoryHeaps[0].flags = VK_MEMORY_HEAP_DEVICE_LOCAL_BIT;
+}
+
+// Only reached with the extension, which the test leaves off
+VKAPI_ATTR void VKAPI_CALL vkGetPhysicalDeviceMemoryProperties2(VkPhysicalDevice physical_device, VkPhysicalDeviceMemoryProperties2 *properties) {
+	vkGetPhysicalDeviceMemoryProperties(physical_device, &properties->memoryProperties);
+}
+
+// Owns CHUNKS allocations and gives back whole ones, the last first
+struct fake_streamable {
+	struct vulkan_memory_budget *budget;
+	uintptr_t first_memory;
+	int chunk_count;
+	int calls;
+	uint32_t last_heap_index;
+};
+
+static VkDeviceMemory fake_memory(uintptr_t handle) {
+	return (VkDeviceMemory) handle;
+}
+
+static VkDeviceSize try_evict(void *user_data, uint32_t heap_index, VkDeviceSize bytes) {
+	struct fake_streamable *this = (struct fake_streamable *) user_data;
+	++this->calls;
+	this->last_heap_index = heap_index;
+	VkDeviceSize freed = 0;
+	while (freed < bytes && this->chunk_count > 0) {
+		--this->chunk_count;
+		vulkan_memory_budget__untrack(this->budget, fake_memory(this->first_memory + (uintptr_t) this->chunk_count));
+		freed += CHUNK_SIZE;
+	}
+	return freed;
+}
+
+static int try_init_fake(struct fake_streamable *this, struct vulkan_memory_budget *budget, uintptr_t first_memory, int priority) {
+	this->budget = budget;
+	this->first_memory = first_memory;
+	this->chunk_count = CHUNKS;
+	this->calls = 0;
+	this->last_heap_index = ~0u;
+	for (int i = 0; i < CHUNKS; ++i) {
+		if (vulkan_memory_budget__try_track(budget, fake_memory(first_memory + (uintptr_t) i), CHUNK_SIZE, 0) < 0) {
+			return -1;
+		}
+	}
+	struct vulkan_memory_streamable streamable;
+	streamable.try_evict = try_evict;
+	streamable.user_data = this;
+	streamable.priority = priority;
+	return vulkan_memory_budget__try_add_streamable(budget, streamable);
+}
+
+static int expect(int condition, const char *what) {
+	if (!condition) {
+		printf("Failed: %s\n", what);
+	}
+	return condition ? 0 : 1;
+}
+
+int main() {
+	struct vulkan_memory_budget budget;
+	if (vulkan_memory_budget__try_init(&budget, VK_NULL_HANDLE, 0) < 0) {
+		printf("Could not create the budget\n");
+		return 1;
+	}
+	// 700 MiB nobody can evict and 160 MiB per streamable, 1020 MiB in all. Eviction starts above 90% of the heap and
+	// goes down to 80%, so it has to free at least 200.8 MiB.
+	struct fake_streamable low, high;
+	if (vulkan_memory_budget__try_track(&budget, fake_memory(1), FIXED_SIZE, 0) < 0 ||
+		try_init_fake(&high, &budget, 200, 1) < 0 || try_init_fake(&low, &budget, 100, 0) < 0) {
+		printf("Could not track the allocations\n");
+		vulkan_memory_budget__free(&budget);
+		return 1;
+	}
+
+	int failed = 0;
+	VkDeviceSize evicted = vulkan_memory_budget__enforce(&budget);
+	failed += expect(low.chunk_count == 0, "the lower priority streamable gives back everything first");
+	failed += expect(high.chunk_count == CHUNKS - 3, "the higher priority streamable only gives back the rest");
+	failed += expect(evicted == 13*CHUNK_SIZE, "enforce returns the bytes freed");
+	failed += expect(low.last_heap_index == 0 && high.last_heap_index == 0, "eviction is asked for the heap over budget");
+
+	struct vulkan_memory_budget_heap heaps[VK_MAX_MEMORY_HEAPS];
+	vulkan_memory_budget__update(&budget, heaps);
+	failed += expect(heaps[0].allocated == FIXED_SIZE + 7*CHUNK_SIZE, "untracked memory leaves the heap");
+	failed += expect(heaps[0].usage <= (VkDeviceSize) (HEAP_SIZE*VULKAN_MEMORY_BUDGET__EVICT_TARGET), "usage ends below the target");
+
+	// Below the threshold nothing is asked for
+	int calls = low.calls + high.calls;
+	failed += expect(vulkan_memory_budget__enforce(&budget) == 0 && low.calls + high.calls == calls, "nothing is evicted under the threshold");
+
+	// Back over the threshold with the low priority streamable removed, only the other one is asked
+	if (vulkan_memory_budget__try_track(&budget, fake_memory(2), 120*MIB, 0) < 0) {
+		printf("Could not track the allocations\n");
+		vulkan_memory_budget__free(&budget);
+		return 1;
+	}
+	vulkan_memory_budget__remove_streamable(&budget, &low);
+	calls = low.calls;
+	evicted = vulkan_memory_budget__enforce(&budget);
+	failed += expect(low.calls == calls, "a removed streamable is not asked");
+	failed += expect(high.chunk_count == 0 && evicted == 7*CHUNK_SIZE, "a streamable can give back less than asked");
+
+	vulkan_memory_budget__free(&budget);
+	if (failed) {
+		return 1;
+	}
+	printf("Memory budget evicts by priority down to the target\n");
+	return 0;
+}
@@ -0,0 +1,247 @@
+#include <stdio.h>
+#include <stdint.h>
+#include <string.h>
+#include "../src/vulkan/vulkan_render_graph.h"
+
+// Fake images take 4 bytes per pixel at an alignment of 256, so where the graph places them can be checked exactly
+#define MAX_HANDLES 64
+#define ALIGNMENT 256
+#define MAX_RECORDED_BARRIERS 8
+#define SIDE 256
+#define SMALL_SIDE 128
+#define SIZE ((VkDeviceSize) SIDE*SIDE*4)
+#define SMALL_SIZE ((VkDeviceSize) SMALL_SIDE*SMALL_SIDE*4)
+// Handles of the imported resources, above the ones the fakes hand out
+#define IMPORTED_HANDLE 1000
+
+static uintptr_t next_handle = 1;
+static VkDeviceSize image_sizes[MAX_HANDLES];
+static int created_images;
+static int destroyed_images;
+static int freed_memory;
+
+struct recorded_barrier {
+	VkPipelineStageFlags src_stages;
+	VkPipelineStageFlags dst_stages;
+	uint32_t buffer_barrier_count;
+	uint32_t image_barrier_count;
+	VkImageLayout last_new_layout;
+};
+
+static struct recorded_barrier recorded_barriers[MAX_RECORDED_BARRIERS];
+static int recorded_barrier_count;
+static int recorded_passes[VULKAN_RENDER_GRAPH__MAX_PASSES];
+static int recorded_pass_count;
+
+VKAPI_ATTR VkResult VKAPI_CALL vkCreateImage(VkDevice device, const VkImageCreateInfo *create_info, const VkAllocationCallbacks *allocator, VkImage *image) {
+	uintptr_t handle = next_handle++;
+	image_sizes[handle % MAX_HANDLES] = (VkDeviceSize) create_info->extent.width*create_info->extent.height*4;
+	*image = (VkImage) handle;
+	++created_images;
+	return VK_SUCCESS;
+}
+
+VKAPI_ATTR void VKAPI_CALL vkDestroyImage(VkDevice device, VkImage image, const VkAllocationCallbacks *allocator) {
+	++destroyed_images;
+}
+
+VKAPI_ATTR void VKAPI_CALL vkGetImageMemoryRequirements(VkDevice device, VkImage image, VkMemoryRequirements *requirements) {
+	requirements->size = image_sizes[(uintptr_t) image % MAX_HANDLES];
+	requirements->alignment = ALIGNMENT;
+	requirements->memoryTypeBits = 1;
+}
+
+VKAPI_ATTR VkResult VKAPI_CALL vkBindImageMemory(VkDevice device, VkImage image, VkDeviceMemory memory, VkDeviceSize offset) {
+	return VK_SUCCESS;
+}
+
+VKAPI_ATTR VkResult VKAPI_CALL vkCreateImageView(VkDevice device, const VkImageViewCreateInfo *create_info, const VkAllocationCallbacks *allocator, VkImageView *image_view) {
+	*image_view = (VkImageView) next_handle++;
+	return VK_SUCCESS;
+}
+
+VKAPI_ATTR void VKAPI_CALL vkDestroyImageView(VkDevice device, VkImageView image_view, const VkAllocationCallbacks *allocator) {
+}
+
+VKAPI_ATTR void VKAPI_CALL vkCmdPipelineBarrier(VkCommandBuffer command_buffer, VkPipelineStageFlags src_stages, VkPipelineStageFlags dst_stages, VkDependencyFlags dependency_flags,
+												uint32_t memory_barrier_count, const VkMemoryBarrier *memory_barriers, uint32_t buffer_barrier_count,
+												const VkBufferMemoryBarrier *buffer_barriers, uint32_t image_barrier_count, const VkImageMemoryBarrier *image_barriers) {
+	if (recorded_barrier_count == MAX_RECORDED_BARRIERS) {
+		return;
+	}
+	struct recorded_barrier *recorded = recorded_barriers + recorded_barrier_count++;
+	recorded->src_stages = src_stages;
+	recorded->dst_stages = dst_stages;
+	recorded->buffer_barrier_count = buffer_barrier_count;
+	recorded->image_barrier_count = image_barrier_count;
+	recorded->last_new_layout = image_barrier_count ? image_barriers[image_barrier_count - 1].newLayout : VK_IMAGE_LAYOUT_UNDEFINED;
+}
+
+// Statistics stay off since the fake device enables no features, the graph only needs these to link
+VKAPI_ATTR VkResult VKAPI_CALL vkCreateQueryPool(VkDevice device, const VkQueryPoolCreateInfo *create_info, const VkAllocationCallbacks *allocator, VkQueryPool *query_pool) {
+	return VK_ERROR_FEATURE_NOT_PRESENT;
+}
+
+VKAPI_ATTR void VKAPI_CALL vkDestroyQueryPool(VkDevice device, VkQueryPool query_pool, const VkAllocationCallbacks *allocator) {
+}
+
+VKAPI_ATTR VkResult VKAPI_CALL vkGetQueryPoolResults(VkDevice device, VkQueryPool query_pool, uint32_t first_query, uint32_t query_count, size_t data_size, void *data,
+													 VkDeviceSize stride, VkQueryResultFlags flags) {
+	return VK_NOT_READY;
+}
+
+VKAPI_ATTR void VKAPI_CALL vkCmdResetQueryPool(VkCommandBuffer command_buffer, VkQueryPool query_pool, uint32_t first_query, uint32_t query_count) {
+}
+
+VKAPI_ATTR void VKAPI_CALL vkCmdBeginQuery(VkCommandBuffer command_buffer, VkQueryPool query_pool, uint32_t query, VkQueryControlFlags flags) {
+}
+
+VKAPI_ATTR void VKAPI_CALL vkCmdEndQuery(VkCommandBuffer command_buffer, VkQueryPool query_pool, uint32_t query) {
+}
+
+// The graph only reaches the base for memory and labels, so it is not linked either
+int vulkan_base__find_memory_type(struct vulkan_base *this, uint32_t type_bits, VkMemoryPropertyFlags properties) {
+	return type_bits & 1 ? 0 : -1;
+}
+
+int vulkan_base__try_allocate_memory(struct vulkan_base *this, const VkMemoryAllocateInfo *allocate_info, VkDeviceMemory *memory_out) {
+	*memory_out = (VkDeviceMemory) next_handle++;
+	return 0;
+}
+
+void vulkan_base__free_memory(struct vulkan_base *this, VkDeviceMemory memory) {
+	++freed_memory;
+}
+
+void vulkan_base__cmd_begin_label(struct vulkan_base *this, VkCommandBuffer command_buffer, const char *name) {
+}
+
+void vulkan_base__cmd_end_label(struct vulkan_base *this, VkCommandBuffer command_buffer) {
+}
+
+static void record_pass(void *user_data, VkCommandBuffer command_buffer) {
+	recorded_passes[recorded_pass_count++] = (int) (intptr_t) user_data;
+}
+
+static int add_pass(struct vulkan_render_graph *graph, const char *name) {
+	return vulkan_render_graph__add_pass(graph, name, record_pass, (void *) (intptr_t) graph->pass_count);
+}
+
+static int create_image(struct vulkan_render_graph *graph, uint32_t side) {
+	VkExtent2D extent = {side, side};
+	return vulkan_render_graph__create_image(graph, VK_FORMAT_R8G8B8A8_UNORM, extent, VK_IMAGE_USAGE_COLOR_ATTACHMENT_BIT | VK_IMAGE_USAGE_SAMPLED_BIT,
+											 VK_IMAGE_ASPECT_COLOR_BIT);
+}
+
+static int expect(int condition, const char *what) {
+	if (!condition) {
+		printf("Failed: %s\n", what);
+	}
+	return condition ? 0 : 1;
+}
+
+static int expect_barrier(struct vulkan_render_graph *graph, int pass, int resource, VkAccessFlags src_access, VkAccessFlags dst_access, VkImageLayout old_layout,
+						  VkImageLayout new_layout, const char *what) {
+	for (int i = 0; i < graph->barrier_count; ++i) {
+		struct vulkan_render_graph_barrier *barrier = graph->barriers + i;
+		if (barrier->pass == pass && barrier->resource == resource) {
+			return expect(barrier->src_access == src_access && barrier->dst_access == dst_access && barrier->old_layout == old_layout &&
+						  barrier->new_layout == new_layout, what);
+		}
+	}
+	return expect(0, what);
+}
+
+static int count_barriers(struct vulkan_render_graph *graph, int pass) {
+	int count = 0;
+	for (int i = 0; i < graph->barrier_count; ++i) {
+		count += graph->barriers[i].pass == pass;
+	}
+	return count;
+}
+
+int main() {
+	struct vulkan_base base;
+	memset(&base, 0, sizeof(base));
+	struct vulkan_render_graph graph;
+	vulkan_render_graph__init(&graph, &base);
+
+	// A compute pass fills the indirect buffer, a pass nobody reads from is culled, and three transient color images
+	// are passed down to the swapchain. The first and last transient never live at the same time so they share memory.
+	int indirect = vulkan_render_graph__import_buffer(&graph, (VkBuffer) (uintptr_t) IMPORTED_HANDLE, 0);
+	int swapchain = vulkan_render_graph__import_image(&graph, (VkImage) (uintptr_t) (IMPORTED_HANDLE + 1), (VkImageView) (uintptr_t) (IMPORTED_HANDLE + 2),
+													  VK_IMAGE_ASPECT_COLOR_BIT, VK_IMAGE_LAYOUT_UNDEFINED, VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT);
+	int scene = create_image(&graph, SIDE);
+	int unused = create_image(&graph, SIDE);
+	int blur = create_image(&graph, SMALL_SIDE);
+	int overlay = create_image(&graph, SIDE);
+	vulkan_render_graph__set_output(&graph, swapchain, VULKAN_RENDER_GRAPH__USAGE_PRESENT);
+
+	int cull = add_pass(&graph, "cull");
+	int debug = add_pass(&graph, "debug");
+	int draw = add_pass(&graph, "draw");
+	int downsample = add_pass(&graph, "downsample");
+	int compose = add_pass(&graph, "compose");
+	if (indirect < 0 || swapchain < 0 || scene < 0 || unused < 0 || blur < 0 || overlay < 0 || cull < 0 || debug < 0 || draw < 0 || downsample < 0 || compose < 0 ||
+		vulkan_render_graph__access(&graph, cull, indirect, VULKAN_RENDER_GRAPH__USAGE_STORAGE_WRITE) < 0 ||
+		vulkan_render_graph__access(&graph, debug, unused, VULKAN_RENDER_GRAPH__USAGE_COLOR_ATTACHMENT) < 0 ||
+		vulkan_render_graph__access(&graph, draw, indirect, VULKAN_RENDER_GRAPH__USAGE_INDIRECT) < 0 ||
+		vulkan_render_graph__access(&graph, draw, scene, VULKAN_RENDER_GRAPH__USAGE_COLOR_ATTACHMENT) < 0 ||
+		vulkan_render_graph__access(&graph, downsample, scene, VULKAN_RENDER_GRAPH__USAGE_SAMPLED) < 0 ||
+		vulkan_render_graph__access(&graph, downsample, blur, VULKAN_RENDER_GRAPH__USAGE_COLOR_ATTACHMENT) < 0 ||
+		vulkan_render_graph__access(&graph, compose, blur, VULKAN_RENDER_GRAPH__USAGE_SAMPLED) < 0 ||
+		vulkan_render_graph__access(&graph, compose, overlay, VULKAN_RENDER_GRAPH__USAGE_COLOR_ATTACHMENT) < 0 ||
+		vulkan_render_graph__access(&graph, compose, swapchain, VULKAN_RENDER_GRAPH__USAGE_COLOR_ATTACHMENT) < 0) {
+		printf("Could not build the graph\n");
+		return 1;
+	}
+	if (vulkan_render_graph__try_compile(&graph) < 0) {
+		printf("Could not compile the graph\n");
+		vulkan_render_graph__free(&graph);
+		return 1;
+	}
+
+	int failed = 0;
+	failed += expect(graph.passes[debug].culled, "a pass whose writes are never read is culled");
+	failed += expect(!graph.passes[cull].culled && !graph.passes[draw].culled && !graph.passes[downsample].culled && !graph.passes[compose].culled,
+					 "passes leading to the output are kept");
+	failed += expect(graph.resources[unused].image == VK_NULL_HANDLE && created_images == 3, "only transients of passes that run get an image");
+
+	failed += expect(graph.resources[scene].first_pass == draw && graph.resources[scene].last_pass == downsample, "lifetimes span first to last access");
+	failed += expect(graph.resources[scene].memory_offset == 0 && graph.resources[overlay].memory_offset == 0, "transients that never overlap in time alias");
+	failed += expect(graph.resources[blur].memory_offset == SIZE, "transients alive together are placed after each other");
+	failed += expect(graph.transient_memory_size == SIZE + SMALL_SIZE, "the memory covers the furthest placement");
+
+	failed += expect(count_barriers(&graph, cull) == 0 && graph.src_stages[cull] == 0 && graph.dst_stages[cull] == 0,
+					 "a first write to a buffer nobody used waits for nothing");
+	failed += expect_barrier(&graph, draw, indirect, VK_ACCESS_SHADER_WRITE_BIT, VK_ACCESS_INDIRECT_COMMAND_READ_BIT, VK_IMAGE_LAYOUT_UNDEFINED,
+							 VK_IMAGE_LAYOUT_UNDEFINED, "indirect reads wait for the compute writes");
+	failed += expect_barrier(&graph, draw, scene, 0, VK_ACCESS_COLOR_ATTACHMENT_READ_BIT | VK_ACCESS_COLOR_ATTACHMENT_WRITE_BIT, VK_IMAGE_LAYOUT_UNDEFINED,
+							 VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL, "a transient starts undefined");
+	failed += expect(graph.src_stages[draw] == VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT &&
+					 graph.dst_stages[draw] == (VK_PIPELINE_STAGE_DRAW_INDIRECT_BIT | VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT),
+					 "the draw waits on the compute stage");
+	failed += expect_barrier(&graph, downsample, scene, VK_ACCESS_COLOR_ATTACHMENT_WRITE_BIT, VK_ACCESS_SHADER_READ_BIT, VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL,
+							 VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL, "sampling waits for the color writes");
+	failed += expect((graph.src_stages[compose] & VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT) != 0, "an aliased image waits for the reads of the image it replaces");
+	failed += expect_barrier(&graph, compose, swapchain, 0, VK_ACCESS_COLOR_ATTACHMENT_READ_BIT | VK_ACCESS_COLOR_ATTACHMENT_WRITE_BIT, VK_IMAGE_LAYOUT_UNDEFINED,
+							 VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL, "an imported image starts in its initial layout");
+	failed += expect_barrier(&graph, graph.pass_count, swapchain, VK_ACCESS_COLOR_ATTACHMENT_WRITE_BIT, 0, VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL,
+							 VK_IMAGE_LAYOUT_PRESENT_SRC_KHR, "the output ends in its final layout");
+
+	vulkan_render_graph__record(&graph, (VkCommandBuffer) (uintptr_t) (IMPORTED_HANDLE + 3));
+	failed += expect(recorded_pass_count == 4 && recorded_passes[0] == cull && recorded_passes[1] == draw && recorded_passes[2] == downsample &&
+					 recorded_passes[3] == compose, "record runs the passes that are kept in order");
+	failed += expect(recorded_barrier_count == 4, "passes without barriers record none");
+	failed += expect(recorded_barriers[0].buffer_barrier_count == 1 && recorded_barriers[0].image_barrier_count == 1, "buffer and image barriers are recorded together");
+	failed += expect(recorded_barriers[3].image_barrier_count == 1 && recorded_barriers[3].last_new_layout == VK_IMAGE_LAYOUT_PRESENT_SRC_KHR &&
+					 recorded_barriers[3].dst_stages == VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT, "the final barrier goes after the last pass");
+
+	vulkan_render_graph__free(&graph);
+	failed += expect(destroyed_images == 3 && freed_memory == 1, "free gives back the transient images and their memory");
+	if (failed) {
+		return 1;
+	}
+	printf("Render graph culls, aliases and places barriers as expected\n");
+	return 0;
+}
@@ -0,0 +1,266 @@
+#include <malloc.h>
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include "obj_file.h"
+#include "../src/mesh/mesh.h"
+#include "../src/mesh/mesh_optimize.h"
+#include "../src/mesh/mesh_simplify.h"
+
+#define SPHERE_STACKS 192
+#define SPHERE_SLICES 384
+#define RUNS 5
+#define OBJ_PATH "mesh_bench.obj"
+#define MESH_PATH "mesh_bench.mesh"
+
+static double now_milliseconds(void) {
+	struct timespec now;
+	clock_gettime(CLOCK_MONOTONIC, &now);
+	return now.tv_sec*1000.0 + now.tv_nsec/1000000.0;
+}
+
+static int compare_doubles(const void *a, const void *b) {
+	double difference = *(const double *) a - *(const double *) b;
+	return (difference > 0.0) - (difference < 0.0);
+}
+
+static double median(double *values, int count) {
+	qsort(values, (size_t) count, sizeof(*values), compare_doubles);
+	return values[count/2];
+}
+
+static uint32_t random_state = 1;
+
+static uint32_t next_random(void) {
+	random_state = random_state*1664525u + 1013904223u;
+	return random_state >> 8;
+}
+
+// A UV sphere, welded and ordered the way a modelling tool would typically write it
+static int try_make_sphere(struct obj_file *this) {
+	uint32_t ring = SPHERE_SLICES + 1;
+	this->vertex_count = (SPHERE_STACKS + 1)*ring;
+	this->index_count = SPHERE_STACKS*SPHERE_SLICES*6;
+	this->positions = malloc(this->vertex_count*sizeof(*this->positions));
+	this->normals = malloc(this->vertex_count*sizeof(*this->normals));
+	this->indices = malloc(this->index_count*sizeof(uint32_t));
+	if (!this->positions || !this->normals || !this->indices) {
+		obj_file__free(this);
+		return -1;
+	}
+	for (uint32_t stack = 0; stack <= SPHERE_STACKS; ++stack) {
+		float theta = (float) M_PI*stack/SPHERE_STACKS;
+		for (uint32_t slice = 0; slice <= SPHERE_SLICES; ++slice) {
+			float phi = 2.0f*(float) M_PI*slice/SPHERE_SLICES;
+			float *position = this->positions[stack*ring + slice];
+			position[0] = sinf(theta)*cosf(phi);
+			position[1] = cosf(theta);
+			position[2] = sinf(theta)*sinf(phi);
+			memcpy(this->normals[stack*ring + slice], position, 3*sizeof(float));
+		}
+	}
+	uint32_t *index = this->indices;
+	for (uint32_t stack = 0; stack < SPHERE_STACKS; ++stack) {
+		for (uint32_t slice = 0; slice < SPHERE_SLICES; ++slice) {
+			uint32_t a = stack*ring + slice;
+			uint32_t b = a + ring;
+			*index++ = a;
+			*index++ = b;
+			*index++ = a + 1;
+			*index++ = a + 1;
+			*index++ = b;
+			*index++ = b + 1;
+		}
+	}
+	return 0;
+}
+
+// Worst case input: triangles and vertices in random order
+static void shuffle(struct mesh_vertex *vertices, uint32_t vertex_count, uint32_t *indices, uint32_t index_count) {
+	uint32_t triangle_count = index_count/3;
+	for (uint32_t i = triangle_count - 1; i > 0; --i) {
+		uint32_t j = next_random() % (i + 1);
+		for (int k = 0; k < 3; ++k) {
+			uint32_t swap = indices[3*i + k];
+			indices[3*i + k] = indices[3*j + k];
+			indices[3*j + k] = swap;
+		}
+	}
+	uint32_t *remap = malloc(vertex_count*sizeof(uint32_t));
+	struct mesh_vertex *shuffled = malloc(vertex_count*sizeof(*shuffled));
+	if (!remap || !shuffled) {
+		free(remap);
+		free(shuffled);
+		return;
+	}
+	for (uint32_t i = 0; i < vertex_count; ++i) {
+		remap[i] = i;
+	}
+	for (uint32_t i = vertex_count - 1; i > 0; --i) {
+		uint32_t j = next_random() % (i + 1);
+		uint32_t swap = remap[i];
+		remap[i] = remap[j];
+		remap[j] = swap;
+	}
+	for (uint32_t i = 0; i < vertex_count; ++i) {
+		shuffled[remap[i]] = vertices[i];
+	}
+	memcpy(vertices, shuffled, vertex_count*sizeof(*shuffled));
+	for (uint32_t i = 0; i < index_count; ++i) {
+		indices[i] = remap[indices[i]];
+	}
+	free(shuffled);
+	free(remap);
+}
+
+// Stands in for the vertex shader behind a FIFO post-transform cache, so ordering shows up as CPU time
+static double time_transform(const struct mesh_vertex *vertices, uint32_t vertex_count, const uint32_t *indices, uint32_t index_count) {
+	unsigned long *entered = malloc(vertex_count*sizeof(unsigned long));
+	if (!entered) {
+		return -1.0;
+	}
+	static const float matrix[4][4] = {
+		{ 0.9f, 0.1f, 0.0f, 0.0f }, { -0.1f, 0.9f, 0.0f, 0.0f }, { 0.0f, 0.0f, 1.0f, 0.0f }, { 0.1f, 0.2f, 0.3f, 1.0f }
+	};
+	double times[RUNS];
+	volatile float sink = 0.0f;
+	for (int run = 0; run < RUNS; ++run) {
+		memset(entered, 0, vertex_count*sizeof(unsigned long));
+		unsigned long misses = 0;
+		float sum = 0.0f;
+		double start = now_milliseconds();
+		for (uint32_t i = 0; i < index_count; ++i) {
+			uint32_t vertex = indices[i];
+			if (entered[vertex] != 0 && misses - entered[vertex] + 1 <= MESH_OPTIMIZE__CACHE_SIZE) {
+				continue;
+			}
+			entered[vertex] = ++misses;
+			const int16_t *position = vertices[vertex].position;
+			float p[3] = { position[0]/MESH__POSITION_SCALE, position[1]/MESH__POSITION_SCALE, position[2]/MESH__POSITION_SCALE };
+			for (int row = 0; row < 4; ++row) {
+				sum += matrix[0][row]*p[0] + matrix[1][row]*p[1] + matrix[2][row]*p[2] + matrix[3][row];
+			}
+		}
+		times[run] = now_milliseconds() - start;
+		sink += sum;
+	}
+	(void) sink;
+	free(entered);
+	return median(times, RUNS);
+}
+
+static void report(const char *name, const struct mesh_vertex *vertices, uint32_t vertex_count, const uint32_t *indices, uint32_t index_count) {
+	printf("%s: ACMR %.3f (cache 16) %.3f (cache 32), overfetch %.3f, transform %.2f ms\n", name,
+		   mesh_optimize__acmr(indices, index_count, vertex_count, 16), mesh_optimize__acmr(indices, index_count, vertex_count, 32),
+		   mesh_optimize__overfetch(indices, index_count, vertex_count), time_transform(vertices, vertex_count, indices, index_count));
+}
+
+static int try_write_obj(const struct obj_file *obj) {
+	FILE *file = fopen(OBJ_PATH, "w");
+	if (!file) {
+		return -1;
+	}
+	for (uint32_t i = 0; i < obj->vertex_count; ++i) {
+		fprintf(file, "v %f %f %f\nvn %f %f %f\n", obj->positions[i][0], obj->positions[i][1], obj->positions[i][2],
+				obj->normals[i][0], obj->normals[i][1], obj->normals[i][2]);
+	}
+	for (uint32_t i = 0; i < obj->index_count; i += 3) {
+		fprintf(file, "f %u//%u %u//%u %u//%u\n", obj->indices[i] + 1, obj->indices[i] + 1, obj->indices[i + 1] + 1, obj->indices[i + 1] + 1,
+				obj->indices[i + 2] + 1, obj->indices[i + 2] + 1);
+	}
+	return fclose(file) == 0 ? 0 : -2;
+}
+
+// Parsing the text format against mapping the binary one and touching every cache line of it
+static void report_loading(void) {
+	double obj_times[RUNS];
+	double mesh_times[RUNS];
+	for (int run = 0; run < RUNS; ++run) {
+		double start = now_milliseconds();
+		struct obj_file obj;
+		if (obj_file__try_load(&obj, OBJ_PATH) < 0) {
+			return;
+		}
+		obj_file__free(&obj);
+		obj_times[run] = now_milliseconds() - start;
+
+		start = now_milliseconds();
+		struct mesh mesh;
+		if (mesh__try_map(&mesh, MESH_PATH) < 0) {
+			return;
+		}
+		volatile uint32_t checksum = 0;
+		const unsigned char *bytes = (const unsigned char *) mesh.mapping;
+		for (size_t i = 0; i < mesh.mapping_size; i += 64) {
+			checksum += bytes[i];
+		}
+		mesh__unmap(&mesh);
+		mesh_times[run] = now_milliseconds() - start;
+	}
+	printf("Loading: OBJ parse %.2f ms, binary mmap %.2f ms\n", median(obj_times, RUNS), median(mesh_times, RUNS));
+}
+
+// Compares a mesh in random order against the same mesh after the converter's optimizations.
+// Uses a generated sphere unless an OBJ file is given.
+int main(int argc, char **argv) {
+	struct obj_file obj;
+	if (argc > 1 ? obj_file__try_load(&obj, argv[1]) : try_make_sphere(&obj)) {
+		printf("Could not load the mesh\n");
+		return -1;
+	}
+	struct mesh_vertex *vertices = malloc(obj.vertex_count*sizeof(*vertices));
+	if (!vertices) {
+		obj_file__free(&obj);
+		return -2;
+	}
+	float center[3];
+	float radius;
+	obj_file__quantize(&obj, vertices, center, &radius);
+	printf("%u vertices, %u triangles, %s indices\n", obj.vertex_count, obj.index_count/3, obj.vertex_count <= MESH__MAX_16BIT_VERTICES ? "16-bit" : "32-bit");
+
+	report("Source order", vertices, obj.vertex_count, obj.indices, obj.index_count);
+	int obj_written = try_write_obj(&obj) == 0;
+	shuffle(vertices, obj.vertex_count, obj.indices, obj.index_count);
+	report("Unoptimized", vertices, obj.vertex_count, obj.indices, obj.index_count);
+
+	double start = now_milliseconds();
+	if (mesh_optimize__try_vertex_cache(obj.indices, obj.index_count, obj.vertex_count) < 0) {
+		free(vertices);
+		obj_file__free(&obj);
+		return -3;
+	}
+	report("Vertex cache optimized", vertices, obj.vertex_count, obj.indices, obj.index_count);
+	uint32_t vertex_count = mesh_optimize__vertex_fetch(vertices, obj.vertex_count, obj.indices, obj.index_count);
+	printf("Optimizing took %.1f ms\n", now_milliseconds() - start);
+	report("Vertex cache and fetch optimized", vertices, vertex_count, obj.indices, obj.index_count);
+
+	// The levels reuse the full detail vertices, which are already in the order it fetches them
+	uint32_t *indices;
+	uint32_t index_count;
+	struct mesh_lod lods[MESH__MAX_LODS];
+	uint32_t lod_count;
+	start = now_milliseconds();
+	if (mesh_simplify__try_build_lods(obj.indices, obj.index_count, vertices, vertex_count, &indices, &index_count, lods, &lod_count) < 0) {
+		free(vertices);
+		obj_file__free(&obj);
+		return -4;
+	}
+	printf("Building %u LODs took %.1f ms\n", lod_count, now_milliseconds() - start);
+	for (uint32_t i = 0; i < lod_count; ++i) {
+		char name[64];
+		snprintf(name, sizeof(name), "LOD %u, %u triangles, error %.4f", i, lods[i].index_count/3, lods[i].error);
+		report(name, vertices, vertex_count, indices + lods[i].first_index, lods[i].index_count);
+	}
+
+	if (obj_written && mesh__try_write(MESH_PATH, vertices, vertex_count, indices, index_count, lods, lod_count, center, radius) == 0) {
+		report_loading();
+	}
+	free(indices);
+	remove(OBJ_PATH);
+	remove(MESH_PATH);
+	free(vertices);
+	obj_file__free(&obj);
+	return 0;
+}
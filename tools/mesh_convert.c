@@ -0,0 +1,90 @@
+#include <malloc.h>
+#include <stdio.h>
+#include <string.h>
+#include "obj_file.h"
+#include "../src/mesh/mesh.h"
+#include "../src/mesh/mesh_optimize.h"
+#include "../src/mesh/mesh_simplify.h"
+
+// Converts a Wavefront OBJ into the binary mesh format loaded by vulkan_base --mesh
+int main(int argc, char **argv) {
+	const char *input = 0;
+	const char *output = 0;
+	int optimize = 1;
+	int lods = 1;
+	for (int i = 1; i < argc; ++i) {
+		if (strcmp(argv[i], "--no-optimize") == 0) {
+			optimize = 0;
+		} else if (strcmp(argv[i], "--no-lods") == 0) {
+			lods = 0;
+		} else if (!input) {
+			input = argv[i];
+		} else if (!output) {
+			output = argv[i];
+		}
+	}
+	if (!input || !output) {
+		printf("Usage: mesh_convert [--no-optimize] [--no-lods] <input.obj> <output.mesh>\n");
+		return 1;
+	}
+
+	struct obj_file obj;
+	if (obj_file__try_load(&obj, input) < 0) {
+		printf("Could not read %s\n", input);
+		return -1;
+	}
+	struct mesh_vertex *vertices = malloc((obj.vertex_count ? obj.vertex_count : 1)*sizeof(*vertices));
+	if (!vertices) {
+		obj_file__free(&obj);
+		return -2;
+	}
+	float center[3];
+	float radius;
+	obj_file__quantize(&obj, vertices, center, &radius);
+	uint32_t vertex_count = obj.vertex_count;
+
+	printf("%u vertices, %u triangles\n", vertex_count, obj.index_count/3);
+	printf("Before: ACMR %.3f, overfetch %.3f\n", mesh_optimize__acmr(obj.indices, obj.index_count, vertex_count, MESH_OPTIMIZE__CACHE_SIZE),
+		   mesh_optimize__overfetch(obj.indices, obj.index_count, vertex_count));
+	if (optimize) {
+		if (mesh_optimize__try_vertex_cache(obj.indices, obj.index_count, vertex_count) < 0) {
+			free(vertices);
+			obj_file__free(&obj);
+			return -3;
+		}
+	}
+
+	uint32_t *indices = obj.indices;
+	uint32_t index_count = obj.index_count;
+	struct mesh_lod lod_table[MESH__MAX_LODS];
+	uint32_t lod_count = 1;
+	lod_table[0].first_index = 0;
+	lod_table[0].index_count = index_count;
+	lod_table[0].error = 0.0f;
+	if (lods && mesh_simplify__try_build_lods(obj.indices, obj.index_count, vertices, vertex_count, &indices, &index_count, lod_table, &lod_count) < 0) {
+		free(vertices);
+		obj_file__free(&obj);
+		return -5;
+	}
+	for (uint32_t i = 0; i < lod_count; ++i) {
+		printf("LOD %u: %u triangles, error %.4f of the radius\n", i, lod_table[i].index_count/3, lod_table[i].error);
+	}
+	// Vertices in the order the full detail level first uses them, the coarser levels use a subset
+	if (optimize) {
+		vertex_count = mesh_optimize__vertex_fetch(vertices, vertex_count, indices, index_count);
+		printf("After: ACMR %.3f, overfetch %.3f\n", mesh_optimize__acmr(indices, lod_table[0].index_count, vertex_count, MESH_OPTIMIZE__CACHE_SIZE),
+			   mesh_optimize__overfetch(indices, lod_table[0].index_count, vertex_count));
+	}
+
+	int result = mesh__try_write(output, vertices, vertex_count, indices, index_count, lod_table, lod_count, center, radius);
+	if (indices != obj.indices) {
+		free(indices);
+	}
+	free(vertices);
+	obj_file__free(&obj);
+	if (result < 0) {
+		printf("Could not write %s\n", output);
+		return -4;
+	}
+	return 0;
+}
@@ -0,0 +1,286 @@
+#define _GNU_SOURCE
+#include <malloc.h>
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "obj_file.h"
+
+#define NO_NORMAL UINT32_MAX
+
+struct array {
+	void *data;
+	size_t count;
+	size_t capacity;
+};
+
+struct corner {
+	uint32_t position;
+	uint32_t normal;
+};
+
+static int try_push(struct array *array, const void *element, size_t element_size) {
+	if (array->count == array->capacity) {
+		size_t capacity = array->capacity ? 2*array->capacity : 256;
+		void *data = realloc(array->data, capacity*element_size);
+		if (!data) {
+			return -1;
+		}
+		array->data = data;
+		array->capacity = capacity;
+	}
+	memcpy((char *) array->data + array->count*element_size, element, element_size);
+	++array->count;
+	return 0;
+}
+
+// OBJ indices are 1-based, negative ones count back from the end
+static int try_resolve(long index, size_t count, uint32_t *index_out) {
+	if (index > 0 && (size_t) index <= count) {
+		*index_out = (uint32_t) (index - 1);
+		return 0;
+	}
+	if (index < 0 && (size_t) -index <= count) {
+		*index_out = (uint32_t) (count + index);
+		return 0;
+	}
+	return -1;
+}
+
+static int try_parse_corner(char *token, size_t position_count, size_t normal_count, struct corner *corner_out) {
+	char *end;
+	long position = strtol(token, &end, 10);
+	if (end == token || try_resolve(position, position_count, &corner_out->position) < 0) {
+		return -1;
+	}
+	corner_out->normal = NO_NORMAL;
+	if (*end != '/') {
+		return 0;
+	}
+	// Skips the texture coordinate
+	char *normal_start = strchr(end + 1, '/');
+	if (!normal_start) {
+		return 0;
+	}
+	long normal = strtol(normal_start + 1, &end, 10);
+	if (end == normal_start + 1 || try_resolve(normal, normal_count, &corner_out->normal) < 0) {
+		return -2;
+	}
+	return 0;
+}
+
+static int try_parse(FILE *file, struct array *positions, struct array *normals, struct array *corners) {
+	char *line = 0;
+	size_t line_capacity = 0;
+	int result = 0;
+	while (result == 0 && getline(&line, &line_capacity, file) >= 0) {
+		float vector[3];
+		if (strncmp(line, "v ", 2) == 0) {
+			if (sscanf(line + 2, "%f %f %f", vector, vector + 1, vector + 2) != 3 || try_push(positions, vector, sizeof(vector)) < 0) {
+				result = -1;
+			}
+		} else if (strncmp(line, "vn ", 3) == 0) {
+			if (sscanf(line + 3, "%f %f %f", vector, vector + 1, vector + 2) != 3 || try_push(normals, vector, sizeof(vector)) < 0) {
+				result = -2;
+			}
+		} else if (strncmp(line, "f ", 2) == 0) {
+			// Fans out polygons into triangles
+			struct corner first;
+			struct corner previous;
+			int count = 0;
+			for (char *token = strtok(line + 2, " \t\r\n"); token && result == 0; token = strtok(0, " \t\r\n")) {
+				struct corner corner;
+				if (try_parse_corner(token, positions->count, normals->count, &corner) < 0) {
+					result = -3;
+				} else if (count >= 2 && (try_push(corners, &first, sizeof(first)) < 0 || try_push(corners, &previous, sizeof(previous)) < 0 ||
+										  try_push(corners, &corner, sizeof(corner)) < 0)) {
+					result = -4;
+				}
+				if (count == 0) {
+					first = corner;
+				}
+				previous = corner;
+				++count;
+			}
+		}
+	}
+	free(line);
+	return result;
+}
+
+static void normalize(float *vector) {
+	float length = sqrtf(vector[0]*vector[0] + vector[1]*vector[1] + vector[2]*vector[2]);
+	if (length > 0.0f) {
+		vector[0] /= length;
+		vector[1] /= length;
+		vector[2] /= length;
+	}
+}
+
+// Area weighted sum of the faces around each position, used by corners without a normal
+static float (*try_generate_normals(const struct array *positions, const struct array *corners))[3] {
+	const float (*position_data)[3] = positions->data;
+	const struct corner *corner_data = corners->data;
+	float (*generated)[3] = calloc(positions->count ? positions->count : 1, sizeof(*generated));
+	if (!generated) {
+		return 0;
+	}
+	for (size_t i = 0; i + 2 < corners->count; i += 3) {
+		const float *a = position_data[corner_data[i].position];
+		const float *b = position_data[corner_data[i + 1].position];
+		const float *c = position_data[corner_data[i + 2].position];
+		float ab[3] = { b[0] - a[0], b[1] - a[1], b[2] - a[2] };
+		float ac[3] = { c[0] - a[0], c[1] - a[1], c[2] - a[2] };
+		float normal[3] = { ab[1]*ac[2] - ab[2]*ac[1], ab[2]*ac[0] - ab[0]*ac[2], ab[0]*ac[1] - ab[1]*ac[0] };
+		for (int j = 0; j < 3; ++j) {
+			float *sum = generated[corner_data[i + j].position];
+			sum[0] += normal[0];
+			sum[1] += normal[1];
+			sum[2] += normal[2];
+		}
+	}
+	for (size_t i = 0; i < positions->count; ++i) {
+		normalize(generated[i]);
+	}
+	return generated;
+}
+
+static uint64_t hash_corner(struct corner corner) {
+	uint64_t key = ((uint64_t) corner.position << 32) | corner.normal;
+	key ^= key >> 33;
+	key *= 0xFF51AFD7ED558CCDull;
+	key ^= key >> 33;
+	return key;
+}
+
+// Gives each distinct corner one vertex
+static int try_weld(struct obj_file *this, const struct array *positions, const struct array *normals, const struct array *corners) {
+	const struct corner *corner_data = corners->data;
+	size_t capacity = 1;
+	while (capacity < 2*corners->count) {
+		capacity *= 2;
+	}
+	uint32_t *table = malloc(capacity*sizeof(uint32_t));
+	struct corner *unique = malloc((corners->count ? corners->count : 1)*sizeof(struct corner));
+	this->indices = malloc((corners->count ? corners->count : 1)*sizeof(uint32_t));
+	if (!table || !unique || !this->indices) {
+		free(table);
+		free(unique);
+		free(this->indices);
+		return -1;
+	}
+	memset(table, 0xFF, capacity*sizeof(uint32_t));
+
+	uint32_t vertex_count = 0;
+	for (size_t i = 0; i < corners->count; ++i) {
+		struct corner corner = corner_data[i];
+		size_t slot = hash_corner(corner) & (capacity - 1);
+		while (table[slot] != UINT32_MAX &&
+			   (unique[table[slot]].position != corner.position || unique[table[slot]].normal != corner.normal)) {
+			slot = (slot + 1) & (capacity - 1);
+		}
+		if (table[slot] == UINT32_MAX) {
+			table[slot] = vertex_count;
+			unique[vertex_count++] = corner;
+		}
+		this->indices[i] = table[slot];
+	}
+	free(table);
+
+	float (*generated)[3] = try_generate_normals(positions, corners);
+	this->positions = malloc((vertex_count ? vertex_count : 1)*sizeof(*this->positions));
+	this->normals = malloc((vertex_count ? vertex_count : 1)*sizeof(*this->normals));
+	if (!generated || !this->positions || !this->normals) {
+		free(generated);
+		free(this->positions);
+		free(this->normals);
+		free(unique);
+		free(this->indices);
+		return -2;
+	}
+	const float (*position_data)[3] = positions->data;
+	const float (*normal_data)[3] = normals->data;
+	for (uint32_t i = 0; i < vertex_count; ++i) {
+		memcpy(this->positions[i], position_data[unique[i].position], sizeof(this->positions[i]));
+		if (unique[i].normal == NO_NORMAL) {
+			memcpy(this->normals[i], generated[unique[i].position], sizeof(this->normals[i]));
+		} else {
+			memcpy(this->normals[i], normal_data[unique[i].normal], sizeof(this->normals[i]));
+			normalize(this->normals[i]);
+		}
+	}
+	free(generated);
+	free(unique);
+	this->vertex_count = vertex_count;
+	this->index_count = (uint32_t) corners->count;
+	return 0;
+}
+
+int obj_file__try_load(struct obj_file *this, const char *path) {
+	FILE *file = fopen(path, "r");
+	if (!file) {
+		return -1;
+	}
+	struct array positions = { 0, 0, 0 };
+	struct array normals = { 0, 0, 0 };
+	struct array corners = { 0, 0, 0 };
+	int result = try_parse(file, &positions, &normals, &corners);
+	fclose(file);
+	if (result == 0 && try_weld(this, &positions, &normals, &corners) < 0) {
+		result = -3;
+	} else if (result < 0) {
+		result = -2;
+	}
+	free(positions.data);
+	free(normals.data);
+	free(corners.data);
+	return result;
+}
+
+void obj_file__free(struct obj_file *this) {
+	free(this->positions);
+	free(this->normals);
+	free(this->indices);
+}
+
+static int16_t quantize_position(float value) {
+	float scaled = roundf(value*MESH__POSITION_SCALE);
+	return (int16_t) (scaled > 32767.0f ? 32767.0f : scaled < -32768.0f ? -32768.0f : scaled);
+}
+
+static int8_t quantize_normal(float value) {
+	float scaled = roundf(value*127.0f);
+	return (int8_t) (scaled > 127.0f ? 127.0f : scaled < -127.0f ? -127.0f : scaled);
+}
+
+void obj_file__quantize(const struct obj_file *this, struct mesh_vertex *vertices_out, float center_out[3], float *radius_out) {
+	float min[3] = { INFINITY, INFINITY, INFINITY };
+	float max[3] = { -INFINITY, -INFINITY, -INFINITY };
+	for (uint32_t i = 0; i < this->vertex_count; ++i) {
+		for (int j = 0; j < 3; ++j) {
+			min[j] = fminf(min[j], this->positions[i][j]);
+			max[j] = fmaxf(max[j], this->positions[i][j]);
+		}
+	}
+	float radius_squared = 0.0f;
+	for (int j = 0; j < 3; ++j) {
+		center_out[j] = this->vertex_count ? 0.5f*(min[j] + max[j]) : 0.0f;
+	}
+	for (uint32_t i = 0; i < this->vertex_count; ++i) {
+		float dx = this->positions[i][0] - center_out[0];
+		float dy = this->positions[i][1] - center_out[1];
+		float dz = this->positions[i][2] - center_out[2];
+		radius_squared = fmaxf(radius_squared, dx*dx + dy*dy + dz*dz);
+	}
+	float radius = radius_squared > 0.0f ? sqrtf(radius_squared) : 1.0f;
+	*radius_out = radius;
+
+	for (uint32_t i = 0; i < this->vertex_count; ++i) {
+		for (int j = 0; j < 3; ++j) {
+			vertices_out[i].position[j] = quantize_position((this->positions[i][j] - center_out[j])/radius);
+			vertices_out[i].normal[j] = quantize_normal(this->normals[i][j]);
+		}
+		vertices_out[i].position[3] = 0;
+		vertices_out[i].normal[3] = 0;
+	}
+}
@@ -0,0 +1,19 @@
+#pragma once
+
+#include <stdint.h>
+#include "../src/mesh/mesh.h"
+
+// Triangulated Wavefront OBJ with one vertex per distinct position and normal pair.
+// Texture coordinates are ignored, missing normals are generated from the faces.
+struct obj_file {
+	float (*positions)[3];
+	float (*normals)[3];
+	uint32_t vertex_count;
+	uint32_t *indices;
+	uint32_t index_count;
+};
+
+int obj_file__try_load(struct obj_file *this, const char *path);
+void obj_file__free(struct obj_file *this);
+// vertices_out needs room for vertex_count vertices
+void obj_file__quantize(const struct obj_file *this, struct mesh_vertex *vertices_out, float center_out[3], float *radius_out);
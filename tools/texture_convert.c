@@ -0,0 +1,136 @@
+#include <malloc.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "../src/texture/texture.h"
+
+// Skips whitespace and comments between the fields of a PPM header
+static int read_ppm_field(FILE *file, uint32_t *value_out) {
+	int c = fgetc(file);
+	while (c == ' ' || c == '\t' || c == '\r' || c == '\n' || c == '#') {
+		if (c == '#') {
+			while (c != '\n' && c != EOF) {
+				c = fgetc(file);
+			}
+		}
+		c = fgetc(file);
+	}
+	if (c < '0' || c > '9') {
+		return -1;
+	}
+	uint64_t value = 0;
+	while (c >= '0' && c <= '9' && value <= 0xFFFFFFFFu) {
+		value = value*10 + (uint64_t) (c - '0');
+		c = fgetc(file);
+	}
+	if (value > 0xFFFFFFFFu) {
+		return -2;
+	}
+	*value_out = (uint32_t) value;
+	return 0;
+}
+
+// Binary PPM with 8-bit channels, expanded to opaque RGBA
+static unsigned char *try_load_ppm(const char *path, uint32_t *width_out, uint32_t *height_out) {
+	FILE *file = fopen(path, "rb");
+	if (!file) {
+		return 0;
+	}
+	uint32_t width, height, max_value;
+	if (fgetc(file) != 'P' || fgetc(file) != '6' || read_ppm_field(file, &width) < 0 || read_ppm_field(file, &height) < 0 ||
+		read_ppm_field(file, &max_value) < 0 || max_value != 255 || width == 0 || height == 0) {
+		fclose(file);
+		return 0;
+	}
+	size_t pixel_count = (size_t) width*height;
+	unsigned char *pixels = malloc(pixel_count*4);
+	if (!pixels) {
+		fclose(file);
+		return 0;
+	}
+	// Read in place into the back of the buffer, then spread out front to back
+	unsigned char *rgb = pixels + pixel_count;
+	if (fread(rgb, 3, pixel_count, file) != pixel_count) {
+		free(pixels);
+		fclose(file);
+		return 0;
+	}
+	fclose(file);
+	for (size_t i = 0; i < pixel_count; ++i) {
+		unsigned char r = rgb[i*3], g = rgb[i*3 + 1], b = rgb[i*3 + 2];
+		pixels[i*4] = r;
+		pixels[i*4 + 1] = g;
+		pixels[i*4 + 2] = b;
+		pixels[i*4 + 3] = 255;
+	}
+	*width_out = width;
+	*height_out = height;
+	return pixels;
+}
+
+// A grid with a gradient per cell, fine enough that every level looks different up close
+static unsigned char *generate(uint32_t size) {
+	unsigned char *pixels = malloc((size_t) size*size*4);
+	if (!pixels) {
+		return 0;
+	}
+	for (uint32_t y = 0; y < size; ++y) {
+		for (uint32_t x = 0; x < size; ++x) {
+			unsigned char *pixel = pixels + ((size_t) y*size + x)*4;
+			int line = (x & 63) < 2 || (y & 63) < 2;
+			pixel[0] = line ? 255 : (unsigned char) (x*255/size);
+			pixel[1] = line ? 255 : (unsigned char) (y*255/size);
+			pixel[2] = line ? 255 : (unsigned char) ((((x >> 6) + (y >> 6)) & 1)*160);
+			pixel[3] = 255;
+		}
+	}
+	return pixels;
+}
+
+// Converts an image into the tiled format streamed by vulkan_base --texture
+int main(int argc, char **argv) {
+	const char *input = 0;
+	const char *output = 0;
+	uint32_t generate_size = 0;
+	for (int i = 1; i < argc; ++i) {
+		if (strcmp(argv[i], "--generate") == 0 && i + 1 < argc) {
+			generate_size = (uint32_t) strtoul(argv[++i], 0, 10);
+		} else if (!input) {
+			input = argv[i];
+		} else if (!output) {
+			output = argv[i];
+		}
+	}
+	// The one path given is the output then
+	if (generate_size && !output) {
+		output = input;
+		input = 0;
+	}
+	if ((!input && !generate_size) || !output) {
+		printf("Usage: texture_convert <input.ppm> <output.texture>\n       texture_convert --generate <size> <output.texture>\n");
+		return 1;
+	}
+
+	uint32_t width, height;
+	unsigned char *pixels;
+	if (generate_size) {
+		width = height = generate_size;
+		pixels = generate(generate_size);
+	} else {
+		pixels = try_load_ppm(input, &width, &height);
+	}
+	if (!pixels) {
+		printf("Could not read %s\n", input ? input : "the generated image");
+		return -1;
+	}
+	int result = texture__try_write(output, pixels, width, height);
+	free(pixels);
+	struct texture texture;
+	if (result < 0 || texture__try_map(&texture, output) < 0) {
+		printf("Could not write %s\n", output);
+		return -2;
+	}
+	printf("%ux%u texels, %u levels, %u tiles of %d\n", texture.width, texture.height, texture.mip_count, texture.tile_count, TEXTURE__TILE_SIZE);
+	texture__unmap(&texture);
+	return 0;
+}
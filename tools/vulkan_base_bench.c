@@ -0,0 +1,711 @@
+#include <malloc.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include "../src/vulkan/vulkan_base.h"
+#include "../src/vulkan/vulkan_swapchain.h"
+#include "../src/vulkan/vulkan_scene.h"
+#include "../src/vulkan/vulkan_mesh.h"
+#include "../src/file/file.h"
+
+#define MAX_UINT64 0xFFFFFFFFFFFFFFFF
+#define WIDTH 512
+#define HEIGHT 512
+#define DEFAULT_RUNS 7
+#define MAX_RUNS 64
+#define DEFAULT_THRESHOLD_PERCENT 10.0
+#define MAX_RESULTS 16
+// Work per sample for scenarios where a single repetition is too short to time
+#define RECREATIONS_PER_RUN 16
+#define FRAMES_PER_RUN 16
+#define UPLOAD_VERTEX_COUNT (1u << 20)
+#define UPLOAD_INDEX_COUNT (3u << 20)
+// Enough objects for the most instances per draw, INSTANCED_DRAWS*256
+#define INSTANCED_DRAWS 64
+#define INSTANCED_GRID_SIZE 128
+#define SKIP_RETURN_CODE 77
+
+static const int grid_sizes[] = { 8, 32, 128 };
+static const uint32_t instance_counts[] = { 1, 16, 256 };
+
+struct result {
+	char name[64];
+	double samples[MAX_RUNS];
+	int run_count;
+	// Nonzero for transfers, to also report bandwidth
+	double bytes;
+	double median;
+	// Median absolute deviation from the median
+	double spread;
+	double min;
+	double max;
+};
+
+// Headless like the golden image test, so the scenarios run on a CPU-only driver too
+struct bench {
+	struct vulkan_base base;
+	struct vulkan_swapchain swapchain;
+	struct vulkan_mesh mesh;
+	struct vulkan_culling culling;
+	struct vulkan_scene scene;
+	VkFence fence;
+};
+
+static double now_milliseconds(void) {
+	struct timespec now;
+	clock_gettime(CLOCK_MONOTONIC, &now);
+	return now.tv_sec*1000.0 + now.tv_nsec/1000000.0;
+}
+
+static int compare_doubles(const void *a, const void *b) {
+	double difference = *(const double *) a - *(const double *) b;
+	return (difference > 0.0) - (difference < 0.0);
+}
+
+static double median(double *values, int count) {
+	qsort(values, (size_t) count, sizeof(*values), compare_doubles);
+	return count % 2 ? values[count/2] : 0.5*(values[count/2 - 1] + values[count/2]);
+}
+
+static void summarize(struct result *this) {
+	double sorted[MAX_RUNS];
+	memcpy(sorted, this->samples, this->run_count*sizeof(double));
+	this->median = median(sorted, this->run_count);
+	this->min = sorted[0];
+	this->max = sorted[this->run_count - 1];
+	double deviations[MAX_RUNS];
+	for (int i = 0; i < this->run_count; ++i) {
+		deviations[i] = this->samples[i] > this->median ? this->samples[i] - this->median : this->median - this->samples[i];
+	}
+	this->spread = median(deviations, this->run_count);
+}
+
+enum try_init_base {
+	TRY_INIT_BASE__NO_FILES = -1,
+	TRY_INIT_BASE__NO_DEVICE = -2
+};
+
+static int try_init_base(struct bench *this) {
+	struct vulkan_base__create_surface headless;
+	headless.create_window_surface = 0;
+	headless.user_data = 0;
+	if (vulkan_base__try_load_files(&this->base) < 0) {
+		return TRY_INIT_BASE__NO_FILES;
+	}
+	if (vulkan_base__try_init(&this->base, 0, 0, 0, headless) < 0) {
+		vulkan_base__free_files(&this->base);
+		return TRY_INIT_BASE__NO_DEVICE;
+	}
+	return 0;
+}
+
+static void free_base(struct bench *this) {
+	vulkan_base__free(&this->base);
+	vulkan_base__free_files(&this->base);
+}
+
+static void free_from_scene(struct bench *this) {
+	vkDestroyFence(this->base.device, this->fence, this->base.allocator);
+	vulkan_scene__free(&this->scene);
+	vulkan_culling__free(&this->culling);
+	vulkan_mesh__free(&this->mesh);
+	vulkan_swapchain__free(&this->swapchain);
+	free_base(this);
+}
+
+static void free_renderer(struct bench *this) {
+	vulkan_scene__free_graph(&this->scene);
+	vulkan_swapchain__free_swapchain(&this->swapchain);
+	free_from_scene(this);
+}
+
+// Everything up to recorded command buffers, the way the application starts minus the window
+static int try_init_renderer(struct bench *this, int grid_size) {
+	int result = try_init_base(this);
+	if (result < 0) {
+		return result;
+	}
+	if (vulkan_swapchain__try_init(&this->swapchain, &this->base) < 0) {
+		free_base(this);
+		return -3;
+	}
+	struct mesh triangle;
+	mesh__init_triangle(&triangle);
+	if (vulkan_mesh__try_init(&this->mesh, &this->base, &triangle) < 0) {
+		vulkan_swapchain__free(&this->swapchain);
+		free_base(this);
+		return -4;
+	}
+	if (vulkan_culling__try_init_grid(&this->culling, &this->base, &this->mesh, grid_size, 1) < 0) {
+		vulkan_mesh__free(&this->mesh);
+		vulkan_swapchain__free(&this->swapchain);
+		free_base(this);
+		return -5;
+	}
+	if (vulkan_scene__try_init(&this->scene, &this->base, &this->swapchain, &this->culling, 0) < 0) {
+		vulkan_culling__free(&this->culling);
+		vulkan_mesh__free(&this->mesh);
+		vulkan_swapchain__free(&this->swapchain);
+		free_base(this);
+		return -5;
+	}
+
+	VkFenceCreateInfo fence_create_info;
+	fence_create_info.sType = VK_STRUCTURE_TYPE_FENCE_CREATE_INFO;
+	fence_create_info.pNext = 0;
+	fence_create_info.flags = 0;
+	if (vkCreateFence(this->base.device, &fence_create_info, this->base.allocator, &this->fence) != VK_SUCCESS) {
+		vulkan_scene__free(&this->scene);
+		vulkan_culling__free(&this->culling);
+		vulkan_mesh__free(&this->mesh);
+		vulkan_swapchain__free(&this->swapchain);
+		free_base(this);
+		return -6;
+	}
+
+	if (vulkan_swapchain__try_init_offscreen(&this->swapchain, WIDTH, HEIGHT) < 0) {
+		free_from_scene(this);
+		return -7;
+	}
+	if (vulkan_scene__try_init_graph(&this->scene) < 0) {
+		vulkan_swapchain__free_swapchain(&this->swapchain);
+		free_from_scene(this);
+		return -8;
+	}
+	return 0;
+}
+
+static int try_submit(struct bench *this, VkCommandBuffer command_buffer) {
+	VkSubmitInfo submit_info;
+	submit_info.sType = VK_STRUCTURE_TYPE_SUBMIT_INFO;
+	submit_info.pNext = 0;
+	submit_info.waitSemaphoreCount = 0;
+	submit_info.pWaitSemaphores = 0;
+	submit_info.pWaitDstStageMask = 0;
+	submit_info.commandBufferCount = 1;
+	submit_info.pCommandBuffers = &command_buffer;
+	submit_info.signalSemaphoreCount = 0;
+	submit_info.pSignalSemaphores = 0;
+
+	if (vkQueueSubmit(this->base.queue, 1, &submit_info, this->fence) != VK_SUCCESS ||
+		vkWaitForFences(this->base.device, 1, &this->fence, VK_TRUE, MAX_UINT64) != VK_SUCCESS) {
+		return -1;
+	}
+	vkResetFences(this->base.device, 1, &this->fence);
+	return 0;
+}
+
+static int try_draw_frame(struct bench *this) {
+	return try_submit(this, this->swapchain.command_buffers[0]);
+}
+
+// From loading the shaders to the first frame having finished on the GPU
+static int try_bench_startup(struct result *result) {
+	for (int run = 0; run < result->run_count; ++run) {
+		struct bench bench;
+		double start = now_milliseconds();
+		int init_result = try_init_renderer(&bench, VULKAN_CULLING__DEFAULT_GRID_SIZE);
+		if (init_result < 0) {
+			return init_result;
+		}
+		int draw_result = try_draw_frame(&bench);
+		result->samples[run] = now_milliseconds() - start;
+		free_renderer(&bench);
+		if (draw_result < 0) {
+			return -9;
+		}
+	}
+	return 0;
+}
+
+// Resizes back and forth with a frame in between, like dragging a window edge. Per recreation.
+static int try_bench_recreation(struct result *result) {
+	struct bench bench;
+	if (try_init_renderer(&bench, VULKAN_CULLING__DEFAULT_GRID_SIZE) < 0) {
+		return -1;
+	}
+	for (int run = 0; run < result->run_count; ++run) {
+		double start = now_milliseconds();
+		for (int i = 0; i < RECREATIONS_PER_RUN; ++i) {
+			vulkan_scene__free_graph(&bench.scene);
+			vulkan_swapchain__free_swapchain(&bench.swapchain);
+			if (vulkan_swapchain__try_init_offscreen(&bench.swapchain, WIDTH + (i % 2)*64, HEIGHT - (i % 2)*64) < 0) {
+				free_from_scene(&bench);
+				return -2;
+			}
+			if (vulkan_scene__try_init_graph(&bench.scene) < 0) {
+				vulkan_swapchain__free_swapchain(&bench.swapchain);
+				free_from_scene(&bench);
+				return -3;
+			}
+			if (try_draw_frame(&bench) < 0) {
+				free_renderer(&bench);
+				return -4;
+			}
+		}
+		result->samples[run] = (now_milliseconds() - start)/RECREATIONS_PER_RUN;
+	}
+	free_renderer(&bench);
+	return 0;
+}
+
+// The swapchain's pipelines, without a pipeline cache or with one that already has them. Per recreation.
+static int try_bench_pipelines(struct result *result, int cached) {
+	struct bench bench;
+	if (try_init_renderer(&bench, VULKAN_CULLING__DEFAULT_GRID_SIZE) < 0) {
+		return -1;
+	}
+	VkPipelineCache pipeline_cache = VK_NULL_HANDLE;
+	if (cached) {
+		VkPipelineCacheCreateInfo create_info;
+		create_info.sType = VK_STRUCTURE_TYPE_PIPELINE_CACHE_CREATE_INFO;
+		create_info.pNext = 0;
+		create_info.flags = 0;
+		create_info.initialDataSize = 0;
+		create_info.pInitialData = 0;
+		if (vkCreatePipelineCache(bench.base.device, &create_info, bench.base.allocator, &pipeline_cache) != VK_SUCCESS) {
+			free_renderer(&bench);
+			return -2;
+		}
+	}
+	// Not loaded from or saved to the pipeline cache file, so runs don't affect each other
+	bench.base.pipeline_cache = pipeline_cache;
+
+	int result_code = 0;
+	if (cached && vulkan_swapchain__try_recreate_pipelines(&bench.swapchain) < 0) {
+		result_code = -3;
+	}
+	for (int run = 0; run < result->run_count && result_code == 0; ++run) {
+		double start = now_milliseconds();
+		for (int i = 0; i < RECREATIONS_PER_RUN; ++i) {
+			if (vulkan_swapchain__try_recreate_pipelines(&bench.swapchain) < 0) {
+				result_code = -3;
+				break;
+			}
+		}
+		result->samples[run] = (now_milliseconds() - start)/RECREATIONS_PER_RUN;
+	}
+
+	bench.base.pipeline_cache = VK_NULL_HANDLE;
+	if (pipeline_cache != VK_NULL_HANDLE) {
+		vkDestroyPipelineCache(bench.base.device, pipeline_cache, bench.base.allocator);
+	}
+	free_renderer(&bench);
+	return result_code;
+}
+
+// Frame time with grid_size*grid_size objects, one instance each before the draw list merges them. Per frame.
+static int try_bench_frames(struct result *result, int grid_size) {
+	struct bench bench;
+	if (try_init_renderer(&bench, grid_size) < 0) {
+		return -1;
+	}
+	// Warms up first so pipeline creation and first-use costs stay out of the timings
+	for (int i = 0; i < 2; ++i) {
+		if (try_draw_frame(&bench) < 0) {
+			free_renderer(&bench);
+			return -2;
+		}
+	}
+	for (int run = 0; run < result->run_count; ++run) {
+		double start = now_milliseconds();
+		for (int i = 0; i < FRAMES_PER_RUN; ++i) {
+			if (try_draw_frame(&bench) < 0) {
+				free_renderer(&bench);
+				return -2;
+			}
+		}
+		result->samples[run] = (now_milliseconds() - start)/FRAMES_PER_RUN;
+	}
+	free_renderer(&bench);
+	return 0;
+}
+
+// INSTANCED_DRAWS draws of the culling's objects in the scene's first image, bypassing the culling and the draw list so
+// neither changes how many instances each draw gets. The base is created without dynamic rendering, so there is a
+// render pass to begin.
+static int try_record_instanced(struct bench *this, VkCommandBuffer command_buffer, uint32_t instance_count) {
+	VkCommandBufferBeginInfo begin_info;
+	begin_info.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO;
+	begin_info.pNext = 0;
+	begin_info.flags = 0;
+	begin_info.pInheritanceInfo = 0;
+	if (vkBeginCommandBuffer(command_buffer, &begin_info) != VK_SUCCESS) {
+		return -1;
+	}
+
+	// The render pass leaves transitions to the render graph, and the scene's last frame left it ready for readback
+	VkImageMemoryBarrier barrier;
+	barrier.sType = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER;
+	barrier.pNext = 0;
+	barrier.srcAccessMask = 0;
+	barrier.dstAccessMask = VK_ACCESS_COLOR_ATTACHMENT_WRITE_BIT;
+	barrier.oldLayout = VK_IMAGE_LAYOUT_UNDEFINED;
+	barrier.newLayout = VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL;
+	barrier.srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+	barrier.dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+	barrier.image = this->swapchain.images[0];
+	barrier.subresourceRange.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
+	barrier.subresourceRange.baseMipLevel = 0;
+	barrier.subresourceRange.levelCount = 1;
+	barrier.subresourceRange.baseArrayLayer = 0;
+	barrier.subresourceRange.layerCount = 1;
+	vkCmdPipelineBarrier(command_buffer, VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT, VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT, 0, 0, 0, 0, 0, 1,
+						 &barrier);
+
+	VkClearValue clear_value;
+	memset(&clear_value, 0, sizeof(clear_value));
+	clear_value.color.float32[3] = 1.0f;
+	VkRenderPassBeginInfo render_pass_begin_info;
+	render_pass_begin_info.sType = VK_STRUCTURE_TYPE_RENDER_PASS_BEGIN_INFO;
+	render_pass_begin_info.pNext = 0;
+	render_pass_begin_info.renderPass = this->swapchain.render_pass;
+	render_pass_begin_info.framebuffer = this->swapchain.framebuffers[0];
+	render_pass_begin_info.renderArea.offset.x = 0;
+	render_pass_begin_info.renderArea.offset.y = 0;
+	render_pass_begin_info.renderArea.extent = this->swapchain.extent;
+	render_pass_begin_info.clearValueCount = 1;
+	render_pass_begin_info.pClearValues = &clear_value;
+	vkCmdBeginRenderPass(command_buffer, &render_pass_begin_info, VK_SUBPASS_CONTENTS_INLINE);
+
+	// The first image's block, holding the same uniforms the scene wrote there
+	struct vulkan_uniform_ring *uniform_ring = &this->scene.uniform_ring;
+	uint32_t uniform_offset;
+	vulkan_uniform_ring__begin_frame(uniform_ring, 0);
+	void *block = vulkan_uniform_ring__allocate(uniform_ring, sizeof(this->scene.frame_uniforms), &uniform_offset);
+	memcpy(block, &this->scene.frame_uniforms, sizeof(this->scene.frame_uniforms));
+	vkCmdBindPipeline(command_buffer, VK_PIPELINE_BIND_POINT_GRAPHICS, this->swapchain.graphics_pipeline);
+	vkCmdBindDescriptorSets(command_buffer, VK_PIPELINE_BIND_POINT_GRAPHICS, this->swapchain.pipeline_layout, 0, 1, &uniform_ring->descriptor_set, 1,
+							&uniform_offset);
+	uint32_t lod = 0;
+	vkCmdPushConstants(command_buffer, this->swapchain.pipeline_layout, VULKAN_DRAW_LIST__PUSH_CONSTANT_STAGES, 0, sizeof(lod), &lod);
+	vulkan_culling__bind_mesh(&this->culling, command_buffer);
+
+	const struct mesh_lod *mesh_lod = this->mesh.lods;
+	for (uint32_t i = 0; i < INSTANCED_DRAWS; ++i) {
+		vkCmdDrawIndexed(command_buffer, mesh_lod->index_count, instance_count, mesh_lod->first_index, 0, i*instance_count);
+	}
+	vkCmdEndRenderPass(command_buffer);
+	return vkEndCommandBuffer(command_buffer) == VK_SUCCESS ? 0 : -2;
+}
+
+// Frame time with a fixed number of draws and instance_count instances in each, to tell the cost of a draw apart from
+// the cost of what it draws. Per frame.
+static int try_bench_instances(struct result *result, uint32_t instance_count) {
+	struct bench bench;
+	if (try_init_renderer(&bench, INSTANCED_GRID_SIZE) < 0) {
+		return -1;
+	}
+	VkCommandBufferAllocateInfo allocate_info;
+	allocate_info.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_ALLOCATE_INFO;
+	allocate_info.pNext = 0;
+	allocate_info.commandPool = bench.base.command_pool;
+	allocate_info.level = VK_COMMAND_BUFFER_LEVEL_PRIMARY;
+	allocate_info.commandBufferCount = 1;
+	VkCommandBuffer command_buffer;
+	if (vkAllocateCommandBuffers(bench.base.device, &allocate_info, &command_buffer) != VK_SUCCESS) {
+		free_renderer(&bench);
+		return -2;
+	}
+
+	int result_code = try_record_instanced(&bench, command_buffer, instance_count) < 0 ? -3 : 0;
+	for (int i = 0; i < 2 && result_code == 0; ++i) {
+		if (try_submit(&bench, command_buffer) < 0) {
+			result_code = -4;
+		}
+	}
+	for (int run = 0; run < result->run_count && result_code == 0; ++run) {
+		double start = now_milliseconds();
+		for (int i = 0; i < FRAMES_PER_RUN; ++i) {
+			if (try_submit(&bench, command_buffer) < 0) {
+				result_code = -4;
+				break;
+			}
+		}
+		result->samples[run] = (now_milliseconds() - start)/FRAMES_PER_RUN;
+	}
+	vkFreeCommandBuffers(bench.base.device, bench.base.command_pool, 1, &command_buffer);
+	free_renderer(&bench);
+	return result_code;
+}
+
+// A mesh about the size of a detailed model through the staging upload, allocation included
+static int try_bench_upload(struct result *result) {
+	struct mesh mesh;
+	memset(&mesh, 0, sizeof(mesh));
+	mesh.vertex_count = UPLOAD_VERTEX_COUNT;
+	mesh.index_count = UPLOAD_INDEX_COUNT;
+	mesh.index_size = 4;
+	mesh.lod_count = 1;
+	mesh.lods[0].index_count = UPLOAD_INDEX_COUNT;
+	// All zero indices are valid ones
+	void *vertices = calloc(UPLOAD_VERTEX_COUNT, sizeof(struct mesh_vertex));
+	void *indices = calloc(UPLOAD_INDEX_COUNT, sizeof(uint32_t));
+	if (!vertices || !indices) {
+		free(vertices);
+		free(indices);
+		return -1;
+	}
+	mesh.vertices = vertices;
+	mesh.indices = indices;
+	result->bytes = (double) UPLOAD_VERTEX_COUNT*sizeof(struct mesh_vertex) + (double) UPLOAD_INDEX_COUNT*sizeof(uint32_t);
+
+	struct bench bench;
+	int result_code = try_init_base(&bench) < 0 ? -1 : 0;
+	int base_ready = result_code == 0;
+	for (int run = 0; run < result->run_count && result_code == 0; ++run) {
+		struct vulkan_mesh vulkan_mesh;
+		double start = now_milliseconds();
+		if (vulkan_mesh__try_init(&vulkan_mesh, &bench.base, &mesh) < 0) {
+			result_code = -2;
+			break;
+		}
+		result->samples[run] = now_milliseconds() - start;
+		vulkan_mesh__free(&vulkan_mesh);
+	}
+	if (base_ready) {
+		free_base(&bench);
+	}
+	free(indices);
+	free(vertices);
+	return result_code;
+}
+
+static void begin_result(struct result *this, int runs, const char *name) {
+	memset(this, 0, sizeof(*this));
+	this->run_count = runs;
+	snprintf(this->name, sizeof(this->name), "%s", name);
+}
+
+// Returns 1 if the scenario produced a result
+static int end_result(struct result *this, int result_code, int *failed) {
+	if (result_code < 0) {
+		fprintf(stderr, "%s: failed (%d)\n", this->name, result_code);
+		*failed = 1;
+		return 0;
+	}
+	summarize(this);
+	fprintf(stderr, "%s: median %.3f ms, spread %.3f ms", this->name, this->median, this->spread);
+	if (this->bytes > 0.0) {
+		fprintf(stderr, ", %.2f GB/s", this->bytes/(this->median*1000000.0));
+	}
+	fprintf(stderr, "\n");
+	return 1;
+}
+
+// Every scenario, in the order they are reported
+static int try_run_scenarios(struct result *results, int *result_count_out, int runs) {
+	int count = 0;
+	int failed = 0;
+
+	begin_result(results + count, runs, "startup_to_first_frame");
+	int result_code = try_bench_startup(results + count);
+	// Nothing runs without a device, which is not a failure of the code being measured
+	if (result_code == TRY_INIT_BASE__NO_DEVICE) {
+		return SKIP_RETURN_CODE;
+	}
+	count += end_result(results + count, result_code, &failed);
+
+	begin_result(results + count, runs, "swapchain_recreation");
+	count += end_result(results + count, try_bench_recreation(results + count), &failed);
+
+	begin_result(results + count, runs, "pipeline_creation");
+	count += end_result(results + count, try_bench_pipelines(results + count, 0), &failed);
+
+	begin_result(results + count, runs, "pipeline_creation_cached");
+	count += end_result(results + count, try_bench_pipelines(results + count, 1), &failed);
+
+	for (int i = 0; i < sizeof(grid_sizes)/sizeof(*grid_sizes); ++i) {
+		char name[64];
+		snprintf(name, sizeof(name), "frame_%d_draws", grid_sizes[i]*grid_sizes[i]);
+		begin_result(results + count, runs, name);
+		count += end_result(results + count, try_bench_frames(results + count, grid_sizes[i]), &failed);
+	}
+
+	for (int i = 0; i < sizeof(instance_counts)/sizeof(*instance_counts); ++i) {
+		char name[64];
+		snprintf(name, sizeof(name), "frame_%d_draws_of_%u_instances", INSTANCED_DRAWS, instance_counts[i]);
+		begin_result(results + count, runs, name);
+		count += end_result(results + count, try_bench_instances(results + count, instance_counts[i]), &failed);
+	}
+
+	begin_result(results + count, runs, "mesh_upload");
+	count += end_result(results + count, try_bench_upload(results + count), &failed);
+
+	*result_count_out = count;
+	return failed ? -1 : 0;
+}
+
+// Quotes, backslashes and control characters escaped, cut short rather than overflowing escaped
+static void escape_json(const char *string, char *escaped, size_t size) {
+	size_t length = 0;
+	for (; *string; ++string) {
+		unsigned char c = (unsigned char) *string;
+		char sequence[8];
+		if (c == '"' || c == '\\') {
+			snprintf(sequence, sizeof(sequence), "\\%c", c);
+		} else if (c < 0x20) {
+			snprintf(sequence, sizeof(sequence), "\\u%04x", c);
+		} else {
+			sequence[0] = (char) c;
+			sequence[1] = 0;
+		}
+		size_t sequence_length = strlen(sequence);
+		if (length + sequence_length + 1 > size) {
+			break;
+		}
+		memcpy(escaped + length, sequence, sequence_length);
+		length += sequence_length;
+	}
+	escaped[length] = 0;
+}
+
+static int try_write_json(const char *path, const char *device_name, const struct result *results, int result_count) {
+	FILE *file = path ? fopen(path, "w") : stdout;
+	if (!file) {
+		return -1;
+	}
+	// One scenario per line, which is all the baseline reader relies on. The device name is escaped already.
+	fprintf(file, "{\n\t\"device\": \"%s\",\n\t\"unit\": \"ms\",\n\t\"scenarios\": [\n", device_name);
+	for (int i = 0; i < result_count; ++i) {
+		const struct result *result = results + i;
+		fprintf(file, "\t\t{ \"name\": \"%s\", \"median\": %.6f, \"spread\": %.6f, \"min\": %.6f, \"max\": %.6f, \"runs\": %d", result->name,
+				result->median, result->spread, result->min, result->max, result->run_count);
+		if (result->bytes > 0.0) {
+			fprintf(file, ", \"bytes\": %.0f", result->bytes);
+		}
+		fprintf(file, " }%s\n", i + 1 < result_count ? "," : "");
+	}
+	fprintf(file, "\t]\n}\n");
+	if (path) {
+		return fclose(file) == 0 ? 0 : -2;
+	}
+	return 0;
+}
+
+// Median of the scenario in a file written with --output, negative if it isn't there
+static double baseline_median(const char *baseline, const char *name) {
+	char key[96];
+	snprintf(key, sizeof(key), "\"name\": \"%s\"", name);
+	const char *line = strstr(baseline, key);
+	if (!line) {
+		return -1.0;
+	}
+	const char *median = strstr(line, "\"median\":");
+	const char *line_end = strchr(line, '\n');
+	double value;
+	if (!median || (line_end && median > line_end) || sscanf(median, "\"median\": %lf", &value) != 1) {
+		return -1.0;
+	}
+	return value;
+}
+
+// A scenario regresses when its median is more than threshold_percent slower than the baseline's
+static int compare_baseline(const char *baseline, const struct result *results, int result_count, double threshold_percent) {
+	int regressions = 0;
+	for (int i = 0; i < result_count; ++i) {
+		double base = baseline_median(baseline, results[i].name);
+		if (base <= 0.0) {
+			fprintf(stderr, "%s: not in the baseline\n", results[i].name);
+			continue;
+		}
+		double change = (results[i].median - base)/base*100.0;
+		int regressed = change > threshold_percent;
+		fprintf(stderr, "%s: %.3f ms against %.3f ms, %+.1f%%%s\n", results[i].name, results[i].median, base, change, regressed ? ", regression" : "");
+		regressions += regressed;
+	}
+	return regressions;
+}
+
+// Runs every scenario and writes the results as JSON. With a baseline from an earlier --output, returns 1 if any
+// scenario got slower than the threshold allows, and skips the comparison on another device than the baseline's or
+// when the baseline doesn't exist yet. Run from the build directory, next to the compiled shaders.
+int main(int argc, char **argv) {
+	const char *output = 0;
+	char *baseline_path = 0;
+	double threshold_percent = DEFAULT_THRESHOLD_PERCENT;
+	int runs = DEFAULT_RUNS;
+	for (int i = 1; i < argc; ++i) {
+		if (strcmp(argv[i], "--output") == 0 && i + 1 < argc) {
+			output = argv[++i];
+		} else if (strcmp(argv[i], "--baseline") == 0 && i + 1 < argc) {
+			baseline_path = argv[++i];
+		} else if (strcmp(argv[i], "--threshold") == 0 && i + 1 < argc) {
+			threshold_percent = atof(argv[++i]);
+		} else if (strcmp(argv[i], "--runs") == 0 && i + 1 < argc) {
+			runs = atoi(argv[++i]);
+		} else {
+			printf("Usage: %s [--runs n] [--output results.json] [--baseline baseline.json] [--threshold percent]\n", argv[0]);
+			return -1;
+		}
+	}
+	if (runs < 1 || runs > MAX_RUNS) {
+		printf("--runs must be between 1 and %d\n", MAX_RUNS);
+		return -1;
+	}
+
+	struct file__try_read baseline;
+	baseline.malloc_bytes = 0;
+	int baseline_missing = 0;
+	if (baseline_path) {
+		baseline = file__try_read(baseline_path);
+		if (baseline.result < 0) {
+			// Still measured, so the same run can write the first one
+			printf("No baseline at %s, nothing compared. Write one with --output on the reference device and commit it\n", baseline_path);
+			baseline_path = 0;
+			baseline_missing = 1;
+			baseline.malloc_bytes = 0;
+		} else {
+			char *terminated = realloc(baseline.malloc_bytes, (size_t) baseline.length + 1);
+			if (!terminated) {
+				free(baseline.malloc_bytes);
+				return -2;
+			}
+			terminated[baseline.length] = 0;
+			baseline.malloc_bytes = terminated;
+		}
+	}
+
+	struct result results[MAX_RESULTS];
+	int result_count = 0;
+	int result = try_run_scenarios(results, &result_count, runs);
+	if (result == SKIP_RETURN_CODE) {
+		printf("No Vulkan device, nothing measured\n");
+		free(baseline.malloc_bytes);
+		return SKIP_RETURN_CODE;
+	}
+
+	// The device every scenario picked, queried once more for the report
+	char device_name[6*VK_MAX_PHYSICAL_DEVICE_NAME_SIZE] = "unknown";
+	struct bench bench;
+	if (try_init_base(&bench) == 0) {
+		escape_json(bench.base.properties.deviceName, device_name, sizeof(device_name));
+		free_base(&bench);
+	}
+	if (try_write_json(output, device_name, results, result_count) < 0) {
+		printf("Could not write %s\n", output);
+		result = -3;
+	}
+
+	// Timings only compare on the device they were measured on
+	char device_key[sizeof(device_name) + 16];
+	snprintf(device_key, sizeof(device_key), "\"device\": \"%s\"", device_name);
+	if (baseline_path && !strstr(baseline.malloc_bytes, device_key)) {
+		printf("The baseline was measured on another device than %s, nothing compared\n", device_name);
+		free(baseline.malloc_bytes);
+		return SKIP_RETURN_CODE;
+	}
+	if (baseline_path) {
+		int regressions = compare_baseline(baseline.malloc_bytes, results, result_count, threshold_percent);
+		free(baseline.malloc_bytes);
+		if (regressions > 0) {
+			fprintf(stderr, "%d scenarios regressed by more than %.1f%%\n", regressions, threshold_percent);
+			return 1;
+		}
+	}
+	if (result < 0) {
+		return -4;
+	}
+	return baseline_missing ? SKIP_RETURN_CODE : 0;
+}